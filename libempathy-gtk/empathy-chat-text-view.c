@@ -37,6 +37,7 @@
 
 #include <libempathy/empathy-utils.h>
 #include <libempathy/empathy-account.h>
+#include <libempathy/empathy-footprint.h>
 
 #include "empathy-chat-text-view.h"
 #include "empathy-chat.h"
@@ -69,7 +70,11 @@ typedef struct {
 	gboolean              allow_scrolling;
 	guint                 notify_system_fonts_id;
 	EmpathySmileyManager *smiley_manager;
+	const EmpathyConfSettings *settings;
 	gboolean              only_if_date;
+	/* characters accounted for in the "chat-buffer" footprint */
+	gint                  footprint;
+	EmpathyTimeCache     *time_cache;
 } EmpathyChatTextViewPriv;
 
 static void chat_text_view_iface_init (EmpathyChatViewIface *iface);
@@ -397,6 +402,22 @@ chat_text_view_maybe_trim_buffer (EmpathyChatTextView *view)
 	}
 }
 
+static void
+chat_text_view_update_footprint (EmpathyChatTextView *view)
+{
+	EmpathyChatTextViewPriv *priv = GET_PRIV (view);
+	gint                     chars;
+
+	if (G_LIKELY (!empathy_footprint_enabled)) {
+		return;
+	}
+
+	/* Characters rather than bytes, close enough for chat logs */
+	chars = gtk_text_buffer_get_char_count (priv->buffer);
+	EMPATHY_FOOTPRINT_ADD ("chat-buffer", 0, chars - priv->footprint);
+	priv->footprint = chars;
+}
+
 static void
 chat_text_view_append_timestamp (EmpathyChatTextView *view,
 				 time_t               timestamp,
@@ -404,7 +425,6 @@ chat_text_view_append_timestamp (EmpathyChatTextView *view,
 {
 	EmpathyChatTextViewPriv *priv = GET_PRIV (view);
 	GtkTextIter              iter;
-	gchar                   *tmp;
 	GString                 *str;
 
 	str = g_string_new ("- ");
@@ -425,9 +445,8 @@ chat_text_view_append_timestamp (EmpathyChatTextView *view,
 	}
 
 	/* Append time */
-	tmp = empathy_time_to_string_local (timestamp, EMPATHY_TIME_FORMAT_DISPLAY_SHORT);
-	g_string_append (str, tmp);
-	g_free (tmp);
+	g_string_append (str, empathy_chat_text_view_time_to_string (view,
+		timestamp, EMPATHY_TIME_FORMAT_DISPLAY_SHORT));
 
 	g_string_append (str, " -\n");
 
@@ -574,16 +593,31 @@ chat_text_view_finalize (GObject *object)
 		g_source_remove (priv->scroll_timeout);
 	}
 	g_object_unref (priv->smiley_manager);
+	empathy_time_cache_free (priv->time_cache);
+
+	EMPATHY_FOOTPRINT_ADD ("chat-buffer", -1, -priv->footprint);
 
 	G_OBJECT_CLASS (empathy_chat_text_view_parent_class)->finalize (object);
 }
 
+static void
+chat_text_view_constructed (GObject *object)
+{
+	/* Not from init, where the type of the themes is still ours */
+	EMPATHY_FOOTPRINT_TRACK (object);
+
+	if (G_OBJECT_CLASS (empathy_chat_text_view_parent_class)->constructed) {
+		G_OBJECT_CLASS (empathy_chat_text_view_parent_class)->constructed (object);
+	}
+}
+
 static void
 empathy_chat_text_view_class_init (EmpathyChatTextViewClass *klass)
 {
 	GObjectClass   *object_class = G_OBJECT_CLASS (klass);
 	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+	object_class->constructed = chat_text_view_constructed;
 	object_class->finalize = chat_text_view_finalize;
 	object_class->get_property = chat_text_view_get_property;
 	object_class->set_property = chat_text_view_set_property;
@@ -617,10 +651,13 @@ empathy_chat_text_view_init (EmpathyChatTextView *view)
 		EMPATHY_TYPE_CHAT_TEXT_VIEW, EmpathyChatTextViewPriv);
 
 	view->priv = priv;
+	EMPATHY_FOOTPRINT_ADD ("chat-buffer", 1, 0);
 	priv->buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
 	priv->last_timestamp = 0;
 	priv->allow_scrolling = TRUE;
 	priv->smiley_manager = empathy_smiley_manager_dup_singleton ();
+	priv->settings = empathy_conf_get_settings ();
+	priv->time_cache = empathy_time_cache_new ();
 
 	g_object_set (view,
 		      "wrap-mode", GTK_WRAP_WORD_CHAR,
@@ -721,6 +758,7 @@ chat_text_view_append_message (EmpathyChatView *view,
 		EMPATHY_CHAT_TEXT_VIEW_GET_CLASS (view)->append_message (text_view,
 									 msg);
 	}
+	chat_text_view_update_footprint (text_view);
 
 	if (bottom) {
 		chat_text_view_scroll_down (view);
@@ -759,6 +797,7 @@ chat_text_view_append_event (EmpathyChatView *view,
 						  EMPATHY_CHAT_TEXT_VIEW_TAG_EVENT,
 						  NULL);
 	g_free (msg);
+	chat_text_view_update_footprint (text_view);
 
 	if (bottom) {
 		chat_text_view_scroll_down (view);
@@ -821,6 +860,8 @@ chat_text_view_clear (EmpathyChatView *view)
 		g_object_unref (priv->last_contact);
 		priv->last_contact = NULL;
 	}
+
+	chat_text_view_update_footprint (EMPATHY_CHAT_TEXT_VIEW (view));
 }
 
 static gboolean
@@ -1213,14 +1254,9 @@ chat_text_view_insert_text_with_emoticons (EmpathyChatTextView *view,
 					   const gchar         *str)
 {
 	EmpathyChatTextViewPriv *priv = GET_PRIV (view);
-	gboolean                 use_smileys = FALSE;
 	GSList                  *smileys, *l;
 
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_CHAT_SHOW_SMILEYS,
-			       &use_smileys);
-
-	if (!use_smileys) {
+	if (!priv->settings->chat_show_smileys) {
 		gtk_text_buffer_insert (priv->buffer, iter, str, -1);
 		return;
 	}
@@ -1331,6 +1367,19 @@ empathy_chat_text_view_append_spacing (EmpathyChatTextView *view)
 						  NULL);
 }
 
+/* Formats @timestamp in local time, reusing the strings of the last minutes
+ * displayed. The string is only valid until the next call. */
+const gchar *
+empathy_chat_text_view_time_to_string (EmpathyChatTextView *view,
+				       time_t               timestamp,
+				       const gchar         *format)
+{
+	EmpathyChatTextViewPriv *priv = GET_PRIV (view);
+
+	return empathy_time_cache_to_string_local (priv->time_cache, timestamp,
+						   format);
+}
+
 GtkTextTag *
 empathy_chat_text_view_tag_set (EmpathyChatTextView *view,
 				const gchar         *tag_name,
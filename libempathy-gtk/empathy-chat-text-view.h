@@ -76,6 +76,9 @@ void                 empathy_chat_text_view_append_body      (EmpathyChatTextVie
 							      const gchar         *body,
 							      const gchar         *tag);
 void                 empathy_chat_text_view_append_spacing   (EmpathyChatTextView *view);
+const gchar *        empathy_chat_text_view_time_to_string   (EmpathyChatTextView *view,
+							      time_t               timestamp,
+							      const gchar         *format);
 GtkTextTag *         empathy_chat_text_view_tag_set          (EmpathyChatTextView *view,
 							      const gchar         *tag_name,
 							      const gchar         *first_property_name,
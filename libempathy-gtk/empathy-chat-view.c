@@ -194,3 +194,24 @@ empathy_chat_view_copy_clipboard (EmpathyChatView *view)
 	}
 }
 
+
+/* Appends all the messages of @block. Each is only turned into an
+ * EmpathyMessage while it is being rendered. */
+void
+empathy_chat_view_append_message_block (EmpathyChatView     *view,
+					EmpathyMessageBlock *block)
+{
+	guint i, len;
+
+	g_return_if_fail (EMPATHY_IS_CHAT_VIEW (view));
+	g_return_if_fail (block != NULL);
+
+	len = empathy_message_block_get_length (block);
+	for (i = 0; i < len; i++) {
+		EmpathyMessage *message;
+
+		message = empathy_message_block_dup_message (block, i);
+		empathy_chat_view_append_message (view, message);
+		g_object_unref (message);
+	}
+}
@@ -27,6 +27,7 @@
 
 #include <libempathy/empathy-contact.h>
 #include <libempathy/empathy-message.h>
+#include <libempathy/empathy-message-block.h>
 
 G_BEGIN_DECLS
 
@@ -89,6 +90,8 @@ void             empathy_chat_view_find_abilities       (EmpathyChatView *view,
 void             empathy_chat_view_highlight            (EmpathyChatView *view,
 							 const gchar     *text);
 void             empathy_chat_view_copy_clipboard       (EmpathyChatView *view);
+void             empathy_chat_view_append_message_block (EmpathyChatView     *view,
+							 EmpathyMessageBlock *block);
 
 G_END_DECLS
 
@@ -41,6 +41,7 @@
 #include <libempathy/empathy-contact-list.h>
 #include <libempathy/empathy-utils.h>
 #include <libempathy/empathy-dispatcher.h>
+#include <libempathy/empathy-footprint.h>
 
 #include "empathy-chat.h"
 #include "empathy-conf.h"
@@ -607,7 +608,6 @@ chat_input_text_buffer_changed_cb (GtkTextBuffer *buffer,
 	EmpathyChatPriv *priv;
 	GtkTextIter     start, end;
 	gchar          *str;
-	gboolean        spell_checker = FALSE;
 
 	priv = GET_PRIV (chat);
 
@@ -617,13 +617,9 @@ chat_input_text_buffer_changed_cb (GtkTextBuffer *buffer,
 		chat_composing_start (chat);
 	}
 
-	empathy_conf_get_bool (empathy_conf_get (),
-                           EMPATHY_PREFS_CHAT_SPELL_CHECKER_ENABLED,
-                           &spell_checker);
-
 	gtk_text_buffer_get_start_iter (buffer, &start);
 
-	if (!spell_checker) {
+	if (!empathy_conf_get_settings ()->chat_spell_checker_enabled) {
 		gtk_text_buffer_get_end_iter (buffer, &end);
 		gtk_text_buffer_remove_tag_by_name (buffer, "misspelled", &start, &end);
 		return;
@@ -787,7 +783,7 @@ chat_input_key_press_event_cb (GtkWidget   *widget,
 		if (completed) {
 			guint        len;
 			const gchar *text;
-			gchar       *complete_char = NULL;
+			const gchar *complete_char;
 
 			gtk_text_buffer_delete (buffer, &start, &current);
 
@@ -807,16 +803,13 @@ chat_input_key_press_event_cb (GtkWidget   *widget,
 
 			gtk_text_buffer_insert_at_cursor (buffer, text, strlen (text));
 
+			complete_char = empathy_conf_get_settings ()->chat_nick_completion_char;
 			if (len == 1 && is_start_of_buffer &&
-			    empathy_conf_get_string (empathy_conf_get (),
-						     EMPATHY_PREFS_CHAT_NICK_COMPLETION_CHAR,
-						     &complete_char) &&
 			    complete_char != NULL) {
 				gtk_text_buffer_insert_at_cursor (buffer,
 								  complete_char,
 								  strlen (complete_char));
 				gtk_text_buffer_insert_at_cursor (buffer, " ", 1);
-				g_free (complete_char);
 			}
 
 			g_free (completed);
@@ -1213,29 +1206,34 @@ build_part_message (guint           reason,
 
 static void
 chat_members_changed_cb (EmpathyTpChat  *tp_chat,
-			 EmpathyContact *contact,
+			 GPtrArray      *added,
+			 GPtrArray      *removed,
 			 EmpathyContact *actor,
 			 guint           reason,
 			 gchar          *message,
-			 gboolean        is_member,
 			 EmpathyChat    *chat)
 {
 	EmpathyChatPriv *priv = GET_PRIV (chat);
-	const gchar *name = empathy_contact_get_name (contact);
 	gchar *str;
+	guint i;
 
 	if (priv->block_events_timeout_id != 0)
 		return;
 
-	if (is_member) {
-		str = g_strdup_printf (_("%s has joined the room"),
-				       name);
-	} else {
-		str = build_part_message (reason, name, actor, message);
+	for (i = 0; removed && i < removed->len; i++) {
+		str = build_part_message (reason,
+			empathy_contact_get_name (g_ptr_array_index (removed, i)),
+			actor, message);
+		empathy_chat_view_append_event (chat->view, str);
+		g_free (str);
 	}
 
-	empathy_chat_view_append_event (chat->view, str);
-	g_free (str);
+	for (i = 0; added && i < added->len; i++) {
+		str = g_strdup_printf (_("%s has joined the room"),
+			empathy_contact_get_name (g_ptr_array_index (added, i)));
+		empathy_chat_view_append_event (chat->view, str);
+		g_free (str);
+	}
 }
 
 static gboolean
@@ -1697,6 +1695,7 @@ empathy_chat_init (EmpathyChat *chat)
 		EMPATHY_TYPE_CHAT, EmpathyChatPriv);
 
 	chat->priv = priv;
+	EMPATHY_FOOTPRINT_TRACK (chat);
 	priv->log_manager = empathy_log_manager_dup_singleton ();
 	priv->contacts_width = -1;
 	priv->sent_messages = NULL;
@@ -1708,9 +1707,7 @@ empathy_chat_init (EmpathyChat *chat)
 			  G_CALLBACK (chat_new_connection_cb),
 			  chat);
 
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_CHAT_SHOW_CONTACTS_IN_ROOMS,
-			       &priv->show_contacts);
+	priv->show_contacts = empathy_conf_get_settings ()->chat_show_contacts_in_rooms;
 
 	/* Block events for some time to avoid having "has come online" or
 	 * "joined" messages. */
@@ -1778,7 +1775,7 @@ empathy_chat_set_tp_chat (EmpathyChat   *chat,
 	g_signal_connect (tp_chat, "property-changed",
 			  G_CALLBACK (chat_property_changed_cb),
 			  chat);
-	g_signal_connect (tp_chat, "members-changed",
+	g_signal_connect (tp_chat, "members-changed-bulk",
 			  G_CALLBACK (chat_members_changed_cb),
 			  chat);
 	g_signal_connect_swapped (tp_chat, "notify::remote-contact",
@@ -37,9 +37,68 @@
 
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyConf)
 typedef struct {
-	GConfClient *gconf_client;
+	GConfClient         *gconf_client;
+	EmpathyConfSettings  settings;
+	GHashTable          *settings_by_key;
+	guint                settings_notify_id;
 } EmpathyConfPriv;
 
+typedef struct {
+	const gchar    *key;
+	GConfValueType  type;
+	glong           offset;
+} EmpathyConfSetting;
+
+#define BOOL_SETTING(key, field) \
+	{ key, GCONF_VALUE_BOOL, G_STRUCT_OFFSET (EmpathyConfSettings, field) }
+#define STRING_SETTING(key, field) \
+	{ key, GCONF_VALUE_STRING, G_STRUCT_OFFSET (EmpathyConfSettings, field) }
+
+static const EmpathyConfSetting conf_settings[] = {
+	BOOL_SETTING (EMPATHY_PREFS_NOTIFICATIONS_ENABLED, notifications_enabled),
+	BOOL_SETTING (EMPATHY_PREFS_NOTIFICATIONS_DISABLED_AWAY, notifications_disabled_away),
+	BOOL_SETTING (EMPATHY_PREFS_NOTIFICATIONS_FOCUS, notifications_focus),
+	BOOL_SETTING (EMPATHY_PREFS_NOTIFICATIONS_CONTACT_SIGNIN, notifications_contact_signin),
+	BOOL_SETTING (EMPATHY_PREFS_NOTIFICATIONS_CONTACT_SIGNOUT, notifications_contact_signout),
+	BOOL_SETTING (EMPATHY_PREFS_POPUPS_WHEN_AVAILABLE, popups_when_available),
+	BOOL_SETTING (EMPATHY_PREFS_SOUNDS_ENABLED, sounds_enabled),
+	BOOL_SETTING (EMPATHY_PREFS_SOUNDS_DISABLED_AWAY, sounds_disabled_away),
+	BOOL_SETTING (EMPATHY_PREFS_SOUNDS_INCOMING_MESSAGE, sounds_incoming_message),
+	BOOL_SETTING (EMPATHY_PREFS_SOUNDS_OUTGOING_MESSAGE, sounds_outgoing_message),
+	BOOL_SETTING (EMPATHY_PREFS_SOUNDS_NEW_CONVERSATION, sounds_new_conversation),
+	BOOL_SETTING (EMPATHY_PREFS_SOUNDS_SERVICE_LOGIN, sounds_service_login),
+	BOOL_SETTING (EMPATHY_PREFS_SOUNDS_SERVICE_LOGOUT, sounds_service_logout),
+	BOOL_SETTING (EMPATHY_PREFS_SOUNDS_CONTACT_LOGIN, sounds_contact_login),
+	BOOL_SETTING (EMPATHY_PREFS_SOUNDS_CONTACT_LOGOUT, sounds_contact_logout),
+	BOOL_SETTING (EMPATHY_PREFS_CHAT_SHOW_SMILEYS, chat_show_smileys),
+	BOOL_SETTING (EMPATHY_PREFS_CHAT_SHOW_CONTACTS_IN_ROOMS, chat_show_contacts_in_rooms),
+	STRING_SETTING (EMPATHY_PREFS_CHAT_THEME, chat_theme),
+	STRING_SETTING (EMPATHY_PREFS_CHAT_ADIUM_PATH, chat_adium_path),
+	STRING_SETTING (EMPATHY_PREFS_CHAT_SPELL_CHECKER_LANGUAGES, chat_spell_checker_languages),
+	BOOL_SETTING (EMPATHY_PREFS_CHAT_SPELL_CHECKER_ENABLED, chat_spell_checker_enabled),
+	STRING_SETTING (EMPATHY_PREFS_CHAT_NICK_COMPLETION_CHAR, chat_nick_completion_char),
+	BOOL_SETTING (EMPATHY_PREFS_CHAT_AVATAR_IN_ICON, chat_avatar_in_icon),
+	BOOL_SETTING (EMPATHY_PREFS_UI_SEPARATE_CHAT_WINDOWS, ui_separate_chat_windows),
+	BOOL_SETTING (EMPATHY_PREFS_UI_MAIN_WINDOW_HIDDEN, ui_main_window_hidden),
+	STRING_SETTING (EMPATHY_PREFS_UI_AVATAR_DIRECTORY, ui_avatar_directory),
+	BOOL_SETTING (EMPATHY_PREFS_UI_SHOW_AVATARS, ui_show_avatars),
+	BOOL_SETTING (EMPATHY_PREFS_UI_COMPACT_CONTACT_LIST, ui_compact_contact_list),
+	BOOL_SETTING (EMPATHY_PREFS_UI_USE_LIBINDICATE, ui_use_libindicate),
+	BOOL_SETTING (EMPATHY_PREFS_CONTACTS_SHOW_OFFLINE, contacts_show_offline),
+	STRING_SETTING (EMPATHY_PREFS_CONTACTS_SORT_CRITERIUM, contacts_sort_criterium),
+	BOOL_SETTING (EMPATHY_PREFS_HINTS_CLOSE_MAIN_WINDOW, hints_close_main_window),
+	BOOL_SETTING (EMPATHY_PREFS_SALUT_ACCOUNT_CREATED, salut_account_created),
+	BOOL_SETTING (EMPATHY_PREFS_USE_NM, use_nm),
+	BOOL_SETTING (EMPATHY_PREFS_AUTOCONNECT, autoconnect),
+	BOOL_SETTING (EMPATHY_PREFS_IMPORT_ASKED, import_asked),
+	STRING_SETTING (EMPATHY_PREFS_FILE_TRANSFER_DEFAULT_FOLDER, file_transfer_default_folder),
+	BOOL_SETTING (EMPATHY_PREFS_LOCATION_PUBLISH, location_publish),
+	BOOL_SETTING (EMPATHY_PREFS_LOCATION_RESOURCE_NETWORK, location_resource_network),
+	BOOL_SETTING (EMPATHY_PREFS_LOCATION_RESOURCE_CELL, location_resource_cell),
+	BOOL_SETTING (EMPATHY_PREFS_LOCATION_RESOURCE_GPS, location_resource_gps),
+	BOOL_SETTING (EMPATHY_PREFS_LOCATION_REDUCE_ACCURACY, location_reduce_accuracy),
+};
+
 typedef struct {
 	EmpathyConf           *conf;
 	EmpathyConfNotifyFunc  func;
@@ -52,6 +111,99 @@ G_DEFINE_TYPE (EmpathyConf, empathy_conf, G_TYPE_OBJECT);
 
 static EmpathyConf *global_conf = NULL;
 
+static void
+conf_setting_update (EmpathyConfPriv          *priv,
+		     const EmpathyConfSetting *setting,
+		     const GConfValue         *value)
+{
+	gpointer field;
+
+	field = G_STRUCT_MEMBER_P (&priv->settings, setting->offset);
+
+	/* An unset key reads as FALSE/NULL, like gconf_client_get_* did */
+	if (value && value->type != setting->type) {
+		value = NULL;
+	}
+
+	switch (setting->type) {
+	case GCONF_VALUE_BOOL:
+		*(gboolean *) field = value ? gconf_value_get_bool (value) : FALSE;
+		break;
+	case GCONF_VALUE_STRING:
+		g_free (*(gchar **) field);
+		*(gchar **) field = value ? g_strdup (gconf_value_get_string (value)) : NULL;
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+}
+
+static const EmpathyConfSetting *
+conf_setting_lookup (EmpathyConfPriv *priv,
+		     const gchar     *key)
+{
+	return g_hash_table_lookup (priv->settings_by_key, key);
+}
+
+static void
+conf_settings_notify_cb (GConfClient *client,
+			 guint        id,
+			 GConfEntry  *entry,
+			 gpointer     user_data)
+{
+	EmpathyConfPriv          *priv = user_data;
+	const EmpathyConfSetting *setting;
+	GConfValue               *value;
+
+	setting = conf_setting_lookup (priv, gconf_entry_get_key (entry));
+	if (!setting) {
+		return;
+	}
+
+	value = gconf_entry_get_value (entry);
+	if (value) {
+		conf_setting_update (priv, setting, value);
+		return;
+	}
+
+	/* The key was unset, read it again to get its schema default */
+	value = gconf_client_get (client, setting->key, NULL);
+	conf_setting_update (priv, setting, value);
+	if (value) {
+		gconf_value_free (value);
+	}
+}
+
+static void
+conf_settings_load (EmpathyConfPriv *priv)
+{
+	guint i;
+
+	priv->settings_by_key = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; i < G_N_ELEMENTS (conf_settings); i++) {
+		const EmpathyConfSetting *setting = &conf_settings[i];
+		GConfValue               *value;
+
+		g_hash_table_insert (priv->settings_by_key,
+				     (gpointer) setting->key,
+				     (gpointer) setting);
+
+		/* The whole tree is preloaded, so this doesn't hit the
+		 * daemon */
+		value = gconf_client_get (priv->gconf_client, setting->key, NULL);
+		conf_setting_update (priv, setting, value);
+		if (value) {
+			gconf_value_free (value);
+		}
+	}
+
+	priv->settings_notify_id = gconf_client_notify_add (priv->gconf_client,
+							    EMPATHY_CONF_ROOT,
+							    conf_settings_notify_cb,
+							    priv, NULL, NULL);
+}
+
 static void
 empathy_conf_class_init (EmpathyConfClass *class)
 {
@@ -75,21 +227,31 @@ empathy_conf_init (EmpathyConf *conf)
 
 	gconf_client_add_dir (priv->gconf_client,
 			      EMPATHY_CONF_ROOT,
-			      GCONF_CLIENT_PRELOAD_ONELEVEL,
+			      GCONF_CLIENT_PRELOAD_RECURSIVE,
 			      NULL);
 	gconf_client_add_dir (priv->gconf_client,
 			      DESKTOP_INTERFACE_ROOT,
 			      GCONF_CLIENT_PRELOAD_NONE,
 			      NULL);
+
+	conf_settings_load (priv);
 }
 
 static void
 conf_finalize (GObject *object)
 {
 	EmpathyConfPriv *priv;
+	guint            i;
 
 	priv = GET_PRIV (object);
 
+	gconf_client_notify_remove (priv->gconf_client,
+				    priv->settings_notify_id);
+	for (i = 0; i < G_N_ELEMENTS (conf_settings); i++) {
+		conf_setting_update (priv, &conf_settings[i], NULL);
+	}
+	g_hash_table_destroy (priv->settings_by_key);
+
 	gconf_client_remove_dir (priv->gconf_client,
 				 EMPATHY_CONF_ROOT,
 				 NULL);
@@ -112,6 +274,16 @@ empathy_conf_get (void)
 	return global_conf;
 }
 
+/* Values are kept in sync with GConf, so callers on hot paths can keep the
+ * returned pointer around instead of asking again for every message. */
+const EmpathyConfSettings *
+empathy_conf_get_settings (void)
+{
+	EmpathyConfPriv *priv = GET_PRIV (empathy_conf_get ());
+
+	return &priv->settings;
+}
+
 void
 empathy_conf_shutdown (void)
 {
@@ -172,7 +344,8 @@ empathy_conf_set_bool (EmpathyConf  *conf,
 		      const gchar *key,
 		      gboolean     value)
 {
-	EmpathyConfPriv *priv;
+	EmpathyConfPriv          *priv;
+	const EmpathyConfSetting *setting;
 
 	g_return_val_if_fail (EMPATHY_IS_CONF (conf), FALSE);
 
@@ -181,10 +354,19 @@ empathy_conf_set_bool (EmpathyConf  *conf,
 
 	priv = GET_PRIV (conf);
 
-	return gconf_client_set_bool (priv->gconf_client,
-				      key,
-				      value,
-				      NULL);
+	if (!gconf_client_set_bool (priv->gconf_client,
+				    key,
+				    value,
+				    NULL)) {
+		return FALSE;
+	}
+
+	setting = conf_setting_lookup (priv, key);
+	if (setting && setting->type == GCONF_VALUE_BOOL) {
+		G_STRUCT_MEMBER (gboolean, &priv->settings, setting->offset) = value;
+	}
+
+	return TRUE;
 }
 
 gboolean
@@ -192,8 +374,9 @@ empathy_conf_get_bool (EmpathyConf  *conf,
 		      const gchar *key,
 		      gboolean    *value)
 {
-	EmpathyConfPriv *priv;
-	GError          *error = NULL;
+	EmpathyConfPriv          *priv;
+	const EmpathyConfSetting *setting;
+	GError                   *error = NULL;
 
 	*value = FALSE;
 
@@ -202,6 +385,12 @@ empathy_conf_get_bool (EmpathyConf  *conf,
 
 	priv = GET_PRIV (conf);
 
+	setting = conf_setting_lookup (priv, key);
+	if (setting && setting->type == GCONF_VALUE_BOOL) {
+		*value = G_STRUCT_MEMBER (gboolean, &priv->settings, setting->offset);
+		return TRUE;
+	}
+
 	*value = gconf_client_get_bool (priv->gconf_client,
 					key,
 					&error);
@@ -219,7 +408,8 @@ empathy_conf_set_string (EmpathyConf  *conf,
 			const gchar *key,
 			const gchar *value)
 {
-	EmpathyConfPriv *priv;
+	EmpathyConfPriv          *priv;
+	const EmpathyConfSetting *setting;
 
 	g_return_val_if_fail (EMPATHY_IS_CONF (conf), FALSE);
 
@@ -227,10 +417,23 @@ empathy_conf_set_string (EmpathyConf  *conf,
 
 	priv = GET_PRIV (conf);
 
-	return gconf_client_set_string (priv->gconf_client,
-					key,
-					value,
-					NULL);
+	if (!gconf_client_set_string (priv->gconf_client,
+				      key,
+				      value,
+				      NULL)) {
+		return FALSE;
+	}
+
+	setting = conf_setting_lookup (priv, key);
+	if (setting && setting->type == GCONF_VALUE_STRING) {
+		gchar **field;
+
+		field = G_STRUCT_MEMBER_P (&priv->settings, setting->offset);
+		g_free (*field);
+		*field = g_strdup (value);
+	}
+
+	return TRUE;
 }
 
 gboolean
@@ -238,8 +441,9 @@ empathy_conf_get_string (EmpathyConf   *conf,
 			const gchar  *key,
 			gchar       **value)
 {
-	EmpathyConfPriv *priv;
-	GError          *error = NULL;
+	EmpathyConfPriv          *priv;
+	const EmpathyConfSetting *setting;
+	GError                   *error = NULL;
 
 	*value = NULL;
 
@@ -247,6 +451,13 @@ empathy_conf_get_string (EmpathyConf   *conf,
 
 	priv = GET_PRIV (conf);
 
+	setting = conf_setting_lookup (priv, key);
+	if (setting && setting->type == GCONF_VALUE_STRING) {
+		*value = g_strdup (G_STRUCT_MEMBER (gchar *, &priv->settings,
+						    setting->offset));
+		return TRUE;
+	}
+
 	*value = gconf_client_get_string (priv->gconf_client,
 					  key,
 					  &error);
@@ -316,10 +527,20 @@ conf_notify_func (GConfClient *client,
 		  GConfEntry  *entry,
 		  gpointer     user_data)
 {
-	EmpathyConfNotifyData *data;
+	EmpathyConfNotifyData    *data;
+	const EmpathyConfSetting *setting;
 
 	data = user_data;
 
+	/* GConf doesn't promise to run our own root listener first, make sure
+	 * the snapshot is current before the callback reads it */
+	setting = conf_setting_lookup (GET_PRIV (data->conf),
+				       gconf_entry_get_key (entry));
+	if (setting) {
+		conf_setting_update (GET_PRIV (data->conf), setting,
+				     gconf_entry_get_value (entry));
+	}
+
 	data->func (data->conf,
 		    gconf_entry_get_key (entry),
 		    data->user_data);
@@ -88,6 +88,54 @@ struct _EmpathyConfClass {
 #define EMPATHY_PREFS_LOCATION_RESOURCE_GPS        EMPATHY_PREFS_PATH "/location/resource_gps"
 #define EMPATHY_PREFS_LOCATION_REDUCE_ACCURACY     EMPATHY_PREFS_PATH "/location/reduce_accuracy"
 
+/* Snapshot of the EMPATHY_PREFS_PATH keys above, loaded once and kept up to
+ * date from GConf notifications. Strings belong to the EmpathyConf and may be
+ * NULL; copy them if they need to outlive a change notification. */
+typedef struct {
+	gboolean  notifications_enabled;
+	gboolean  notifications_disabled_away;
+	gboolean  notifications_focus;
+	gboolean  notifications_contact_signin;
+	gboolean  notifications_contact_signout;
+	gboolean  popups_when_available;
+	gboolean  sounds_enabled;
+	gboolean  sounds_disabled_away;
+	gboolean  sounds_incoming_message;
+	gboolean  sounds_outgoing_message;
+	gboolean  sounds_new_conversation;
+	gboolean  sounds_service_login;
+	gboolean  sounds_service_logout;
+	gboolean  sounds_contact_login;
+	gboolean  sounds_contact_logout;
+	gboolean  chat_show_smileys;
+	gboolean  chat_show_contacts_in_rooms;
+	gchar    *chat_theme;
+	gchar    *chat_adium_path;
+	gchar    *chat_spell_checker_languages;
+	gboolean  chat_spell_checker_enabled;
+	gchar    *chat_nick_completion_char;
+	gboolean  chat_avatar_in_icon;
+	gboolean  ui_separate_chat_windows;
+	gboolean  ui_main_window_hidden;
+	gchar    *ui_avatar_directory;
+	gboolean  ui_show_avatars;
+	gboolean  ui_compact_contact_list;
+	gboolean  ui_use_libindicate;
+	gboolean  contacts_show_offline;
+	gchar    *contacts_sort_criterium;
+	gboolean  hints_close_main_window;
+	gboolean  salut_account_created;
+	gboolean  use_nm;
+	gboolean  autoconnect;
+	gboolean  import_asked;
+	gchar    *file_transfer_default_folder;
+	gboolean  location_publish;
+	gboolean  location_resource_network;
+	gboolean  location_resource_cell;
+	gboolean  location_resource_gps;
+	gboolean  location_reduce_accuracy;
+} EmpathyConfSettings;
+
 typedef void (*EmpathyConfNotifyFunc) (EmpathyConf  *conf,
 				      const gchar *key,
 				      gpointer     user_data);
@@ -95,6 +143,8 @@ typedef void (*EmpathyConfNotifyFunc) (EmpathyConf  *conf,
 GType       empathy_conf_get_type        (void) G_GNUC_CONST;
 EmpathyConf *empathy_conf_get             (void);
 void        empathy_conf_shutdown        (void);
+const EmpathyConfSettings *
+            empathy_conf_get_settings    (void);
 guint       empathy_conf_notify_add      (EmpathyConf            *conf,
 					 const gchar           *key,
 					 EmpathyConfNotifyFunc   func,
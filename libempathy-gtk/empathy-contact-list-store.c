@@ -32,6 +32,7 @@
 
 #include <telepathy-glib/util.h>
 
+#include <libempathy/empathy-contact-search.h>
 #include <libempathy/empathy-utils.h>
 #include "empathy-contact-list-store.h"
 #include "empathy-ui-utils.h"
@@ -50,9 +51,14 @@
 /* Time in seconds after connecting which we wait before active users are enabled */
 #define ACTIVE_USER_WAIT_TO_ENABLE_TIME 5
 
+/* Number of contacts added at once above which the store is sorted once
+ * after the insertions instead of on each of them */
+#define BULK_UNSORTED_THRESHOLD 16
+
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyContactListStore)
 typedef struct {
 	EmpathyContactList         *list;
+	EmpathyRosterCache         *roster_cache;
 	gboolean                    show_offline;
 	gboolean                    show_avatars;
 	gboolean                    show_groups;
@@ -60,6 +66,9 @@ typedef struct {
 	gboolean                    show_active;
 	EmpathyContactListStoreSort sort_criterium;
 	guint                       inhibit_active;
+	/* EmpathyContact -> GList of the GtkTreeIter of its rows, the rows
+	 * keep the contact alive */
+	GHashTable                 *contact_rows;
 } EmpathyContactListStorePriv;
 
 typedef struct {
@@ -68,12 +77,6 @@ typedef struct {
 	gboolean     found;
 } FindGroup;
 
-typedef struct {
-	EmpathyContact *contact;
-	gboolean       found;
-	GList         *iters;
-} FindContact;
-
 typedef struct {
 	EmpathyContactListStore *store;
 	EmpathyContact          *contact;
@@ -91,22 +94,32 @@ static void             contact_list_store_set_property              (GObject
 								      GParamSpec                    *pspec);
 static void             contact_list_store_setup                     (EmpathyContactListStore       *store);
 static gboolean         contact_list_store_inibit_active_cb          (EmpathyContactListStore       *store);
-static void             contact_list_store_members_changed_cb        (EmpathyContactList            *list_iface,
-								      EmpathyContact                *contact,
+static void             contact_list_store_members_changed_bulk_cb   (EmpathyContactList            *list_iface,
+								      GPtrArray                     *added,
+								      GPtrArray                     *removed,
 								      EmpathyContact                *actor,
 								      guint                          reason,
 								      gchar                         *message,
-								      gboolean                       is_member,
 								      EmpathyContactListStore       *store);
+static void             contact_list_store_add_members               (EmpathyContactListStore       *store,
+								      EmpathyContactList            *list_iface,
+								      GList                         *contacts);
 static void             contact_list_store_groups_changed_cb         (EmpathyContactList            *list_iface,
 								      EmpathyContact                *contact,
 								      gchar                         *group,
 								      gboolean                       is_member,
 								      EmpathyContactListStore       *store);
+static GList *          contact_list_store_dup_members               (EmpathyContactListStore       *store);
+static void             contact_list_store_free_iters                (GList                         *iters);
+static const GList *    contact_list_store_insert_contact            (EmpathyContactListStore       *store,
+								      EmpathyContact                *contact);
 static void             contact_list_store_add_contact               (EmpathyContactListStore       *store,
 								      EmpathyContact                *contact);
 static void             contact_list_store_remove_contact            (EmpathyContactListStore       *store,
 								      EmpathyContact                *contact);
+static void             contact_list_store_set_contact_rows          (EmpathyContactListStore       *store,
+								      EmpathyContact                *contact,
+								      const GList                   *iters);
 static void             contact_list_store_contact_update            (EmpathyContactListStore       *store,
 								      EmpathyContact                *contact);
 static void             contact_list_store_contact_updated_cb        (EmpathyContact                *contact,
@@ -138,10 +151,6 @@ static gint             contact_list_store_name_sort_func            (GtkTreeMod
 								      GtkTreeIter                   *iter_a,
 								      GtkTreeIter                   *iter_b,
 								      gpointer                       user_data);
-static gboolean         contact_list_store_find_contact_foreach      (GtkTreeModel                  *model,
-								      GtkTreePath                   *path,
-								      GtkTreeIter                   *iter,
-								      FindContact                   *fc);
 static GList *          contact_list_store_find_contact              (EmpathyContactListStore       *store,
 								      EmpathyContact                *contact);
 static gboolean         contact_list_store_update_list_mode_foreach  (GtkTreeModel                  *model,
@@ -170,8 +179,8 @@ contact_list_store_iface_setup (gpointer user_data)
 
 	/* Signal connection. */
 	g_signal_connect (priv->list,
-			  "members-changed",
-			  G_CALLBACK (contact_list_store_members_changed_cb),
+			  "members-changed-bulk",
+			  G_CALLBACK (contact_list_store_members_changed_bulk_cb),
 			  store);
 	g_signal_connect (priv->list,
 			  "groups-changed",
@@ -180,12 +189,8 @@ contact_list_store_iface_setup (gpointer user_data)
 
 	/* Add contacts already created. */
 	contacts = empathy_contact_list_get_members (priv->list);
+	contact_list_store_add_members (store, priv->list, contacts);
 	for (l = contacts; l; l = l->next) {
-		contact_list_store_members_changed_cb (priv->list, l->data,
-						       NULL, 0, NULL,
-						       TRUE,
-						       store);
-
 		g_object_unref (l->data);
 	}
 	g_list_free (contacts);
@@ -288,7 +293,7 @@ contact_list_store_finalize (GObject *object)
 	EmpathyContactListStorePriv *priv = GET_PRIV (object);
 	GList                       *contacts, *l;
 
-	contacts = empathy_contact_list_get_members (priv->list);
+	contacts = contact_list_store_dup_members (EMPATHY_CONTACT_LIST_STORE (object));
 	for (l = contacts; l; l = l->next) {
 		g_signal_handlers_disconnect_by_func (l->data,
 						      G_CALLBACK (contact_list_store_contact_updated_cb),
@@ -298,8 +303,15 @@ contact_list_store_finalize (GObject *object)
 	}
 	g_list_free (contacts);
 
+	if (priv->roster_cache) {
+		g_signal_handlers_disconnect_by_func (priv->roster_cache,
+						      G_CALLBACK (contact_list_store_members_changed_bulk_cb),
+						      object);
+		g_object_unref (priv->roster_cache);
+	}
+
 	g_signal_handlers_disconnect_by_func (priv->list,
-					      G_CALLBACK (contact_list_store_members_changed_cb),
+					      G_CALLBACK (contact_list_store_members_changed_bulk_cb),
 					      object);
 	g_signal_handlers_disconnect_by_func (priv->list,
 					      G_CALLBACK (contact_list_store_groups_changed_cb),
@@ -310,6 +322,8 @@ contact_list_store_finalize (GObject *object)
 		g_source_remove (priv->inhibit_active);
 	}
 
+	g_hash_table_destroy (priv->contact_rows);
+
 	G_OBJECT_CLASS (empathy_contact_list_store_parent_class)->finalize (object);
 }
 
@@ -411,6 +425,46 @@ empathy_contact_list_store_get_list_iface (EmpathyContactListStore *store)
 	return priv->list;
 }
 
+/**
+ * empathy_contact_list_store_set_roster_cache:
+ * @store: an #EmpathyContactListStore
+ * @cache: an #EmpathyRosterCache
+ *
+ * Also shows the stale contacts of @cache, from the roster snapshot of the
+ * previous session, until their live counterparts replace them. Their rows
+ * have %EMPATHY_CONTACT_LIST_STORE_COL_IS_STALE set.
+ */
+void
+empathy_contact_list_store_set_roster_cache (EmpathyContactListStore *store,
+					     EmpathyRosterCache      *cache)
+{
+	EmpathyContactListStorePriv *priv;
+	GList                       *contacts, *l;
+
+	g_return_if_fail (EMPATHY_IS_CONTACT_LIST_STORE (store));
+	g_return_if_fail (EMPATHY_IS_ROSTER_CACHE (cache));
+
+	priv = GET_PRIV (store);
+
+	if (priv->roster_cache) {
+		return;
+	}
+
+	priv->roster_cache = g_object_ref (cache);
+	g_signal_connect (cache,
+			  "members-changed-bulk",
+			  G_CALLBACK (contact_list_store_members_changed_bulk_cb),
+			  store);
+
+	contacts = empathy_contact_list_get_members (EMPATHY_CONTACT_LIST (cache));
+	contact_list_store_add_members (store, EMPATHY_CONTACT_LIST (cache),
+					contacts);
+	for (l = contacts; l; l = l->next) {
+		g_object_unref (l->data);
+	}
+	g_list_free (contacts);
+}
+
 gboolean
 empathy_contact_list_store_get_show_offline (EmpathyContactListStore *store)
 {
@@ -441,7 +495,7 @@ empathy_contact_list_store_set_show_offline (EmpathyContactListStore *store,
 	/* Disable temporarily. */
 	priv->show_active = FALSE;
 
-	contacts = empathy_contact_list_get_members (priv->list);
+	contacts = contact_list_store_dup_members (store);
 	for (l = contacts; l; l = l->next) {
 		contact_list_store_contact_update (store, l->data);
 
@@ -522,13 +576,10 @@ empathy_contact_list_store_set_show_groups (EmpathyContactListStore *store,
 	/* Remove all contacts and add them back, not optimized but that's the
 	 * easy way :) */
 	gtk_tree_store_clear (GTK_TREE_STORE (store));
-	contacts = empathy_contact_list_get_members (priv->list);
+	g_hash_table_remove_all (priv->contact_rows);
+	contacts = contact_list_store_dup_members (store);
+	contact_list_store_add_members (store, priv->list, contacts);
 	for (l = contacts; l; l = l->next) {
-		contact_list_store_members_changed_cb (priv->list, l->data,
-						       NULL, 0, NULL,
-						       TRUE,
-						       store);
-
 		g_object_unref (l->data);
 	}
 	g_list_free (contacts);
@@ -686,9 +737,10 @@ empathy_contact_list_store_search_equal_func (GtkTreeModel *model,
 					      GtkTreeIter  *iter,
 					      gpointer      search_data)
 {
-	gchar    *name, *name_folded;
-	gchar    *key_folded;
-	gboolean  ret;
+	EmpathyContact *contact;
+	gchar          *name, *name_folded;
+	gchar          *key_folded;
+	gboolean        ret;
 
 	g_return_val_if_fail (GTK_IS_TREE_MODEL (model), FALSE);
 
@@ -697,9 +749,26 @@ empathy_contact_list_store_search_equal_func (GtkTreeModel *model,
 	}
 
 	gtk_tree_model_get (model, iter,
+			    EMPATHY_CONTACT_LIST_STORE_COL_CONTACT, &contact,
 			    EMPATHY_CONTACT_LIST_STORE_COL_NAME, &name,
 			    -1);
 
+	/* Contact rows are looked up in the search index, which keeps the
+	 * matching set of the current key instead of casefolding every row
+	 * on each keystroke. */
+	if (contact && EMPATHY_IS_CONTACT_SEARCH (search_data)) {
+		ret = !empathy_contact_search_matches (search_data,
+						       contact, key);
+		g_object_unref (contact);
+		g_free (name);
+
+		return ret;
+	}
+
+	if (contact) {
+		g_object_unref (contact);
+	}
+
 	if (!name) {
 		return TRUE;
 	}
@@ -737,10 +806,15 @@ contact_list_store_setup (EmpathyContactListStore *store)
 					       G_TYPE_BOOLEAN,       /* Is online */
 					       G_TYPE_BOOLEAN,       /* Is separator */
 					       G_TYPE_BOOLEAN,       /* Can make audio calls */
-					       G_TYPE_BOOLEAN};      /* Can make video calls */
+					       G_TYPE_BOOLEAN,       /* Can make video calls */
+					       G_TYPE_BOOLEAN};      /* Is stale */
 
 	priv = GET_PRIV (store);
 
+	priv->contact_rows = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						    NULL,
+						    (GDestroyNotify) contact_list_store_free_iters);
+
 	gtk_tree_store_set_column_types (GTK_TREE_STORE (store),
 					 EMPATHY_CONTACT_LIST_STORE_COL_COUNT,
 					 types);
@@ -773,48 +847,118 @@ contact_list_store_inibit_active_cb (EmpathyContactListStore *store)
 }
 
 static void
-contact_list_store_members_changed_cb (EmpathyContactList      *list_iface,
-				       EmpathyContact          *contact,
-				       EmpathyContact          *actor,
-				       guint                    reason,
-				       gchar                   *message,
-				       gboolean                 is_member,
-				       EmpathyContactListStore *store)
+contact_list_store_connect_contact (EmpathyContactListStore *store,
+				    EmpathyContact          *contact)
+{
+	g_signal_connect (contact, "notify::presence",
+			  G_CALLBACK (contact_list_store_contact_updated_cb),
+			  store);
+	g_signal_connect (contact, "notify::presence-message",
+			  G_CALLBACK (contact_list_store_contact_updated_cb),
+			  store);
+	g_signal_connect (contact, "notify::name",
+			  G_CALLBACK (contact_list_store_contact_updated_cb),
+			  store);
+	g_signal_connect (contact, "notify::avatar",
+			  G_CALLBACK (contact_list_store_contact_updated_cb),
+			  store);
+	g_signal_connect (contact, "notify::capabilities",
+			  G_CALLBACK (contact_list_store_contact_updated_cb),
+			  store);
+}
+
+static void
+contact_list_store_members_changed_bulk_cb (EmpathyContactList      *list_iface,
+					    GPtrArray               *added,
+					    GPtrArray               *removed,
+					    EmpathyContact          *actor,
+					    guint                    reason,
+					    gchar                   *message,
+					    EmpathyContactListStore *store)
 {
 	EmpathyContactListStorePriv *priv;
+	gint                         sort_column_id;
+	GtkSortType                  order;
+	gboolean                     resort = FALSE;
+	guint                        i;
 
 	priv = GET_PRIV (store);
 
-	DEBUG ("Contact %s (%d) %s",
-		empathy_contact_get_id (contact),
-		empathy_contact_get_handle (contact),
-		is_member ? "added" : "removed");
-
-	if (is_member) {
-		g_signal_connect (contact, "notify::presence",
-				  G_CALLBACK (contact_list_store_contact_updated_cb),
-				  store);
-		g_signal_connect (contact, "notify::presence-message",
-				  G_CALLBACK (contact_list_store_contact_updated_cb),
-				  store);
-		g_signal_connect (contact, "notify::name",
-				  G_CALLBACK (contact_list_store_contact_updated_cb),
-				  store);
-		g_signal_connect (contact, "notify::avatar",
-				  G_CALLBACK (contact_list_store_contact_updated_cb),
-				  store);
-		g_signal_connect (contact, "notify::capabilities",
-				  G_CALLBACK (contact_list_store_contact_updated_cb),
-				  store);
+	for (i = 0; removed && i < removed->len; i++) {
+		EmpathyContact *contact = g_ptr_array_index (removed, i);
+
+		DEBUG ("Contact %s (%d) removed",
+			empathy_contact_get_id (contact),
+			empathy_contact_get_handle (contact));
 
-		contact_list_store_add_contact (store, contact);
-	} else {
 		g_signal_handlers_disconnect_by_func (contact,
 						      G_CALLBACK (contact_list_store_contact_updated_cb),
 						      store);
 
 		contact_list_store_remove_contact (store, contact);
 	}
+
+	/* Inserting rows in a sorted store walks the siblings for each of
+	 * them, for big batches insert unsorted and sort once at the end. */
+	if (added && added->len >= BULK_UNSORTED_THRESHOLD &&
+	    gtk_tree_sortable_get_sort_column_id (GTK_TREE_SORTABLE (store),
+						  &sort_column_id, &order)) {
+		gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (store),
+						      GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID,
+						      order);
+		resort = TRUE;
+	}
+
+	for (i = 0; added && i < added->len; i++) {
+		EmpathyContact *contact = g_ptr_array_index (added, i);
+		const GList    *iters;
+
+		DEBUG ("Contact %s (%d) added",
+			empathy_contact_get_id (contact),
+			empathy_contact_get_handle (contact));
+
+		contact_list_store_connect_contact (store, contact);
+
+		if (g_hash_table_lookup (priv->contact_rows, contact)) {
+			contact_list_store_contact_update (store, contact);
+			continue;
+		}
+
+		/* Newcomers are highlighted with timeouts, leave that to
+		 * the usual path */
+		if (priv->show_active) {
+			contact_list_store_add_contact (store, contact);
+			continue;
+		}
+
+		iters = contact_list_store_insert_contact (store, contact);
+		if (iters) {
+			contact_list_store_set_contact_rows (store, contact, iters);
+		}
+	}
+
+	if (resort) {
+		gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (store),
+						      sort_column_id, order);
+	}
+}
+
+static void
+contact_list_store_add_members (EmpathyContactListStore *store,
+				EmpathyContactList      *list_iface,
+				GList                   *contacts)
+{
+	GPtrArray *added;
+	GList     *l;
+
+	added = g_ptr_array_new ();
+	for (l = contacts; l; l = l->next) {
+		g_ptr_array_add (added, l->data);
+	}
+
+	contact_list_store_members_changed_bulk_cb (list_iface, added, NULL,
+						    NULL, 0, NULL, store);
+	g_ptr_array_free (added, TRUE);
 }
 
 static void
@@ -844,23 +988,56 @@ contact_list_store_groups_changed_cb (EmpathyContactList      *list_iface,
 	priv->show_active = show_active;
 }
 
-static void
-contact_list_store_add_contact (EmpathyContactListStore *store,
-				EmpathyContact          *contact)
+static GList *
+contact_list_store_dup_members (EmpathyContactListStore *store)
+{
+	EmpathyContactListStorePriv *priv;
+	GList                       *contacts;
+
+	priv = GET_PRIV (store);
+
+	contacts = empathy_contact_list_get_members (priv->list);
+	if (priv->roster_cache) {
+		contacts = g_list_concat (contacts,
+			empathy_contact_list_get_members (EMPATHY_CONTACT_LIST (priv->roster_cache)));
+	}
+
+	return contacts;
+}
+
+/* Adds the rows of @contact, without filling the columns which
+ * contact_list_store_set_contact_rows() sets. Returns all the rows of the
+ * contact, owned by the store, or NULL if the contact isn't shown. */
+static const GList *
+contact_list_store_insert_contact (EmpathyContactListStore *store,
+				   EmpathyContact          *contact)
 {
 	EmpathyContactListStorePriv *priv;
 	GtkTreeIter                 iter;
 	GList                      *groups = NULL, *l;
+	GList                      *iters = NULL;
+	gboolean                    is_stale = FALSE;
 
 	priv = GET_PRIV (store);
 
 	if (EMP_STR_EMPTY (empathy_contact_get_name (contact)) ||
 	    (!priv->show_offline && !empathy_contact_is_online (contact))) {
-		return;
+		return NULL;
+	}
+
+	if (priv->roster_cache) {
+		is_stale = empathy_roster_cache_is_stale (priv->roster_cache,
+							  contact);
 	}
 
 	if (priv->show_groups) {
-		groups = empathy_contact_list_get_groups (priv->list, contact);
+		/* Stale contacts keep the groups of the snapshot */
+		if (is_stale) {
+			groups = empathy_contact_list_get_groups (
+				EMPATHY_CONTACT_LIST (priv->roster_cache), contact);
+		} else {
+			groups = empathy_contact_list_get_groups (priv->list, contact);
+		}
 	}
 
 	/* If no groups just add it at the top level. */
@@ -877,7 +1054,9 @@ contact_list_store_add_contact (EmpathyContactListStore *store,
 				    EMPATHY_CONTACT_LIST_STORE_COL_CAN_VIDEO_CALL,
 				      empathy_contact_get_capabilities (contact) &
 				        EMPATHY_CAPABILITIES_VIDEO,
+				    EMPATHY_CONTACT_LIST_STORE_COL_IS_STALE, is_stale,
 				    -1);
+		iters = g_list_prepend (iters, gtk_tree_iter_copy (&iter));
 	}
 
 	/* Else add to each group. */
@@ -899,13 +1078,39 @@ contact_list_store_add_contact (EmpathyContactListStore *store,
 				    EMPATHY_CONTACT_LIST_STORE_COL_CAN_VIDEO_CALL,
 				      empathy_contact_get_capabilities (contact) &
 				        EMPATHY_CAPABILITIES_VIDEO,
+				    EMPATHY_CONTACT_LIST_STORE_COL_IS_STALE, is_stale,
 				    -1);
+		iters = g_list_prepend (iters, gtk_tree_iter_copy (&iter));
 		g_free (l->data);
 	}
 	g_list_free (groups);
 
-	contact_list_store_contact_update (store, contact);
+	/* Keep the rows of the contact in the index, so they are never
+	 * looked for in the whole tree */
+	iters = g_list_concat (g_hash_table_lookup (priv->contact_rows, contact),
+			       g_list_reverse (iters));
+	g_hash_table_steal (priv->contact_rows, contact);
+	g_hash_table_insert (priv->contact_rows, contact, iters);
 
+	return iters;
+}
+
+static void
+contact_list_store_free_iters (GList *iters)
+{
+	g_list_foreach (iters, (GFunc) gtk_tree_iter_free, NULL);
+	g_list_free (iters);
+}
+
+static void
+contact_list_store_add_contact (EmpathyContactListStore *store,
+				EmpathyContact          *contact)
+{
+	if (!contact_list_store_insert_contact (store, contact)) {
+		return;
+	}
+
+	contact_list_store_contact_update (store, contact);
 }
 
 static void
@@ -918,7 +1123,7 @@ contact_list_store_remove_contact (EmpathyContactListStore *store,
 
 	priv = GET_PRIV (store);
 
-	iters = contact_list_store_find_contact (store, contact);
+	iters = g_hash_table_lookup (priv->contact_rows, contact);
 	if (!iters) {
 		return;
 	}
@@ -941,8 +1146,41 @@ contact_list_store_remove_contact (EmpathyContactListStore *store,
 		}
 	}
 
-	g_list_foreach (iters, (GFunc) gtk_tree_iter_free, NULL);
-	g_list_free (iters);
+	g_hash_table_remove (priv->contact_rows, contact);
+}
+
+static void
+contact_list_store_set_contact_rows (EmpathyContactListStore *store,
+				     EmpathyContact          *contact,
+				     const GList             *iters)
+{
+	EmpathyContactListStorePriv *priv;
+	const GList                 *l;
+	gboolean                     show_avatar;
+
+	priv = GET_PRIV (store);
+
+	show_avatar = priv->show_avatars && !priv->is_compact;
+
+	/* The avatar pixbuf is decoded by the view, for visible rows only */
+	for (l = iters; l; l = l->next) {
+		gtk_tree_store_set (GTK_TREE_STORE (store), l->data,
+				    EMPATHY_CONTACT_LIST_STORE_COL_ICON_STATUS, empathy_icon_name_for_contact (contact),
+				    EMPATHY_CONTACT_LIST_STORE_COL_PIXBUF_AVATAR_VISIBLE, show_avatar,
+				    EMPATHY_CONTACT_LIST_STORE_COL_NAME, empathy_contact_get_name (contact),
+				    EMPATHY_CONTACT_LIST_STORE_COL_STATUS, empathy_contact_get_status (contact),
+				    EMPATHY_CONTACT_LIST_STORE_COL_STATUS_VISIBLE, !priv->is_compact,
+				    EMPATHY_CONTACT_LIST_STORE_COL_IS_GROUP, FALSE,
+				    EMPATHY_CONTACT_LIST_STORE_COL_IS_ONLINE, empathy_contact_is_online (contact),
+				    EMPATHY_CONTACT_LIST_STORE_COL_IS_SEPARATOR, FALSE,
+				    EMPATHY_CONTACT_LIST_STORE_COL_CAN_AUDIO_CALL,
+				      empathy_contact_get_capabilities (contact) &
+				        EMPATHY_CAPABILITIES_AUDIO,
+				    EMPATHY_CONTACT_LIST_STORE_COL_CAN_VIDEO_CALL,
+				      empathy_contact_get_capabilities (contact) &
+				        EMPATHY_CAPABILITIES_VIDEO,
+				    -1);
+	}
 }
 
 static void
@@ -961,8 +1199,6 @@ contact_list_store_contact_update (EmpathyContactListStore *store,
 	gboolean                    do_remove = FALSE;
 	gboolean                    do_set_active = FALSE;
 	gboolean                    do_set_refresh = FALSE;
-	gboolean                    show_avatar = FALSE;
-	GdkPixbuf                  *pixbuf_avatar;
 
 	priv = GET_PRIV (store);
 
@@ -1052,32 +1288,8 @@ contact_list_store_contact_update (EmpathyContactListStore *store,
 		set_model = TRUE;
 	}
 
-	if (priv->show_avatars && !priv->is_compact) {
-		show_avatar = TRUE;
-	}
-	pixbuf_avatar = empathy_pixbuf_avatar_from_contact_scaled (contact, 32, 32);
-	for (l = iters; l && set_model; l = l->next) {
-		gtk_tree_store_set (GTK_TREE_STORE (store), l->data,
-				    EMPATHY_CONTACT_LIST_STORE_COL_ICON_STATUS, empathy_icon_name_for_contact (contact),
-				    EMPATHY_CONTACT_LIST_STORE_COL_PIXBUF_AVATAR, pixbuf_avatar,
-				    EMPATHY_CONTACT_LIST_STORE_COL_PIXBUF_AVATAR_VISIBLE, show_avatar,
-				    EMPATHY_CONTACT_LIST_STORE_COL_NAME, empathy_contact_get_name (contact),
-				    EMPATHY_CONTACT_LIST_STORE_COL_STATUS, empathy_contact_get_status (contact),
-				    EMPATHY_CONTACT_LIST_STORE_COL_STATUS_VISIBLE, !priv->is_compact,
-				    EMPATHY_CONTACT_LIST_STORE_COL_IS_GROUP, FALSE,
-				    EMPATHY_CONTACT_LIST_STORE_COL_IS_ONLINE, now_online,
-				    EMPATHY_CONTACT_LIST_STORE_COL_IS_SEPARATOR, FALSE,
-				    EMPATHY_CONTACT_LIST_STORE_COL_CAN_AUDIO_CALL,
-				      empathy_contact_get_capabilities (contact) &
-				        EMPATHY_CAPABILITIES_AUDIO,
-				    EMPATHY_CONTACT_LIST_STORE_COL_CAN_VIDEO_CALL,
-				      empathy_contact_get_capabilities (contact) &
-				        EMPATHY_CAPABILITIES_VIDEO,
-				    -1);
-	}
-
-	if (pixbuf_avatar) {
-		g_object_unref (pixbuf_avatar);
+	if (set_model) {
+		contact_list_store_set_contact_rows (store, contact, iters);
 	}
 
 	if (priv->show_active && do_set_active) {
@@ -1430,55 +1642,22 @@ contact_list_store_name_sort_func (GtkTreeModel *model,
 	return ret_val;
 }
 
-static gboolean
-contact_list_store_find_contact_foreach (GtkTreeModel *model,
-					 GtkTreePath  *path,
-					 GtkTreeIter  *iter,
-					 FindContact  *fc)
-{
-	EmpathyContact *contact;
-
-	gtk_tree_model_get (model, iter,
-			    EMPATHY_CONTACT_LIST_STORE_COL_CONTACT, &contact,
-			    -1);
-
-	if (contact == fc->contact) {
-		fc->found = TRUE;
-		fc->iters = g_list_append (fc->iters, gtk_tree_iter_copy (iter));
-	}
-
-	if (contact) {
-		g_object_unref (contact);
-	}
-
-	return FALSE;
-}
-
+/* Returns a copy of the rows of @contact, free it with
+ * contact_list_store_free_iters() */
 static GList *
 contact_list_store_find_contact (EmpathyContactListStore *store,
 				 EmpathyContact          *contact)
 {
 	EmpathyContactListStorePriv *priv;
-	GtkTreeModel              *model;
-	GList                     *l = NULL;
-	FindContact                fc;
+	GList                      *l, *iters = NULL;
 
 	priv = GET_PRIV (store);
 
-	memset (&fc, 0, sizeof (fc));
-
-	fc.contact = contact;
-
-	model = GTK_TREE_MODEL (store);
-	gtk_tree_model_foreach (model,
-				(GtkTreeModelForeachFunc) contact_list_store_find_contact_foreach,
-				&fc);
-
-	if (fc.found) {
-		l = fc.iters;
+	for (l = g_hash_table_lookup (priv->contact_rows, contact); l; l = l->next) {
+		iters = g_list_prepend (iters, gtk_tree_iter_copy (l->data));
 	}
 
-	return l;
+	return g_list_reverse (iters);
 }
 
 static gboolean
@@ -30,6 +30,7 @@
 
 #include <libempathy/empathy-contact-list.h>
 #include <libempathy/empathy-contact.h>
+#include <libempathy/empathy-roster-cache.h>
 
 G_BEGIN_DECLS
 
@@ -50,6 +51,7 @@ typedef enum {
 
 typedef enum {
 	EMPATHY_CONTACT_LIST_STORE_COL_ICON_STATUS,
+	/* Not filled, EmpathyContactListView decodes avatars of visible rows */
 	EMPATHY_CONTACT_LIST_STORE_COL_PIXBUF_AVATAR,
 	EMPATHY_CONTACT_LIST_STORE_COL_PIXBUF_AVATAR_VISIBLE,
 	EMPATHY_CONTACT_LIST_STORE_COL_NAME,
@@ -62,6 +64,7 @@ typedef enum {
 	EMPATHY_CONTACT_LIST_STORE_COL_IS_SEPARATOR,
 	EMPATHY_CONTACT_LIST_STORE_COL_CAN_AUDIO_CALL,
 	EMPATHY_CONTACT_LIST_STORE_COL_CAN_VIDEO_CALL,
+	EMPATHY_CONTACT_LIST_STORE_COL_IS_STALE,
 	EMPATHY_CONTACT_LIST_STORE_COL_COUNT
 } EmpathyContactListStoreCol;
 
@@ -77,6 +80,8 @@ struct _EmpathyContactListStoreClass {
 GType                      empathy_contact_list_store_get_type           (void) G_GNUC_CONST;
 EmpathyContactListStore *  empathy_contact_list_store_new                (EmpathyContactList         *list_iface);
 EmpathyContactList *       empathy_contact_list_store_get_list_iface     (EmpathyContactListStore     *store);
+void                       empathy_contact_list_store_set_roster_cache   (EmpathyContactListStore     *store,
+									 EmpathyRosterCache          *cache);
 gboolean                   empathy_contact_list_store_get_show_offline   (EmpathyContactListStore     *store);
 void                       empathy_contact_list_store_set_show_offline   (EmpathyContactListStore     *store,
 									 gboolean                    show_offline);
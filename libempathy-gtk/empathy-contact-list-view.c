@@ -29,6 +29,7 @@
 
 #include <glib/gi18n-lib.h>
 #include <gdk/gdkkeysyms.h>
+#include <gio/gio.h>
 #include <gtk/gtk.h>
 
 #include <telepathy-glib/util.h>
@@ -38,6 +39,7 @@
 #include <libempathy/empathy-tp-contact-factory.h>
 #include <libempathy/empathy-contact-list.h>
 #include <libempathy/empathy-contact-groups.h>
+#include <libempathy/empathy-contact-search.h>
 #include <libempathy/empathy-dispatcher.h>
 #include <libempathy/empathy-utils.h>
 
@@ -58,6 +60,13 @@
  * (e.g. online, offline or from normal to a busy state).
  */
 
+/* Size of the avatars in the list */
+#define AVATAR_SIZE 32
+
+/* Number of decoded avatars kept, the ones drawn longest ago are dropped
+ * first */
+#define AVATAR_CACHE_SIZE 64
+
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyContactListView)
 typedef struct {
 	EmpathyContactListStore        *store;
@@ -65,8 +74,30 @@ typedef struct {
 	EmpathyContactListFeatureFlags  list_features;
 	EmpathyContactFeatureFlags      contact_features;
 	GtkWidget                      *tooltip_widget;
+	EmpathyContactSearch           *search;
+
+	/* avatar token -> AvatarEntry, for rows drawn recently */
+	GHashTable                     *avatars;
+	/* Incremented on each expose of the rows */
+	guint                           avatar_frame;
+	guint                           avatar_evict_id;
+	GtkTreePath                    *visible_start;
+	GtkTreePath                    *visible_end;
 } EmpathyContactListViewPriv;
 
+typedef struct {
+	gchar     *token;
+	GdkPixbuf *pixbuf;
+	gboolean   decoded;
+	guint      last_drawn;
+} AvatarEntry;
+
+typedef struct {
+	EmpathyContactListView *view;
+	EmpathyAvatar          *avatar;
+	GdkPixbuf              *pixbuf;
+} AvatarDecodeData;
+
 typedef struct {
 	EmpathyContactListView *view;
 	GtkTreePath           *path;
@@ -706,16 +737,21 @@ contact_list_view_pixbuf_cell_data_func (GtkTreeViewColumn     *tree_column,
 	gchar    *icon_name;
 	gboolean  is_group;
 	gboolean  is_active;
+	gboolean  is_stale;
 
 	gtk_tree_model_get (model, iter,
 			    EMPATHY_CONTACT_LIST_STORE_COL_IS_GROUP, &is_group,
 			    EMPATHY_CONTACT_LIST_STORE_COL_IS_ACTIVE, &is_active,
 			    EMPATHY_CONTACT_LIST_STORE_COL_ICON_STATUS, &icon_name,
+			    EMPATHY_CONTACT_LIST_STORE_COL_IS_STALE, &is_stale,
 			    -1);
 
+	/* Presence from the roster snapshot is shown greyed out until the
+	 * contact is back from the connection */
 	g_object_set (cell,
 		      "visible", !is_group,
 		      "icon-name", icon_name,
+		      "sensitive", !is_stale,
 		      NULL);
 
 	g_free (icon_name);
@@ -776,6 +812,222 @@ contact_list_view_video_call_cell_data_func (
 }
 
 
+static void
+contact_list_view_avatar_entry_free (AvatarEntry *entry)
+{
+	if (entry->pixbuf) {
+		g_object_unref (entry->pixbuf);
+	}
+	g_free (entry->token);
+	g_slice_free (AvatarEntry, entry);
+}
+
+static gboolean
+contact_list_view_avatar_decoded_cb (gpointer user_data)
+{
+	AvatarDecodeData           *data = user_data;
+	EmpathyContactListViewPriv *priv = GET_PRIV (data->view);
+	AvatarEntry                *entry;
+
+	entry = g_hash_table_lookup (priv->avatars, data->avatar->token);
+	if (entry && !entry->decoded) {
+		entry->pixbuf = data->pixbuf;
+		entry->decoded = TRUE;
+		data->pixbuf = NULL;
+
+		gtk_widget_queue_draw (GTK_WIDGET (data->view));
+	}
+
+	if (data->pixbuf) {
+		g_object_unref (data->pixbuf);
+	}
+	empathy_avatar_unref (data->avatar);
+	g_object_unref (data->view);
+	g_slice_free (AvatarDecodeData, data);
+
+	return FALSE;
+}
+
+static gboolean
+contact_list_view_avatar_decode_job (GIOSchedulerJob *job,
+				     GCancellable    *cancellable,
+				     gpointer         user_data)
+{
+	AvatarDecodeData *data = user_data;
+
+	/* The avatar is only read here, its references are kept and
+	 * dropped in the main thread */
+	data->pixbuf = empathy_pixbuf_from_avatar_scaled (data->avatar,
+							  AVATAR_SIZE,
+							  AVATAR_SIZE);
+
+	g_io_scheduler_job_send_to_mainloop_async (job,
+						   contact_list_view_avatar_decoded_cb,
+						   data, NULL);
+
+	return FALSE;
+}
+
+static gboolean
+contact_list_view_is_row_visible (EmpathyContactListView *view,
+				  GtkTreeModel           *model,
+				  GtkTreeIter            *iter)
+{
+	EmpathyContactListViewPriv *priv = GET_PRIV (view);
+	GtkTreePath                *path;
+	gboolean                    visible;
+
+	if (!priv->visible_start || !priv->visible_end) {
+		return FALSE;
+	}
+
+	path = gtk_tree_model_get_path (model, iter);
+	visible = gtk_tree_path_compare (path, priv->visible_start) >= 0 &&
+		  gtk_tree_path_compare (path, priv->visible_end) <= 0;
+	gtk_tree_path_free (path);
+
+	return visible;
+}
+
+static GdkPixbuf *
+contact_list_view_get_avatar (EmpathyContactListView *view,
+			      GtkTreeModel           *model,
+			      GtkTreeIter            *iter,
+			      EmpathyContact         *contact)
+{
+	EmpathyContactListViewPriv *priv = GET_PRIV (view);
+	EmpathyAvatar              *avatar;
+	AvatarEntry                *entry;
+	AvatarDecodeData           *data;
+
+	avatar = empathy_contact_get_avatar (contact);
+	if (!avatar || EMP_STR_EMPTY (avatar->token)) {
+		return NULL;
+	}
+
+	entry = g_hash_table_lookup (priv->avatars, avatar->token);
+	if (entry) {
+		entry->last_drawn = priv->avatar_frame;
+		return entry->pixbuf;
+	}
+
+	/* The tree view also measures rows which are not shown, only decode
+	 * avatars of the rows being drawn */
+	if (!contact_list_view_is_row_visible (view, model, iter)) {
+		return NULL;
+	}
+
+	entry = g_slice_new0 (AvatarEntry);
+	entry->token = g_strdup (avatar->token);
+	entry->last_drawn = priv->avatar_frame;
+	g_hash_table_insert (priv->avatars, entry->token, entry);
+
+	data = g_slice_new0 (AvatarDecodeData);
+	data->view = g_object_ref (view);
+	data->avatar = empathy_avatar_ref (avatar);
+
+	g_io_scheduler_push_job (contact_list_view_avatar_decode_job,
+				 data, NULL,
+				 G_PRIORITY_DEFAULT, NULL);
+
+	/* The cell stays empty until the avatar is decoded */
+	return NULL;
+}
+
+static gint
+contact_list_view_avatar_entry_compare (gconstpointer a,
+					gconstpointer b)
+{
+	const AvatarEntry *entry_a = *(const AvatarEntry **) a;
+	const AvatarEntry *entry_b = *(const AvatarEntry **) b;
+
+	if (entry_a->last_drawn < entry_b->last_drawn) {
+		return -1;
+	}
+
+	return entry_a->last_drawn > entry_b->last_drawn;
+}
+
+static gboolean
+contact_list_view_evict_avatars_cb (gpointer user_data)
+{
+	EmpathyContactListView     *view = user_data;
+	EmpathyContactListViewPriv *priv = GET_PRIV (view);
+	GHashTableIter              hash_iter;
+	GPtrArray                  *entries;
+	gpointer                    value;
+	guint                       size, i;
+
+	priv->avatar_evict_id = 0;
+
+	entries = g_ptr_array_new ();
+	g_hash_table_iter_init (&hash_iter, priv->avatars);
+	while (g_hash_table_iter_next (&hash_iter, NULL, &value)) {
+		g_ptr_array_add (entries, value);
+	}
+	g_ptr_array_sort (entries, contact_list_view_avatar_entry_compare);
+
+	/* Drop the avatars drawn longest ago, but keep those drawn by the
+	 * last expose and the ones being decoded. Scrolling only exposes
+	 * part of the rows, so the rows still on screen but not redrawn
+	 * can be dropped too; they are decoded again when needed. */
+	size = entries->len;
+	for (i = 0; i < entries->len && size > AVATAR_CACHE_SIZE; i++) {
+		AvatarEntry *entry = g_ptr_array_index (entries, i);
+
+		if (entry->last_drawn >= priv->avatar_frame) {
+			break;
+		}
+		if (!entry->decoded) {
+			continue;
+		}
+
+		g_hash_table_remove (priv->avatars, entry->token);
+		size--;
+	}
+
+	g_ptr_array_free (entries, TRUE);
+
+	return FALSE;
+}
+
+static gboolean
+contact_list_view_expose_event_cb (EmpathyContactListView *view,
+				   GdkEventExpose         *event,
+				   gpointer                user_data)
+{
+	EmpathyContactListViewPriv *priv = GET_PRIV (view);
+	GdkWindow                  *bin_window;
+
+	bin_window = gtk_tree_view_get_bin_window (GTK_TREE_VIEW (view));
+	if (event->window != bin_window) {
+		return FALSE;
+	}
+
+	/* Remember which rows are about to be drawn */
+	priv->avatar_frame++;
+
+	if (priv->visible_start) {
+		gtk_tree_path_free (priv->visible_start);
+		priv->visible_start = NULL;
+	}
+	if (priv->visible_end) {
+		gtk_tree_path_free (priv->visible_end);
+		priv->visible_end = NULL;
+	}
+	gtk_tree_view_get_visible_range (GTK_TREE_VIEW (view),
+					 &priv->visible_start,
+					 &priv->visible_end);
+
+	if (g_hash_table_size (priv->avatars) > AVATAR_CACHE_SIZE &&
+	    priv->avatar_evict_id == 0) {
+		priv->avatar_evict_id = g_idle_add (contact_list_view_evict_avatars_cb,
+						    view);
+	}
+
+	return FALSE;
+}
+
 static void
 contact_list_view_avatar_cell_data_func (GtkTreeViewColumn     *tree_column,
 					 GtkCellRenderer       *cell,
@@ -783,25 +1035,30 @@ contact_list_view_avatar_cell_data_func (GtkTreeViewColumn     *tree_column,
 					 GtkTreeIter           *iter,
 					 EmpathyContactListView *view)
 {
-	GdkPixbuf *pixbuf;
-	gboolean   show_avatar;
-	gboolean   is_group;
-	gboolean   is_active;
+	EmpathyContact *contact;
+	GdkPixbuf      *pixbuf = NULL;
+	gboolean        show_avatar;
+	gboolean        is_group;
+	gboolean        is_active;
 
 	gtk_tree_model_get (model, iter,
-			    EMPATHY_CONTACT_LIST_STORE_COL_PIXBUF_AVATAR, &pixbuf,
+			    EMPATHY_CONTACT_LIST_STORE_COL_CONTACT, &contact,
 			    EMPATHY_CONTACT_LIST_STORE_COL_PIXBUF_AVATAR_VISIBLE, &show_avatar,
 			    EMPATHY_CONTACT_LIST_STORE_COL_IS_GROUP, &is_group,
 			    EMPATHY_CONTACT_LIST_STORE_COL_IS_ACTIVE, &is_active,
 			    -1);
 
+	if (contact && !is_group && show_avatar) {
+		pixbuf = contact_list_view_get_avatar (view, model, iter, contact);
+	}
+
 	g_object_set (cell,
 		      "visible", !is_group && show_avatar,
 		      "pixbuf", pixbuf,
 		      NULL);
 
-	if (pixbuf) {
-		g_object_unref (pixbuf);
+	if (contact) {
+		g_object_unref (contact);
 	}
 
 	contact_list_view_cell_set_background (view, cell, is_group, is_active);
@@ -817,15 +1074,18 @@ contact_list_view_text_cell_data_func (GtkTreeViewColumn     *tree_column,
 	gboolean is_group;
 	gboolean is_active;
 	gboolean show_status;
+	gboolean is_stale;
 
 	gtk_tree_model_get (model, iter,
 			    EMPATHY_CONTACT_LIST_STORE_COL_IS_GROUP, &is_group,
 			    EMPATHY_CONTACT_LIST_STORE_COL_IS_ACTIVE, &is_active,
 			    EMPATHY_CONTACT_LIST_STORE_COL_STATUS_VISIBLE, &show_status,
+			    EMPATHY_CONTACT_LIST_STORE_COL_IS_STALE, &is_stale,
 			    -1);
 
 	g_object_set (cell,
 		      "show-status", show_status,
+		      "sensitive", !is_stale,
 		      NULL);
 
 	contact_list_view_cell_set_background (view, cell, is_group, is_active);
@@ -944,9 +1204,10 @@ contact_list_view_setup (EmpathyContactListView *view)
 
 	priv = GET_PRIV (view);
 
+	priv->search = empathy_contact_search_dup_singleton ();
 	gtk_tree_view_set_search_equal_func (GTK_TREE_VIEW (view),
 					     empathy_contact_list_store_search_equal_func,
-					     NULL, NULL);
+					     priv->search, NULL);
 
 	g_signal_connect (priv->store, "row-has-child-toggled",
 			  G_CALLBACK (contact_list_view_row_has_child_toggled_cb),
@@ -1036,8 +1297,8 @@ contact_list_view_setup (EmpathyContactListView *view)
 		      "xpad", 0,
 		      "ypad", 0,
 		      "visible", FALSE,
-		      "width", 32,
-		      "height", 32,
+		      "width", AVATAR_SIZE,
+		      "height", AVATAR_SIZE,
 		      NULL);
 
 	/* Expander */
@@ -1115,6 +1376,19 @@ contact_list_view_finalize (GObject *object)
 	if (priv->tooltip_widget) {
 		gtk_widget_destroy (priv->tooltip_widget);
 	}
+	if (priv->search) {
+		g_object_unref (priv->search);
+	}
+	if (priv->avatar_evict_id) {
+		g_source_remove (priv->avatar_evict_id);
+	}
+	if (priv->visible_start) {
+		gtk_tree_path_free (priv->visible_start);
+	}
+	if (priv->visible_end) {
+		gtk_tree_path_free (priv->visible_end);
+	}
+	g_hash_table_destroy (priv->avatars);
 
 	G_OBJECT_CLASS (empathy_contact_list_view_parent_class)->finalize (object);
 }
@@ -1238,6 +1512,9 @@ empathy_contact_list_view_init (EmpathyContactListView *view)
 		EMPATHY_TYPE_CONTACT_LIST_VIEW, EmpathyContactListViewPriv);
 
 	view->priv = priv;
+	priv->avatars = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+		(GDestroyNotify) contact_list_view_avatar_entry_free);
+
 	/* Get saved group states. */
 	empathy_contact_groups_get_all ();
 
@@ -1261,6 +1538,9 @@ empathy_contact_list_view_init (EmpathyContactListView *view)
 	g_signal_connect (view, "query-tooltip",
 			  G_CALLBACK (contact_list_view_query_tooltip_cb),
 			  NULL);
+	g_signal_connect (view, "expose-event",
+			  G_CALLBACK (contact_list_view_expose_event_cb),
+			  NULL);
 }
 
 EmpathyContactListView *
@@ -26,6 +26,7 @@
 #include <gtk/gtk.h>
 
 #include <libempathy/empathy-contact.h>
+#include <libempathy/empathy-contact-search.h>
 #include <libempathy-gtk/empathy-contact-list-store.h>
 #include <libempathy/empathy-utils.h>
 
@@ -38,7 +39,8 @@
  * @include: libempathy-gtk/empathy-contact-selector.h
  *
  * #EmpathyContactSelector is a widget which extends #GtkComboBox to provide
- * a chooser of available contacts.
+ * a chooser of available contacts. Typing while the selector has the focus
+ * selects the best match for the typed text.
  */
 
 /**
@@ -57,12 +59,18 @@ enum
   PROP_CONTACT_LIST
 };
 
+/* Time in milliseconds after which the type-ahead text is reset */
+#define TYPEAHEAD_TIMEOUT 1000
+
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyContactSelector)
 typedef struct
 {
   EmpathyContactList *contact_list;
   EmpathyContactListStore *store;
   GtkTreeModel *model;
+  EmpathyContactSearch *search;
+  GString *typeahead;
+  guint typeahead_id;
   gboolean dispose_run;
 } EmpathyContactSelectorPriv;
 
@@ -191,6 +199,92 @@ contact_selector_manage_blank_contact (EmpathyContactSelector *selector)
   contact_selector_manage_sensitivity (selector);
 }
 
+static gboolean
+contact_selector_typeahead_timeout_cb (EmpathyContactSelector *selector)
+{
+  EmpathyContactSelectorPriv *priv = GET_PRIV (selector);
+
+  priv->typeahead_id = 0;
+  g_string_truncate (priv->typeahead, 0);
+
+  return FALSE;
+}
+
+static void
+contact_selector_select_best_match (EmpathyContactSelector *selector)
+{
+  EmpathyContactSelectorPriv *priv = GET_PRIV (selector);
+  GHashTable *ranks;
+  GList *matches, *l;
+  GtkTreeIter iter, best_iter;
+  guint rank, best_rank = 0;
+  gboolean ok;
+
+  matches = empathy_contact_search_query (priv->search,
+      priv->typeahead->str, 0);
+  if (matches == NULL)
+    return;
+
+  ranks = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (l = matches, rank = 1; l != NULL; l = l->next, rank++)
+    g_hash_table_insert (ranks, l->data, GUINT_TO_POINTER (rank));
+
+  /* The best ranked contact is not necessarily shown by the selector */
+  for (ok = gtk_tree_model_get_iter_first (priv->model, &iter);
+      ok; ok = gtk_tree_model_iter_next (priv->model, &iter))
+    {
+      EmpathyContact *contact;
+
+      gtk_tree_model_get (priv->model, &iter,
+          EMPATHY_CONTACT_LIST_STORE_COL_CONTACT, &contact, -1);
+      if (contact == NULL)
+        continue;
+
+      rank = GPOINTER_TO_UINT (g_hash_table_lookup (ranks, contact));
+      if (rank != 0 && (best_rank == 0 || rank < best_rank))
+        {
+          best_rank = rank;
+          best_iter = iter;
+        }
+
+      g_object_unref (contact);
+    }
+
+  if (best_rank != 0)
+    gtk_combo_box_set_active_iter (GTK_COMBO_BOX (selector), &best_iter);
+
+  g_hash_table_destroy (ranks);
+  g_list_foreach (matches, (GFunc) g_object_unref, NULL);
+  g_list_free (matches);
+}
+
+static gboolean
+contact_selector_key_press_event_cb (GtkWidget *widget,
+                                     GdkEventKey *event,
+                                     EmpathyContactSelector *selector)
+{
+  EmpathyContactSelectorPriv *priv = GET_PRIV (selector);
+  gunichar c;
+
+  if (event->state & (GDK_CONTROL_MASK | GDK_MOD1_MASK))
+    return FALSE;
+
+  c = gdk_keyval_to_unicode (event->keyval);
+  if (c == 0 || !g_unichar_isprint (c))
+    return FALSE;
+
+  g_string_append_unichar (priv->typeahead, c);
+
+  if (priv->typeahead_id != 0)
+    g_source_remove (priv->typeahead_id);
+  priv->typeahead_id = g_timeout_add (TYPEAHEAD_TIMEOUT,
+      (GSourceFunc) contact_selector_typeahead_timeout_cb, selector);
+
+  contact_selector_select_best_match (selector);
+
+  return TRUE;
+}
+
 static GObject *
 contact_selector_constructor (GType type,
                               guint n_construct_params,
@@ -224,6 +318,12 @@ contact_selector_constructor (GType type,
       G_CALLBACK (contact_selector_manage_blank_contact),
       contact_selector);
 
+  priv->search = empathy_contact_search_dup_singleton ();
+  priv->typeahead = g_string_new (NULL);
+  g_signal_connect (contact_selector, "key-press-event",
+      G_CALLBACK (contact_selector_key_press_event_cb),
+      contact_selector);
+
   priv->model = gtk_tree_model_filter_new (GTK_TREE_MODEL (priv->store), NULL);
 
   gtk_combo_box_set_model (GTK_COMBO_BOX (contact_selector), priv->model);
@@ -324,6 +424,24 @@ contact_selector_dispose (GObject *object)
       priv->store = NULL;
     }
 
+  if (priv->typeahead_id != 0)
+    {
+      g_source_remove (priv->typeahead_id);
+      priv->typeahead_id = 0;
+    }
+
+  if (priv->typeahead)
+    {
+      g_string_free (priv->typeahead, TRUE);
+      priv->typeahead = NULL;
+    }
+
+  if (priv->search)
+    {
+      g_object_unref (priv->search);
+      priv->search = NULL;
+    }
+
   (G_OBJECT_CLASS (empathy_contact_selector_parent_class)->dispose) (object);
 }
 
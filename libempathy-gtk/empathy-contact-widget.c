@@ -1420,6 +1420,7 @@ contact_widget_location_update (EmpathyContactWidget *information)
       ClutterActor *marker;
       ChamplainLayer *layer;
 
+      empathy_gtk_clutter_init ();
       information->map_view_embed = gtk_champlain_embed_new ();
       information->map_view = gtk_champlain_embed_get_view (
           GTK_CHAMPLAIN_EMBED (information->map_view_embed));
@@ -187,22 +187,14 @@ publish_location (EmpathyLocationManager *location_manager,
 {
   EmpathyLocationManagerPriv *priv = GET_PRIV (location_manager);
   guint connection_status = -1;
-  gboolean can_publish;
-  EmpathyConf *conf = empathy_conf_get ();
   EmpathyTpContactFactory *factory;
 
   if (!conn)
     return;
 
-  if (force_publication == FALSE)
-    {
-      if (!empathy_conf_get_bool (conf, EMPATHY_PREFS_LOCATION_PUBLISH,
-            &can_publish))
-        return;
-
-      if (can_publish == FALSE)
-        return;
-    }
+  if (force_publication == FALSE &&
+      !empathy_conf_get_settings ()->location_publish)
+    return;
 
   connection_status = tp_connection_get_status (conn, NULL);
 
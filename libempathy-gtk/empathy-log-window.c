@@ -306,9 +306,7 @@ log_window_find_changed_cb (GtkTreeSelection *selection,
 	gchar         *chat_id;
 	gboolean       is_chatroom;
 	gchar         *date;
-	EmpathyMessage *message;
-	GList         *messages;
-	GList         *l;
+	EmpathyMessageBlock *block;
 	gboolean       can_do_previous;
 	gboolean       can_do_next;
 
@@ -342,21 +340,17 @@ log_window_find_changed_cb (GtkTreeSelection *selection,
 	empathy_chat_view_scroll (window->chatview_find, FALSE);
 
 	/* Get messages */
-	messages = empathy_log_manager_get_messages_for_date (window->log_manager,
-							      account,
-							      chat_id,
-							      is_chatroom,
-							      date);
+	block = empathy_log_manager_get_message_block_for_date (window->log_manager,
+								account,
+								chat_id,
+								is_chatroom,
+								date);
 	g_object_unref (account);
 	g_free (date);
 	g_free (chat_id);
 
-	for (l = messages; l; l = l->next) {
-		message = l->data;
-		empathy_chat_view_append_message (window->chatview_find, message);
-		g_object_unref (message);
-	}
-	g_list_free (messages);
+	empathy_chat_view_append_message_block (window->chatview_find, block);
+	empathy_message_block_unref (block);
 
 	/* Scroll to the most recent messages */
 	empathy_chat_view_scroll (window->chatview_find, TRUE);
@@ -843,8 +837,7 @@ log_window_chats_get_messages (EmpathyLogWindow *window,
 	EmpathyAccount     *account;
 	gchar         *chat_id;
 	gboolean       is_chatroom;
-	EmpathyMessage *message;
-	GList         *messages;
+	EmpathyMessageBlock *block;
 	GList         *dates = NULL;
 	GList         *l;
 	const gchar   *date;
@@ -945,19 +938,13 @@ log_window_chats_get_messages (EmpathyLogWindow *window,
 	empathy_chat_view_scroll (window->chatview_find, FALSE);
 
 	/* Get messages */
-	messages = empathy_log_manager_get_messages_for_date (window->log_manager,
-							      account, chat_id,
-							      is_chatroom,
-							      date);
+	block = empathy_log_manager_get_message_block_for_date (window->log_manager,
+								account, chat_id,
+								is_chatroom,
+								date);
 
-	for (l = messages; l; l = l->next) {
-		message = l->data;
-
-		empathy_chat_view_append_message (window->chatview_chats,
-						 message);
-		g_object_unref (message);
-	}
-	g_list_free (messages);
+	empathy_chat_view_append_message_block (window->chatview_chats, block);
+	empathy_message_block_unref (block);
 
 	/* Turn back on scrolling */
 	empathy_chat_view_scroll (window->chatview_find, TRUE);
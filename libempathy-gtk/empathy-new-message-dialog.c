@@ -32,6 +32,7 @@
 #include <libempathy/empathy-call-factory.h>
 #include <libempathy/empathy-tp-contact-factory.h>
 #include <libempathy/empathy-contact-manager.h>
+#include <libempathy/empathy-contact-search.h>
 #include <libempathy/empathy-dispatcher.h>
 #include <libempathy/empathy-utils.h>
 #include <libempathy/empathy-account.h>
@@ -62,12 +63,15 @@ typedef struct {
 	GtkWidget *button_chat;
 	GtkWidget *button_call;
 	EmpathyContactManager *contact_manager;
+	EmpathyContactSearch  *contact_search;
 } EmpathyNewMessageDialog;
 
 enum {
 	COMPLETION_COL_TEXT,
 	COMPLETION_COL_ID,
 	COMPLETION_COL_NAME,
+	COMPLETION_COL_CONTACT,
+	COMPLETION_COL_COUNT
 } CompletionCol;
 
 static void
@@ -115,6 +119,7 @@ new_message_dialog_account_changed_cb (GtkWidget               *widget,
 				COMPLETION_COL_TEXT, tmpstr,
 				COMPLETION_COL_ID, empathy_contact_get_id (contact),
 				COMPLETION_COL_NAME, empathy_contact_get_name (contact),
+				COMPLETION_COL_CONTACT, contact,
 				-1);
 
 			g_free (tmpstr);
@@ -153,32 +158,28 @@ new_message_dialog_match_func (GtkEntryCompletion *completion,
 			       GtkTreeIter        *iter,
 			       gpointer            user_data)
 {
-	GtkTreeModel *model;
-	gchar        *id;
-	gchar        *name;
+	EmpathyNewMessageDialog *dialog = user_data;
+	GtkTreeModel            *model;
+	EmpathyContact          *contact;
+	gboolean                 ret;
 
 	model = gtk_entry_completion_get_model (completion);
 	if (!model || !iter) {
 		return FALSE;
 	}
 
-	gtk_tree_model_get (model, iter, COMPLETION_COL_NAME, &name, -1);
-	if (strstr (name, key)) {
-		DEBUG ("Key %s is matching name **%s**", key, name);
-		g_free (name);
-		return TRUE;
+	/* The search index answers every row for the same key from a
+	 * single lookup. */
+	gtk_tree_model_get (model, iter, COMPLETION_COL_CONTACT, &contact, -1);
+	if (!contact) {
+		return FALSE;
 	}
-	g_free (name);
 
-	gtk_tree_model_get (model, iter, COMPLETION_COL_ID, &id, -1);
-	if (strstr (id, key)) {
-		DEBUG ("Key %s is matching ID **%s**", key, id);
-		g_free (id);
-		return TRUE;
-	}
-	g_free (id);
+	ret = empathy_contact_search_matches (dialog->contact_search,
+					      contact, key);
+	g_object_unref (contact);
 
-	return FALSE;
+	return ret;
 }
 
 static void
@@ -249,6 +250,7 @@ new_message_dialog_destroy_cb (GtkWidget               *widget,
 			       EmpathyNewMessageDialog *dialog)
 {
 	g_object_unref (dialog->contact_manager);
+	g_object_unref (dialog->contact_search);
 	g_free (dialog);
 }
 
@@ -278,6 +280,7 @@ empathy_new_message_dialog_show (GtkWindow *parent)
 
 	/* create a contact manager */
 	dialog->contact_manager = empathy_contact_manager_dup_singleton ();
+	dialog->contact_search = empathy_contact_search_dup_singleton ();
 
 	filename = empathy_file_lookup ("empathy-new-message-dialog.ui",
 					"libempathy-gtk");
@@ -292,11 +295,15 @@ empathy_new_message_dialog_show (GtkWindow *parent)
 
 	/* text completion */
 	completion = gtk_entry_completion_new ();
-	model = gtk_list_store_new (3, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+	model = gtk_list_store_new (COMPLETION_COL_COUNT,
+				    G_TYPE_STRING,
+				    G_TYPE_STRING,
+				    G_TYPE_STRING,
+				    EMPATHY_TYPE_CONTACT);
 	gtk_entry_completion_set_text_column (completion, COMPLETION_COL_TEXT);
 	gtk_entry_completion_set_match_func (completion,
 					     new_message_dialog_match_func,
-					     NULL, NULL);
+					     dialog, NULL);
 	gtk_entry_completion_set_model (completion, GTK_TREE_MODEL (model));
 	gtk_entry_set_completion (GTK_ENTRY (dialog->entry_id), completion);
 	g_signal_connect (completion, "match-selected",
@@ -35,7 +35,7 @@ typedef struct {
   EmpathySound sound_id;
   const char * event_ca_id;
   const char * event_ca_description;
-  const char * gconf_key;
+  glong setting_offset;
 } EmpathySoundEntry;
 
 typedef struct {
@@ -45,28 +45,31 @@ typedef struct {
   guint replay_timeout_id;
 } EmpathyRepeatableSound;
 
+/* Offset of the gboolean in EmpathyConfSettings enabling the sound, or -1 */
+#define SOUND_SETTING(field) G_STRUCT_OFFSET (EmpathyConfSettings, field)
+
 /* NOTE: these entries MUST be in the same order than EmpathySound enum */
 static EmpathySoundEntry sound_entries[LAST_EMPATHY_SOUND] = {
   { EMPATHY_SOUND_MESSAGE_INCOMING, "message-new-instant",
-    N_("Received an instant message"), EMPATHY_PREFS_SOUNDS_INCOMING_MESSAGE } ,
+    N_("Received an instant message"), SOUND_SETTING (sounds_incoming_message) } ,
   { EMPATHY_SOUND_MESSAGE_OUTGOING, "message-sent-instant",
-    N_("Sent an instant message"), EMPATHY_PREFS_SOUNDS_OUTGOING_MESSAGE } ,
+    N_("Sent an instant message"), SOUND_SETTING (sounds_outgoing_message) } ,
   { EMPATHY_SOUND_CONVERSATION_NEW, "message-new-instant",
-    N_("Incoming chat request"), EMPATHY_PREFS_SOUNDS_NEW_CONVERSATION },
+    N_("Incoming chat request"), SOUND_SETTING (sounds_new_conversation) },
   { EMPATHY_SOUND_CONTACT_CONNECTED, "service-login",
-    N_("Contact connected"), EMPATHY_PREFS_SOUNDS_CONTACT_LOGIN },
+    N_("Contact connected"), SOUND_SETTING (sounds_contact_login) },
   { EMPATHY_SOUND_CONTACT_DISCONNECTED, "service-logout",
-    N_("Contact disconnected"), EMPATHY_PREFS_SOUNDS_CONTACT_LOGOUT },
+    N_("Contact disconnected"), SOUND_SETTING (sounds_contact_logout) },
   { EMPATHY_SOUND_ACCOUNT_CONNECTED, "service-login",
-    N_("Connected to server"), EMPATHY_PREFS_SOUNDS_SERVICE_LOGIN },
+    N_("Connected to server"), SOUND_SETTING (sounds_service_login) },
   { EMPATHY_SOUND_ACCOUNT_DISCONNECTED, "service-logout",
-    N_("Disconnected from server"), EMPATHY_PREFS_SOUNDS_SERVICE_LOGOUT },
+    N_("Disconnected from server"), SOUND_SETTING (sounds_service_logout) },
   { EMPATHY_SOUND_PHONE_INCOMING, "phone-incoming-call",
-    N_("Incoming voice call"), NULL },
+    N_("Incoming voice call"), -1 },
   { EMPATHY_SOUND_PHONE_OUTGOING, "phone-outgoing-calling",
-    N_("Outgoing voice call"), NULL },
+    N_("Outgoing voice call"), -1 },
   { EMPATHY_SOUND_PHONE_HANGUP, "phone-hangup",
-    N_("Voice call ended"), NULL },
+    N_("Voice call ended"), -1 },
 };
 
 /* An hash table containing currently repeating sounds. The format is the
@@ -79,34 +82,23 @@ static gboolean
 empathy_sound_pref_is_enabled (EmpathySound sound_id)
 {
   EmpathySoundEntry *entry;
-  EmpathyConf *conf;
-  gboolean res;
+  const EmpathyConfSettings *settings;
 
   entry = &(sound_entries[sound_id]);
   g_return_val_if_fail (entry->sound_id == sound_id, FALSE);
 
-  if (entry->gconf_key == NULL)
+  if (entry->setting_offset < 0)
     return TRUE;
 
-  conf = empathy_conf_get ();
-  res = FALSE;
-
-  empathy_conf_get_bool (conf, EMPATHY_PREFS_SOUNDS_ENABLED, &res);
+  settings = empathy_conf_get_settings ();
 
-  if (!res)
+  if (!settings->sounds_enabled)
     return FALSE;
 
-  if (!empathy_check_available_state ())
-    {
-      empathy_conf_get_bool (conf, EMPATHY_PREFS_SOUNDS_DISABLED_AWAY, &res);
-
-      if (res)
-        return FALSE;
-    }
-
-  empathy_conf_get_bool (conf, entry->gconf_key, &res);
+  if (!empathy_check_available_state () && settings->sounds_disabled_away)
+    return FALSE;
 
-  return res;
+  return G_STRUCT_MEMBER (gboolean, settings, entry->setting_offset);
 }
 
 /**
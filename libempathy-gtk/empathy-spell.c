@@ -186,7 +186,7 @@ spell_notify_languages_cb (EmpathyConf  *conf,
 static void
 spell_setup_languages (void)
 {
-	gchar  *str;
+	const gchar *str;
 
 	if (!empathy_conf_notify_inited) {
 		empathy_conf_notify_add (empathy_conf_get (),
@@ -200,9 +200,8 @@ spell_setup_languages (void)
 		return;
 	}
 
-	if (empathy_conf_get_string (empathy_conf_get (),
-				     EMPATHY_PREFS_CHAT_SPELL_CHECKER_LANGUAGES,
-				     &str) && str) {
+	str = empathy_conf_get_settings ()->chat_spell_checker_languages;
+	if (str) {
 		gchar **strv;
 		gint    i;
 
@@ -226,8 +225,6 @@ spell_setup_languages (void)
 		if (strv) {
 			g_strfreev (strv);
 		}
-
-		g_free (str);
 	}
 }
 
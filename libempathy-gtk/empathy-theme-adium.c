@@ -30,6 +30,7 @@
 
 
 #include <libempathy/empathy-time.h>
+#include <libempathy/empathy-footprint.h>
 #include <libempathy/empathy-utils.h>
 #include <libmissioncontrol/mc-profile.h>
 
@@ -50,10 +51,14 @@
 typedef struct {
 	EmpathyAdiumData     *data;
 	EmpathySmileyManager *smiley_manager;
+	const EmpathyConfSettings *settings;
 	EmpathyContact       *last_contact;
 	time_t                last_timestamp;
 	gboolean              page_loaded;
 	GList                *message_queue;
+	/* bytes accounted for in the "adium-html" footprint */
+	gssize                footprint;
+	EmpathyTimeCache     *time_cache;
 } EmpathyThemeAdiumPriv;
 
 struct _EmpathyAdiumData {
@@ -153,12 +158,23 @@ theme_adium_populate_popup_cb (WebKitWebView *view,
 	 */
 }
 
-static gchar *
-theme_adium_parse_body (EmpathyThemeAdium *theme,
-			const gchar       *text)
+/*
+ * empathy_adium_parse_body:
+ * @smiley_manager: the smileys to replace by images, or %NULL to not
+ * replace them
+ * @text: the body of a message
+ *
+ * Turns a message body into the HTML put in %message%: smileys become
+ * images, links become anchors and new lines become <br/>. This and
+ * empathy_adium_build_script() don't need the view so the benchmarks in
+ * tests/ can run them.
+ *
+ * Returns: a newly allocated string, or %NULL if @text needs no change
+ */
+gchar *
+empathy_adium_parse_body (EmpathySmileyManager *smiley_manager,
+			  const gchar          *text)
 {
-	EmpathyThemeAdiumPriv *priv = GET_PRIV (theme);
-	gboolean               use_smileys = FALSE;
 	GSList                *smileys, *l;
 	GString               *string;
 	gint                   i;
@@ -168,14 +184,10 @@ theme_adium_parse_body (EmpathyThemeAdium *theme,
 	gchar                 *ret = NULL;
 	gint                   prev;
 
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_CHAT_SHOW_SMILEYS,
-			       &use_smileys);
-
-	if (use_smileys) {
+	if (smiley_manager) {
 		/* Replace smileys by a <img/> tag */
 		string = g_string_sized_new (strlen (text));
-		smileys = empathy_smiley_manager_parse (priv->smiley_manager, text);
+		smileys = empathy_smiley_manager_parse (smiley_manager, text);
 		for (l = smileys; l; l = l->next) {
 			EmpathySmiley *smiley;
 
@@ -298,21 +310,29 @@ theme_adium_match (const gchar **str, const gchar *match)
 	return FALSE;
 }
 
-static void
-theme_adium_append_html (EmpathyThemeAdium *theme,
-			 const gchar       *func,
-			 const gchar       *html, gsize len,
-		         const gchar       *message,
-		         const gchar       *avatar_filename,
-		         const gchar       *name,
-		         const gchar       *contact_id,
-		         const gchar       *service_name,
-		         const gchar       *message_classes,
-		         time_t             timestamp)
+/*
+ * empathy_adium_build_script:
+ *
+ * Substitutes the keywords of the @html template of a theme and wraps the
+ * result in a call to the @func JavaScript function of the page. Times are
+ * formatted through @time_cache when it isn't %NULL.
+ *
+ * Returns: the script to run in the view
+ */
+gchar *
+empathy_adium_build_script (const gchar *func,
+			    const gchar *html, gsize len,
+			    const gchar *message,
+			    const gchar *avatar_filename,
+			    const gchar *name,
+			    const gchar *contact_id,
+			    const gchar *service_name,
+			    const gchar *message_classes,
+			    time_t       timestamp,
+			    EmpathyTimeCache *time_cache)
 {
 	GString     *string;
 	const gchar *cur = NULL;
-	gchar       *script;
 
 	/* Make some search-and-replace in the html code */
 	string = g_string_sized_new (len + strlen (message));
@@ -342,9 +362,15 @@ theme_adium_append_html (EmpathyThemeAdium *theme,
 		} else if (theme_adium_match (&cur, "%service%")) {
 			replace = service_name;
 		} else if (theme_adium_match (&cur, "%shortTime%")) {
-			dup_replace = empathy_time_to_string_local (timestamp,
-				EMPATHY_TIME_FORMAT_DISPLAY_SHORT);
-			replace = dup_replace;
+			if (time_cache) {
+				replace = empathy_time_cache_to_string_local (
+					time_cache, timestamp,
+					EMPATHY_TIME_FORMAT_DISPLAY_SHORT);
+			} else {
+				dup_replace = empathy_time_to_string_local (timestamp,
+					EMPATHY_TIME_FORMAT_DISPLAY_SHORT);
+				replace = dup_replace;
+			}
 		} else if (theme_adium_match (&cur, "%time")) {
 			gchar *format = NULL;
 			gchar *end;
@@ -365,9 +391,15 @@ theme_adium_append_html (EmpathyThemeAdium *theme,
 				cur++;
 			}
 
-			dup_replace = empathy_time_to_string_local (timestamp,
-				format ? format : EMPATHY_TIME_FORMAT_DISPLAY_SHORT);
-			replace = dup_replace;
+			if (time_cache) {
+				replace = empathy_time_cache_to_string_local (
+					time_cache, timestamp,
+					format ? format : EMPATHY_TIME_FORMAT_DISPLAY_SHORT);
+			} else {
+				dup_replace = empathy_time_to_string_local (timestamp,
+					format ? format : EMPATHY_TIME_FORMAT_DISPLAY_SHORT);
+				replace = dup_replace;
+			}
 			g_free (format);
 		} else {
 			escape_and_append_len (string, cur, 1);
@@ -380,8 +412,39 @@ theme_adium_append_html (EmpathyThemeAdium *theme,
 	}
 	g_string_append (string, "\")");
 
-	script = g_string_free (string, FALSE);
+	return g_string_free (string, FALSE);
+}
+
+static void
+theme_adium_append_html (EmpathyThemeAdium *theme,
+			 const gchar       *func,
+			 const gchar       *html, gsize len,
+		         const gchar       *message,
+		         const gchar       *avatar_filename,
+		         const gchar       *name,
+		         const gchar       *contact_id,
+		         const gchar       *service_name,
+		         const gchar       *message_classes,
+		         time_t             timestamp)
+{
+	EmpathyThemeAdiumPriv *priv = GET_PRIV (theme);
+	gchar *script;
+
+	script = empathy_adium_build_script (func, html, len, message,
+					     avatar_filename, name, contact_id,
+					     service_name, message_classes,
+					     timestamp, priv->time_cache);
 	webkit_web_view_execute_script (WEBKIT_WEB_VIEW (theme), script);
+
+	/* The DOM is never trimmed, the script is a fair estimate of what
+	 * it grows by */
+	if (G_UNLIKELY (empathy_footprint_enabled)) {
+		gssize size = strlen (script);
+
+		EMPATHY_FOOTPRINT_ADD ("adium-html", 0, size);
+		priv->footprint += size;
+	}
+
 	g_free (script);
 }
 
@@ -420,7 +483,9 @@ theme_adium_append_message (EmpathyChatView *view,
 	service_name = mc_profile_get_display_name (account_profile);
 	timestamp = empathy_message_get_timestamp (msg);
 	body = empathy_message_get_body (msg);
-	dup_body = theme_adium_parse_body (theme, body);
+	dup_body = empathy_adium_parse_body (priv->settings->chat_show_smileys ?
+					     priv->smiley_manager : NULL,
+					     body);
 	if (dup_body) {
 		body = dup_body;
 	}
@@ -565,6 +630,9 @@ theme_adium_clear (EmpathyChatView *view)
 					  basedir_uri);
 	g_free (basedir_uri);
 
+	EMPATHY_FOOTPRINT_ADD ("adium-html", 0, -priv->footprint);
+	priv->footprint = 0;
+
 	/* Clear last contact to avoid trying to add a 'joined'
 	 * message when we don't have an insertion point. */
 	if (priv->last_contact) {
@@ -668,6 +736,9 @@ theme_adium_finalize (GObject *object)
 	EmpathyThemeAdiumPriv *priv = GET_PRIV (object);
 
 	empathy_adium_data_unref (priv->data);
+	empathy_time_cache_free (priv->time_cache);
+
+	EMPATHY_FOOTPRINT_ADD ("adium-html", -1, -priv->footprint);
 
 	G_OBJECT_CLASS (empathy_theme_adium_parent_class)->finalize (object);
 }
@@ -790,8 +861,12 @@ empathy_theme_adium_init (EmpathyThemeAdium *theme)
 		EMPATHY_TYPE_THEME_ADIUM, EmpathyThemeAdiumPriv);
 
 	theme->priv = priv;
+	EMPATHY_FOOTPRINT_TRACK (theme);
+	EMPATHY_FOOTPRINT_ADD ("adium-html", 1, 0);
 
 	priv->smiley_manager = empathy_smiley_manager_dup_singleton ();
+	priv->settings = empathy_conf_get_settings ();
+	priv->time_cache = empathy_time_cache_new ();
 
 	g_signal_connect (theme, "load-finished",
 			  G_CALLBACK (theme_adium_load_finished_cb),
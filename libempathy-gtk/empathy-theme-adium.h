@@ -25,6 +25,7 @@
 #include <webkit/webkitwebview.h>
 
 #include "empathy-chat-view.h"
+#include "empathy-smiley-manager.h"
 
 G_BEGIN_DECLS
 
@@ -53,6 +54,18 @@ EmpathyThemeAdium *empathy_theme_adium_new      (EmpathyAdiumData *data);
 
 gboolean           empathy_adium_path_is_valid (const gchar *path);
 GHashTable        *empathy_adium_info_new (const gchar *path);
+gchar             *empathy_adium_parse_body (EmpathySmileyManager *smiley_manager,
+					     const gchar          *text);
+gchar             *empathy_adium_build_script (const gchar *func,
+					       const gchar *html, gsize len,
+					       const gchar *message,
+					       const gchar *avatar_filename,
+					       const gchar *name,
+					       const gchar *contact_id,
+					       const gchar *service_name,
+					       const gchar *message_classes,
+					       time_t       timestamp,
+					       EmpathyTimeCache *time_cache);
 
 #define EMPATHY_TYPE_ADIUM_DATA (empathy_adium_data_get_type ())
 GType              empathy_adium_data_get_type (void) G_GNUC_CONST;
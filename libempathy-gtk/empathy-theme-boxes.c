@@ -194,7 +194,6 @@ theme_boxes_maybe_append_header (EmpathyThemeBoxes *theme,
 	GtkWidget            *box;
 	gchar                *str;
 	time_t                time;
-	gchar                *tmp;
 	GtkTextIter           start;
 	gboolean              color_set;
 	GtkTextTagTable      *table;
@@ -259,15 +258,14 @@ theme_boxes_maybe_append_header (EmpathyThemeBoxes *theme,
 
 	/* Add the message receive time */
 	time = empathy_message_get_timestamp (msg);
-	tmp = empathy_time_to_string_local (time,
-					   EMPATHY_TIME_FORMAT_DISPLAY_SHORT);
-	str = g_strdup_printf ("<i>%s</i>", tmp);
+	str = g_strdup_printf ("<i>%s</i>",
+		empathy_chat_text_view_time_to_string (view, time,
+			EMPATHY_TIME_FORMAT_DISPLAY_SHORT));
 	label2 = g_object_new (GTK_TYPE_LABEL,
 			       "label", str,
 			       "use-markup", TRUE,
 			       "xalign", 1.0,
 			       NULL);
-	g_free (tmp);
 	g_free (str);
 
 	/* Set foreground color of labels to the same color than the header tag. */
@@ -395,9 +393,7 @@ empathy_theme_boxes_init (EmpathyThemeBoxes *theme)
 					 theme_boxes_notify_show_avatars_cb,
 					 theme);
 
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_UI_SHOW_AVATARS,
-			       &priv->show_avatars);
+	priv->show_avatars = empathy_conf_get_settings ()->ui_show_avatars;
 
 	/* Define margin */
 	g_object_set (theme,
@@ -40,6 +40,10 @@
 
 #include <libmissioncontrol/mc-profile.h>
 
+#if HAVE_LIBCHAMPLAIN
+#include <clutter-gtk/gtk-clutter-embed.h>
+#endif
+
 #include "empathy-ui-utils.h"
 #include "empathy-images.h"
 #include "empathy-conf.h"
@@ -74,6 +78,24 @@ empathy_gtk_init (void)
 	initialized = TRUE;
 }
 
+/* Clutter is only needed for maps, so it is initialized the first time one
+ * is shown rather than when Empathy starts. Must be called before creating
+ * a GtkChamplainEmbed. */
+void
+empathy_gtk_clutter_init (void)
+{
+#if HAVE_LIBCHAMPLAIN
+	static gboolean initialized = FALSE;
+
+	if (initialized)
+		return;
+
+	gtk_clutter_init (NULL, NULL);
+
+	initialized = TRUE;
+#endif
+}
+
 GRegex *
 empathy_uri_regex_dup_singleton (void)
 {
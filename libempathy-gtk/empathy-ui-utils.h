@@ -45,6 +45,7 @@
 G_BEGIN_DECLS
 
 void            empathy_gtk_init                        (void);
+void            empathy_gtk_clutter_init                (void);
 GRegex *        empathy_uri_regex_dup_singleton         (void);
 
 /* Glade */
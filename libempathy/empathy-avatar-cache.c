@@ -0,0 +1,683 @@
+/*
+ * empathy-avatar-cache.c - Source for EmpathyAvatarCache
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "empathy-avatar-cache.h"
+#include "empathy-utils.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_CONTACT
+#include "empathy-debug.h"
+
+/**
+ * SECTION:empathy-avatar-cache
+ * @title:EmpathyAvatarCache
+ * @short_description: content-addressed avatar store
+ * @include: libempathy/empathy-avatar-cache.h
+ *
+ * #EmpathyAvatarCache stores avatars on disk keyed by their token only, so
+ * an avatar seen on several accounts or in several chat rooms is stored
+ * and loaded once. Files live in avatars/&lt;xx&gt;/&lt;sha1 of the
+ * token&gt; under the user cache dir.
+ *
+ * Reads go through GIO asynchronously, writes and the trimming of the disk
+ * cache run in the GIO worker threads, so nothing blocks the main loop.
+ * Recently used avatars are kept in memory.
+ */
+
+/* Bytes of avatar data kept in memory */
+#define MEMORY_CACHE_SIZE (4 * 1024 * 1024)
+
+/* Bytes of avatar data kept on disk; the cache is trimmed down to three
+ * quarters of it once per session */
+#define DISK_CACHE_SIZE (32 * 1024 * 1024)
+
+/* Seconds after startup before the disk cache is trimmed */
+#define TRIM_DELAY 60
+
+G_DEFINE_TYPE (EmpathyAvatarCache, empathy_avatar_cache, G_TYPE_OBJECT);
+
+#define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyAvatarCache)
+
+typedef struct {
+  gchar *root;
+
+  /* Most recently used first, owned EmpathyAvatar */
+  GQueue *lru;
+  /* token -> link in lru */
+  GHashTable *memory;
+  gsize memory_size;
+
+  /* owned token -> GSList of owned PendingLoad */
+  GHashTable *pending;
+  /* owned token, of avatars known not to be on disk */
+  GHashTable *missing;
+
+  guint trim_id;
+} EmpathyAvatarCachePriv;
+
+typedef struct {
+  EmpathyAvatarCacheLoadCb callback;
+  gpointer user_data;
+} PendingLoad;
+
+typedef struct {
+  EmpathyAvatarCache *cache;
+  gchar *token;
+  gchar *filename;
+} LoadData;
+
+/* The jobs run in GIO worker threads and report back to the main loop,
+ * where DEBUG() can be used */
+typedef struct {
+  gchar *filename;
+  guchar *data;
+  gsize len;
+  gboolean written;
+  GError *error;
+} WriteJob;
+
+typedef struct {
+  gchar *root;
+  goffset size;
+  goffset trimmed_size;
+} TrimJob;
+
+typedef struct {
+  gchar *path;
+  goffset size;
+  time_t time;
+} CachedFile;
+
+static EmpathyAvatarCache *cache_singleton = NULL;
+
+static gchar *
+avatar_cache_dup_filename (EmpathyAvatarCache *cache,
+    const gchar *token)
+{
+  EmpathyAvatarCachePriv *priv = GET_PRIV (cache);
+  gchar *checksum;
+  gchar dir[3];
+  gchar *filename;
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, token, -1);
+  g_strlcpy (dir, checksum, sizeof (dir));
+
+  filename = g_build_filename (priv->root, dir, checksum, NULL);
+  g_free (checksum);
+
+  return filename;
+}
+
+static void
+avatar_cache_touch (EmpathyAvatarCache *cache,
+    GList *link)
+{
+  EmpathyAvatarCachePriv *priv = GET_PRIV (cache);
+
+  if (link == priv->lru->head)
+    return;
+
+  g_queue_unlink (priv->lru, link);
+  g_queue_push_head_link (priv->lru, link);
+}
+
+static void
+avatar_cache_remember (EmpathyAvatarCache *cache,
+    EmpathyAvatar *avatar)
+{
+  EmpathyAvatarCachePriv *priv = GET_PRIV (cache);
+  GList *link;
+
+  link = g_hash_table_lookup (priv->memory, avatar->token);
+  if (link != NULL)
+    {
+      avatar_cache_touch (cache, link);
+      return;
+    }
+
+  g_queue_push_head (priv->lru, empathy_avatar_ref (avatar));
+  g_hash_table_insert (priv->memory, avatar->token, priv->lru->head);
+  priv->memory_size += avatar->len;
+
+  /* Always keep the newest one, even if it is bigger than the cache */
+  while (priv->memory_size > MEMORY_CACHE_SIZE && priv->lru->length > 1)
+    {
+      EmpathyAvatar *old = g_queue_pop_tail (priv->lru);
+
+      g_hash_table_remove (priv->memory, old->token);
+      priv->memory_size -= old->len;
+      empathy_avatar_unref (old);
+    }
+}
+
+static void
+write_job_free (WriteJob *job)
+{
+  g_free (job->filename);
+  g_free (job->data);
+  if (job->error != NULL)
+    g_error_free (job->error);
+  g_slice_free (WriteJob, job);
+}
+
+static gboolean
+avatar_cache_write_done_cb (gpointer user_data)
+{
+  WriteJob *data = user_data;
+
+  if (data->error != NULL)
+    DEBUG ("Failed to save avatar in cache: %s", data->error->message);
+  else if (data->written)
+    DEBUG ("Avatar saved to %s", data->filename);
+
+  return FALSE;
+}
+
+static gboolean
+avatar_cache_write_job (GIOSchedulerJob *job,
+    GCancellable *cancellable,
+    gpointer user_data)
+{
+  WriteJob *data = user_data;
+  gchar *dirname;
+
+  /* Another account or chat room already saved it */
+  if (!g_file_test (data->filename, G_FILE_TEST_EXISTS))
+    {
+      dirname = g_path_get_dirname (data->filename);
+      g_mkdir_with_parents (dirname, 0700);
+      g_free (dirname);
+
+      data->written = g_file_set_contents (data->filename,
+          (gchar *) data->data, data->len, &data->error);
+    }
+
+  g_io_scheduler_job_send_to_mainloop_async (job, avatar_cache_write_done_cb,
+      data, (GDestroyNotify) write_job_free);
+
+  return FALSE;
+}
+
+static gint
+cached_file_compare (gconstpointer a,
+    gconstpointer b)
+{
+  const CachedFile *file_a = *(const CachedFile **) a;
+  const CachedFile *file_b = *(const CachedFile **) b;
+
+  if (file_a->time < file_b->time)
+    return -1;
+
+  return file_a->time > file_b->time;
+}
+
+static void
+cached_file_free (CachedFile *file)
+{
+  g_free (file->path);
+  g_slice_free (CachedFile, file);
+}
+
+static void
+trim_job_free (TrimJob *job)
+{
+  g_free (job->root);
+  g_slice_free (TrimJob, job);
+}
+
+static gboolean
+avatar_cache_trim_done_cb (gpointer user_data)
+{
+  TrimJob *data = user_data;
+
+  if (data->trimmed_size != data->size)
+    DEBUG ("Avatar cache trimmed from %" G_GOFFSET_FORMAT " to %"
+        G_GOFFSET_FORMAT " bytes", data->size, data->trimmed_size);
+
+  return FALSE;
+}
+
+static void
+avatar_cache_trim (TrimJob *data)
+{
+  const gchar *root = data->root;
+  GPtrArray *files;
+  GDir *dir;
+  const gchar *name;
+  goffset total = 0;
+  guint i;
+
+  dir = g_dir_open (root, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  files = g_ptr_array_new ();
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      GDir *subdir;
+      gchar *subpath;
+      const gchar *file_name;
+
+      /* Only look into the fan-out directories */
+      if (strlen (name) != 2 || !g_ascii_isxdigit (name[0]) ||
+          !g_ascii_isxdigit (name[1]))
+        continue;
+
+      subpath = g_build_filename (root, name, NULL);
+      subdir = g_dir_open (subpath, 0, NULL);
+
+      while (subdir != NULL &&
+          (file_name = g_dir_read_name (subdir)) != NULL)
+        {
+          CachedFile *file;
+          struct stat st;
+          gchar *path;
+
+          path = g_build_filename (subpath, file_name, NULL);
+          if (g_stat (path, &st) != 0 || !S_ISREG (st.st_mode))
+            {
+              g_free (path);
+              continue;
+            }
+
+          file = g_slice_new (CachedFile);
+          file->path = path;
+          file->size = st.st_size;
+          /* atime is only updated on some mounts, fall back to mtime */
+          file->time = MAX (st.st_atime, st.st_mtime);
+
+          g_ptr_array_add (files, file);
+          total += file->size;
+        }
+
+      if (subdir != NULL)
+        g_dir_close (subdir);
+      g_free (subpath);
+    }
+
+  g_dir_close (dir);
+
+  data->size = total;
+
+  if (total > DISK_CACHE_SIZE)
+    {
+      goffset target = DISK_CACHE_SIZE / 4 * 3;
+
+      g_ptr_array_sort (files, cached_file_compare);
+      for (i = 0; i < files->len && total > target; i++)
+        {
+          CachedFile *file = g_ptr_array_index (files, i);
+
+          if (g_unlink (file->path) == 0)
+            total -= file->size;
+        }
+    }
+
+  data->trimmed_size = total;
+
+  g_ptr_array_foreach (files, (GFunc) cached_file_free, NULL);
+  g_ptr_array_free (files, TRUE);
+}
+
+static gboolean
+avatar_cache_trim_job (GIOSchedulerJob *job,
+    GCancellable *cancellable,
+    gpointer user_data)
+{
+  TrimJob *data = user_data;
+
+  avatar_cache_trim (data);
+
+  g_io_scheduler_job_send_to_mainloop_async (job, avatar_cache_trim_done_cb,
+      data, (GDestroyNotify) trim_job_free);
+
+  return FALSE;
+}
+
+static gboolean
+avatar_cache_trim_timeout_cb (gpointer user_data)
+{
+  EmpathyAvatarCache *cache = user_data;
+  EmpathyAvatarCachePriv *priv = GET_PRIV (cache);
+  TrimJob *job;
+
+  priv->trim_id = 0;
+
+  job = g_slice_new0 (TrimJob);
+  job->root = g_strdup (priv->root);
+  g_io_scheduler_push_job (avatar_cache_trim_job, job, NULL, G_PRIORITY_LOW,
+      NULL);
+
+  return FALSE;
+}
+
+static void
+avatar_cache_load_contents_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  LoadData *data = user_data;
+  EmpathyAvatarCachePriv *priv = GET_PRIV (data->cache);
+  EmpathyAvatar *avatar = NULL;
+  GSList *pendings = NULL, *l;
+  gpointer key;
+  gchar *contents;
+  gsize len;
+  GError *error = NULL;
+
+  if (g_file_load_contents_finish (G_FILE (source), result, &contents, &len,
+          NULL, &error))
+    {
+      DEBUG ("Avatar loaded from %s", data->filename);
+      avatar = empathy_avatar_new ((guchar *) contents, len, NULL,
+          data->token, data->filename);
+      avatar_cache_remember (data->cache, avatar);
+
+      /* Now owned by the avatar */
+      data->token = NULL;
+      data->filename = NULL;
+    }
+  else
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        DEBUG ("Failed to load avatar from cache: %s", error->message);
+
+      g_hash_table_insert (priv->missing, g_strdup (data->token),
+          GUINT_TO_POINTER (TRUE));
+      g_error_free (error);
+    }
+
+  if (g_hash_table_lookup_extended (priv->pending,
+          avatar != NULL ? avatar->token : data->token, &key,
+          (gpointer *) &pendings))
+    {
+      g_hash_table_steal (priv->pending, key);
+      g_free (key);
+    }
+
+  for (l = pendings; l != NULL; l = l->next)
+    {
+      PendingLoad *pending = l->data;
+
+      pending->callback (avatar, pending->user_data);
+      g_slice_free (PendingLoad, pending);
+    }
+
+  g_slist_free (pendings);
+
+  if (avatar != NULL)
+    empathy_avatar_unref (avatar);
+
+  g_object_unref (data->cache);
+  g_free (data->token);
+  g_free (data->filename);
+  g_slice_free (LoadData, data);
+}
+
+static GObject *
+avatar_cache_constructor (GType type,
+    guint n_props,
+    GObjectConstructParam *props)
+{
+  GObject *retval;
+
+  if (cache_singleton != NULL)
+    {
+      retval = g_object_ref (cache_singleton);
+    }
+  else
+    {
+      retval = G_OBJECT_CLASS (empathy_avatar_cache_parent_class)->constructor
+        (type, n_props, props);
+
+      cache_singleton = EMPATHY_AVATAR_CACHE (retval);
+      g_object_add_weak_pointer (retval, (gpointer *) &cache_singleton);
+    }
+
+  return retval;
+}
+
+static void
+avatar_cache_finalize (GObject *object)
+{
+  EmpathyAvatarCachePriv *priv = GET_PRIV (object);
+
+  if (priv->trim_id != 0)
+    g_source_remove (priv->trim_id);
+
+  /* Pending loads hold a reference, so there are none left */
+  g_hash_table_destroy (priv->pending);
+  g_hash_table_destroy (priv->missing);
+  g_hash_table_destroy (priv->memory);
+
+  g_queue_foreach (priv->lru, (GFunc) empathy_avatar_unref, NULL);
+  g_queue_free (priv->lru);
+
+  g_free (priv->root);
+
+  G_OBJECT_CLASS (empathy_avatar_cache_parent_class)->finalize (object);
+}
+
+static void
+empathy_avatar_cache_class_init (EmpathyAvatarCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructor = avatar_cache_constructor;
+  object_class->finalize = avatar_cache_finalize;
+
+  g_type_class_add_private (klass, sizeof (EmpathyAvatarCachePriv));
+}
+
+static void
+empathy_avatar_cache_init (EmpathyAvatarCache *cache)
+{
+  EmpathyAvatarCachePriv *priv = G_TYPE_INSTANCE_GET_PRIVATE (cache,
+      EMPATHY_TYPE_AVATAR_CACHE, EmpathyAvatarCachePriv);
+
+  cache->priv = priv;
+
+  priv->root = g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME,
+      "avatars", NULL);
+  priv->lru = g_queue_new ();
+  priv->memory = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      NULL);
+  priv->missing = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      NULL);
+
+  priv->trim_id = g_timeout_add_seconds (TRIM_DELAY,
+      avatar_cache_trim_timeout_cb, cache);
+}
+
+/* public methods */
+
+/**
+ * empathy_avatar_cache_dup_singleton:
+ *
+ * Returns a reference to the #EmpathyAvatarCache singleton.
+ *
+ * Returns: a new reference to the #EmpathyAvatarCache singleton
+ */
+EmpathyAvatarCache *
+empathy_avatar_cache_dup_singleton (void)
+{
+  return g_object_new (EMPATHY_TYPE_AVATAR_CACHE, NULL);
+}
+
+/**
+ * empathy_avatar_cache_lookup:
+ * @cache: an #EmpathyAvatarCache
+ * @token: the token of the avatar
+ *
+ * Looks up the avatar with @token in memory only, without any I/O.
+ *
+ * Returns: a new reference to the #EmpathyAvatar, or %NULL if it has to be
+ * loaded with empathy_avatar_cache_load_async()
+ */
+EmpathyAvatar *
+empathy_avatar_cache_lookup (EmpathyAvatarCache *cache,
+    const gchar *token)
+{
+  EmpathyAvatarCachePriv *priv;
+  GList *link;
+
+  g_return_val_if_fail (EMPATHY_IS_AVATAR_CACHE (cache), NULL);
+  g_return_val_if_fail (!EMP_STR_EMPTY (token), NULL);
+
+  priv = GET_PRIV (cache);
+
+  link = g_hash_table_lookup (priv->memory, token);
+  if (link == NULL)
+    return NULL;
+
+  avatar_cache_touch (cache, link);
+
+  return empathy_avatar_ref (link->data);
+}
+
+/**
+ * empathy_avatar_cache_load_async:
+ * @cache: an #EmpathyAvatarCache
+ * @token: the token of the avatar
+ * @callback: function to call with the avatar
+ * @user_data: data to pass to @callback
+ *
+ * Loads the avatar with @token. If it is in memory, or already known not to
+ * be cached, @callback is called before this function returns. Concurrent
+ * loads of the same token share one read.
+ */
+void
+empathy_avatar_cache_load_async (EmpathyAvatarCache *cache,
+    const gchar *token,
+    EmpathyAvatarCacheLoadCb callback,
+    gpointer user_data)
+{
+  EmpathyAvatarCachePriv *priv;
+  EmpathyAvatar *avatar;
+  PendingLoad *pending;
+  GSList *pendings;
+  LoadData *data;
+  GFile *file;
+
+  g_return_if_fail (EMPATHY_IS_AVATAR_CACHE (cache));
+  g_return_if_fail (!EMP_STR_EMPTY (token));
+  g_return_if_fail (callback != NULL);
+
+  priv = GET_PRIV (cache);
+
+  avatar = empathy_avatar_cache_lookup (cache, token);
+  if (avatar != NULL)
+    {
+      callback (avatar, user_data);
+      empathy_avatar_unref (avatar);
+      return;
+    }
+
+  if (g_hash_table_lookup (priv->missing, token) != NULL)
+    {
+      callback (NULL, user_data);
+      return;
+    }
+
+  pending = g_slice_new (PendingLoad);
+  pending->callback = callback;
+  pending->user_data = user_data;
+
+  pendings = g_hash_table_lookup (priv->pending, token);
+  if (pendings != NULL)
+    {
+      /* The head doesn't change, no need to update the table */
+      g_slist_append (pendings, pending);
+      return;
+    }
+
+  g_hash_table_insert (priv->pending, g_strdup (token),
+      g_slist_prepend (NULL, pending));
+
+  data = g_slice_new (LoadData);
+  data->cache = g_object_ref (cache);
+  data->token = g_strdup (token);
+  data->filename = avatar_cache_dup_filename (cache, token);
+
+  file = g_file_new_for_path (data->filename);
+  g_file_load_contents_async (file, NULL, avatar_cache_load_contents_cb,
+      data);
+  g_object_unref (file);
+}
+
+/**
+ * empathy_avatar_cache_add:
+ * @cache: an #EmpathyAvatarCache
+ * @data: the avatar data
+ * @len: the size of @data
+ * @format: the mime type of the avatar image
+ * @token: the token of the avatar
+ *
+ * Adds an avatar to the cache. It is saved to disk in the background if it
+ * is not there yet.
+ *
+ * Returns: a new reference to the #EmpathyAvatar
+ */
+EmpathyAvatar *
+empathy_avatar_cache_add (EmpathyAvatarCache *cache,
+    const guchar *data,
+    gsize len,
+    const gchar *format,
+    const gchar *token)
+{
+  EmpathyAvatarCachePriv *priv;
+  EmpathyAvatar *avatar;
+  WriteJob *job;
+  gchar *filename;
+
+  g_return_val_if_fail (EMPATHY_IS_AVATAR_CACHE (cache), NULL);
+  g_return_val_if_fail (data != NULL, NULL);
+  g_return_val_if_fail (len > 0, NULL);
+  g_return_val_if_fail (!EMP_STR_EMPTY (token), NULL);
+
+  priv = GET_PRIV (cache);
+
+  avatar = empathy_avatar_cache_lookup (cache, token);
+  if (avatar != NULL)
+    return avatar;
+
+  filename = avatar_cache_dup_filename (cache, token);
+
+  job = g_slice_new0 (WriteJob);
+  job->filename = g_strdup (filename);
+  job->data = g_memdup (data, len);
+  job->len = len;
+  g_io_scheduler_push_job (avatar_cache_write_job, job, NULL, G_PRIORITY_LOW,
+      NULL);
+
+  avatar = empathy_avatar_new (g_memdup (data, len), len, g_strdup (format),
+      g_strdup (token), filename);
+  avatar_cache_remember (cache, avatar);
+  g_hash_table_remove (priv->missing, token);
+
+  return avatar;
+}
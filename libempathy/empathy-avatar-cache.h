@@ -0,0 +1,83 @@
+/*
+ * empathy-avatar-cache.h - Header for EmpathyAvatarCache
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_AVATAR_CACHE_H__
+#define __EMPATHY_AVATAR_CACHE_H__
+
+#include <glib-object.h>
+
+#include "empathy-contact.h"
+
+G_BEGIN_DECLS
+
+#define EMPATHY_TYPE_AVATAR_CACHE empathy_avatar_cache_get_type()
+#define EMPATHY_AVATAR_CACHE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   EMPATHY_TYPE_AVATAR_CACHE, EmpathyAvatarCache))
+#define EMPATHY_AVATAR_CACHE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+   EMPATHY_TYPE_AVATAR_CACHE, EmpathyAvatarCacheClass))
+#define EMPATHY_IS_AVATAR_CACHE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EMPATHY_TYPE_AVATAR_CACHE))
+#define EMPATHY_IS_AVATAR_CACHE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), EMPATHY_TYPE_AVATAR_CACHE))
+#define EMPATHY_AVATAR_CACHE_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+   EMPATHY_TYPE_AVATAR_CACHE, EmpathyAvatarCacheClass))
+
+typedef struct {
+  GObject parent;
+  gpointer priv;
+} EmpathyAvatarCache;
+
+typedef struct {
+  GObjectClass parent_class;
+} EmpathyAvatarCacheClass;
+
+/**
+ * EmpathyAvatarCacheLoadCb:
+ * @avatar: the avatar found in the cache, or %NULL if it is not cached
+ * @user_data: user data passed to empathy_avatar_cache_load_async()
+ *
+ * Called when empathy_avatar_cache_load_async() finishes. @avatar is only
+ * valid during the call, use empathy_avatar_ref() to keep it.
+ */
+typedef void (*EmpathyAvatarCacheLoadCb) (EmpathyAvatar *avatar,
+    gpointer user_data);
+
+GType empathy_avatar_cache_get_type (void);
+
+/* public methods */
+EmpathyAvatarCache * empathy_avatar_cache_dup_singleton (void);
+
+EmpathyAvatar * empathy_avatar_cache_lookup (EmpathyAvatarCache *cache,
+    const gchar *token);
+void empathy_avatar_cache_load_async (EmpathyAvatarCache *cache,
+    const gchar *token,
+    EmpathyAvatarCacheLoadCb callback,
+    gpointer user_data);
+EmpathyAvatar * empathy_avatar_cache_add (EmpathyAvatarCache *cache,
+    const guchar *data,
+    gsize len,
+    const gchar *format,
+    const gchar *token);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_AVATAR_CACHE_H__ */
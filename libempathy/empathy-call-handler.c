@@ -27,6 +27,7 @@
 #include <telepathy-farsight/channel.h>
 #include <telepathy-farsight/stream.h>
 
+#include <gst/gst.h>
 #include <gst/farsight/fs-element-added-notifier.h>
 
 #include "empathy-call-handler.h"
@@ -194,6 +195,10 @@ empathy_call_handler_class_init (EmpathyCallHandlerClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GParamSpec *param_spec;
 
+  /* Empathy doesn't pay for GStreamer at startup, the first call brings it
+   * up; the call window and the audio/video widgets only exist for one */
+  gst_init (NULL, NULL);
+
   g_type_class_add_private (klass, sizeof (EmpathyCallHandlerPriv));
 
   object_class->constructed = empathy_call_handler_constructed;
@@ -34,6 +34,7 @@
 #include "empathy-chatroom-manager.h"
 #include "empathy-account-manager.h"
 #include "empathy-utils.h"
+#include "empathy-xml-saver.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_OTHER
 #include "empathy-debug.h"
@@ -50,8 +51,7 @@ typedef struct
   GList *chatrooms;
   gchar *file;
   EmpathyAccountManager *account_manager;
-  /* source id of the autosave timer */
-  gint save_timer_id;
+  EmpathyXmlSaver *saver;
 } EmpathyChatroomManagerPriv;
 
 enum {
@@ -75,15 +75,15 @@ G_DEFINE_TYPE (EmpathyChatroomManager, empathy_chatroom_manager, G_TYPE_OBJECT);
  * API to save/load and parse the chatrooms file.
  */
 
-static gboolean
-chatroom_manager_file_save (EmpathyChatroomManager *manager)
+static xmlDocPtr
+chatroom_manager_file_build (gpointer user_data)
 {
 	EmpathyChatroomManagerPriv *priv;
 	xmlDocPtr                  doc;
 	xmlNodePtr                 root;
 	GList                     *l;
 
-	priv = GET_PRIV (manager);
+	priv = GET_PRIV (user_data);
 
 	doc = xmlNewDoc ("1.0");
 	root = xmlNewNode (NULL, "chatrooms");
@@ -111,28 +111,7 @@ chatroom_manager_file_save (EmpathyChatroomManager *manager)
 			empathy_chatroom_get_auto_connect (chatroom) ? "yes" : "no");
 	}
 
-	/* Make sure the XML is indented properly */
-	xmlIndentTreeOutput = 1;
-
-	DEBUG ("Saving file:'%s'", priv->file);
-	xmlSaveFormatFileEnc (priv->file, doc, "utf-8", 1);
-	xmlFreeDoc (doc);
-
-	xmlCleanupParser ();
-	xmlMemoryDump ();
-
-	return TRUE;
-}
-
-static gboolean
-save_timeout (EmpathyChatroomManager *self)
-{
-  EmpathyChatroomManagerPriv *priv = GET_PRIV (self);
-
-  priv->save_timer_id = 0;
-  chatroom_manager_file_save (self);
-
-  return FALSE;
+	return doc;
 }
 
 static void
@@ -140,13 +119,7 @@ reset_save_timeout (EmpathyChatroomManager *self)
 {
   EmpathyChatroomManagerPriv *priv = GET_PRIV (self);
 
-  if (priv->save_timer_id > 0)
-    {
-      g_source_remove (priv->save_timer_id);
-    }
-
-  priv->save_timer_id = g_timeout_add_seconds (SAVE_TIMER,
-      (GSourceFunc) save_timeout, self);
+  empathy_xml_saver_queue (priv->saver);
 }
 
 static void
@@ -356,13 +329,8 @@ chatroom_manager_finalize (GObject *object)
 
   g_object_unref (priv->account_manager);
 
-  if (priv->save_timer_id > 0)
-    {
-      /* have to save before destroy the object */
-      g_source_remove (priv->save_timer_id);
-      priv->save_timer_id = 0;
-      chatroom_manager_file_save (self);
-    }
+  /* have to save before destroy the object */
+  empathy_xml_saver_free (priv->saver);
 
   for (l = priv->chatrooms; l != NULL; l = g_list_next (l))
     {
@@ -417,6 +385,9 @@ empathy_chatroom_manager_constructor (GType type,
       g_free (dir);
     }
 
+  priv->saver = empathy_xml_saver_new (priv->file, SAVE_TIMER,
+      chatroom_manager_file_build, self);
+
   chatroom_manager_get_all (self);
   return obj;
 }
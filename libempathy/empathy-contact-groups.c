@@ -34,12 +34,14 @@
 
 #include "empathy-utils.h"
 #include "empathy-contact-groups.h"
+#include "empathy-xml-saver.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_CONTACT
 #include "empathy-debug.h"
 
 #define CONTACT_GROUPS_XML_FILENAME "contact-groups.xml"
 #define CONTACT_GROUPS_DTD_FILENAME "empathy-contact-groups.dtd"
+#define CONTACT_GROUPS_SAVE_TIMER   2
 
 typedef struct {
 	gchar    *name;
@@ -47,12 +49,14 @@ typedef struct {
 } ContactGroup;
 
 static void          contact_groups_file_parse (const gchar  *filename);
-static gboolean      contact_groups_file_save  (void);
+static xmlDocPtr     contact_groups_file_build (gpointer      user_data);
 static ContactGroup *contact_group_new         (const gchar  *name,
 						gboolean      expanded);
 static void          contact_group_free        (ContactGroup *group);
 
-static GList *groups = NULL;
+/* Group name -> ContactGroup */
+static GHashTable      *groups = NULL;
+static EmpathyXmlSaver *saver = NULL;
 
 void
 empathy_contact_groups_get_all (void)
@@ -62,15 +66,24 @@ empathy_contact_groups_get_all (void)
 
 	/* If already set up clean up first */
 	if (groups) {
-		g_list_foreach (groups, (GFunc)contact_group_free, NULL);
-		g_list_free (groups);
-		groups = NULL;
+		g_hash_table_remove_all (groups);
+	} else {
+		groups = g_hash_table_new_full (g_str_hash, g_str_equal,
+						NULL,
+						(GDestroyNotify) contact_group_free);
 	}
 
 	dir = g_build_filename (g_get_home_dir (), ".gnome2", PACKAGE_NAME, NULL);
 	file_with_path = g_build_filename (dir, CONTACT_GROUPS_XML_FILENAME, NULL);
 	g_free (dir);
 
+	if (!saver) {
+		saver = empathy_xml_saver_new (file_with_path,
+					       CONTACT_GROUPS_SAVE_TIMER,
+					       contact_groups_file_build,
+					       NULL);
+	}
+
 	if (g_file_test (file_with_path, G_FILE_TEST_EXISTS)) {
 		contact_groups_file_parse (file_with_path);
 	}
@@ -140,8 +153,11 @@ contact_groups_file_parse (const gchar *filename)
 				expanded = FALSE;
 			}
 
-			contact_group = contact_group_new (name, expanded);
-			groups = g_list_append (groups, contact_group);
+			if (name) {
+				contact_group = contact_group_new (name, expanded);
+				g_hash_table_replace (groups, contact_group->name,
+						      contact_group);
+			}
 
 			xmlFree (name);
 			xmlFree (expanded_str);
@@ -150,7 +166,7 @@ contact_groups_file_parse (const gchar *filename)
 		node = node->next;
 	}
 
-	DEBUG ("Parsed %d contact groups", g_list_length (groups));
+	DEBUG ("Parsed %d contact groups", g_hash_table_size (groups));
 
 	xmlFreeDoc (doc);
 	xmlFreeParserCtxt (ctxt);
@@ -180,20 +196,14 @@ contact_group_free (ContactGroup *group)
 	g_free (group);
 }
 
-static gboolean
-contact_groups_file_save (void)
+static xmlDocPtr
+contact_groups_file_build (gpointer user_data)
 {
-	xmlDocPtr   doc;
-	xmlNodePtr  root;
-	xmlNodePtr  node;
-	GList      *l;
-	gchar      *dir;
-	gchar      *file;
-
-	dir = g_build_filename (g_get_home_dir (), ".gnome2", PACKAGE_NAME, NULL);
-	g_mkdir_with_parents (dir, S_IRUSR | S_IWUSR | S_IXUSR);
-	file = g_build_filename (dir, CONTACT_GROUPS_XML_FILENAME, NULL);
-	g_free (dir);
+	xmlDocPtr       doc;
+	xmlNodePtr      root;
+	xmlNodePtr      node;
+	GHashTableIter  iter;
+	gpointer        value;
 
 	doc = xmlNewDoc ("1.0");
 	root = xmlNewNode (NULL, "contacts");
@@ -202,50 +212,34 @@ contact_groups_file_save (void)
 	node = xmlNewChild (root, NULL, "account", NULL);
 	xmlNewProp (node, "name", "Default");
 
-	for (l = groups; l; l = l->next) {
-		ContactGroup *cg;
+	g_hash_table_iter_init (&iter, groups);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		ContactGroup *cg = value;
 		xmlNodePtr    subnode;
 
-		cg = l->data;
-
 		subnode = xmlNewChild (node, NULL, "group", NULL);
 		xmlNewProp (subnode, "expanded", cg->expanded ? "yes" : "no");
 		xmlNewProp (subnode, "name", cg->name);
 	}
 
-	/* Make sure the XML is indented properly */
-	xmlIndentTreeOutput = 1;
-
-	DEBUG ("Saving file:'%s'", file);
-	xmlSaveFormatFileEnc (file, doc, "utf-8", 1);
-	xmlFreeDoc (doc);
-
-	xmlCleanupParser ();
-	xmlMemoryDump ();
-
-	g_free (file);
-
-	return TRUE;
+	return doc;
 }
 
 gboolean
 empathy_contact_group_get_expanded (const gchar *group)
 {
-	GList    *l;
-	gboolean  default_val = TRUE;
+	ContactGroup *cg;
+	gboolean      default_val = TRUE;
 
 	g_return_val_if_fail (group != NULL, default_val);
 
-	for (l = groups; l; l = l->next) {
-		ContactGroup *cg = l->data;
-
-		if (!cg || !cg->name) {
-			continue;
-		}
+	if (!groups) {
+		return default_val;
+	}
 
-		if (strcmp (cg->name, group) == 0) {
-			return cg->expanded;
-		}
+	cg = g_hash_table_lookup (groups, group);
+	if (cg) {
+		return cg->expanded;
 	}
 
 	return default_val;
@@ -255,31 +249,24 @@ void
 empathy_contact_group_set_expanded (const gchar *group,
 				   gboolean     expanded)
 {
-	GList        *l;
 	ContactGroup *cg;
-	gboolean      changed = FALSE;
 
 	g_return_if_fail (group != NULL);
 
-	for (l = groups; l; l = l->next) {
-		ContactGroup *cg = l->data;
-
-		if (!cg || !cg->name) {
-			continue;
-		}
-
-		if (strcmp (cg->name, group) == 0) {
-			cg->expanded = expanded;
-			changed = TRUE;
-			break;
-		}
+	if (!groups) {
+		empathy_contact_groups_get_all ();
 	}
 
-	/* if here... we don't have a ContactGroup for the group. */
-	if (!changed) {
+	cg = g_hash_table_lookup (groups, group);
+	if (cg) {
+		if (cg->expanded == expanded) {
+			return;
+		}
+		cg->expanded = expanded;
+	} else {
 		cg = contact_group_new (group, expanded);
-		groups = g_list_append (groups, cg);
+		g_hash_table_insert (groups, cg->name, cg);
 	}
 
-	contact_groups_file_save ();
+	empathy_xml_saver_queue (saver);
 }
@@ -64,6 +64,19 @@ contact_list_base_init (gpointer klass)
 			      5, EMPATHY_TYPE_CONTACT, EMPATHY_TYPE_CONTACT,
 			      G_TYPE_UINT, G_TYPE_STRING, G_TYPE_BOOLEAN);
 
+		/* Emitted once per batch, before the members-changed
+		 * signal of each contact. The arrays of EmpathyContact are
+		 * NULL if empty. */
+		g_signal_new ("members-changed-bulk",
+			      G_TYPE_FROM_CLASS (klass),
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+			      _empathy_marshal_VOID__POINTER_POINTER_OBJECT_UINT_STRING,
+			      G_TYPE_NONE,
+			      5, G_TYPE_POINTER, G_TYPE_POINTER,
+			      EMPATHY_TYPE_CONTACT, G_TYPE_UINT, G_TYPE_STRING);
+
 		g_signal_new ("pendings-changed",
 			      G_TYPE_FROM_CLASS (klass),
 			      G_SIGNAL_RUN_LAST,
@@ -125,6 +138,66 @@ empathy_contact_list_get_members (EmpathyContactList *list)
 	return NULL;
 }
 
+/**
+ * empathy_contact_list_emit_members_changed:
+ * @list: an #EmpathyContactList
+ * @added: a #GPtrArray of the #EmpathyContact which became members, or %NULL
+ * @removed: a #GPtrArray of the #EmpathyContact which left, or %NULL
+ * @actor: the #EmpathyContact responsible for the change, or %NULL
+ * @reason: a #TpChannelGroupChangeReason
+ * @message: the message of the change, or %NULL
+ *
+ * For implementations of #EmpathyContactList: emits
+ * #EmpathyContactList::members-changed-bulk once for the whole batch,
+ * then #EmpathyContactList::members-changed for each contact if anyone
+ * listens to it.
+ */
+void
+empathy_contact_list_emit_members_changed (EmpathyContactList *list,
+					   GPtrArray          *added,
+					   GPtrArray          *removed,
+					   EmpathyContact     *actor,
+					   guint               reason,
+					   const gchar        *message)
+{
+	guint i;
+
+	g_return_if_fail (EMPATHY_IS_CONTACT_LIST (list));
+
+	if (added && added->len == 0) {
+		added = NULL;
+	}
+	if (removed && removed->len == 0) {
+		removed = NULL;
+	}
+	if (!added && !removed) {
+		return;
+	}
+
+	g_signal_emit_by_name (list, "members-changed-bulk", added, removed,
+			       actor, reason, message);
+
+	/* Empathy itself only listens to the bulk signal, don't walk big
+	 * batches for nothing */
+	if (!g_signal_has_handler_pending (list,
+					   g_signal_lookup ("members-changed",
+							    EMPATHY_TYPE_CONTACT_LIST),
+					   0, FALSE)) {
+		return;
+	}
+
+	for (i = 0; removed && i < removed->len; i++) {
+		g_signal_emit_by_name (list, "members-changed",
+				       g_ptr_array_index (removed, i),
+				       actor, reason, message, FALSE);
+	}
+	for (i = 0; added && i < added->len; i++) {
+		g_signal_emit_by_name (list, "members-changed",
+				       g_ptr_array_index (added, i),
+				       actor, reason, message, TRUE);
+	}
+}
+
 EmpathyContactMonitor *
 empathy_contact_list_get_monitor (EmpathyContactList *list)
 {
@@ -91,6 +91,12 @@ void	 empathy_contact_list_remove_group	(EmpathyContactList *list,
 						 const gchar	    *group);
 EmpathyContactMonitor *
          empathy_contact_list_get_monitor       (EmpathyContactList *list);
+void     empathy_contact_list_emit_members_changed (EmpathyContactList *list,
+						 GPtrArray          *added,
+						 GPtrArray          *removed,
+						 EmpathyContact     *actor,
+						 guint               reason,
+						 const gchar        *message);
 
 G_END_DECLS
 
@@ -50,16 +50,17 @@ G_DEFINE_TYPE_WITH_CODE (EmpathyContactManager, empathy_contact_manager, G_TYPE_
 static EmpathyContactManager *manager_singleton = NULL;
 
 static void
-contact_manager_members_changed_cb (EmpathyTpContactList  *list,
-				    EmpathyContact        *contact,
-				    EmpathyContact        *actor,
-				    guint                  reason,
-				    gchar                 *message,
-				    gboolean               is_member,
-				    EmpathyContactManager *manager)
+contact_manager_members_changed_bulk_cb (EmpathyTpContactList  *list,
+					 GPtrArray             *added,
+					 GPtrArray             *removed,
+					 EmpathyContact        *actor,
+					 guint                  reason,
+					 gchar                 *message,
+					 EmpathyContactManager *manager)
 {
-	g_signal_emit_by_name (manager, "members-changed",
-			       contact, actor, reason, message, is_member);
+	empathy_contact_list_emit_members_changed (EMPATHY_CONTACT_LIST (manager),
+						   added, removed, actor,
+						   reason, message);
 }
 
 static void
@@ -118,7 +119,7 @@ contact_manager_disconnect_foreach (gpointer key,
 
 	/* Disconnect signals from the list */
 	g_signal_handlers_disconnect_by_func (list,
-					      contact_manager_members_changed_cb,
+					      contact_manager_members_changed_bulk_cb,
 					      manager);
 	g_signal_handlers_disconnect_by_func (list,
 					      contact_manager_pendings_changed_cb,
@@ -153,8 +154,8 @@ contact_manager_new_connection_cb (EmpathyAccountManager *account_manager,
 			  self);
 
 	/* Connect signals */
-	g_signal_connect (list, "members-changed",
-			  G_CALLBACK (contact_manager_members_changed_cb),
+	g_signal_connect (list, "members-changed-bulk",
+			  G_CALLBACK (contact_manager_members_changed_bulk_cb),
 			  self);
 	g_signal_connect (list, "pendings-changed",
 			  G_CALLBACK (contact_manager_pendings_changed_cb),
@@ -33,7 +33,8 @@
 
 typedef struct {
   EmpathyContactList *iface;
-  GList *contacts;
+  /* EmpathyContact -> itself, owns a ref */
+  GHashTable *contacts;
 
   gboolean dispose_run;
 } EmpathyContactMonitorPriv;
@@ -56,6 +57,12 @@ enum {
 
 static guint signals[LAST_SIGNAL];
 
+/* Interned in class_init, like the names of the GParamSpecs */
+static const gchar *presence_message_name;
+static const gchar *name_name;
+static const gchar *avatar_name;
+static const gchar *capabilities_name;
+
 G_DEFINE_TYPE (EmpathyContactMonitor, empathy_contact_monitor, G_TYPE_OBJECT);
 
 static void
@@ -69,9 +76,8 @@ contact_monitor_presence_changed_cb (EmpathyContact *contact,
 }
 
 static void
-contact_monitor_presence_message_changed_cb (EmpathyContact *contact,
-                                             GParamSpec *pspec,
-                                             EmpathyContactMonitor *self)
+contact_monitor_presence_message_changed (EmpathyContact *contact,
+                                          EmpathyContactMonitor *self)
 {
   const char *status;
 
@@ -83,9 +89,8 @@ contact_monitor_presence_message_changed_cb (EmpathyContact *contact,
 }
 
 static void
-contact_monitor_name_changed_cb (EmpathyContact *contact,
-                                 GParamSpec *pspec,
-                                 EmpathyContactMonitor *self)
+contact_monitor_name_changed (EmpathyContact *contact,
+                              EmpathyContactMonitor *self)
 {
   const char *name;
 
@@ -95,9 +100,8 @@ contact_monitor_name_changed_cb (EmpathyContact *contact,
 }
 
 static void
-contact_monitor_avatar_changed_cb (EmpathyContact *contact,
-                                   GParamSpec *pspec,
-                                   EmpathyContactMonitor *self)
+contact_monitor_avatar_changed (EmpathyContact *contact,
+                                EmpathyContactMonitor *self)
 {
   /* don't emit a pixbuf in the signal, as we don't depend on GTK+ here
    */
@@ -106,36 +110,46 @@ contact_monitor_avatar_changed_cb (EmpathyContact *contact,
 }
 
 static void
-contact_monitor_capabilities_changed_cb (EmpathyContact *contact,
-                                         GParamSpec *pspec,
-                                         EmpathyContactMonitor *self)
+contact_monitor_capabilities_changed (EmpathyContact *contact,
+                                      EmpathyContactMonitor *self)
 {
   g_signal_emit (self, signals[CONTACT_CAPABILITIES_CHANGED], 0, contact);
 }
 
+static void
+contact_monitor_notify_cb (EmpathyContact *contact,
+                           GParamSpec *pspec,
+                           EmpathyContactMonitor *self)
+{
+  /* A single "notify" handler per contact instead of one per property,
+   * property names are interned so compare the pointers */
+  if (pspec->name == presence_message_name)
+    contact_monitor_presence_message_changed (contact, self);
+  else if (pspec->name == name_name)
+    contact_monitor_name_changed (contact, self);
+  else if (pspec->name == avatar_name)
+    contact_monitor_avatar_changed (contact, self);
+  else if (pspec->name == capabilities_name)
+    contact_monitor_capabilities_changed (contact, self);
+}
+
 static void
 contact_add (EmpathyContactMonitor *monitor,
              EmpathyContact *contact)
 {
   EmpathyContactMonitorPriv *priv = GET_PRIV (monitor);
 
+  if (g_hash_table_lookup (priv->contacts, contact) != NULL)
+    return;
+
   g_signal_connect (contact, "presence-changed",
                     G_CALLBACK (contact_monitor_presence_changed_cb),
                     monitor);
-  g_signal_connect (contact, "notify::presence-message",
-                    G_CALLBACK (contact_monitor_presence_message_changed_cb),
-                    monitor);
-  g_signal_connect (contact, "notify::name",
-                    G_CALLBACK (contact_monitor_name_changed_cb),
-                    monitor);
-  g_signal_connect (contact, "notify::avatar",
-                    G_CALLBACK (contact_monitor_avatar_changed_cb),
-                    monitor);
-  g_signal_connect (contact, "notify::capabilities",
-                    G_CALLBACK (contact_monitor_capabilities_changed_cb),
+  g_signal_connect (contact, "notify",
+                    G_CALLBACK (contact_monitor_notify_cb),
                     monitor);
 
-  priv->contacts = g_list_prepend (priv->contacts, g_object_ref (contact));
+  g_hash_table_insert (priv->contacts, g_object_ref (contact), contact);
 
   g_signal_emit (monitor, signals[CONTACT_ADDED], 0, contact);
 }
@@ -146,23 +160,18 @@ contact_remove (EmpathyContactMonitor *monitor,
 {
   EmpathyContactMonitorPriv *priv = GET_PRIV (monitor);
 
+  if (g_hash_table_lookup (priv->contacts, contact) == NULL)
+    return;
+
   g_signal_handlers_disconnect_by_func (contact,
                                         G_CALLBACK (contact_monitor_presence_changed_cb),
                                         monitor);
   g_signal_handlers_disconnect_by_func (contact,
-                                        G_CALLBACK (contact_monitor_presence_message_changed_cb),
-                                        monitor);
-  g_signal_handlers_disconnect_by_func (contact,
-                                        G_CALLBACK (contact_monitor_name_changed_cb),
-                                        monitor);
-  g_signal_handlers_disconnect_by_func (contact,
-                                        G_CALLBACK (contact_monitor_avatar_changed_cb),
-                                        monitor);
-  g_signal_handlers_disconnect_by_func (contact,
-                                        G_CALLBACK (contact_monitor_capabilities_changed_cb),
+                                        G_CALLBACK (contact_monitor_notify_cb),
                                         monitor);
 
-  priv->contacts = g_list_remove (priv->contacts, contact);
+  /* Keep the contact alive while the signal is emitted */
+  g_hash_table_steal (priv->contacts, contact);
 
   g_signal_emit (monitor, signals[CONTACT_REMOVED], 0, contact);
 
@@ -170,25 +179,33 @@ contact_remove (EmpathyContactMonitor *monitor,
 }
 
 static void
-contact_remove_foreach (EmpathyContact *contact,
-                        EmpathyContactMonitor *monitor)
+contact_remove_all (EmpathyContactMonitor *monitor)
 {
-  contact_remove (monitor, contact);
+  EmpathyContactMonitorPriv *priv = GET_PRIV (monitor);
+  GList *contacts, *l;
+
+  contacts = g_hash_table_get_keys (priv->contacts);
+  for (l = contacts; l != NULL; l = l->next)
+    contact_remove (monitor, l->data);
+  g_list_free (contacts);
 }
 
 static void
-cl_members_changed_cb (EmpathyContactList    *cl,
-                       EmpathyContact        *contact,
-                       EmpathyContact        *actor,
-                       guint                  reason,
-                       gchar                 *message,
-                       gboolean               is_member,
-                       EmpathyContactMonitor *monitor)
+cl_members_changed_bulk_cb (EmpathyContactList    *cl,
+                            GPtrArray             *added,
+                            GPtrArray             *removed,
+                            EmpathyContact        *actor,
+                            guint                  reason,
+                            gchar                 *message,
+                            EmpathyContactMonitor *monitor)
 {
-  if (is_member)
-    contact_add (monitor, contact);
-  else
-    contact_remove (monitor, contact);
+  guint i;
+
+  for (i = 0; removed != NULL && i < removed->len; i++)
+    contact_remove (monitor, g_ptr_array_index (removed, i));
+
+  for (i = 0; added != NULL && i < added->len; i++)
+    contact_add (monitor, g_ptr_array_index (added, i));
 }
 
 static void
@@ -235,15 +252,11 @@ do_finalize (GObject *obj)
 
   priv = GET_PRIV (obj);
 
-  if (priv->contacts)
-    {
-      g_list_free (priv->contacts);
-      priv->contacts = NULL;
-    }
+  g_hash_table_destroy (priv->contacts);
 
   if (priv->iface)
     g_signal_handlers_disconnect_by_func (priv->iface,
-                                          cl_members_changed_cb, obj);
+                                          cl_members_changed_bulk_cb, obj);
 
   G_OBJECT_CLASS (empathy_contact_monitor_parent_class)->finalize (obj);
 }
@@ -260,13 +273,11 @@ do_dispose (GObject *obj)
 
   priv->dispose_run = TRUE;
 
-  if (priv->contacts)
-    g_list_foreach (priv->contacts,
-                    (GFunc) contact_remove_foreach, obj);
+  contact_remove_all (EMPATHY_CONTACT_MONITOR (obj));
 
   if (priv->iface)
     g_signal_handlers_disconnect_by_func (priv->iface,
-                                          cl_members_changed_cb, obj);
+                                          cl_members_changed_bulk_cb, obj);
 
   G_OBJECT_CLASS (empathy_contact_monitor_parent_class)->dispose (obj);
 }
@@ -281,6 +292,11 @@ empathy_contact_monitor_class_init (EmpathyContactMonitorClass *klass)
   oclass->get_property = do_get_property;
   oclass->set_property = do_set_property;
 
+  presence_message_name = g_intern_static_string ("presence-message");
+  name_name = g_intern_static_string ("name");
+  avatar_name = g_intern_static_string ("avatar");
+  capabilities_name = g_intern_static_string ("capabilities");
+
   g_object_class_install_property (oclass,
                                    PROP_IFACE,
                                    g_param_spec_object ("iface",
@@ -370,7 +386,9 @@ empathy_contact_monitor_init (EmpathyContactMonitor *self)
                                    EmpathyContactMonitorPriv);
 
   self->priv = priv;
-  priv->contacts = NULL;
+  priv->contacts = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                          (GDestroyNotify) g_object_unref,
+                                          NULL);
   priv->iface = NULL;
   priv->dispose_run = FALSE;
 }
@@ -388,18 +406,12 @@ empathy_contact_monitor_set_iface (EmpathyContactMonitor *self,
 
   priv = GET_PRIV (self);
 
-  if (priv->contacts != NULL)
-    {
-      g_list_foreach (priv->contacts,
-                      (GFunc) contact_remove_foreach, self);
-      g_list_free (priv->contacts);
-      priv->contacts = NULL;
-    }
+  contact_remove_all (self);
 
   priv->iface = iface;
 
-  g_signal_connect (iface, "members-changed",
-                    G_CALLBACK (cl_members_changed_cb), self);
+  g_signal_connect (iface, "members-changed-bulk",
+                    G_CALLBACK (cl_members_changed_bulk_cb), self);
 }
 
 EmpathyContactMonitor *
@@ -0,0 +1,719 @@
+/*
+ * empathy-contact-search.c - Source for EmpathyContactSearch
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <telepathy-glib/util.h>
+
+#include "empathy-contact-search.h"
+#include "empathy-contact-manager.h"
+#include "empathy-utils.h"
+
+/**
+ * SECTION:empathy-contact-search
+ * @title:EmpathyContactSearch
+ * @short_description: type-ahead search index over contacts
+ * @include: libempathy/empathy-contact-search.h
+ *
+ * #EmpathyContactSearch keeps an index of the casefolded alias and
+ * identifier of a set of contacts, so that looking up the contacts matching
+ * a search key does not need to walk and casefold every contact.
+ *
+ * Every substring of up to three characters of the indexed strings has a
+ * posting set; shorter keys are answered directly from it, longer keys
+ * intersect the postings of their trigrams and check the few remaining
+ * candidates.
+ *
+ * The singleton returned by empathy_contact_search_dup_singleton() follows
+ * the members of the #EmpathyContactManager, so it covers all the contacts
+ * of all the connections.
+ */
+
+/* Length, in characters, of the longest indexed substring */
+#define MAX_GRAM_LEN 3
+
+G_DEFINE_TYPE (EmpathyContactSearch, empathy_contact_search, G_TYPE_OBJECT);
+
+#define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyContactSearch)
+
+typedef struct {
+  EmpathyContact *contact;
+  gchar *name;
+  gchar *id;
+} SearchEntry;
+
+/* Lower is better */
+typedef enum {
+  MATCH_EXACT,
+  MATCH_NAME_PREFIX,
+  MATCH_WORD_PREFIX,
+  MATCH_ID_PREFIX,
+  MATCH_NAME_SUBSTRING,
+  MATCH_ID_SUBSTRING,
+  MATCH_NONE
+} MatchScore;
+
+typedef struct {
+  SearchEntry *entry;
+  MatchScore score;
+} ScoredEntry;
+
+typedef struct {
+  EmpathyContactManager *manager;
+
+  /* EmpathyContact -> owned SearchEntry */
+  GHashTable *entries;
+  /* owned casefolded substring -> owned GHashTable<SearchEntry> */
+  GHashTable *postings;
+
+  /* Result set for the last key given to empathy_contact_search_matches() */
+  gchar *cached_key;
+  GHashTable *cached_matches;
+
+  gboolean dispose_run;
+} EmpathyContactSearchPriv;
+
+static EmpathyContactSearch *search_singleton = NULL;
+
+static void contact_search_name_changed_cb (EmpathyContact *contact,
+    GParamSpec *pspec,
+    EmpathyContactSearch *search);
+
+static void
+search_entry_free (SearchEntry *entry)
+{
+  g_object_unref (entry->contact);
+  g_free (entry->name);
+  g_free (entry->id);
+
+  g_slice_free (SearchEntry, entry);
+}
+
+static void
+contact_search_invalidate_cache (EmpathyContactSearch *search)
+{
+  EmpathyContactSearchPriv *priv = GET_PRIV (search);
+
+  g_free (priv->cached_key);
+  priv->cached_key = NULL;
+
+  if (priv->cached_matches != NULL)
+    {
+      g_hash_table_destroy (priv->cached_matches);
+      priv->cached_matches = NULL;
+    }
+}
+
+static void
+contact_search_posting_add (EmpathyContactSearchPriv *priv,
+    gchar *gram,
+    SearchEntry *entry)
+{
+  GHashTable *posting;
+
+  posting = g_hash_table_lookup (priv->postings, gram);
+
+  if (posting == NULL)
+    {
+      posting = g_hash_table_new (g_direct_hash, g_direct_equal);
+      g_hash_table_insert (priv->postings, gram, posting);
+    }
+  else
+    {
+      g_free (gram);
+    }
+
+  g_hash_table_insert (posting, entry, entry);
+}
+
+static void
+contact_search_posting_remove (EmpathyContactSearchPriv *priv,
+    gchar *gram,
+    SearchEntry *entry)
+{
+  GHashTable *posting;
+
+  posting = g_hash_table_lookup (priv->postings, gram);
+
+  if (posting != NULL)
+    {
+      g_hash_table_remove (posting, entry);
+
+      if (g_hash_table_size (posting) == 0)
+        g_hash_table_remove (priv->postings, gram);
+    }
+
+  g_free (gram);
+}
+
+static void
+contact_search_index_string (EmpathyContactSearchPriv *priv,
+    SearchEntry *entry,
+    const gchar *str,
+    gboolean add)
+{
+  const gchar *start;
+
+  if (str == NULL)
+    return;
+
+  for (start = str; *start != '\0'; start = g_utf8_next_char (start))
+    {
+      const gchar *end = start;
+      guint len;
+
+      for (len = 0; len < MAX_GRAM_LEN && *end != '\0'; len++)
+        {
+          gchar *gram;
+
+          end = g_utf8_next_char (end);
+          gram = g_strndup (start, end - start);
+
+          if (add)
+            contact_search_posting_add (priv, gram, entry);
+          else
+            contact_search_posting_remove (priv, gram, entry);
+        }
+    }
+}
+
+static void
+contact_search_index_entry (EmpathyContactSearchPriv *priv,
+    SearchEntry *entry,
+    gboolean add)
+{
+  contact_search_index_string (priv, entry, entry->name, add);
+  contact_search_index_string (priv, entry, entry->id, add);
+}
+
+static void
+search_entry_update_strings (SearchEntry *entry)
+{
+  const gchar *str;
+
+  g_free (entry->name);
+  g_free (entry->id);
+
+  str = empathy_contact_get_name (entry->contact);
+  entry->name = str != NULL ? g_utf8_casefold (str, -1) : NULL;
+
+  str = empathy_contact_get_id (entry->contact);
+  entry->id = str != NULL ? g_utf8_casefold (str, -1) : NULL;
+}
+
+static MatchScore
+contact_search_score_string (const gchar *str,
+    const gchar *key,
+    gboolean is_name)
+{
+  const gchar *p;
+
+  if (str == NULL)
+    return MATCH_NONE;
+
+  p = strstr (str, key);
+  if (p == NULL)
+    return MATCH_NONE;
+
+  if (p == str)
+    {
+      if (is_name && strcmp (str, key) == 0)
+        return MATCH_EXACT;
+
+      return is_name ? MATCH_NAME_PREFIX : MATCH_ID_PREFIX;
+    }
+
+  if (!is_name)
+    return MATCH_ID_SUBSTRING;
+
+  /* UTF-8 is self-synchronising, so every match starts on a character */
+  for (; p != NULL; p = strstr (p + 1, key))
+    {
+      gunichar prev;
+
+      prev = g_utf8_get_char (g_utf8_prev_char (p));
+      if (!g_unichar_isalnum (prev))
+        return MATCH_WORD_PREFIX;
+    }
+
+  return MATCH_NAME_SUBSTRING;
+}
+
+static MatchScore
+contact_search_score (SearchEntry *entry,
+    const gchar *key)
+{
+  MatchScore name_score, id_score;
+
+  name_score = contact_search_score_string (entry->name, key, TRUE);
+  if (name_score <= MATCH_WORD_PREFIX)
+    return name_score;
+
+  id_score = contact_search_score_string (entry->id, key, FALSE);
+
+  return MIN (name_score, id_score);
+}
+
+/* Fills @result with a ScoredEntry for every indexed contact matching the
+ * casefolded @key */
+static void
+contact_search_lookup (EmpathyContactSearchPriv *priv,
+    const gchar *key,
+    GArray *result)
+{
+  GHashTable *candidates = NULL;
+  GHashTableIter iter;
+  gpointer entry;
+  const gchar *start;
+  glong len;
+
+  len = g_utf8_strlen (key, -1);
+
+  if (len == 0)
+    {
+      candidates = priv->entries;
+    }
+  else if (len <= MAX_GRAM_LEN)
+    {
+      candidates = g_hash_table_lookup (priv->postings, key);
+    }
+  else
+    {
+      /* Only the smallest posting of the key's trigrams needs checking */
+      for (start = key; len >= MAX_GRAM_LEN;
+           start = g_utf8_next_char (start), len--)
+        {
+          GHashTable *posting;
+          gchar *gram;
+
+          gram = g_strndup (start,
+              g_utf8_offset_to_pointer (start, MAX_GRAM_LEN) - start);
+          posting = g_hash_table_lookup (priv->postings, gram);
+          g_free (gram);
+
+          if (posting == NULL)
+            return;
+
+          if (candidates == NULL ||
+              g_hash_table_size (posting) < g_hash_table_size (candidates))
+            candidates = posting;
+        }
+    }
+
+  if (candidates == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, candidates);
+  while (g_hash_table_iter_next (&iter, NULL, &entry))
+    {
+      ScoredEntry scored;
+
+      /* priv->entries maps contacts to entries, postings map entries to
+       * themselves */
+      scored.entry = entry;
+      scored.score = contact_search_score (scored.entry, key);
+
+      if (scored.score != MATCH_NONE)
+        g_array_append_val (result, scored);
+    }
+}
+
+static gint
+contact_search_compare_scored (gconstpointer a,
+    gconstpointer b)
+{
+  const ScoredEntry *scored_a = a;
+  const ScoredEntry *scored_b = b;
+
+  if (scored_a->score != scored_b->score)
+    return scored_a->score - scored_b->score;
+
+  return g_utf8_collate (
+      empathy_contact_get_name (scored_a->entry->contact),
+      empathy_contact_get_name (scored_b->entry->contact));
+}
+
+static void
+contact_search_members_changed_cb (EmpathyContactList *list,
+    GPtrArray *added,
+    GPtrArray *removed,
+    EmpathyContact *actor,
+    guint reason,
+    gchar *message,
+    EmpathyContactSearch *search)
+{
+  guint i;
+
+  for (i = 0; removed != NULL && i < removed->len; i++)
+    empathy_contact_search_remove_contact (search,
+        g_ptr_array_index (removed, i));
+
+  for (i = 0; added != NULL && i < added->len; i++)
+    empathy_contact_search_add_contact (search,
+        g_ptr_array_index (added, i));
+}
+
+static void
+contact_search_name_changed_cb (EmpathyContact *contact,
+    GParamSpec *pspec,
+    EmpathyContactSearch *search)
+{
+  EmpathyContactSearchPriv *priv = GET_PRIV (search);
+  SearchEntry *entry;
+
+  entry = g_hash_table_lookup (priv->entries, contact);
+  if (entry == NULL)
+    return;
+
+  contact_search_index_entry (priv, entry, FALSE);
+  search_entry_update_strings (entry);
+  contact_search_index_entry (priv, entry, TRUE);
+
+  contact_search_invalidate_cache (search);
+}
+
+static void
+contact_search_set_manager (EmpathyContactSearch *search,
+    EmpathyContactManager *manager)
+{
+  EmpathyContactSearchPriv *priv = GET_PRIV (search);
+  GList *members, *l;
+
+  priv->manager = g_object_ref (manager);
+
+  g_signal_connect (manager, "members-changed-bulk",
+      G_CALLBACK (contact_search_members_changed_cb), search);
+
+  members = empathy_contact_list_get_members (EMPATHY_CONTACT_LIST (manager));
+  for (l = members; l != NULL; l = l->next)
+    {
+      empathy_contact_search_add_contact (search, l->data);
+      g_object_unref (l->data);
+    }
+  g_list_free (members);
+}
+
+static void
+do_dispose (GObject *object)
+{
+  EmpathyContactSearchPriv *priv = GET_PRIV (object);
+  GHashTableIter iter;
+  gpointer contact;
+
+  if (priv->dispose_run)
+    return;
+
+  priv->dispose_run = TRUE;
+
+  if (priv->manager != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (priv->manager,
+          contact_search_members_changed_cb, object);
+      g_object_unref (priv->manager);
+      priv->manager = NULL;
+    }
+
+  g_hash_table_iter_init (&iter, priv->entries);
+  while (g_hash_table_iter_next (&iter, &contact, NULL))
+    g_signal_handlers_disconnect_by_func (contact,
+        contact_search_name_changed_cb, object);
+
+  G_OBJECT_CLASS (empathy_contact_search_parent_class)->dispose (object);
+}
+
+static void
+do_finalize (GObject *object)
+{
+  EmpathyContactSearchPriv *priv = GET_PRIV (object);
+
+  contact_search_invalidate_cache (EMPATHY_CONTACT_SEARCH (object));
+
+  g_hash_table_destroy (priv->postings);
+  g_hash_table_destroy (priv->entries);
+
+  G_OBJECT_CLASS (empathy_contact_search_parent_class)->finalize (object);
+}
+
+static void
+empathy_contact_search_class_init (EmpathyContactSearchClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = do_dispose;
+  object_class->finalize = do_finalize;
+
+  g_type_class_add_private (klass, sizeof (EmpathyContactSearchPriv));
+}
+
+static void
+empathy_contact_search_init (EmpathyContactSearch *search)
+{
+  EmpathyContactSearchPriv *priv = G_TYPE_INSTANCE_GET_PRIVATE (search,
+      EMPATHY_TYPE_CONTACT_SEARCH, EmpathyContactSearchPriv);
+
+  search->priv = priv;
+
+  priv->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) search_entry_free);
+  priv->postings = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_hash_table_destroy);
+}
+
+/* public methods */
+
+/**
+ * empathy_contact_search_new:
+ *
+ * Creates a new, empty #EmpathyContactSearch. Contacts have to be added
+ * to it with empathy_contact_search_add_contact().
+ *
+ * Returns: a new #EmpathyContactSearch
+ */
+EmpathyContactSearch *
+empathy_contact_search_new (void)
+{
+  return g_object_new (EMPATHY_TYPE_CONTACT_SEARCH, NULL);
+}
+
+/**
+ * empathy_contact_search_dup_singleton:
+ *
+ * Returns a reference to the #EmpathyContactSearch indexing all the
+ * members of the #EmpathyContactManager singleton.
+ *
+ * Returns: a new reference to the #EmpathyContactSearch singleton
+ */
+EmpathyContactSearch *
+empathy_contact_search_dup_singleton (void)
+{
+  EmpathyContactManager *manager;
+
+  if (search_singleton != NULL)
+    return g_object_ref (search_singleton);
+
+  search_singleton = empathy_contact_search_new ();
+  g_object_add_weak_pointer (G_OBJECT (search_singleton),
+      (gpointer *) &search_singleton);
+
+  manager = empathy_contact_manager_dup_singleton ();
+  contact_search_set_manager (search_singleton, manager);
+  g_object_unref (manager);
+
+  return search_singleton;
+}
+
+/**
+ * empathy_contact_search_add_contact:
+ * @search: an #EmpathyContactSearch
+ * @contact: an #EmpathyContact
+ *
+ * Adds @contact to the index. Its entry is kept up to date when its alias
+ * changes.
+ */
+void
+empathy_contact_search_add_contact (EmpathyContactSearch *search,
+    EmpathyContact *contact)
+{
+  EmpathyContactSearchPriv *priv;
+  SearchEntry *entry;
+
+  g_return_if_fail (EMPATHY_IS_CONTACT_SEARCH (search));
+  g_return_if_fail (EMPATHY_IS_CONTACT (contact));
+
+  priv = GET_PRIV (search);
+
+  if (g_hash_table_lookup (priv->entries, contact) != NULL)
+    return;
+
+  entry = g_slice_new0 (SearchEntry);
+  entry->contact = g_object_ref (contact);
+  search_entry_update_strings (entry);
+
+  g_hash_table_insert (priv->entries, contact, entry);
+  contact_search_index_entry (priv, entry, TRUE);
+
+  g_signal_connect (contact, "notify::name",
+      G_CALLBACK (contact_search_name_changed_cb), search);
+
+  contact_search_invalidate_cache (search);
+}
+
+/**
+ * empathy_contact_search_remove_contact:
+ * @search: an #EmpathyContactSearch
+ * @contact: an #EmpathyContact
+ *
+ * Removes @contact from the index.
+ */
+void
+empathy_contact_search_remove_contact (EmpathyContactSearch *search,
+    EmpathyContact *contact)
+{
+  EmpathyContactSearchPriv *priv;
+  SearchEntry *entry;
+
+  g_return_if_fail (EMPATHY_IS_CONTACT_SEARCH (search));
+  g_return_if_fail (EMPATHY_IS_CONTACT (contact));
+
+  priv = GET_PRIV (search);
+
+  entry = g_hash_table_lookup (priv->entries, contact);
+  if (entry == NULL)
+    return;
+
+  g_signal_handlers_disconnect_by_func (contact,
+      contact_search_name_changed_cb, search);
+
+  contact_search_index_entry (priv, entry, FALSE);
+  g_hash_table_remove (priv->entries, contact);
+
+  contact_search_invalidate_cache (search);
+}
+
+/**
+ * empathy_contact_search_query:
+ * @search: an #EmpathyContactSearch
+ * @key: the search key
+ * @max_results: the maximum number of contacts to return, or 0 for no limit
+ *
+ * Looks up the indexed contacts whose alias or identifier contains @key,
+ * ignoring case. Contacts are ranked with exact matches first, then
+ * contacts whose alias, one of the words of their alias, or their
+ * identifier starts with @key, and then the other matches; contacts with
+ * the same rank are sorted by alias.
+ *
+ * Returns: a #GList of references to the matching #EmpathyContact<!-- -->s,
+ * to be unreffed and freed by the caller
+ */
+GList *
+empathy_contact_search_query (EmpathyContactSearch *search,
+    const gchar *key,
+    guint max_results)
+{
+  EmpathyContactSearchPriv *priv;
+  GArray *result;
+  GList *contacts = NULL;
+  gchar *key_folded;
+  guint i;
+
+  g_return_val_if_fail (EMPATHY_IS_CONTACT_SEARCH (search), NULL);
+
+  priv = GET_PRIV (search);
+
+  key_folded = g_utf8_casefold (key != NULL ? key : "", -1);
+  result = g_array_new (FALSE, FALSE, sizeof (ScoredEntry));
+
+  contact_search_lookup (priv, key_folded, result);
+  g_array_sort (result, contact_search_compare_scored);
+
+  if (max_results == 0 || max_results > result->len)
+    max_results = result->len;
+
+  for (i = max_results; i > 0; i--)
+    {
+      ScoredEntry *scored = &g_array_index (result, ScoredEntry, i - 1);
+
+      contacts = g_list_prepend (contacts,
+          g_object_ref (scored->entry->contact));
+    }
+
+  g_array_free (result, TRUE);
+  g_free (key_folded);
+
+  return contacts;
+}
+
+/**
+ * empathy_contact_search_matches:
+ * @search: an #EmpathyContactSearch
+ * @contact: an #EmpathyContact
+ * @key: the search key
+ *
+ * Checks whether the alias or identifier of @contact contains @key,
+ * ignoring case. The matching set for @key is computed once and kept until
+ * a different key is asked for, so calling this function for every row of
+ * a view costs a hash lookup per row.
+ *
+ * Contacts which are not indexed by @search are matched directly.
+ *
+ * Returns: %TRUE if @contact matches @key
+ */
+gboolean
+empathy_contact_search_matches (EmpathyContactSearch *search,
+    EmpathyContact *contact,
+    const gchar *key)
+{
+  EmpathyContactSearchPriv *priv;
+
+  g_return_val_if_fail (EMPATHY_IS_CONTACT_SEARCH (search), FALSE);
+  g_return_val_if_fail (EMPATHY_IS_CONTACT (contact), FALSE);
+
+  priv = GET_PRIV (search);
+
+  if (EMP_STR_EMPTY (key))
+    return TRUE;
+
+  if (g_hash_table_lookup (priv->entries, contact) == NULL)
+    {
+      SearchEntry entry = { contact, NULL, NULL };
+      gchar *key_folded;
+      MatchScore score;
+
+      search_entry_update_strings (&entry);
+      key_folded = g_utf8_casefold (key, -1);
+      score = contact_search_score (&entry, key_folded);
+
+      g_free (key_folded);
+      g_free (entry.name);
+      g_free (entry.id);
+
+      return score != MATCH_NONE;
+    }
+
+  if (tp_strdiff (priv->cached_key, key))
+    {
+      GArray *result;
+      gchar *key_folded;
+      guint i;
+
+      contact_search_invalidate_cache (search);
+
+      key_folded = g_utf8_casefold (key, -1);
+      result = g_array_new (FALSE, FALSE, sizeof (ScoredEntry));
+      contact_search_lookup (priv, key_folded, result);
+
+      priv->cached_key = g_strdup (key);
+      priv->cached_matches = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+      for (i = 0; i < result->len; i++)
+        {
+          ScoredEntry *scored = &g_array_index (result, ScoredEntry, i);
+
+          g_hash_table_insert (priv->cached_matches,
+              scored->entry->contact, scored->entry->contact);
+        }
+
+      g_array_free (result, TRUE);
+      g_free (key_folded);
+    }
+
+  return g_hash_table_lookup (priv->cached_matches, contact) != NULL;
+}
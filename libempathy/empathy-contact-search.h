@@ -0,0 +1,73 @@
+/*
+ * empathy-contact-search.h - Header for EmpathyContactSearch
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_CONTACT_SEARCH_H__
+#define __EMPATHY_CONTACT_SEARCH_H__
+
+#include <glib-object.h>
+
+#include "empathy-contact.h"
+
+G_BEGIN_DECLS
+
+#define EMPATHY_TYPE_CONTACT_SEARCH empathy_contact_search_get_type()
+#define EMPATHY_CONTACT_SEARCH(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   EMPATHY_TYPE_CONTACT_SEARCH, EmpathyContactSearch))
+#define EMPATHY_CONTACT_SEARCH_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+   EMPATHY_TYPE_CONTACT_SEARCH, EmpathyContactSearchClass))
+#define EMPATHY_IS_CONTACT_SEARCH(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EMPATHY_TYPE_CONTACT_SEARCH))
+#define EMPATHY_IS_CONTACT_SEARCH_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), EMPATHY_TYPE_CONTACT_SEARCH))
+#define EMPATHY_CONTACT_SEARCH_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+   EMPATHY_TYPE_CONTACT_SEARCH, EmpathyContactSearchClass))
+
+typedef struct {
+  GObject parent;
+  gpointer priv;
+} EmpathyContactSearch;
+
+typedef struct {
+  GObjectClass parent_class;
+} EmpathyContactSearchClass;
+
+GType empathy_contact_search_get_type (void);
+
+/* public methods */
+EmpathyContactSearch * empathy_contact_search_dup_singleton (void);
+EmpathyContactSearch * empathy_contact_search_new (void);
+
+void empathy_contact_search_add_contact (EmpathyContactSearch *search,
+    EmpathyContact *contact);
+void empathy_contact_search_remove_contact (EmpathyContactSearch *search,
+    EmpathyContact *contact);
+
+GList * empathy_contact_search_query (EmpathyContactSearch *search,
+    const gchar *key,
+    guint max_results);
+gboolean empathy_contact_search_matches (EmpathyContactSearch *search,
+    EmpathyContact *contact,
+    const gchar *key);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_CONTACT_SEARCH_H__ */
@@ -29,8 +29,10 @@
 
 #include "empathy-contact.h"
 #include "empathy-account-manager.h"
+#include "empathy-avatar-cache.h"
 #include "empathy-utils.h"
 #include "empathy-enum-types.h"
+#include "empathy-footprint.h"
 #include "empathy-marshal.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_CONTACT
@@ -43,6 +45,8 @@ typedef struct {
   gchar *id;
   gchar *name;
   EmpathyAvatar *avatar;
+  /* Token of the avatar being loaded from the cache */
+  gchar *loading_avatar_token;
   TpConnectionPresenceType presence;
   gchar *presence_message;
   guint handle;
@@ -261,6 +265,7 @@ empathy_contact_init (EmpathyContact *contact)
     EMPATHY_TYPE_CONTACT, EmpathyContactPriv);
 
   contact->priv = priv;
+  EMPATHY_FOOTPRINT_TRACK (contact);
 
   priv->location = NULL;
 }
@@ -277,6 +282,7 @@ contact_finalize (GObject *object)
   g_free (priv->name);
   g_free (priv->id);
   g_free (priv->presence_message);
+  g_free (priv->loading_avatar_token);
 
   if (priv->avatar)
       empathy_avatar_unref (priv->avatar);
@@ -538,6 +544,10 @@ empathy_contact_set_avatar (EmpathyContact *contact,
 
   priv = GET_PRIV (contact);
 
+  /* A pending cache load must not override this one */
+  g_free (priv->loading_avatar_token);
+  priv->loading_avatar_token = NULL;
+
   if (priv->avatar == avatar)
     return;
 
@@ -825,41 +835,6 @@ empathy_contact_can_use_stream_tube (EmpathyContact *contact)
   return priv->capabilities & EMPATHY_CAPABILITIES_STREAM_TUBE;
 }
 
-static gchar *
-contact_get_avatar_filename (EmpathyContact *contact,
-                             const gchar *token)
-{
-  EmpathyAccount *account;
-  gchar *avatar_path;
-  gchar *avatar_file;
-  gchar *token_escaped;
-  gchar *contact_escaped;
-
-  if (EMP_STR_EMPTY (empathy_contact_get_id (contact)))
-    return NULL;
-
-  contact_escaped = tp_escape_as_identifier (empathy_contact_get_id (contact));
-  token_escaped = tp_escape_as_identifier (token);
-  account = empathy_contact_get_account (contact);
-
-  /* FIXME: Do not use the account, but proto/cm instead */
-  avatar_path = g_build_filename (g_get_user_cache_dir (),
-      PACKAGE_NAME,
-      "avatars",
-      empathy_account_get_unique_name (account),
-      contact_escaped,
-      NULL);
-  g_mkdir_with_parents (avatar_path, 0700);
-
-  avatar_file = g_build_filename (avatar_path, token_escaped, NULL);
-
-  g_free (contact_escaped);
-  g_free (token_escaped);
-  g_free (avatar_path);
-
-  return avatar_file;
-}
-
 void
 empathy_contact_load_avatar_data (EmpathyContact *contact,
                                   const guchar *data,
@@ -867,9 +842,8 @@ empathy_contact_load_avatar_data (EmpathyContact *contact,
                                   const gchar *format,
                                   const gchar *token)
 {
+  EmpathyAvatarCache *cache;
   EmpathyAvatar *avatar;
-  gchar *filename;
-  GError *error = NULL;
 
   g_return_if_fail (EMPATHY_IS_CONTACT (contact));
   g_return_if_fail (data != NULL);
@@ -877,61 +851,71 @@ empathy_contact_load_avatar_data (EmpathyContact *contact,
   g_return_if_fail (format != NULL);
   g_return_if_fail (!EMP_STR_EMPTY (token));
 
-  /* Load and set the avatar */
-  filename = contact_get_avatar_filename (contact, token);
-  avatar = empathy_avatar_new (g_memdup (data, len), len, g_strdup (format),
-      g_strdup (token), filename);
+  /* Load and set the avatar, the cache saves it in the background */
+  cache = empathy_avatar_cache_dup_singleton ();
+  avatar = empathy_avatar_cache_add (cache, data, len, format, token);
   empathy_contact_set_avatar (contact, avatar);
   empathy_avatar_unref (avatar);
+  g_object_unref (cache);
+}
 
-  /* Save to cache if not yet in it */
-  if (filename && !g_file_test (filename, G_FILE_TEST_EXISTS))
-    {
-      if (!empathy_avatar_save_to_file (avatar, filename, &error))
-        {
-          DEBUG ("Failed to save avatar in cache: %s",
-            error ? error->message : "No error given");
-          g_clear_error (&error);
-        }
-      else
-          DEBUG ("Avatar saved to %s", filename);
-    }
+static void
+contact_avatar_cache_loaded_cb (EmpathyAvatar *avatar,
+                                gpointer user_data)
+{
+  EmpathyContact *contact = user_data;
+  EmpathyContactPriv *priv = GET_PRIV (contact);
+
+  if (avatar != NULL && priv->loading_avatar_token != NULL &&
+      !tp_strdiff (priv->loading_avatar_token, avatar->token))
+    empathy_contact_set_avatar (contact, avatar);
+
+  g_object_unref (contact);
 }
 
+/**
+ * empathy_contact_load_avatar_cache:
+ * @contact: an #EmpathyContact
+ * @token: the token of the avatar
+ *
+ * Sets the avatar of @contact from the avatar cache. If the avatar is not
+ * in memory, it is loaded asynchronously and set once read, unless another
+ * avatar has been set in the meantime.
+ *
+ * Returns: %TRUE if the avatar was in memory and has been set
+ */
 gboolean
 empathy_contact_load_avatar_cache (EmpathyContact *contact,
                                    const gchar *token)
 {
-  EmpathyAvatar *avatar = NULL;
-  gchar *filename;
-  gchar *data = NULL;
-  gsize len;
-  GError *error = NULL;
+  EmpathyContactPriv *priv;
+  EmpathyAvatarCache *cache;
+  EmpathyAvatar *avatar;
 
   g_return_val_if_fail (EMPATHY_IS_CONTACT (contact), FALSE);
   g_return_val_if_fail (!EMP_STR_EMPTY (token), FALSE);
 
-  /* Load the avatar from file if it exists */
-  filename = contact_get_avatar_filename (contact, token);
-  if (filename && g_file_test (filename, G_FILE_TEST_EXISTS))
-    {
-      if (!g_file_get_contents (filename, &data, &len, &error))
-        {
-          DEBUG ("Failed to load avatar from cache: %s",
-            error ? error->message : "No error given");
-          g_clear_error (&error);
-        }
-    }
+  priv = GET_PRIV (contact);
+  cache = empathy_avatar_cache_dup_singleton ();
 
-  if (data)
+  avatar = empathy_avatar_cache_lookup (cache, token);
+  if (avatar != NULL)
     {
-      DEBUG ("Avatar loaded from %s", filename);
-      avatar = empathy_avatar_new (data, len, NULL, g_strdup (token), filename);
       empathy_contact_set_avatar (contact, avatar);
       empathy_avatar_unref (avatar);
     }
+  else
+    {
+      g_free (priv->loading_avatar_token);
+      priv->loading_avatar_token = g_strdup (token);
+
+      empathy_avatar_cache_load_async (cache, token,
+          contact_avatar_cache_loaded_cb, g_object_ref (contact));
+    }
 
-  return data != NULL;
+  g_object_unref (cache);
+
+  return avatar != NULL;
 }
 
 GType
@@ -979,6 +963,8 @@ empathy_avatar_new (guchar *data,
   avatar->filename = filename;
   avatar->refcount = 1;
 
+  EMPATHY_FOOTPRINT_ADD ("avatar", 1, len);
+
   return avatar;
 }
 
@@ -990,9 +976,11 @@ empathy_avatar_unref (EmpathyAvatar *avatar)
   avatar->refcount--;
   if (avatar->refcount == 0)
     {
+      EMPATHY_FOOTPRINT_ADD ("avatar", -1, -(gssize) avatar->len);
       g_free (avatar->data);
       g_free (avatar->format);
       g_free (avatar->token);
+      g_free (avatar->filename);
       g_slice_free (EmpathyAvatar, avatar);
     }
 }
@@ -35,9 +35,12 @@
 
 #include "empathy-debugger.h"
 
+guint empathy_debug_active_flags = 0;
+
 #ifdef ENABLE_DEBUG
 
 static EmpathyDebugFlags flags = 0;
+static gboolean listening = FALSE;
 
 static GDebugKey keys[] = {
   { "Tp", EMPATHY_DEBUG_TP },
@@ -52,10 +55,26 @@ static GDebugKey keys[] = {
   { 0, }
 };
 
+static void
+debug_update_active_flags (void)
+{
+  empathy_debug_active_flags = listening ? G_MAXUINT : flags;
+}
+
 static void
 debug_set_flags (EmpathyDebugFlags new_flags)
 {
   flags |= new_flags;
+  debug_update_active_flags ();
+}
+
+/* Called by the debugger when a client starts or stops listening, everything
+ * has to be logged while somebody is */
+void
+empathy_debug_set_listening (gboolean new_listening)
+{
+  listening = new_listening;
+  debug_update_active_flags ();
 }
 
 void
@@ -77,69 +96,63 @@ empathy_debug_flag_is_set (EmpathyDebugFlags flag)
   return (flag & flags) != 0;
 }
 
-GHashTable *flag_to_keys = NULL;
+static GHashTable *flag_to_domains = NULL;
 
+/* Returns the interned "empathy/<key>" domain of the flag */
 static const gchar *
-debug_flag_to_key (EmpathyDebugFlags flag)
+debug_flag_to_domain (EmpathyDebugFlags flag)
 {
-  if (flag_to_keys == NULL)
+  if (G_UNLIKELY (flag_to_domains == NULL))
     {
       guint i;
 
-      flag_to_keys = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-          NULL, g_free);
+      flag_to_domains = g_hash_table_new (g_direct_hash, g_direct_equal);
 
       for (i = 0; keys[i].value; i++)
         {
           GDebugKey key = (GDebugKey) keys[i];
-          g_hash_table_insert (flag_to_keys, GUINT_TO_POINTER (key.value),
-              g_strdup (key.key));
+          gchar *domain;
+
+          domain = g_strdup_printf ("%s/%s", G_LOG_DOMAIN, key.key);
+          g_hash_table_insert (flag_to_domains, GUINT_TO_POINTER (key.value),
+              (gpointer) g_intern_string (domain));
+          g_free (domain);
         }
     }
 
-  return g_hash_table_lookup (flag_to_keys, GUINT_TO_POINTER (flag));
+  return g_hash_table_lookup (flag_to_domains, GUINT_TO_POINTER (flag));
 }
 
 void
 empathy_debug_free (void)
 {
-  if (flag_to_keys == NULL)
+  if (flag_to_domains == NULL)
     return;
 
-  g_hash_table_destroy (flag_to_keys);
-  flag_to_keys = NULL;
-}
-
-static void
-log_to_debugger (EmpathyDebugFlags flag,
-    const gchar *message)
-{
-  EmpathyDebugger *dbg = empathy_debugger_get_singleton ();
-  gchar *domain;
-  GTimeVal now;
-
-  g_get_current_time (&now);
-
-  domain = g_strdup_printf ("%s/%s", G_LOG_DOMAIN, debug_flag_to_key (flag));
-
-  empathy_debugger_add_message (dbg, &now, domain, G_LOG_LEVEL_DEBUG, message);
-
-  g_free (domain);
+  g_hash_table_destroy (flag_to_domains);
+  flag_to_domains = NULL;
 }
 
+/* The message is formatted right away, even when only the debugger wants
+ * it: the arguments often point to strings which don't outlive the call, so
+ * formatting can't wait until a client calls GetMessages. */
 void
 empathy_debug (EmpathyDebugFlags flag,
     const gchar *format,
     ...)
 {
+  EmpathyDebugger *dbg = empathy_debugger_get_singleton ();
   gchar *message;
+  GTimeVal now;
   va_list args;
 
   va_start (args, format);
   message = g_strdup_vprintf (format, args);
   va_end (args);
 
-  log_to_debugger (flag, message);
+  g_get_current_time (&now);
+  empathy_debugger_add_message (dbg, &now, debug_flag_to_domain (flag),
+      G_LOG_LEVEL_DEBUG, message);
 
   if (flag & flags)
     g_log (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, "%s", message);
@@ -165,5 +178,10 @@ empathy_debug_set_flags (const gchar *flags_string)
 {
 }
 
+void
+empathy_debug_set_listening (gboolean listening)
+{
+}
+
 #endif /* ENABLE_DEBUG */
 
@@ -43,11 +43,17 @@ typedef enum
   EMPATHY_DEBUG_OTHER = 1 << 9,
 } EmpathyDebugFlags;
 
+/* Flags for which empathy_debug() has something to do, either because they
+ * are in EMPATHY_DEBUG or because a debugger is listening. Only the DEBUG
+ * macro should need it, so disabled messages cost a single test. */
+extern guint empathy_debug_active_flags;
+
 gboolean empathy_debug_flag_is_set (EmpathyDebugFlags flag);
 void empathy_debug (EmpathyDebugFlags flag, const gchar *format, ...)
     G_GNUC_PRINTF (2, 3);
 void empathy_debug_free (void);
 void empathy_debug_set_flags (const gchar *flags_string);
+void empathy_debug_set_listening (gboolean listening);
 G_END_DECLS
 
 #endif /* __EMPATHY_DEBUG_H__ */
@@ -75,7 +81,10 @@ G_END_DECLS
 
 #undef DEBUG
 #define DEBUG(format, ...) \
-  empathy_debug (DEBUG_FLAG, "%s: " format, G_STRFUNC, ##__VA_ARGS__)
+  G_STMT_START { \
+    if (G_UNLIKELY (empathy_debug_active_flags & DEBUG_FLAG)) \
+      empathy_debug (DEBUG_FLAG, "%s: " format, G_STRFUNC, ##__VA_ARGS__); \
+  } G_STMT_END
 
 #undef DEBUGGING
 #define DEBUGGING empathy_debug_flag_is_set (DEBUG_FLAG)
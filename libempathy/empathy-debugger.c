@@ -20,14 +20,22 @@
 #include "empathy-debugger.h"
 #include "config.h"
 
+#include <string.h>
+
 #include <telepathy-glib/dbus.h>
+#include <telepathy-glib/errors.h>
 
 #include "extensions/extensions.h"
 
+#include "empathy-debug.h"
+#include "empathy-footprint.h"
+
 static EmpathyDebugger *singleton = NULL;
 
 static void
 debug_iface_init (gpointer g_iface, gpointer iface_data);
+static void
+debugger_free_messages (GPtrArray *messages);
 
 G_DEFINE_TYPE_WITH_CODE (EmpathyDebugger, empathy_debugger, G_TYPE_OBJECT,
     G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
@@ -38,6 +46,7 @@ G_DEFINE_TYPE_WITH_CODE (EmpathyDebugger, empathy_debugger, G_TYPE_OBJECT,
 enum
 {
   PROP_ENABLED = 1,
+  PROP_BATCH_MESSAGES,
   NUM_PROPERTIES
 };
 
@@ -61,28 +70,22 @@ log_level_flags_to_debug_level (GLogLevelFlags level)
     return EMP_DEBUG_LEVEL_DEBUG;
 }
 
-static EmpathyDebugMessage *
-debug_message_new (GTimeVal *timestamp,
-    const gchar *domain,
-    GLogLevelFlags level,
-    const gchar *string)
+static EmpathyDebugLatency *
+debug_latency_new (const gchar *category,
+    const gchar *stage)
 {
-  EmpathyDebugMessage *msg;
+  EmpathyDebugLatency *latency;
 
-  msg = g_slice_new0 (EmpathyDebugMessage);
-  msg->timestamp = timestamp->tv_sec + timestamp->tv_usec / 1e6;
-  msg->domain = g_strdup (domain);
-  msg->level = log_level_flags_to_debug_level (level);
-  msg->string = g_strdup (string);
-  return msg;
+  latency = g_slice_new0 (EmpathyDebugLatency);
+  latency->category = category;
+  latency->stage = stage;
+  return latency;
 }
 
 static void
-debug_message_free (EmpathyDebugMessage *msg)
+debug_latency_free (EmpathyDebugLatency *latency)
 {
-  g_free (msg->domain);
-  g_free (msg->string);
-  g_slice_free (EmpathyDebugMessage, msg);
+  g_slice_free (EmpathyDebugLatency, latency);
 }
 
 static void
@@ -99,6 +102,10 @@ empathy_debugger_get_property (GObject *object,
         g_value_set_boolean (value, self->enabled);
         break;
 
+      case PROP_BATCH_MESSAGES:
+        g_value_set_boolean (value, self->batch_messages);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -115,7 +122,18 @@ empathy_debugger_set_property (GObject *object,
   switch (property_id)
     {
       case PROP_ENABLED:
+        g_static_mutex_lock (&self->lock);
         self->enabled = g_value_get_boolean (value);
+
+        /* Listeners got the older messages from GetMessages */
+        self->flushed_message = self->next_message;
+        g_static_mutex_unlock (&self->lock);
+
+        empathy_debug_set_listening (self->enabled);
+        break;
+
+      case PROP_BATCH_MESSAGES:
+        self->batch_messages = g_value_get_boolean (value);
         break;
 
      default:
@@ -127,11 +145,25 @@ static void
 empathy_debugger_finalize (GObject *object)
 {
   EmpathyDebugger *self = EMPATHY_DEBUGGER (object);
+  guint i;
+
+  if (self->flush_id != 0)
+    g_source_remove (self->flush_id);
+
+  for (i = 0; i < DEBUG_MESSAGE_LIMIT; i++)
+    g_free (self->messages[i].string);
 
-  g_queue_foreach (self->messages, (GFunc) debug_message_free, NULL);
-  g_queue_free (self->messages);
+  g_free (self->messages);
   self->messages = NULL;
 
+  debugger_free_messages (self->overflow);
+  self->overflow = NULL;
+
+  g_static_mutex_free (&self->lock);
+
+  g_hash_table_destroy (self->latencies);
+  self->latencies = NULL;
+
   G_OBJECT_CLASS (empathy_debugger_parent_class)->finalize (object);
 }
 
@@ -141,6 +173,7 @@ empathy_debugger_class_init (EmpathyDebuggerClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   static TpDBusPropertiesMixinPropImpl debug_props[] = {
       { "Enabled", "enabled", "enabled" },
+      { "BatchMessages", "batch-messages", "batch-messages" },
       { NULL }
   };
   static TpDBusPropertiesMixinIfaceImpl prop_interfaces[] = {
@@ -162,53 +195,344 @@ empathy_debugger_class_init (EmpathyDebuggerClass *klass)
           FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_BATCH_MESSAGES,
+      g_param_spec_boolean ("batch-messages", "Batch messages?",
+          "True if new messages are sent with the new-debug-messages "
+          "signal instead of new-debug-message.",
+          FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   klass->dbus_props_class.interfaces = prop_interfaces;
   tp_dbus_properties_mixin_class_init (object_class,
       G_STRUCT_OFFSET (EmpathyDebuggerClass, dbus_props_class));
 }
 
+static GType
+debug_message_get_struct_type (void)
+{
+  static GType struct_type = 0;
+
+  if (G_UNLIKELY (struct_type == 0))
+    {
+      struct_type = dbus_g_type_get_struct (
+          "GValueArray", G_TYPE_DOUBLE, G_TYPE_STRING, G_TYPE_UINT,
+          G_TYPE_STRING, G_TYPE_INVALID);
+    }
+
+  return struct_type;
+}
+
+static GValueArray *
+debug_message_to_struct (EmpathyDebugMessage *message)
+{
+  GType struct_type = debug_message_get_struct_type ();
+  GValue gvalue = { 0 };
+
+  g_value_init (&gvalue, struct_type);
+  g_value_take_boxed (&gvalue,
+      dbus_g_type_specialized_construct (struct_type));
+  dbus_g_type_struct_set (&gvalue,
+      0, message->timestamp,
+      1, message->domain,
+      2, message->level,
+      3, message->string,
+      G_MAXUINT);
+
+  return g_value_get_boxed (&gvalue);
+}
+
+/* Appends the messages written at positions [start, end) which are still in
+ * the ring to @messages, as D-Bus structs. Must be called with the lock
+ * held. */
+static void
+debugger_dup_messages (EmpathyDebugger *self,
+    GPtrArray *messages,
+    guint start,
+    guint end)
+{
+  guint i;
+
+  if (end - start > DEBUG_MESSAGE_LIMIT)
+    start = end - DEBUG_MESSAGE_LIMIT;
+
+  for (i = start; i != end; i++)
+    g_ptr_array_add (messages,
+        debug_message_to_struct (self->messages + i % DEBUG_MESSAGE_LIMIT));
+}
+
+static void
+debugger_free_messages (GPtrArray *messages)
+{
+  GType struct_type = debug_message_get_struct_type ();
+  guint i;
+
+  for (i = 0; i < messages->len; i++)
+    g_boxed_free (struct_type, messages->pdata[i]);
+
+  g_ptr_array_free (messages, TRUE);
+}
+
+/* Runs in the main loop: messages can be logged from any thread, but the
+ * D-Bus signals are only ever emitted from here */
+static gboolean
+debugger_flush_cb (gpointer user_data)
+{
+  EmpathyDebugger *self = EMPATHY_DEBUGGER (user_data);
+  GPtrArray *messages;
+  guint i;
+
+  g_static_mutex_lock (&self->lock);
+
+  /* Messages written from now on need a new flush */
+  self->flush_id = 0;
+  self->flush_early = FALSE;
+
+  messages = self->overflow;
+  self->overflow = g_ptr_array_new ();
+
+  if (self->enabled)
+    debugger_dup_messages (self, messages, self->flushed_message,
+        self->next_message);
+
+  self->flushed_message = self->next_message;
+
+  g_static_mutex_unlock (&self->lock);
+
+  if (!self->enabled || messages->len == 0)
+    {
+      debugger_free_messages (messages);
+      return FALSE;
+    }
+
+  if (self->batch_messages)
+    {
+      emp_svc_debug_emit_new_debug_messages (self, messages);
+    }
+  else
+    {
+      for (i = 0; i < messages->len; i++)
+        {
+          GValueArray *values = g_ptr_array_index (messages, i);
+
+          emp_svc_debug_emit_new_debug_message (self,
+              g_value_get_double (g_value_array_get_nth (values, 0)),
+              g_value_get_string (g_value_array_get_nth (values, 1)),
+              g_value_get_uint (g_value_array_get_nth (values, 2)),
+              g_value_get_string (g_value_array_get_nth (values, 3)));
+        }
+    }
+
+  debugger_free_messages (messages);
+
+  return FALSE;
+}
+
 static void
 get_messages (EmpSvcDebug *self,
     DBusGMethodInvocation *context)
 {
   EmpathyDebugger *dbg = EMPATHY_DEBUGGER (self);
   GPtrArray *messages;
+
+  messages = g_ptr_array_new ();
+
+  g_static_mutex_lock (&dbg->lock);
+  debugger_dup_messages (dbg, messages, 0, dbg->next_message);
+  g_static_mutex_unlock (&dbg->lock);
+
+  emp_svc_debug_return_from_get_messages (context, messages);
+
+  debugger_free_messages (messages);
+}
+
+static void
+get_latencies (EmpSvcDebug *self,
+    DBusGMethodInvocation *context)
+{
+  EmpathyDebugger *dbg = EMPATHY_DEBUGGER (self);
+  GPtrArray *latencies;
   static GType struct_type = 0;
-  GList *i;
+  GHashTableIter i;
+  gpointer stages;
   guint j;
 
   if (G_UNLIKELY (struct_type == 0))
     {
       struct_type = dbus_g_type_get_struct (
-          "GValueArray", G_TYPE_DOUBLE, G_TYPE_STRING, G_TYPE_UINT,
-          G_TYPE_STRING, G_TYPE_INVALID);
+          "GValueArray", G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT,
+          G_TYPE_UINT64, G_TYPE_UINT64, DBUS_TYPE_G_UINT_ARRAY,
+          G_TYPE_INVALID);
+    }
+
+  latencies = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&i, dbg->latencies);
+  while (g_hash_table_iter_next (&i, NULL, &stages))
+    {
+      GHashTableIter k;
+      gpointer value;
+
+      g_hash_table_iter_init (&k, stages);
+      while (g_hash_table_iter_next (&k, NULL, &value))
+        {
+          EmpathyDebugLatency *latency = (EmpathyDebugLatency *) value;
+          GValue gvalue = { 0 };
+          GArray *buckets;
+
+          buckets = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+              DEBUG_LATENCY_BUCKETS);
+          g_array_append_vals (buckets, latency->buckets,
+              DEBUG_LATENCY_BUCKETS);
+
+          g_value_init (&gvalue, struct_type);
+          g_value_take_boxed (&gvalue,
+              dbus_g_type_specialized_construct (struct_type));
+          dbus_g_type_struct_set (&gvalue,
+              0, latency->category,
+              1, latency->stage,
+              2, latency->count,
+              3, latency->total,
+              4, latency->max,
+              5, buckets,
+              G_MAXUINT);
+          g_ptr_array_add (latencies, g_value_get_boxed (&gvalue));
+
+          g_array_free (buckets, TRUE);
+        }
     }
 
-  messages = g_ptr_array_sized_new (g_queue_get_length (dbg->messages));
+  emp_svc_debug_return_from_get_latencies (context, latencies);
+
+  for (j = 0; j < latencies->len; j++)
+    g_boxed_free (struct_type, latencies->pdata[j]);
+
+  g_ptr_array_free (latencies, TRUE);
+}
+
+static GValueArray *
+footprint_entry_new (GType struct_type,
+    const EmpathyFootprintEntry *entry)
+{
+  GValue gvalue = { 0 };
+
+  g_value_init (&gvalue, struct_type);
+  g_value_take_boxed (&gvalue,
+      dbus_g_type_specialized_construct (struct_type));
+  dbus_g_type_struct_set (&gvalue,
+      0, entry->name,
+      1, entry->live,
+      2, entry->total,
+      3, entry->bytes,
+      G_MAXUINT);
+
+  return g_value_get_boxed (&gvalue);
+}
+
+static void
+get_footprint (EmpSvcDebug *self,
+    DBusGMethodInvocation *context)
+{
+  EmpathyDebugger *dbg = EMPATHY_DEBUGGER (self);
+  EmpathyFootprintEntry ring;
+  GPtrArray *footprint;
+  GArray *entries;
+  static GType struct_type = 0;
+  guint i;
+
+  if (!empathy_footprint_enabled)
+    {
+      GError error = { TP_ERRORS, TP_ERROR_NOT_AVAILABLE,
+          "Memory accounting is disabled, set EMPATHY_FOOTPRINT" };
+
+      dbus_g_method_return_error (context, &error);
+      return;
+    }
 
-  for (i = dbg->messages->head; i; i = i->next)
+  if (G_UNLIKELY (struct_type == 0))
     {
+      struct_type = dbus_g_type_get_struct (
+          "GValueArray", G_TYPE_STRING, G_TYPE_UINT, G_TYPE_UINT64,
+          G_TYPE_UINT64, G_TYPE_INVALID);
+    }
+
+  entries = empathy_footprint_dup_entries ();
+  footprint = g_ptr_array_sized_new (entries->len + 1);
+
+  for (i = 0; i < entries->len; i++)
+    g_ptr_array_add (footprint, footprint_entry_new (struct_type,
+        &g_array_index (entries, EmpathyFootprintEntry, i)));
+
+  /* The ring is allocated once, only the texts of the messages change */
+  g_static_mutex_lock (&dbg->lock);
+  ring.name = "debug-messages";
+  ring.total = dbg->next_message;
+  ring.live = MIN (ring.total, DEBUG_MESSAGE_LIMIT);
+  ring.bytes = DEBUG_MESSAGE_LIMIT * sizeof (EmpathyDebugMessage) +
+      dbg->string_bytes;
+  g_static_mutex_unlock (&dbg->lock);
+  g_ptr_array_add (footprint, footprint_entry_new (struct_type, &ring));
+
+  emp_svc_debug_return_from_get_footprint (context, footprint);
+
+  for (i = 0; i < footprint->len; i++)
+    g_boxed_free (struct_type, footprint->pdata[i]);
+
+  g_ptr_array_free (footprint, TRUE);
+  g_array_free (entries, TRUE);
+}
+
+static void
+get_footprint_history (EmpSvcDebug *self,
+    DBusGMethodInvocation *context)
+{
+  GPtrArray *history;
+  GArray *snapshots;
+  static GType struct_type = 0;
+  guint i;
+
+  if (!empathy_footprint_enabled)
+    {
+      GError error = { TP_ERRORS, TP_ERROR_NOT_AVAILABLE,
+          "Memory accounting is disabled, set EMPATHY_FOOTPRINT" };
+
+      dbus_g_method_return_error (context, &error);
+      return;
+    }
+
+  if (G_UNLIKELY (struct_type == 0))
+    {
+      struct_type = dbus_g_type_get_struct (
+          "GValueArray", G_TYPE_DOUBLE, G_TYPE_UINT64, G_TYPE_UINT64,
+          G_TYPE_INVALID);
+    }
+
+  snapshots = empathy_footprint_dup_snapshots ();
+  history = g_ptr_array_sized_new (snapshots->len);
+
+  for (i = 0; i < snapshots->len; i++)
+    {
+      EmpathyFootprintSnapshot *snapshot = &g_array_index (snapshots,
+          EmpathyFootprintSnapshot, i);
       GValue gvalue = { 0 };
-      EmpathyDebugMessage *message = (EmpathyDebugMessage *) i->data;
 
       g_value_init (&gvalue, struct_type);
       g_value_take_boxed (&gvalue,
           dbus_g_type_specialized_construct (struct_type));
       dbus_g_type_struct_set (&gvalue,
-          0, message->timestamp,
-          1, message->domain,
-          2, message->level,
-          3, message->string,
+          0, snapshot->timestamp,
+          1, snapshot->rss,
+          2, snapshot->accounted,
           G_MAXUINT);
-      g_ptr_array_add (messages, g_value_get_boxed (&gvalue));
+      g_ptr_array_add (history, g_value_get_boxed (&gvalue));
     }
 
-  emp_svc_debug_return_from_get_messages (context, messages);
+  emp_svc_debug_return_from_get_footprint_history (context, history);
 
-  for (j = 0; j < messages->len; j++)
-    g_boxed_free (struct_type, messages->pdata[j]);
+  for (i = 0; i < history->len; i++)
+    g_boxed_free (struct_type, history->pdata[i]);
 
-  g_ptr_array_free (messages, TRUE);
+  g_ptr_array_free (history, TRUE);
+  g_array_free (snapshots, TRUE);
 }
 
 static void
@@ -218,12 +542,20 @@ debug_iface_init (gpointer g_iface,
   EmpSvcDebugClass *klass = (EmpSvcDebugClass *) g_iface;
 
   emp_svc_debug_implement_get_messages (klass, get_messages);
+  emp_svc_debug_implement_get_latencies (klass, get_latencies);
+  emp_svc_debug_implement_get_footprint (klass, get_footprint);
+  emp_svc_debug_implement_get_footprint_history (klass,
+      get_footprint_history);
 }
 
 static void
 empathy_debugger_init (EmpathyDebugger *self)
 {
-  self->messages = g_queue_new ();
+  g_static_mutex_init (&self->lock);
+  self->messages = g_new0 (EmpathyDebugMessage, DEBUG_MESSAGE_LIMIT);
+  self->overflow = g_ptr_array_new ();
+  self->latencies = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) g_hash_table_destroy);
 }
 
 EmpathyDebugger *
@@ -249,22 +581,99 @@ empathy_debugger_add_message (EmpathyDebugger *self,
     GLogLevelFlags level,
     const gchar *string)
 {
-  EmpathyDebugMessage *new_msg;
+  EmpathyDebugMessage *msg;
+  gchar *old_string;
 
-  if (g_queue_get_length (self->messages) >= DEBUG_MESSAGE_LIMIT)
-    {
-      EmpathyDebugMessage *old_head =
-        (EmpathyDebugMessage *) g_queue_pop_head (self->messages);
+  g_static_mutex_lock (&self->lock);
+
+  msg = self->messages + self->next_message % DEBUG_MESSAGE_LIMIT;
 
-      debug_message_free (old_head);
+  /* The record still holds a message listeners haven't been sent: keep it
+   * aside for the next flush, and have that flush run as soon as the main
+   * loop gets to it */
+  if (self->enabled &&
+      self->next_message - self->flushed_message >= DEBUG_MESSAGE_LIMIT)
+    {
+      g_ptr_array_add (self->overflow, debug_message_to_struct (msg));
+      self->flushed_message++;
+
+      if (!self->flush_early)
+        {
+          if (self->flush_id != 0)
+            g_source_remove (self->flush_id);
+
+          self->flush_id = g_idle_add_full (G_PRIORITY_HIGH,
+              debugger_flush_cb, self, NULL);
+          self->flush_early = TRUE;
+        }
     }
 
-  new_msg = debug_message_new (timestamp, domain, level, string);
-  g_queue_push_tail (self->messages, new_msg);
+  self->next_message++;
 
-  if (self->enabled)
+  old_string = msg->string;
+  if (old_string != NULL)
+    self->string_bytes -= strlen (old_string) + 1;
+
+  msg->timestamp = timestamp->tv_sec + timestamp->tv_usec / 1e6;
+  msg->domain = g_intern_string (domain);
+  msg->level = log_level_flags_to_debug_level (level);
+  msg->string = g_strdup (string);
+  self->string_bytes += strlen (string) + 1;
+
+  /* Listeners get the new messages at most every DEBUG_FLUSH_INTERVAL ms,
+   * batched if they asked for it, so a chatty service doesn't flood the
+   * bus. The flush runs in the main loop whichever thread logged the
+   * message. */
+  if (self->enabled && self->flush_id == 0)
+    self->flush_id = g_timeout_add (DEBUG_FLUSH_INTERVAL, debugger_flush_cb,
+        self);
+
+  g_static_mutex_unlock (&self->lock);
+
+  g_free (old_string);
+}
+
+void
+empathy_debugger_add_latency (EmpathyDebugger *self,
+    const gchar *category,
+    const gchar *stage,
+    gint64 usec)
+{
+  GHashTable *stages;
+  EmpathyDebugLatency *latency;
+  guint64 msec;
+  guint bucket;
+
+  /* Categories and stages are a handful of fixed strings, so interning them
+   * keeps the lookups down to pointer comparisons */
+  category = g_intern_string (category);
+  stage = g_intern_string (stage);
+
+  stages = g_hash_table_lookup (self->latencies, category);
+  if (stages == NULL)
     {
-      emp_svc_debug_emit_new_debug_message (self, new_msg->timestamp,
-          domain, new_msg->level, string);
+      stages = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+          NULL, (GDestroyNotify) debug_latency_free);
+      g_hash_table_insert (self->latencies, (gpointer) category, stages);
     }
+
+  latency = g_hash_table_lookup (stages, stage);
+  if (latency == NULL)
+    {
+      latency = debug_latency_new (category, stage);
+      g_hash_table_insert (stages, (gpointer) stage, latency);
+    }
+
+  usec = MAX (usec, 0);
+  msec = usec / 1000;
+  if (msec == 0)
+    bucket = 0;
+  else
+    bucket = MIN (g_bit_storage ((gulong) MIN (msec, G_MAXULONG)),
+        DEBUG_LATENCY_BUCKETS - 1);
+
+  latency->count++;
+  latency->total += usec;
+  latency->max = MAX (latency->max, (guint64) usec);
+  latency->buckets[bucket]++;
 }
@@ -46,24 +46,60 @@ G_BEGIN_DECLS
 #define EMPATHY_DEBUGGER_GET_CLASS(obj) \
   (G_TYPE_INSTANCE_GET_CLASS ((obj), EMPATHY_TYPE_DEBUGGER, EmpathyDebuggerClass))
 
-/* On the basis that messages are around 60 bytes on average, and that 50kb is
- * a reasonable maximum size for a frame buffer.
+/* Messages are kept in a ring of records which is allocated once. The text
+ * is kept in full, so each message costs one allocation, freed when its
+ * record is reused; cutting messages to a fixed size lost the end of the
+ * long ones, which are often the interesting ones.
  */
 
-#define DEBUG_MESSAGE_LIMIT 800
+#define DEBUG_MESSAGE_LIMIT 512
+
+/* How often new messages are sent while somebody listens, in ms */
+#define DEBUG_FLUSH_INTERVAL 100
+
+/* Latency histograms have one bucket for everything under a millisecond, then
+ * one per power of two milliseconds up to ~16s.
+ */
+
+#define DEBUG_LATENCY_BUCKETS 16
 
 typedef struct {
   gdouble timestamp;
-  gchar *domain;
+  /* interned */
+  const gchar *domain;
   EmpDebugLevel level;
   gchar *string;
 } EmpathyDebugMessage;
 
+typedef struct {
+  const gchar *category;
+  const gchar *stage;
+  guint count;
+  guint64 total;
+  guint64 max;
+  guint buckets[DEBUG_LATENCY_BUCKETS];
+} EmpathyDebugLatency;
+
 typedef struct {
   GObject parent;
 
   gboolean enabled;
-  GQueue *messages;
+  gboolean batch_messages;
+  /* messages are logged from any thread, the lock protects the ring and
+   * the flush state */
+  GStaticMutex lock;
+  EmpathyDebugMessage *messages;
+  guint next_message;
+  gsize string_bytes;
+  /* position of the first message listeners haven't been sent yet */
+  guint flushed_message;
+  /* D-Bus structs of the messages listeners haven't been sent yet which
+   * were pushed out of the ring */
+  GPtrArray *overflow;
+  guint flush_id;
+  gboolean flush_early;
+  /* interned category -> (interned stage -> EmpathyDebugLatency) */
+  GHashTable *latencies;
 } EmpathyDebugger;
 
 typedef struct {
@@ -83,6 +119,12 @@ empathy_debugger_add_message (EmpathyDebugger *self,
     GLogLevelFlags level,
     const gchar *string);
 
+void
+empathy_debugger_add_latency (EmpathyDebugger *self,
+    const gchar *category,
+    const gchar *stage,
+    gint64 usec);
+
 G_END_DECLS
 
 #endif /* _EMPATHY_DEBUGGER */
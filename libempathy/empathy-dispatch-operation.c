@@ -25,11 +25,14 @@
 #include <telepathy-glib/interfaces.h>
 
 #include "empathy-dispatch-operation.h"
+#include <libempathy/empathy-debugger.h>
 #include <libempathy/empathy-enum-types.h>
+#include <libempathy/empathy-footprint.h>
 #include <libempathy/empathy-tp-contact-factory.h>
 #include <libempathy/empathy-tp-chat.h>
 #include <libempathy/empathy-tp-call.h>
 #include <libempathy/empathy-tp-file.h>
+#include <libempathy/empathy-time.h>
 
 #include "empathy-marshal.h"
 
@@ -88,6 +91,9 @@ struct _EmpathyDispatchOperationPriv
   gboolean approved;
   gulong invalidated_handler;
   gulong ready_handler;
+  /* Monotonic times of the creation and of the last status change */
+  gint64 created_time;
+  gint64 status_time;
 };
 
 #define GET_PRIV(o)  \
@@ -101,6 +107,7 @@ empathy_dispatch_operation_init (EmpathyDispatchOperation *obj)
   //  GET_PRIV (obj);
 
   /* allocate any data required by the object here */
+  EMPATHY_FOOTPRINT_TRACK (obj);
 }
 
 static void empathy_dispatch_operation_dispose (GObject *object);
@@ -208,6 +215,9 @@ empathy_dispatch_operation_constructed (GObject *object)
   TpHandle handle;
   TpHandleType handle_type;
 
+  priv->created_time = empathy_time_get_monotonic ();
+  priv->status_time = priv->created_time;
+
   empathy_dispatch_operation_set_status (self,
     EMPATHY_DISPATCHER_OPERATION_STATE_PREPARING);
 
@@ -367,6 +377,46 @@ empathy_dispatch_operation_finalize (GObject *object)
   G_OBJECT_CLASS (empathy_dispatch_operation_parent_class)->finalize (object);
 }
 
+/* Record how long the operation stayed in its current status, so the
+ * debugger can tell where incoming channels spend their time */
+static void
+empathy_dispatch_operation_trace (EmpathyDispatchOperation *self,
+  EmpathyDispatchOperationState status)
+{
+  EmpathyDispatchOperationPriv *priv = GET_PRIV (self);
+  static const gchar *stages[] = {
+    "preparing",
+    "pending",
+    "approving",
+    "dispatching",
+  };
+  EmpathyDebugger *debugger;
+  const gchar *channel_type;
+  gint64 now;
+
+  now = empathy_time_get_monotonic ();
+
+  /* Operations which went away don't tell anything about dispatching */
+  if (status == EMPATHY_DISPATCHER_OPERATION_STATE_INVALIDATED ||
+      priv->status >= G_N_ELEMENTS (stages))
+    {
+      priv->status_time = now;
+      return;
+    }
+
+  debugger = empathy_debugger_get_singleton ();
+  channel_type = tp_channel_get_channel_type (priv->channel);
+
+  empathy_debugger_add_latency (debugger, channel_type, stages[priv->status],
+    now - priv->status_time);
+
+  if (status == EMPATHY_DISPATCHER_OPERATION_STATE_CLAIMED)
+    empathy_debugger_add_latency (debugger, channel_type, "total",
+      now - priv->created_time);
+
+  priv->status_time = now;
+}
+
 static void
 empathy_dispatch_operation_set_status (EmpathyDispatchOperation *self,
   EmpathyDispatchOperationState status)
@@ -382,6 +432,8 @@ empathy_dispatch_operation_set_status (EmpathyDispatchOperation *self,
         empathy_dispatch_operation_get_object_path (self),
         priv->status, status);
 
+      empathy_dispatch_operation_trace (self, status);
+
       priv->status = status;
       g_object_notify (G_OBJECT (self), "status");
 
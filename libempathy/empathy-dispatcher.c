@@ -21,6 +21,7 @@
 
 #include <config.h>
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <glib/gi18n-lib.h>
@@ -58,8 +59,9 @@ typedef struct
   gpointer token;
   GSList *tubes;
 
-  /* channels which the dispatcher is listening "invalidated" */
-  GList *channels;
+  /* channels which the dispatcher is listening "invalidated", used as a
+   * set */
+  GHashTable *channels;
 
   GHashTable *request_channel_class_async_ids;
 } EmpathyDispatcherPriv;
@@ -97,6 +99,9 @@ typedef struct
   EmpathyDispatcherRequestCb *cb;
   gpointer user_data;
   gpointer *request_data;
+
+  /* link of this request in ConnectionData->outstanding_requests */
+  GList *link;
 } DispatcherRequestData;
 
 typedef struct
@@ -123,10 +128,20 @@ typedef struct
    * held in limbo here until we know whether they were requested.
    */
   GHashTable *outstanding_channels;
-  /* List of DispatcherRequestData */
-  GList *outstanding_requests;
+  /* DispatcherRequestData, newest first */
+  GQueue *outstanding_requests;
+  /* channel type -> number of outstanding requests without operation */
+  GHashTable *pending_requests_by_type;
+  /* EmpathyDispatchOperation -> GList of its DispatcherRequestData */
+  GHashTable *requests_by_operation;
   /* List of requestable channel classes */
   GPtrArray *requestable_channels;
+  /* "ChannelType TargetHandleType" -> GList of the GValueArray in
+   * requestable_channels with these fixed properties */
+  GHashTable *classes_by_type;
+  /* "ChannelType TargetHandleType properties..." -> GList of the classes
+   * matching this query */
+  GHashTable *matching_classes;
 } ConnectionData;
 
 typedef struct
@@ -223,22 +238,39 @@ new_connection_data (void)
   cd->outstanding_channels = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, NULL);
 
+  cd->outstanding_requests = g_queue_new ();
+
+  cd->pending_requests_by_type = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, NULL);
+
+  cd->requests_by_operation = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, (GDestroyNotify) g_list_free);
+
+  cd->classes_by_type = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_list_free);
+
+  cd->matching_classes = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_list_free);
+
   return cd;
 }
 
 static void
 free_connection_data (ConnectionData *cd)
 {
-  GList *l;
+  DispatcherRequestData *r;
 
   g_hash_table_destroy (cd->dispatched_channels);
   g_hash_table_destroy (cd->dispatching_channels);
+  g_hash_table_destroy (cd->classes_by_type);
+  g_hash_table_destroy (cd->matching_classes);
+  g_hash_table_destroy (cd->pending_requests_by_type);
+  g_hash_table_destroy (cd->requests_by_operation);
   int i;
 
-  for (l = cd->outstanding_requests ; l != NULL; l = g_list_delete_link (l,l))
-    {
-      free_dispatcher_request_data (l->data);
-    }
+  while ((r = g_queue_pop_head (cd->outstanding_requests)) != NULL)
+    free_dispatcher_request_data (r);
+  g_queue_free (cd->outstanding_requests);
 
   if (cd->requestable_channels  != NULL)
     {
@@ -249,6 +281,186 @@ free_connection_data (ConnectionData *cd)
     }
 }
 
+static void
+pending_requests_add (ConnectionData *cd,
+                      const gchar *channel_type,
+                      gint delta)
+{
+  guint count;
+
+  /* requests without a type can't hold back any channel */
+  if (channel_type == NULL)
+    return;
+
+  count = GPOINTER_TO_UINT (g_hash_table_lookup (cd->pending_requests_by_type,
+      channel_type)) + delta;
+
+  if (count == 0)
+    g_hash_table_remove (cd->pending_requests_by_type, channel_type);
+  else
+    g_hash_table_insert (cd->pending_requests_by_type,
+        g_strdup (channel_type), GUINT_TO_POINTER (count));
+}
+
+static void
+connection_data_add_request (ConnectionData *cd,
+                             DispatcherRequestData *request_data)
+{
+  g_queue_push_head (cd->outstanding_requests, request_data);
+  request_data->link = cd->outstanding_requests->head;
+
+  pending_requests_add (cd, request_data->channel_type, 1);
+}
+
+static void
+connection_data_set_request_operation (ConnectionData *cd,
+                                       DispatcherRequestData *request_data,
+                                       EmpathyDispatchOperation *operation)
+{
+  GList *requests;
+
+  g_assert (request_data->operation == NULL);
+
+  request_data->operation = operation;
+  pending_requests_add (cd, request_data->channel_type, -1);
+
+  requests = g_hash_table_lookup (cd->requests_by_operation, operation);
+  g_hash_table_steal (cd->requests_by_operation, operation);
+  g_hash_table_insert (cd->requests_by_operation, operation,
+      g_list_prepend (requests, request_data));
+}
+
+static void
+connection_data_remove_request (ConnectionData *cd,
+                                DispatcherRequestData *request_data)
+{
+  g_queue_delete_link (cd->outstanding_requests, request_data->link);
+  request_data->link = NULL;
+
+  if (request_data->operation == NULL)
+    {
+      pending_requests_add (cd, request_data->channel_type, -1);
+    }
+  else
+    {
+      GList *requests;
+
+      requests = g_hash_table_lookup (cd->requests_by_operation,
+          request_data->operation);
+      g_hash_table_steal (cd->requests_by_operation, request_data->operation);
+      requests = g_list_remove (requests, request_data);
+
+      if (requests != NULL)
+        g_hash_table_insert (cd->requests_by_operation,
+            request_data->operation, requests);
+    }
+}
+
+static gchar *
+channel_class_dup_key (const gchar *channel_type,
+                       guint handle_type)
+{
+  return g_strdup_printf ("%s %u", channel_type, handle_type);
+}
+
+static void
+connection_data_set_requestable_channels (ConnectionData *cd,
+                                          GPtrArray *requestable_channels)
+{
+  gint i;
+
+  cd->requestable_channels = g_boxed_copy (
+    TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, requestable_channels);
+
+  g_hash_table_remove_all (cd->classes_by_type);
+  g_hash_table_remove_all (cd->matching_classes);
+
+  /* walk backwards so that each list keeps the order of the classes */
+  for (i = (gint) cd->requestable_channels->len - 1; i >= 0; i--)
+    {
+      GValueArray *class;
+      GHashTable *fprops;
+      const gchar *channel_type;
+      guint handle_type;
+      gboolean valid;
+      gchar *key;
+      gpointer old_key;
+      GList *classes = NULL;
+
+      class = g_ptr_array_index (cd->requestable_channels, i);
+      fprops = g_value_get_boxed (g_value_array_get_nth (class, 0));
+
+      channel_type = tp_asv_get_string (fprops,
+          TP_IFACE_CHANNEL ".ChannelType");
+      handle_type = tp_asv_get_uint32 (fprops,
+          TP_IFACE_CHANNEL ".TargetHandleType", &valid);
+
+      /* such classes can't match any query */
+      if (channel_type == NULL || !valid)
+        continue;
+
+      key = channel_class_dup_key (channel_type, handle_type);
+
+      /* take the list out without freeing it, and keep the stored key */
+      if (g_hash_table_lookup_extended (cd->classes_by_type, key, &old_key,
+              (gpointer *) &classes))
+        {
+          g_hash_table_steal (cd->classes_by_type, old_key);
+          g_free (key);
+          key = old_key;
+        }
+
+      classes = g_list_prepend (classes, class);
+
+      /* the table owns key now */
+      g_hash_table_insert (cd->classes_by_type, key, classes);
+    }
+}
+
+static gint
+compare_property_names (gconstpointer a,
+                        gconstpointer b)
+{
+  return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+static gchar *
+find_channel_classes_dup_key (const gchar *channel_type,
+                              guint handle_type,
+                              GArray *fixed_properties)
+{
+  GString *key;
+  const gchar **names;
+  guint i;
+
+  key = g_string_new (NULL);
+  g_string_printf (key, "%s %u", channel_type, handle_type);
+
+  if (fixed_properties == NULL)
+    return g_string_free (key, FALSE);
+
+  /* the order of the properties doesn't change the result */
+  names = g_new (const gchar *, fixed_properties->len);
+  for (i = 0; i < fixed_properties->len; i++)
+    names[i] = g_array_index (fixed_properties, const gchar *, i);
+
+  qsort (names, fixed_properties->len, sizeof (const gchar *),
+      compare_property_names);
+
+  /* a list with no property doesn't match the same classes as no list */
+  g_string_append_c (key, ':');
+
+  for (i = 0; i < fixed_properties->len; i++)
+    {
+      g_string_append_c (key, ' ');
+      g_string_append (key, names[i]);
+    }
+
+  g_free (names);
+
+  return g_string_free (key, FALSE);
+}
+
 static void
 free_find_channel_request (FindChannelRequest *r)
 {
@@ -290,21 +502,13 @@ dispatcher_operation_can_start (EmpathyDispatcher *self,
                                 EmpathyDispatchOperation *operation,
                                 ConnectionData *cd)
 {
-  GList *l;
   const gchar *channel_type =
     empathy_dispatch_operation_get_channel_type (operation);
 
-  for (l = cd->outstanding_requests; l != NULL; l = g_list_next (l))
-    {
-      DispatcherRequestData *d = (DispatcherRequestData *) l->data;
-
-      if (d->operation == NULL && !tp_strdiff (d->channel_type, channel_type))
-        {
-          return FALSE;
-        }
-    }
-
-  return TRUE;
+  /* wait until we know whether the outstanding requests of the same type
+   * will give us this channel */
+  return g_hash_table_lookup (cd->pending_requests_by_type,
+      channel_type) == NULL;
 }
 
 static void
@@ -313,32 +517,29 @@ dispatch_operation_flush_requests (EmpathyDispatcher *dispatcher,
                                    GError *error,
                                    ConnectionData *cd)
 {
-  GList *l;
+  GList *requests, *l;
+
+  requests = g_hash_table_lookup (cd->requests_by_operation, operation);
+  g_hash_table_steal (cd->requests_by_operation, operation);
 
-  l = cd->outstanding_requests;
-  while (l != NULL)
+  for (l = requests; l != NULL; l = g_list_next (l))
     {
       DispatcherRequestData *d = (DispatcherRequestData *) l->data;
-      GList *lt = l;
 
-      l = g_list_next (l);
-
-      if (d->operation == operation)
+      if (d->cb != NULL)
         {
-          if (d->cb != NULL)
-            {
-              if (error != NULL)
-                d->cb (NULL, error, d->user_data);
-              else
-                d->cb (operation, NULL, d->user_data);
-            }
+          if (error != NULL)
+            d->cb (NULL, error, d->user_data);
+          else
+            d->cb (operation, NULL, d->user_data);
+        }
 
-          cd->outstanding_requests = g_list_delete_link
-            (cd->outstanding_requests, lt);
+      g_queue_delete_link (cd->outstanding_requests, d->link);
 
-          free_dispatcher_request_data (d);
-        }
+      free_dispatcher_request_data (d);
     }
+
+  g_list_free (requests);
 }
 
 static void
@@ -369,7 +570,7 @@ dispatcher_channel_invalidated_cb (TpProxy *proxy,
   g_hash_table_remove (cd->dispatched_channels, object_path);
   g_hash_table_remove (cd->dispatching_channels, object_path);
 
-  priv->channels = g_list_remove (priv->channels, proxy);
+  g_hash_table_remove (priv->channels, proxy);
 
   operation = g_hash_table_lookup (cd->outstanding_channels, object_path);
   if (operation != NULL)
@@ -613,7 +814,7 @@ dispatcher_connection_new_channel (EmpathyDispatcher *dispatcher,
     G_CALLBACK (dispatcher_channel_invalidated_cb),
     dispatcher);
 
-  priv->channels = g_list_prepend (priv->channels, channel);
+  g_hash_table_insert (priv->channels, channel, channel);
 
   operation = empathy_dispatch_operation_new (connection, channel, NULL,
     incoming);
@@ -772,8 +973,7 @@ dispatcher_connection_got_all (TpProxy *proxy,
       cd = g_hash_table_lookup (priv->connections, proxy);
       g_assert (cd != NULL);
 
-      cd->requestable_channels = g_boxed_copy (
-        TP_ARRAY_TYPE_REQUESTABLE_CHANNEL_CLASS_LIST, requestable_channels);
+      connection_data_set_requestable_channels (cd, requestable_channels);
 
       requests = g_hash_table_lookup (priv->outstanding_classes_requests,
           proxy);
@@ -945,9 +1145,8 @@ static void
 dispatcher_finalize (GObject *object)
 {
   EmpathyDispatcherPriv *priv = GET_PRIV (object);
-  GList *l;
   GHashTableIter iter;
-  gpointer connection;
+  gpointer connection, channel;
   GList *list;
 
   if (priv->request_channel_class_async_ids != NULL)
@@ -960,13 +1159,14 @@ dispatcher_finalize (GObject *object)
   g_signal_handlers_disconnect_by_func (priv->account_manager,
       dispatcher_new_connection_cb, object);
 
-  for (l = priv->channels; l; l = l->next)
+  g_hash_table_iter_init (&iter, priv->channels);
+  while (g_hash_table_iter_next (&iter, &channel, NULL))
     {
-      g_signal_handlers_disconnect_by_func (l->data,
+      g_signal_handlers_disconnect_by_func (channel,
           dispatcher_channel_invalidated_cb, object);
     }
 
-  g_list_free (priv->channels);
+  g_hash_table_destroy (priv->channels);
 
   g_hash_table_iter_init (&iter, priv->connections);
   while (g_hash_table_iter_next (&iter, &connection, NULL))
@@ -1052,7 +1252,7 @@ empathy_dispatcher_init (EmpathyDispatcher *dispatcher)
   priv->outstanding_classes_requests = g_hash_table_new_full (g_direct_hash,
     g_direct_equal, g_object_unref, NULL);
 
-  priv->channels = NULL;
+  priv->channels = g_hash_table_new (g_direct_hash, g_direct_equal);
 
   connections = empathy_account_manager_dup_connections (priv->account_manager);
   for (l = connections; l; l = l->next)
@@ -1084,8 +1284,7 @@ dispatcher_request_failed (EmpathyDispatcher *dispatcher,
   if (request_data->cb != NULL)
     request_data->cb (NULL, error, request_data->user_data);
 
-  conn_data->outstanding_requests =
-      g_list_remove (conn_data->outstanding_requests, request_data);
+  connection_data_remove_request (conn_data, request_data);
   free_dispatcher_request_data (request_data);
 }
 
@@ -1149,7 +1348,7 @@ dispatcher_connection_new_requested_channel (EmpathyDispatcher *dispatcher,
             G_CALLBACK (dispatcher_channel_invalidated_cb),
             request_data->dispatcher);
 
-          priv->channels = g_list_prepend (priv->channels, channel);
+          g_hash_table_insert (priv->channels, channel, channel);
 
           operation = empathy_dispatch_operation_new (request_data->connection,
              channel, request_data->contact, FALSE);
@@ -1164,7 +1363,7 @@ dispatcher_connection_new_requested_channel (EmpathyDispatcher *dispatcher,
         NULL);
     }
 
-  request_data->operation = operation;
+  connection_data_set_request_operation (conn_data, request_data, operation);
 
   /* (pre)-approve this right away as we requested it
    * This might cause the channel to be claimed, in which case the operation
@@ -1235,8 +1434,7 @@ empathy_dispatcher_chat_with_contact (EmpathyContact *contact,
     TP_IFACE_CHANNEL_TYPE_TEXT, TP_HANDLE_TYPE_CONTACT,
     empathy_contact_get_handle (contact), NULL, contact, callback, user_data);
 
-  connection_data->outstanding_requests = g_list_prepend
-    (connection_data->outstanding_requests, request_data);
+  connection_data_add_request (connection_data, request_data);
 
   dispatcher_request_channel (request_data);
 
@@ -1318,8 +1516,7 @@ dispatcher_request_handles_cb (TpConnection *connection,
       if (request_data->cb)
         request_data->cb (NULL, error, request_data->user_data);
 
-      cd->outstanding_requests = g_list_remove (cd->outstanding_requests,
-        request_data);
+      connection_data_remove_request (cd, request_data);
 
       free_dispatcher_request_data (request_data);
 
@@ -1356,8 +1553,7 @@ empathy_dispatcher_join_muc (TpConnection *connection,
     TP_IFACE_CHANNEL_TYPE_TEXT, TP_HANDLE_TYPE_ROOM, 0, NULL,
     NULL, callback, user_data);
 
-  connection_data->outstanding_requests = g_list_prepend
-    (connection_data->outstanding_requests, request_data);
+  connection_data_add_request (connection_data, request_data);
 
   tp_cli_connection_call_request_handles (connection, -1,
     TP_HANDLE_TYPE_ROOM, names,
@@ -1417,8 +1613,7 @@ empathy_dispatcher_create_channel (EmpathyDispatcher *dispatcher,
     channel_type, handle_type, handle, request,
     NULL, callback, user_data);
 
-  connection_data->outstanding_requests = g_list_prepend
-    (connection_data->outstanding_requests, request_data);
+  connection_data_add_request (connection_data, request_data);
 
   tp_cli_connection_interface_requests_call_create_channel (
     request_data->connection, -1,
@@ -1516,9 +1711,9 @@ empathy_dispatcher_find_channel_classes (EmpathyDispatcher *dispatcher,
 {
   EmpathyDispatcherPriv *priv = GET_PRIV (dispatcher);
   GValueArray *class;
-  GPtrArray *classes;
+  GList *classes, *l;
   GList *matching_classes;
-  int i;
+  gchar *key, *type_key;
   ConnectionData *cd;
 
   g_return_val_if_fail (channel_type != NULL, NULL);
@@ -1529,15 +1724,29 @@ empathy_dispatcher_find_channel_classes (EmpathyDispatcher *dispatcher,
   if (cd == NULL)
     return NULL;
 
-  classes = cd->requestable_channels;
-  if (classes == NULL)
+  if (cd->requestable_channels == NULL)
     return NULL;
 
+  key = find_channel_classes_dup_key (channel_type, handle_type,
+      fixed_properties);
+
+  if (g_hash_table_lookup_extended (cd->matching_classes, key, NULL,
+        (gpointer *) &matching_classes))
+    {
+      g_free (key);
+      return g_list_copy (matching_classes);
+    }
+
+  /* only the classes with the right type need to be checked */
+  type_key = channel_class_dup_key (channel_type, handle_type);
+  classes = g_hash_table_lookup (cd->classes_by_type, type_key);
+  g_free (type_key);
+
   matching_classes = NULL;
 
-  for (i = 0; i < classes->len; i++)
+  for (l = classes; l != NULL; l = l->next)
     {
-      class = g_ptr_array_index (classes, i);
+      class = l->data;
 
       if (!channel_class_matches
           (class, channel_type, handle_type, fixed_properties))
@@ -1546,7 +1755,10 @@ empathy_dispatcher_find_channel_classes (EmpathyDispatcher *dispatcher,
       matching_classes = g_list_prepend (matching_classes, class);
     }
 
-  return matching_classes;
+  /* the table owns key now */
+  g_hash_table_insert (cd->matching_classes, key, matching_classes);
+
+  return g_list_copy (matching_classes);
 }
 
 static gboolean
@@ -0,0 +1,261 @@
+/*
+ * Memory accounting
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Counts what the long-lived parts of Empathy hold on to, so a footprint
+ * that keeps growing over weeks can be pinned on a subsystem by asking the
+ * debugger, without valgrind. Objects are counted per type, everything
+ * else per category of allocation, and a snapshot of the totals and of the
+ * RSS is taken every few minutes. */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "empathy-footprint.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_OTHER
+#include "empathy-debug.h"
+
+gboolean empathy_footprint_enabled = FALSE;
+
+typedef struct {
+  EmpathyFootprintEntry entry;
+  /* G_TYPE_INVALID for categories */
+  GType type;
+} FootprintCounter;
+
+/* Objects may be finalized in any thread, the counters are only touched
+ * with this held */
+static GStaticMutex footprint_lock = G_STATIC_MUTEX_INIT;
+/* interned name -> FootprintCounter */
+static GHashTable *counters = NULL;
+static EmpathyFootprintSnapshot *snapshots = NULL;
+static guint next_snapshot = 0;
+static GQuark tracked_quark = 0;
+
+static FootprintCounter *
+footprint_get_counter (const gchar *name,
+    GType type)
+{
+  FootprintCounter *counter;
+
+  counter = g_hash_table_lookup (counters, name);
+  if (counter == NULL)
+    {
+      counter = g_slice_new0 (FootprintCounter);
+      counter->entry.name = name;
+      counter->type = type;
+      g_hash_table_insert (counters, (gpointer) name, counter);
+    }
+
+  return counter;
+}
+
+static guint64
+footprint_get_rss (void)
+{
+  gchar *statm;
+  guint64 rss = 0;
+
+  /* Linux only; the second field is the resident size in pages */
+  if (g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL))
+    {
+      gchar *resident = strchr (statm, ' ');
+
+      if (resident != NULL)
+        rss = g_ascii_strtoull (resident + 1, NULL, 10) *
+            sysconf (_SC_PAGESIZE);
+
+      g_free (statm);
+    }
+
+  return rss;
+}
+
+static gboolean
+footprint_snapshot_cb (gpointer user_data)
+{
+  EmpathyFootprintSnapshot *snapshot;
+  GArray *entries;
+  guint64 accounted = 0;
+  GTimeVal now;
+  guint i;
+
+  entries = empathy_footprint_dup_entries ();
+  for (i = 0; i < entries->len; i++)
+    accounted += g_array_index (entries, EmpathyFootprintEntry, i).bytes;
+  g_array_free (entries, TRUE);
+
+  g_get_current_time (&now);
+
+  snapshot = snapshots + next_snapshot % EMPATHY_FOOTPRINT_SNAPSHOT_LIMIT;
+  snapshot->timestamp = now.tv_sec + now.tv_usec / 1e6;
+  snapshot->rss = footprint_get_rss ();
+  snapshot->accounted = accounted;
+  next_snapshot++;
+
+  DEBUG ("Footprint: %" G_GUINT64_FORMAT " bytes resident, %"
+      G_GUINT64_FORMAT " accounted for", snapshot->rss, snapshot->accounted);
+
+  return TRUE;
+}
+
+/* Turns the accounting on, with a snapshot every @interval seconds or
+ * EMPATHY_FOOTPRINT_DEFAULT_INTERVAL if it's 0. Objects created before
+ * aren't counted, so call it as early as possible. */
+void
+empathy_footprint_enable (guint interval)
+{
+  if (empathy_footprint_enabled)
+    return;
+
+  if (interval == 0)
+    interval = EMPATHY_FOOTPRINT_DEFAULT_INTERVAL;
+
+  counters = g_hash_table_new (g_direct_hash, g_direct_equal);
+  snapshots = g_new0 (EmpathyFootprintSnapshot,
+      EMPATHY_FOOTPRINT_SNAPSHOT_LIMIT);
+  tracked_quark = g_quark_from_static_string ("empathy-footprint-tracked");
+
+  empathy_footprint_enabled = TRUE;
+
+  /* One right away so there is a baseline to compare with */
+  footprint_snapshot_cb (NULL);
+  g_timeout_add_seconds (interval, footprint_snapshot_cb, NULL);
+}
+
+static void
+footprint_object_finalized_cb (gpointer data,
+    GObject *where_the_object_was)
+{
+  FootprintCounter *counter = data;
+
+  g_static_mutex_lock (&footprint_lock);
+  counter->entry.live--;
+  g_static_mutex_unlock (&footprint_lock);
+}
+
+void
+empathy_footprint_track (GObject *object)
+{
+  FootprintCounter *counter;
+  GType type;
+
+  g_return_if_fail (empathy_footprint_enabled);
+
+  if (g_object_get_qdata (object, tracked_quark) != NULL)
+    return;
+
+  g_object_set_qdata (object, tracked_quark, GUINT_TO_POINTER (TRUE));
+
+  type = G_OBJECT_TYPE (object);
+
+  g_static_mutex_lock (&footprint_lock);
+  counter = footprint_get_counter (g_type_name (type), type);
+  counter->entry.live++;
+  counter->entry.total++;
+  g_static_mutex_unlock (&footprint_lock);
+
+  /* Counters are never freed, so they can be handed to the weak ref */
+  g_object_weak_ref (object, footprint_object_finalized_cb, counter);
+}
+
+void
+empathy_footprint_add (const gchar *category,
+    gint count,
+    gssize bytes)
+{
+  FootprintCounter *counter;
+
+  g_return_if_fail (empathy_footprint_enabled);
+
+  category = g_intern_string (category);
+
+  g_static_mutex_lock (&footprint_lock);
+  counter = footprint_get_counter (category, G_TYPE_INVALID);
+  counter->entry.live += count;
+  if (count > 0)
+    counter->entry.total += count;
+  counter->entry.bytes += bytes;
+  g_static_mutex_unlock (&footprint_lock);
+}
+
+/* Returns the counters as an array of EmpathyFootprintEntry, empty when the
+ * accounting is off. Free it with g_array_free(). */
+GArray *
+empathy_footprint_dup_entries (void)
+{
+  GArray *entries;
+  GHashTableIter iter;
+  gpointer value;
+
+  entries = g_array_new (FALSE, FALSE, sizeof (EmpathyFootprintEntry));
+
+  if (!empathy_footprint_enabled)
+    return entries;
+
+  g_static_mutex_lock (&footprint_lock);
+
+  g_hash_table_iter_init (&iter, counters);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      FootprintCounter *counter = value;
+      EmpathyFootprintEntry entry = counter->entry;
+
+      /* Only the instance itself, not what it points to: the categories
+       * cover the big allocations hanging off the objects */
+      if (counter->type != G_TYPE_INVALID)
+        {
+          GTypeQuery query;
+
+          g_type_query (counter->type, &query);
+          entry.bytes = (guint64) entry.live * query.instance_size;
+        }
+
+      g_array_append_val (entries, entry);
+    }
+
+  g_static_mutex_unlock (&footprint_lock);
+
+  return entries;
+}
+
+/* Returns the snapshots still kept, oldest first, as an array of
+ * EmpathyFootprintSnapshot. Free it with g_array_free(). */
+GArray *
+empathy_footprint_dup_snapshots (void)
+{
+  GArray *result;
+  guint i, start = 0;
+
+  result = g_array_new (FALSE, FALSE, sizeof (EmpathyFootprintSnapshot));
+
+  if (!empathy_footprint_enabled)
+    return result;
+
+  if (next_snapshot > EMPATHY_FOOTPRINT_SNAPSHOT_LIMIT)
+    start = next_snapshot - EMPATHY_FOOTPRINT_SNAPSHOT_LIMIT;
+
+  for (i = start; i < next_snapshot; i++)
+    g_array_append_val (result,
+        snapshots[i % EMPATHY_FOOTPRINT_SNAPSHOT_LIMIT]);
+
+  return result;
+}
@@ -0,0 +1,85 @@
+/*
+ * Memory accounting
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_FOOTPRINT_H__
+#define __EMPATHY_FOOTPRINT_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Snapshots kept, a day's worth at the default interval */
+#define EMPATHY_FOOTPRINT_SNAPSHOT_LIMIT 288
+
+/* Seconds between snapshots when EMPATHY_FOOTPRINT doesn't say */
+#define EMPATHY_FOOTPRINT_DEFAULT_INTERVAL 300
+
+typedef struct {
+  /* interned: a type name, or a category of allocations */
+  const gchar *name;
+  /* live instances or allocations */
+  guint live;
+  /* instances or allocations ever made */
+  guint64 total;
+  /* bytes held by the live ones */
+  guint64 bytes;
+} EmpathyFootprintEntry;
+
+typedef struct {
+  gdouble timestamp;
+  /* resident set size of the process, 0 where we can't tell */
+  guint64 rss;
+  /* sum of the bytes of all the entries */
+  guint64 accounted;
+} EmpathyFootprintSnapshot;
+
+/* Accounting is off unless empathy_footprint_enable() was called, which
+ * empathy_init() does when EMPATHY_FOOTPRINT is set. Only the macros below
+ * should need to look at it, so it costs a single test when off. */
+extern gboolean empathy_footprint_enabled;
+
+void empathy_footprint_enable (guint interval);
+void empathy_footprint_track (GObject *object);
+void empathy_footprint_add (const gchar *category,
+    gint count,
+    gssize bytes);
+GArray *empathy_footprint_dup_entries (void);
+GArray *empathy_footprint_dup_snapshots (void);
+
+/* Counts @object among the live instances of its type until it is
+ * finalized; an object is only counted once. The type is taken at the first
+ * call, so for a class which has subclasses call it from constructed: in
+ * an instance init the object still has the type being initialized. */
+#define EMPATHY_FOOTPRINT_TRACK(object) \
+  G_STMT_START { \
+    if (G_UNLIKELY (empathy_footprint_enabled)) \
+      empathy_footprint_track (G_OBJECT (object)); \
+  } G_STMT_END
+
+/* Adds @count allocations and @bytes bytes to @category, negative for
+ * frees. @category should be a string literal. */
+#define EMPATHY_FOOTPRINT_ADD(category, count, bytes) \
+  G_STMT_START { \
+    if (G_UNLIKELY (empathy_footprint_enabled)) \
+      empathy_footprint_add ((category), (count), (bytes)); \
+  } G_STMT_END
+
+G_END_DECLS
+
+#endif /* __EMPATHY_FOOTPRINT_H__ */
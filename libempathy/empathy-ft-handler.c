@@ -21,7 +21,10 @@
 
 /* empathy-ft-handler.c */
 
+#include "config.h"
+
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <glib/gi18n.h>
 #include <telepathy-glib/util.h>
 #include <telepathy-glib/dbus.h>
@@ -73,7 +76,20 @@ G_DEFINE_TYPE (EmpathyFTHandler, empathy_ft_handler, G_TYPE_OBJECT)
 
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyFTHandler)
 
-#define BUFFER_SIZE 4096
+#define BUFFER_SIZE (256 * 1024)
+
+/* Minimum interval between two progress signals, in milliseconds */
+#define PROGRESS_INTERVAL 100
+
+/* Weight of the latest sample in the moving average of the speed */
+#define SPEED_SMOOTHING 0.3
+
+/* Maximum number of files in the hash cache */
+#define HASH_CACHE_SIZE 256
+#define HASH_CACHE_KEY_STAMP "stamp"
+
+/* Seconds the hash cache waits for more changes before being written */
+#define HASH_CACHE_SAVE_DELAY 5
 
 enum {
   PROP_TP_FILE = 1,
@@ -103,7 +119,8 @@ typedef struct {
   GError *error /* comment to make the style checker happy */;
   guchar *buffer;
   GChecksum *checksum;
-  gssize total_read;
+  guint64 total_read;
+  gint64 last_progress_time;
   guint64 total_bytes;
   EmpathyFTHandler *handler;
 } HashingData;
@@ -139,18 +156,32 @@ typedef struct {
   gchar *content_hash;
   TpFileHashType content_hash_type;
 
+  /* "device:inode" of the outgoing file, if known */
+  gchar *file_id;
+
   /* time and speed */
   gdouble speed;
   guint remaining_time;
-  time_t last_update_time;
+  gint64 last_update_time;
+  guint64 last_update_bytes;
+  guint progress_id;
 
+  gboolean is_started;
   gboolean is_completed;
 } EmpathyFTHandlerPriv;
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
+/* Hashes of the files sent before, a group per file_id */
+static GKeyFile *hash_cache = NULL;
+static guint hash_cache_save_id = 0;
+static gboolean hash_cache_saving = FALSE;
+
 static gboolean do_hash_job_incoming (GIOSchedulerJob *job,
     GCancellable *cancellable, gpointer user_data);
+static void emit_error_signal (EmpathyFTHandler *handler,
+    const GError *error);
+static void ft_handler_flush_transfer_progress (EmpathyFTHandler *handler);
 
 /* GObject implementations */
 static void
@@ -247,6 +278,12 @@ do_dispose (GObject *object)
 
   priv->dispose_run = TRUE;
 
+  if (priv->progress_id != 0)
+    {
+      g_source_remove (priv->progress_id);
+      priv->progress_id = 0;
+    }
+
   if (priv->contact != NULL) {
     g_object_unref (priv->contact);
     priv->contact = NULL;
@@ -302,6 +339,9 @@ do_finalize (GObject *object)
   g_free (priv->content_hash);
   priv->content_hash = NULL;
 
+  g_free (priv->file_id);
+  priv->file_id = NULL;
+
   G_OBJECT_CLASS (empathy_ft_handler_parent_class)->finalize (object);
 }
 
@@ -475,10 +515,11 @@ empathy_ft_handler_class_init (EmpathyFTHandlerClass *klass)
    * @total_bytes: the total bytes of the handler
    * @remaining_time: the number of seconds remaining for the transfer
    * to be completed
-   * @speed: the current speed of the transfer (in KB/s)
+   * @speed: the current speed of the transfer (in bytes/s)
    *
    * This signal is emitted to notify clients of the progress of the
-   * transfer.
+   * transfer. Updates are coalesced, so it is emitted at most ten times
+   * per second.
    */
   signals[TRANSFER_PROGRESS] =
     g_signal_new ("transfer-progress", G_TYPE_FROM_CLASS (klass),
@@ -591,25 +632,72 @@ tp_file_hash_to_g_checksum (TpFileHashType type)
   return retval;
 }
 
+static GError *
+check_hash_matches (EmpathyFTHandler *handler,
+    const gchar *hash)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  if (g_strcmp0 (hash, priv->content_hash))
+    {
+      DEBUG ("Hash mismatch when checking incoming handler: "
+             "received %s, calculated %s", priv->content_hash, hash);
+
+      return g_error_new_literal (EMPATHY_FT_ERROR_QUARK,
+          EMPATHY_FT_ERROR_HASH_MISMATCH,
+          _("The hash of the received file and the "
+            "sent one do not match"));
+    }
+
+  DEBUG ("Hash verification matched, received %s, calculated %s",
+         priv->content_hash, hash);
+
+  return NULL;
+}
+
 static void
 check_hash_incoming (EmpathyFTHandler *handler)
 {
   HashingData *hash_data;
   EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  const gchar *hash;
+
+  if (EMP_STR_EMPTY (priv->content_hash))
+    return;
 
-  if (!EMP_STR_EMPTY (priv->content_hash))
+  hash = empathy_tp_file_get_checksum (priv->tpfile);
+  if (hash != NULL)
     {
-      hash_data = g_slice_new0 (HashingData);
-      hash_data->total_bytes = priv->total_bytes;
-      hash_data->handler = g_object_ref (handler);
-      hash_data->checksum = g_checksum_new
-        (tp_file_hash_to_g_checksum (priv->content_hash_type));
+      GError *error;
 
+      /* the data was hashed while being received, no need to read the
+       * file again */
       g_signal_emit (handler, signals[HASHING_STARTED], 0);
 
-      g_io_scheduler_push_job (do_hash_job_incoming, hash_data, NULL,
-                               G_PRIORITY_DEFAULT, priv->cancellable);
+      error = check_hash_matches (handler, hash);
+      if (error != NULL)
+        {
+          emit_error_signal (handler, error);
+          g_error_free (error);
+        }
+      else
+        {
+          g_signal_emit (handler, signals[HASHING_DONE], 0);
+        }
+
+      return;
     }
+
+  hash_data = g_slice_new0 (HashingData);
+  hash_data->total_bytes = priv->total_bytes;
+  hash_data->handler = g_object_ref (handler);
+  hash_data->checksum = g_checksum_new
+    (tp_file_hash_to_g_checksum (priv->content_hash_type));
+
+  g_signal_emit (handler, signals[HASHING_STARTED], 0);
+
+  g_io_scheduler_push_job (do_hash_job_incoming, hash_data, NULL,
+                           G_PRIORITY_DEFAULT, priv->cancellable);
 }
 
 static void
@@ -621,6 +709,12 @@ emit_error_signal (EmpathyFTHandler *handler,
   if (!g_cancellable_is_cancelled (priv->cancellable))
     g_cancellable_cancel (priv->cancellable);
 
+  if (priv->progress_id != 0)
+    {
+      g_source_remove (priv->progress_id);
+      priv->progress_id = 0;
+    }
+
   g_signal_emit (handler, signals[TRANSFER_ERROR], 0, error);
 }
 
@@ -640,6 +734,8 @@ ft_transfer_operation_callback (EmpathyTpFile *tp_file,
     }
   else
     {
+      ft_handler_flush_transfer_progress (handler);
+
       priv->is_completed = TRUE;
       g_signal_emit (handler, signals[TRANSFER_DONE], 0, tp_file);
 
@@ -653,30 +749,70 @@ ft_transfer_operation_callback (EmpathyTpFile *tp_file,
 }
 
 static void
-update_remaining_time_and_speed (EmpathyFTHandler *handler,
-    guint64 transferred_bytes)
+update_remaining_time_and_speed (EmpathyFTHandler *handler)
 {
   EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
-  time_t elapsed_time, current_time;
-  guint64 transferred, last_transferred_bytes;
-  gdouble speed;
-  gint remaining_time;
+  gint64 current_time;
+  gdouble elapsed_time, speed;
 
-  last_transferred_bytes = priv->transferred_bytes;
-  priv->transferred_bytes = transferred_bytes;
+  current_time = empathy_time_get_monotonic ();
+  elapsed_time = (gdouble) (current_time - priv->last_update_time) /
+    G_USEC_PER_SEC;
 
-  current_time = empathy_time_get_current ();
-  elapsed_time = current_time - priv->last_update_time;
+  if (elapsed_time <= 0)
+    return;
 
-  if (elapsed_time >= 1)
-    {
-      transferred = transferred_bytes - last_transferred_bytes;
-      speed = (gdouble) transferred / (gdouble) elapsed_time;
-      remaining_time = (priv->total_bytes - priv->transferred_bytes) / speed;
-      priv->speed = speed;
-      priv->remaining_time = remaining_time;
-      priv->last_update_time = current_time;
-    }
+  speed = (priv->transferred_bytes - priv->last_update_bytes) / elapsed_time;
+
+  /* smooth the speed so that it does not jump around between samples */
+  if (priv->speed > 0)
+    speed = SPEED_SMOOTHING * speed + (1 - SPEED_SMOOTHING) * priv->speed;
+
+  priv->speed = speed;
+  priv->last_update_time = current_time;
+  priv->last_update_bytes = priv->transferred_bytes;
+
+  if (speed > 0)
+    priv->remaining_time =
+      (priv->total_bytes - priv->transferred_bytes) / speed;
+}
+
+static void
+ft_handler_emit_transfer_progress (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  update_remaining_time_and_speed (handler);
+
+  g_signal_emit (handler, signals[TRANSFER_PROGRESS], 0,
+      priv->transferred_bytes, priv->total_bytes, priv->remaining_time,
+      priv->speed);
+}
+
+static gboolean
+ft_handler_progress_timeout_cb (gpointer user_data)
+{
+  EmpathyFTHandler *handler = user_data;
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  priv->progress_id = 0;
+  ft_handler_emit_transfer_progress (handler);
+
+  return FALSE;
+}
+
+static void
+ft_handler_flush_transfer_progress (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  if (priv->progress_id == 0)
+    return;
+
+  g_source_remove (priv->progress_id);
+  priv->progress_id = 0;
+
+  ft_handler_emit_transfer_progress (handler);
 }
 
 static void
@@ -692,17 +828,20 @@ ft_transfer_progress_callback (EmpathyTpFile *tp_file,
 
   if (transferred_bytes == 0)
     {
-      priv->last_update_time = empathy_time_get_current ();
+      priv->last_update_time = empathy_time_get_monotonic ();
+      priv->last_update_bytes = 0;
       g_signal_emit (handler, signals[TRANSFER_STARTED], 0, tp_file);
     }
 
   if (priv->transferred_bytes != transferred_bytes)
     {
-      update_remaining_time_and_speed (handler, transferred_bytes);
+      priv->transferred_bytes = transferred_bytes;
 
-      g_signal_emit (handler, signals[TRANSFER_PROGRESS], 0,
-          transferred_bytes, priv->total_bytes, priv->remaining_time,
-          priv->speed);
+      /* the signal is emitted by the timeout, collecting all the changes
+       * happening until then */
+      if (priv->progress_id == 0)
+        priv->progress_id = g_timeout_add (PROGRESS_INTERVAL,
+            ft_handler_progress_timeout_cb, handler);
     }
 }
 
@@ -803,6 +942,197 @@ ft_handler_populate_outgoing_request (EmpathyFTHandler *handler)
       TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER ".Date", value);
 }
 
+static const gchar *
+hash_type_to_string (TpFileHashType type)
+{
+  switch (type)
+    {
+      case TP_FILE_HASH_TYPE_MD5:
+        return "md5";
+      case TP_FILE_HASH_TYPE_SHA1:
+        return "sha1";
+      case TP_FILE_HASH_TYPE_SHA256:
+        return "sha256";
+      default:
+        g_assert_not_reached ();
+        return NULL;
+    }
+}
+
+static gchar *
+hash_cache_dup_filename (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME,
+      "file-hashes", NULL);
+}
+
+static GKeyFile *
+hash_cache_get (void)
+{
+  gchar *filename;
+  GError *error = NULL;
+
+  if (hash_cache != NULL)
+    return hash_cache;
+
+  hash_cache = g_key_file_new ();
+  filename = hash_cache_dup_filename ();
+
+  if (!g_key_file_load_from_file (hash_cache, filename, G_KEY_FILE_NONE,
+          &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        DEBUG ("Failed to load the hash cache: %s", error->message);
+
+      g_error_free (error);
+    }
+
+  g_free (filename);
+
+  return hash_cache;
+}
+
+static void hash_cache_schedule_save (void);
+
+static void
+hash_cache_replace_contents_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  gchar *data = user_data;
+  GError *error = NULL;
+
+  if (!g_file_replace_contents_finish (G_FILE (source), result, NULL,
+          &error))
+    {
+      DEBUG ("Failed to save the hash cache: %s", error->message);
+      g_error_free (error);
+    }
+
+  g_free (data);
+  hash_cache_saving = FALSE;
+}
+
+static gboolean
+hash_cache_save_timeout_cb (gpointer user_data)
+{
+  gchar *filename, *dirname, *data;
+  gsize length;
+  GFile *file;
+
+  hash_cache_save_id = 0;
+
+  /* only one write at a time, try again later */
+  if (hash_cache_saving)
+    {
+      hash_cache_schedule_save ();
+      return FALSE;
+    }
+
+  filename = hash_cache_dup_filename ();
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, S_IRWXU);
+
+  /* the data must stay around until the write is done */
+  data = g_key_file_to_data (hash_cache, &length, NULL);
+  file = g_file_new_for_path (filename);
+  hash_cache_saving = TRUE;
+  g_file_replace_contents_async (file, data, length, NULL, FALSE,
+      G_FILE_CREATE_PRIVATE, NULL, hash_cache_replace_contents_cb, data);
+
+  g_object_unref (file);
+  g_free (dirname);
+  g_free (filename);
+
+  return FALSE;
+}
+
+/* Hashes often come in bursts when several files are sent, write them all
+ * at once, off the main loop */
+static void
+hash_cache_schedule_save (void)
+{
+  if (hash_cache_save_id == 0)
+    hash_cache_save_id = g_timeout_add_seconds (HASH_CACHE_SAVE_DELAY,
+        hash_cache_save_timeout_cb, NULL);
+}
+
+static gchar *
+ft_handler_dup_hash_cache_stamp (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+
+  /* a file with the same inode, size and mtime is assumed unchanged */
+  return g_strdup_printf ("%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+      priv->total_bytes, priv->mtime);
+}
+
+static void
+ft_handler_cache_hash (EmpathyFTHandler *handler,
+    const gchar *hash)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  GKeyFile *key_file;
+  gchar *stamp, *old_stamp;
+  gchar **groups;
+  gsize n_groups, i;
+
+  if (priv->file_id == NULL)
+    return;
+
+  key_file = hash_cache_get ();
+  stamp = ft_handler_dup_hash_cache_stamp (handler);
+
+  /* forget the hashes of the previous version of the file */
+  old_stamp = g_key_file_get_string (key_file, priv->file_id,
+      HASH_CACHE_KEY_STAMP, NULL);
+  if (old_stamp != NULL && tp_strdiff (old_stamp, stamp))
+    g_key_file_remove_group (key_file, priv->file_id, NULL);
+  g_free (old_stamp);
+
+  g_key_file_set_string (key_file, priv->file_id, HASH_CACHE_KEY_STAMP,
+      stamp);
+  g_key_file_set_string (key_file, priv->file_id,
+      hash_type_to_string (priv->content_hash_type), hash);
+  g_free (stamp);
+
+  /* groups are in insertion order, drop the oldest files */
+  groups = g_key_file_get_groups (key_file, &n_groups);
+  for (i = 0; i + HASH_CACHE_SIZE < n_groups; i++)
+    g_key_file_remove_group (key_file, groups[i], NULL);
+  g_strfreev (groups);
+
+  hash_cache_schedule_save ();
+}
+
+static gchar *
+ft_handler_dup_cached_hash (EmpathyFTHandler *handler)
+{
+  EmpathyFTHandlerPriv *priv = GET_PRIV (handler);
+  GKeyFile *key_file;
+  gchar *stamp, *cached_stamp;
+  gchar *hash = NULL;
+
+  if (priv->file_id == NULL)
+    return NULL;
+
+  key_file = hash_cache_get ();
+  cached_stamp = g_key_file_get_string (key_file, priv->file_id,
+      HASH_CACHE_KEY_STAMP, NULL);
+  if (cached_stamp == NULL)
+    return NULL;
+
+  stamp = ft_handler_dup_hash_cache_stamp (handler);
+  if (!tp_strdiff (stamp, cached_stamp))
+    hash = g_key_file_get_string (key_file, priv->file_id,
+        hash_type_to_string (priv->content_hash_type), NULL);
+
+  g_free (stamp);
+  g_free (cached_stamp);
+
+  return hash;
+}
+
 static gboolean
 hash_job_done (gpointer user_data)
 {
@@ -826,25 +1156,10 @@ hash_job_done (gpointer user_data)
 
   if (empathy_ft_handler_is_incoming (handler))
     {
-      if (g_strcmp0 (g_checksum_get_string (hash_data->checksum),
-                     priv->content_hash))
-        {
-          DEBUG ("Hash mismatch when checking incoming handler: "
-                 "received %s, calculated %s", priv->content_hash,
-                 g_checksum_get_string (hash_data->checksum));
-
-          error = g_error_new_literal (EMPATHY_FT_ERROR_QUARK,
-              EMPATHY_FT_ERROR_HASH_MISMATCH,
-              _("The hash of the received file and the "
-                "sent one do not match"));
-          goto cleanup;
-        }
-      else
-        {
-          DEBUG ("Hash verification matched, received %s, calculated %s",
-                 priv->content_hash,
-                 g_checksum_get_string (hash_data->checksum));
-        }
+      error = check_hash_matches (handler,
+          g_checksum_get_string (hash_data->checksum));
+      if (error != NULL)
+        goto cleanup;
     }
   else
     {
@@ -855,6 +1170,9 @@ hash_job_done (gpointer user_data)
           (g_checksum_get_string (hash_data->checksum));
       g_hash_table_insert (priv->request,
           TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER ".ContentHash", value);
+
+      ft_handler_cache_hash (handler,
+          g_checksum_get_string (hash_data->checksum));
     }
 
 cleanup:
@@ -903,7 +1221,7 @@ do_hash_job (GIOSchedulerJob *job,
 
 again:
   if (hash_data->buffer == NULL)
-    hash_data->buffer = g_malloc0 (BUFFER_SIZE);
+    hash_data->buffer = g_malloc (BUFFER_SIZE);
 
   bytes_read = g_input_stream_read (hash_data->stream, hash_data->buffer,
                                     BUFFER_SIZE, cancellable, &error);
@@ -915,12 +1233,17 @@ again:
   /* we now have the chunk */
   if (bytes_read > 0)
     {
+      gint64 now;
+
       g_checksum_update (hash_data->checksum, hash_data->buffer, bytes_read);
-      g_io_scheduler_job_send_to_mainloop_async (job, emit_hashing_progress,
-          hash_data, NULL);
 
-      g_free (hash_data->buffer);
-      hash_data->buffer = NULL;
+      now = empathy_time_get_monotonic ();
+      if (now - hash_data->last_progress_time >= PROGRESS_INTERVAL * 1000)
+        {
+          hash_data->last_progress_time = now;
+          g_io_scheduler_job_send_to_mainloop_async (job,
+              emit_hashing_progress, hash_data, NULL);
+        }
 
       goto again;
     }
@@ -993,11 +1316,11 @@ ft_handler_read_async_cb (GObject *source,
   hash_data->stream = G_INPUT_STREAM (stream);
   hash_data->total_bytes = priv->total_bytes;
   hash_data->handler = g_object_ref (handler);
-  /* FIXME: MD5 is the only ContentHashType supported right now */
-  hash_data->checksum = g_checksum_new (G_CHECKSUM_MD5);
+  hash_data->checksum = g_checksum_new
+    (tp_file_hash_to_g_checksum (priv->content_hash_type));
 
   /* org.freedesktop.Telepathy.Channel.Type.FileTransfer.ContentHashType */
-  value = tp_g_value_slice_new_uint (TP_FILE_HASH_TYPE_MD5);
+  value = tp_g_value_slice_new_uint (priv->content_hash_type);
   g_hash_table_insert (priv->request,
       TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER ".ContentHashType", value);
 
@@ -1043,7 +1366,10 @@ set_content_hash_type_from_classes (EmpathyFTHandler *handler,
         (fprops, TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER ".ContentHashType",
          &valid);
 
-      if (valid)
+      /* only keep the types we can compute */
+      if (valid && (value == TP_FILE_HASH_TYPE_MD5 ||
+              value == TP_FILE_HASH_TYPE_SHA1 ||
+              value == TP_FILE_HASH_TYPE_SHA256))
         g_array_append_val (possible_values, value);
     }
 
@@ -1058,22 +1384,11 @@ set_content_hash_type_from_classes (EmpathyFTHandler *handler,
 
   priv->use_hash = TRUE;
 
-  if (possible_values->len == 1)
-    {
-      priv->content_hash_type = g_array_index (possible_values, guint, 0);
-    }
-  else
-    {
-      /* order the array and pick the first non zero, so that MD5
-       * is the preferred value.
-       */
-      g_array_sort (possible_values, empathy_uint_compare);
-
-      if (g_array_index (possible_values, guint, 0) == 0)
-        priv->content_hash_type = g_array_index (possible_values, guint, 1);
-      else
-        priv->content_hash_type = g_array_index (possible_values, guint, 0);
-    }
+  /* order the array and pick the first one, so that MD5, the cheapest to
+   * compute, is the preferred value.
+   */
+  g_array_sort (possible_values, empathy_uint_compare);
+  priv->content_hash_type = g_array_index (possible_values, guint, 0);
 
 out:
   g_array_free (possible_values, TRUE);
@@ -1124,12 +1439,42 @@ ft_handler_complete_request (EmpathyFTHandler *handler)
   ft_handler_populate_outgoing_request (handler);
 
   if (priv->use_hash)
-    /* start hashing the file */
-    g_file_read_async (priv->gfile, G_PRIORITY_DEFAULT,
-        priv->cancellable, ft_handler_read_async_cb, handler);
+    {
+      gchar *hash;
+
+      hash = ft_handler_dup_cached_hash (handler);
+      if (hash != NULL)
+        {
+          GValue *value;
+
+          DEBUG ("Using the cached hash %s", hash);
+
+          value = tp_g_value_slice_new_uint (priv->content_hash_type);
+          g_hash_table_insert (priv->request,
+              TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER ".ContentHashType", value);
+
+          value = tp_g_value_slice_new_string (hash);
+          g_hash_table_insert (priv->request,
+              TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER ".ContentHash", value);
+          g_free (hash);
+
+          g_signal_emit (handler, signals[HASHING_STARTED], 0);
+          g_signal_emit (handler, signals[HASHING_DONE], 0);
+
+          ft_handler_push_to_dispatcher (handler);
+        }
+      else
+        {
+          /* start hashing the file */
+          g_file_read_async (priv->gfile, G_PRIORITY_DEFAULT,
+              priv->cancellable, ft_handler_read_async_cb, handler);
+        }
+    }
   else
-    /* push directly the handler to the dispatcher */
-    ft_handler_push_to_dispatcher (handler);
+    {
+      /* push directly the handler to the dispatcher */
+      ft_handler_push_to_dispatcher (handler);
+    }
 }
 
 static void
@@ -1170,6 +1515,11 @@ ft_handler_gfile_ready_cb (GObject *source,
   priv->filename = g_strdup (g_file_info_get_display_name (info));
   g_file_info_get_modification_time (info, &mtime);
   priv->mtime = mtime.tv_sec;
+
+  if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_UNIX_INODE))
+    priv->file_id = g_strdup_printf ("%u:%" G_GUINT64_FORMAT,
+        g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_DEVICE),
+        g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_UNIX_INODE));
   priv->transferred_bytes = 0;
   priv->description = NULL;
 
@@ -1320,7 +1670,9 @@ empathy_ft_handler_new_outgoing (EmpathyContact *contact,
       G_FILE_ATTRIBUTE_STANDARD_SIZE ","
       G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
       G_FILE_ATTRIBUTE_STANDARD_TYPE ","
-      G_FILE_ATTRIBUTE_TIME_MODIFIED,
+      G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+      G_FILE_ATTRIBUTE_UNIX_DEVICE ","
+      G_FILE_ATTRIBUTE_UNIX_INODE,
       G_FILE_QUERY_INFO_NONE, G_PRIORITY_DEFAULT,
       NULL, (GAsyncReadyCallback) ft_handler_gfile_ready_cb, data);
 }
@@ -1377,6 +1729,7 @@ empathy_ft_handler_start_transfer (EmpathyFTHandler *handler)
   g_return_if_fail (EMPATHY_IS_FT_HANDLER (handler));
 
   priv = GET_PRIV (handler);
+  priv->is_started = TRUE;
 
   if (priv->tpfile == NULL)
     {
@@ -1384,6 +1737,11 @@ empathy_ft_handler_start_transfer (EmpathyFTHandler *handler)
     }
   else
     {
+      /* verify the hash while receiving the data */
+      if (priv->use_hash)
+        empathy_tp_file_set_checksum_type (priv->tpfile,
+            tp_file_hash_to_g_checksum (priv->content_hash_type));
+
       /* TODO: add support for resume. */
       empathy_tp_file_accept (priv->tpfile, 0, priv->gfile, priv->cancellable,
           ft_transfer_progress_callback, handler,
@@ -1408,6 +1766,23 @@ empathy_ft_handler_cancel_transfer (EmpathyFTHandler *handler)
 
   priv = GET_PRIV (handler);
 
+  /* the transfer is still waiting to be started, nobody else will report
+   * the cancellation */
+  if (!priv->is_started)
+    {
+      GError *error;
+
+      if (priv->tpfile != NULL)
+        empathy_tp_file_cancel (priv->tpfile);
+
+      error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+          _("You canceled the file transfer"));
+      emit_error_signal (handler, error);
+      g_error_free (error);
+
+      return;
+    }
+
   /* if we don't have an EmpathyTpFile, we are hashing, so
    * we can just cancel the GCancellable to stop it.
    */
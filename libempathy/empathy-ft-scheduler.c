@@ -0,0 +1,622 @@
+/*
+ * empathy-ft-scheduler.c - Source for EmpathyFTScheduler
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include "empathy-ft-scheduler.h"
+#include "empathy-tp-file.h"
+#include "empathy-utils.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_FT
+#include "empathy-debug.h"
+
+/**
+ * SECTION:empathy-ft-scheduler
+ * @title:EmpathyFTScheduler
+ * @short_description: queues file transfers and limits their concurrency
+ * @include: libempathy/empathy-ft-scheduler.h
+ *
+ * #EmpathyFTScheduler starts the #EmpathyFTHandler objects queued with
+ * empathy_ft_scheduler_queue(), instead of having all of them running at
+ * the same time. Only a few outgoing transfers are hashed at once, and no
+ * outgoing transfer is offered while too many transfers are open with the
+ * same contact or on the same connection. Offers waiting for the contact
+ * to accept them don't count, they could wait forever. Incoming transfers
+ * were accepted by the user already and are started right away.
+ *
+ * Pending transfers are started smallest first, but a transfer is only
+ * overtaken a few times by smaller ones so that big files are not starved.
+ * Clients can inspect the queue with empathy_ft_scheduler_get_pending() and
+ * reorder it with empathy_ft_scheduler_move(); the ::queue-changed signal
+ * is emitted whenever it changes.
+ */
+
+/* Maximum number of outgoing files being hashed at the same time */
+#define MAX_HASHING 2
+
+/* Maximum number of open transfers with the same contact */
+#define MAX_TRANSFERS_PER_CONTACT 2
+
+/* Maximum number of open transfers on the same connection */
+#define MAX_TRANSFERS_PER_CONNECTION 4
+
+/* Number of times a pending transfer can be overtaken by smaller files */
+#define MAX_OVERTAKEN 8
+
+G_DEFINE_TYPE (EmpathyFTScheduler, empathy_ft_scheduler, G_TYPE_OBJECT);
+
+#define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyFTScheduler)
+
+enum {
+  QUEUE_CHANGED,
+  TRANSFER_STARTED,
+  LAST_SIGNAL
+};
+
+typedef struct {
+  EmpathyFTScheduler *scheduler;
+  EmpathyFTHandler *handler;
+  /* not owned, the handler keeps them alive */
+  EmpathyContact *contact;
+  TpConnection *connection;
+  gboolean hashing;
+  /* the channel is open, the transfer takes a slot */
+  gboolean open;
+  guint overtaken;
+} ScheduledTransfer;
+
+typedef struct {
+  /* owned EmpathyFTHandler -> owned ScheduledTransfer */
+  GHashTable *transfers;
+  /* ScheduledTransfer waiting to be started, in order */
+  GQueue *pending;
+
+  /* EmpathyContact -> number of open transfers */
+  GHashTable *open_per_contact;
+  /* TpConnection -> number of open transfers */
+  GHashTable *open_per_connection;
+  guint n_hashing;
+
+  guint schedule_id;
+  gboolean dispose_run;
+} EmpathyFTSchedulerPriv;
+
+static EmpathyFTScheduler *scheduler_singleton = NULL;
+static guint signals[LAST_SIGNAL] = { 0 };
+
+static void scheduler_schedule (EmpathyFTScheduler *scheduler);
+
+static guint
+count_get (GHashTable *counts,
+    gpointer key)
+{
+  return GPOINTER_TO_UINT (g_hash_table_lookup (counts, key));
+}
+
+static void
+count_add (GHashTable *counts,
+    gpointer key,
+    gint delta)
+{
+  guint count;
+
+  count = count_get (counts, key) + delta;
+
+  if (count == 0)
+    g_hash_table_remove (counts, key);
+  else
+    g_hash_table_insert (counts, key, GUINT_TO_POINTER (count));
+}
+
+static void
+scheduled_transfer_free (ScheduledTransfer *transfer)
+{
+  g_signal_handlers_disconnect_matched (transfer->handler,
+      G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, transfer);
+
+  g_slice_free (ScheduledTransfer, transfer);
+}
+
+static void
+scheduler_forget_transfer (EmpathyFTScheduler *scheduler,
+    ScheduledTransfer *transfer)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (scheduler);
+  GList *l;
+
+  if (transfer->hashing)
+    priv->n_hashing--;
+
+  if (transfer->open)
+    {
+      count_add (priv->open_per_contact, transfer->contact, -1);
+      count_add (priv->open_per_connection, transfer->connection, -1);
+    }
+
+  l = g_queue_find (priv->pending, transfer);
+  if (l != NULL)
+    {
+      g_queue_delete_link (priv->pending, l);
+      g_signal_emit (scheduler, signals[QUEUE_CHANGED], 0);
+    }
+
+  /* this frees the transfer */
+  g_hash_table_remove (priv->transfers, transfer->handler);
+
+  scheduler_schedule (scheduler);
+}
+
+static void
+ft_handler_hashing_done_cb (EmpathyFTHandler *handler,
+    ScheduledTransfer *transfer)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (transfer->scheduler);
+
+  if (!transfer->hashing)
+    return;
+
+  transfer->hashing = FALSE;
+  priv->n_hashing--;
+
+  scheduler_schedule (transfer->scheduler);
+}
+
+static void
+ft_handler_transfer_started_cb (EmpathyFTHandler *handler,
+    EmpathyTpFile *tp_file,
+    ScheduledTransfer *transfer)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (transfer->scheduler);
+
+  if (transfer->open)
+    return;
+
+  /* the channel is open now, the transfer takes its slot until it ends */
+  transfer->open = TRUE;
+  count_add (priv->open_per_contact, transfer->contact, 1);
+  count_add (priv->open_per_connection, transfer->connection, 1);
+}
+
+static void
+ft_handler_transfer_done_cb (EmpathyFTHandler *handler,
+    EmpathyTpFile *tp_file,
+    ScheduledTransfer *transfer)
+{
+  DEBUG ("Transfer of %s done", empathy_ft_handler_get_filename (handler));
+
+  scheduler_forget_transfer (transfer->scheduler, transfer);
+}
+
+static void
+ft_handler_transfer_error_cb (EmpathyFTHandler *handler,
+    GError *error,
+    ScheduledTransfer *transfer)
+{
+  DEBUG ("Transfer of %s failed: %s",
+      empathy_ft_handler_get_filename (handler), error->message);
+
+  scheduler_forget_transfer (transfer->scheduler, transfer);
+}
+
+static gboolean
+scheduler_can_start (EmpathyFTScheduler *scheduler,
+    ScheduledTransfer *transfer)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (scheduler);
+
+  if (!empathy_ft_handler_is_incoming (transfer->handler) &&
+      empathy_ft_handler_get_use_hash (transfer->handler) &&
+      priv->n_hashing >= MAX_HASHING)
+    return FALSE;
+
+  if (count_get (priv->open_per_contact, transfer->contact) >=
+      MAX_TRANSFERS_PER_CONTACT)
+    return FALSE;
+
+  if (count_get (priv->open_per_connection, transfer->connection) >=
+      MAX_TRANSFERS_PER_CONNECTION)
+    return FALSE;
+
+  return TRUE;
+}
+
+static void
+scheduler_start_transfer (EmpathyFTScheduler *scheduler,
+    ScheduledTransfer *transfer)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (scheduler);
+
+  DEBUG ("Starting the transfer of %s",
+      empathy_ft_handler_get_filename (transfer->handler));
+
+  /* hashing happens within start_transfer(), the transfer slot is only
+   * taken once the channel is open, see ft_handler_transfer_started_cb() */
+  if (!empathy_ft_handler_is_incoming (transfer->handler) &&
+      empathy_ft_handler_get_use_hash (transfer->handler))
+    {
+      transfer->hashing = TRUE;
+      priv->n_hashing++;
+    }
+
+  g_signal_emit (scheduler, signals[TRANSFER_STARTED], 0, transfer->handler);
+  empathy_ft_handler_start_transfer (transfer->handler);
+}
+
+static gboolean
+scheduler_start_transfers_cb (gpointer user_data)
+{
+  EmpathyFTScheduler *scheduler = user_data;
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (scheduler);
+  GList *l, *next;
+  gboolean changed = FALSE;
+
+  priv->schedule_id = 0;
+
+  for (l = priv->pending->head; l != NULL; l = next)
+    {
+      ScheduledTransfer *transfer = l->data;
+
+      next = l->next;
+
+      /* skip the transfers blocked by a limit, others might still be
+       * allowed to start */
+      if (!scheduler_can_start (scheduler, transfer))
+        continue;
+
+      g_queue_delete_link (priv->pending, l);
+      changed = TRUE;
+
+      scheduler_start_transfer (scheduler, transfer);
+    }
+
+  if (changed)
+    g_signal_emit (scheduler, signals[QUEUE_CHANGED], 0);
+
+  return FALSE;
+}
+
+static void
+scheduler_schedule (EmpathyFTScheduler *scheduler)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (scheduler);
+
+  /* transfers are started from an idle so that signal handlers are never
+   * re-entered */
+  if (priv->schedule_id == 0 && !g_queue_is_empty (priv->pending))
+    priv->schedule_id = g_idle_add (scheduler_start_transfers_cb, scheduler);
+}
+
+static GObject *
+do_constructor (GType type,
+    guint n_props,
+    GObjectConstructParam *props)
+{
+  GObject *retval;
+
+  if (scheduler_singleton != NULL)
+    {
+      retval = g_object_ref (scheduler_singleton);
+    }
+  else
+    {
+      retval = G_OBJECT_CLASS (empathy_ft_scheduler_parent_class)->constructor
+        (type, n_props, props);
+
+      scheduler_singleton = EMPATHY_FT_SCHEDULER (retval);
+      g_object_add_weak_pointer (retval, (gpointer *) &scheduler_singleton);
+    }
+
+  return retval;
+}
+
+static void
+do_dispose (GObject *object)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (object);
+
+  if (priv->dispose_run)
+    return;
+
+  priv->dispose_run = TRUE;
+
+  if (priv->schedule_id != 0)
+    {
+      g_source_remove (priv->schedule_id);
+      priv->schedule_id = 0;
+    }
+
+  g_queue_clear (priv->pending);
+  g_hash_table_remove_all (priv->transfers);
+
+  G_OBJECT_CLASS (empathy_ft_scheduler_parent_class)->dispose (object);
+}
+
+static void
+do_finalize (GObject *object)
+{
+  EmpathyFTSchedulerPriv *priv = GET_PRIV (object);
+
+  DEBUG ("%p", object);
+
+  g_queue_free (priv->pending);
+  g_hash_table_destroy (priv->transfers);
+  g_hash_table_destroy (priv->open_per_contact);
+  g_hash_table_destroy (priv->open_per_connection);
+
+  G_OBJECT_CLASS (empathy_ft_scheduler_parent_class)->finalize (object);
+}
+
+static void
+empathy_ft_scheduler_class_init (EmpathyFTSchedulerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (EmpathyFTSchedulerPriv));
+
+  object_class->constructor = do_constructor;
+  object_class->dispose = do_dispose;
+  object_class->finalize = do_finalize;
+
+  /**
+   * EmpathyFTScheduler::queue-changed
+   * @scheduler: the object which received the signal
+   *
+   * The signal is emitted when transfers are added to, removed from or
+   * moved in the pending queue.
+   */
+  signals[QUEUE_CHANGED] =
+    g_signal_new ("queue-changed",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0,
+      NULL, NULL,
+      g_cclosure_marshal_VOID__VOID,
+      G_TYPE_NONE, 0);
+
+  /**
+   * EmpathyFTScheduler::transfer-started
+   * @scheduler: the object which received the signal
+   * @handler: the #EmpathyFTHandler being started
+   *
+   * The signal is emitted when a queued transfer leaves the queue, right
+   * before empathy_ft_handler_start_transfer() is called on @handler.
+   */
+  signals[TRANSFER_STARTED] =
+    g_signal_new ("transfer-started",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0,
+      NULL, NULL,
+      g_cclosure_marshal_VOID__OBJECT,
+      G_TYPE_NONE, 1, EMPATHY_TYPE_FT_HANDLER);
+}
+
+static void
+empathy_ft_scheduler_init (EmpathyFTScheduler *scheduler)
+{
+  EmpathyFTSchedulerPriv *priv = G_TYPE_INSTANCE_GET_PRIVATE (scheduler,
+      EMPATHY_TYPE_FT_SCHEDULER, EmpathyFTSchedulerPriv);
+
+  scheduler->priv = priv;
+
+  priv->transfers = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      (GDestroyNotify) g_object_unref,
+      (GDestroyNotify) scheduled_transfer_free);
+  priv->pending = g_queue_new ();
+  priv->open_per_contact = g_hash_table_new (g_direct_hash,
+      g_direct_equal);
+  priv->open_per_connection = g_hash_table_new (g_direct_hash,
+      g_direct_equal);
+}
+
+/* public methods */
+
+/**
+ * empathy_ft_scheduler_dup_singleton:
+ *
+ * Gives the caller a reference to the #EmpathyFTScheduler singleton,
+ * (creating it if necessary).
+ *
+ * Return value: an #EmpathyFTScheduler object
+ */
+EmpathyFTScheduler *
+empathy_ft_scheduler_dup_singleton (void)
+{
+  return g_object_new (EMPATHY_TYPE_FT_SCHEDULER, NULL);
+}
+
+/**
+ * empathy_ft_scheduler_queue:
+ * @scheduler: an #EmpathyFTScheduler
+ * @handler: an #EmpathyFTHandler ready to be started
+ *
+ * Adds @handler to the pending queue, before the first pending transfer
+ * of a bigger file which was not overtaken too often already.
+ * empathy_ft_handler_start_transfer() will be called on @handler once the
+ * limits allow it, or right away for incoming transfers; clients should
+ * connect to the signals of @handler before calling this function.
+ */
+void
+empathy_ft_scheduler_queue (EmpathyFTScheduler *scheduler,
+    EmpathyFTHandler *handler)
+{
+  EmpathyFTSchedulerPriv *priv;
+  ScheduledTransfer *transfer;
+  guint64 total_bytes;
+  GList *l, *before = NULL;
+
+  g_return_if_fail (EMPATHY_IS_FT_SCHEDULER (scheduler));
+  g_return_if_fail (EMPATHY_IS_FT_HANDLER (handler));
+
+  priv = GET_PRIV (scheduler);
+
+  if (g_hash_table_lookup (priv->transfers, handler) != NULL)
+    return;
+
+  transfer = g_slice_new0 (ScheduledTransfer);
+  transfer->scheduler = scheduler;
+  transfer->handler = handler;
+  transfer->contact = empathy_ft_handler_get_contact (handler);
+  transfer->connection = empathy_contact_get_connection (transfer->contact);
+
+  g_hash_table_insert (priv->transfers, g_object_ref (handler), transfer);
+
+  g_signal_connect (handler, "hashing-done",
+      G_CALLBACK (ft_handler_hashing_done_cb), transfer);
+  g_signal_connect (handler, "transfer-started",
+      G_CALLBACK (ft_handler_transfer_started_cb), transfer);
+  g_signal_connect (handler, "transfer-done",
+      G_CALLBACK (ft_handler_transfer_done_cb), transfer);
+  g_signal_connect (handler, "transfer-error",
+      G_CALLBACK (ft_handler_transfer_error_cb), transfer);
+
+  /* the user accepted the incoming transfer already, don't delay it */
+  if (empathy_ft_handler_is_incoming (handler))
+    {
+      scheduler_start_transfer (scheduler, transfer);
+      return;
+    }
+
+  /* smallest files first, in the order they were queued, but never ahead
+   * of a transfer which was overtaken too often */
+  total_bytes = empathy_ft_handler_get_total_bytes (handler);
+  for (l = priv->pending->head; l != NULL; l = l->next)
+    {
+      ScheduledTransfer *other = l->data;
+
+      if (other->overtaken >= MAX_OVERTAKEN)
+        before = NULL;
+      else if (before == NULL &&
+          empathy_ft_handler_get_total_bytes (other->handler) > total_bytes)
+        before = l;
+    }
+
+  if (before != NULL)
+    {
+      for (l = before; l != NULL; l = l->next)
+        ((ScheduledTransfer *) l->data)->overtaken++;
+
+      g_queue_insert_before (priv->pending, before, transfer);
+    }
+  else
+    {
+      g_queue_push_tail (priv->pending, transfer);
+    }
+
+  DEBUG ("Queued the transfer of %s, %u pending",
+      empathy_ft_handler_get_filename (handler),
+      g_queue_get_length (priv->pending));
+
+  g_signal_emit (scheduler, signals[QUEUE_CHANGED], 0);
+  scheduler_schedule (scheduler);
+}
+
+/**
+ * empathy_ft_scheduler_get_pending:
+ * @scheduler: an #EmpathyFTScheduler
+ *
+ * Returns the transfers waiting to be started, in the order they will be
+ * started.
+ *
+ * Return value: a #GList of #EmpathyFTHandler, free it with g_list_free()
+ */
+GList *
+empathy_ft_scheduler_get_pending (EmpathyFTScheduler *scheduler)
+{
+  EmpathyFTSchedulerPriv *priv;
+  GList *l, *handlers = NULL;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (scheduler), NULL);
+
+  priv = GET_PRIV (scheduler);
+
+  for (l = priv->pending->tail; l != NULL; l = l->prev)
+    {
+      ScheduledTransfer *transfer = l->data;
+
+      handlers = g_list_prepend (handlers, transfer->handler);
+    }
+
+  return handlers;
+}
+
+/**
+ * empathy_ft_scheduler_get_position:
+ * @scheduler: an #EmpathyFTScheduler
+ * @handler: an #EmpathyFTHandler
+ *
+ * Returns the position of @handler in the pending queue.
+ *
+ * Return value: the position of @handler, or -1 if it is not pending
+ */
+gint
+empathy_ft_scheduler_get_position (EmpathyFTScheduler *scheduler,
+    EmpathyFTHandler *handler)
+{
+  EmpathyFTSchedulerPriv *priv;
+  ScheduledTransfer *transfer;
+
+  g_return_val_if_fail (EMPATHY_IS_FT_SCHEDULER (scheduler), -1);
+  g_return_val_if_fail (EMPATHY_IS_FT_HANDLER (handler), -1);
+
+  priv = GET_PRIV (scheduler);
+
+  transfer = g_hash_table_lookup (priv->transfers, handler);
+  if (transfer == NULL)
+    return -1;
+
+  return g_queue_index (priv->pending, transfer);
+}
+
+/**
+ * empathy_ft_scheduler_move:
+ * @scheduler: an #EmpathyFTScheduler
+ * @handler: a pending #EmpathyFTHandler
+ * @position: the new position of @handler in the pending queue
+ *
+ * Moves @handler to @position in the pending queue. A negative or too big
+ * @position moves it to the end of the queue.
+ */
+void
+empathy_ft_scheduler_move (EmpathyFTScheduler *scheduler,
+    EmpathyFTHandler *handler,
+    gint position)
+{
+  EmpathyFTSchedulerPriv *priv;
+  ScheduledTransfer *transfer;
+  GList *l;
+
+  g_return_if_fail (EMPATHY_IS_FT_SCHEDULER (scheduler));
+  g_return_if_fail (EMPATHY_IS_FT_HANDLER (handler));
+
+  priv = GET_PRIV (scheduler);
+
+  transfer = g_hash_table_lookup (priv->transfers, handler);
+  if (transfer == NULL)
+    return;
+
+  l = g_queue_find (priv->pending, transfer);
+  if (l == NULL)
+    return;
+
+  g_queue_delete_link (priv->pending, l);
+  g_queue_push_nth (priv->pending, transfer, position);
+
+  g_signal_emit (scheduler, signals[QUEUE_CHANGED], 0);
+}
@@ -0,0 +1,68 @@
+/*
+ * empathy-ft-scheduler.h - Header for EmpathyFTScheduler
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_FT_SCHEDULER_H__
+#define __EMPATHY_FT_SCHEDULER_H__
+
+#include <glib-object.h>
+
+#include "empathy-ft-handler.h"
+
+G_BEGIN_DECLS
+
+#define EMPATHY_TYPE_FT_SCHEDULER empathy_ft_scheduler_get_type()
+#define EMPATHY_FT_SCHEDULER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   EMPATHY_TYPE_FT_SCHEDULER, EmpathyFTScheduler))
+#define EMPATHY_FT_SCHEDULER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+   EMPATHY_TYPE_FT_SCHEDULER, EmpathyFTSchedulerClass))
+#define EMPATHY_IS_FT_SCHEDULER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EMPATHY_TYPE_FT_SCHEDULER))
+#define EMPATHY_IS_FT_SCHEDULER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), EMPATHY_TYPE_FT_SCHEDULER))
+#define EMPATHY_FT_SCHEDULER_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+   EMPATHY_TYPE_FT_SCHEDULER, EmpathyFTSchedulerClass))
+
+typedef struct {
+  GObject parent;
+  gpointer priv;
+} EmpathyFTScheduler;
+
+typedef struct {
+  GObjectClass parent_class;
+} EmpathyFTSchedulerClass;
+
+GType empathy_ft_scheduler_get_type (void);
+
+/* public methods */
+EmpathyFTScheduler * empathy_ft_scheduler_dup_singleton (void);
+void empathy_ft_scheduler_queue (EmpathyFTScheduler *scheduler,
+    EmpathyFTHandler *handler);
+GList * empathy_ft_scheduler_get_pending (EmpathyFTScheduler *scheduler);
+gint empathy_ft_scheduler_get_position (EmpathyFTScheduler *scheduler,
+    EmpathyFTHandler *handler);
+void empathy_ft_scheduler_move (EmpathyFTScheduler *scheduler,
+    EmpathyFTHandler *handler,
+    gint position);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_FT_SCHEDULER_H__ */
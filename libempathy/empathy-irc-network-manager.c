@@ -27,6 +27,7 @@
 
 #include "empathy-utils.h"
 #include "empathy-irc-network-manager.h"
+#include "empathy-xml-saver.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_IRC
 #include "empathy-debug.h"
@@ -42,12 +43,10 @@ typedef struct {
   gchar *user_file;
   guint last_id;
 
-  /* Do we have to save modifications to the user file ? */
-  gboolean have_to_save;
   /* Are we loading networks from XML files ? */
   gboolean loading;
-  /* source id of the autosave timer */
-  gint save_timer_id;
+  /* saves modifications to the user file, NULL if there is none */
+  EmpathyXmlSaver *saver;
 } EmpathyIrcNetworkManagerPriv;
 
 /* properties */
@@ -66,8 +65,7 @@ static void irc_network_manager_load_servers (
 static gboolean irc_network_manager_file_parse (
     EmpathyIrcNetworkManager *manager, const gchar *filename,
     gboolean user_defined);
-static gboolean irc_network_manager_file_save (
-    EmpathyIrcNetworkManager *manager);
+static xmlDocPtr irc_network_manager_file_build (gpointer user_data);
 
 static void
 empathy_irc_network_manager_get_property (GObject *object,
@@ -124,14 +122,20 @@ empathy_irc_network_manager_constructor (GType type,
 {
   GObject *obj;
   EmpathyIrcNetworkManager *self;
+  EmpathyIrcNetworkManagerPriv *priv;
 
   /* Parent constructor chain */
   obj = G_OBJECT_CLASS (empathy_irc_network_manager_parent_class)->
         constructor (type, n_props, props);
 
   self = EMPATHY_IRC_NETWORK_MANAGER (obj);
+  priv = GET_PRIV (self);
   irc_network_manager_load_servers (self);
 
+  if (priv->user_file != NULL)
+    priv->saver = empathy_xml_saver_new (priv->user_file, SAVE_TIMER,
+        irc_network_manager_file_build, self);
+
   return obj;
 }
 
@@ -141,15 +145,9 @@ empathy_irc_network_manager_finalize (GObject *object)
   EmpathyIrcNetworkManager *self = EMPATHY_IRC_NETWORK_MANAGER (object);
   EmpathyIrcNetworkManagerPriv *priv = GET_PRIV (self);
 
-  if (priv->save_timer_id > 0)
-    {
-      g_source_remove (priv->save_timer_id);
-    }
-
-  if (priv->have_to_save)
-    {
-      irc_network_manager_file_save (self);
-    }
+  /* Writes pending modifications */
+  if (priv->saver != NULL)
+    empathy_xml_saver_free (priv->saver);
 
   g_free (priv->global_file);
   g_free (priv->user_file);
@@ -172,9 +170,7 @@ empathy_irc_network_manager_init (EmpathyIrcNetworkManager *self)
 
   priv->last_id = 0;
 
-  priv->have_to_save = FALSE;
   priv->loading = FALSE;
-  priv->save_timer_id = 0;
 }
 
 static void
@@ -241,29 +237,18 @@ empathy_irc_network_manager_new (const gchar *global_file,
   return manager;
 }
 
-static gboolean
-save_timeout (EmpathyIrcNetworkManager *self)
-{
-  EmpathyIrcNetworkManagerPriv *priv = GET_PRIV (self);
-
-  priv->save_timer_id = 0;
-  irc_network_manager_file_save (self);
-
-  return FALSE;
-}
-
 static void
 reset_save_timeout (EmpathyIrcNetworkManager *self)
 {
   EmpathyIrcNetworkManagerPriv *priv = GET_PRIV (self);
 
-  if (priv->save_timer_id > 0)
+  if (priv->saver == NULL)
     {
-      g_source_remove (priv->save_timer_id);
+      DEBUG ("can't save: no user file defined");
+      return;
     }
 
-  priv->save_timer_id = g_timeout_add_seconds (SAVE_TIMER,
-      (GSourceFunc) save_timeout, self);
+  empathy_xml_saver_queue (priv->saver);
 }
 
 static void
@@ -275,10 +260,7 @@ network_modified (EmpathyIrcNetwork *network,
   network->user_defined = TRUE;
 
   if (!priv->loading)
-    {
-      priv->have_to_save = TRUE;
-      reset_save_timeout (self);
-    }
+    reset_save_timeout (self);
 }
 
 static void
@@ -332,7 +314,6 @@ empathy_irc_network_manager_add (EmpathyIrcNetworkManager *self,
   network->user_defined = TRUE;
   add_network (self, network, id);
 
-  priv->have_to_save = TRUE;
   reset_save_timeout (self);
 
   g_free (id);
@@ -360,7 +341,6 @@ empathy_irc_network_manager_remove (EmpathyIrcNetworkManager *self,
   network->user_defined = TRUE;
   network->dropped = TRUE;
 
-  priv->have_to_save = TRUE;
   reset_save_timeout (self);
 }
 
@@ -449,7 +429,6 @@ irc_network_manager_load_servers (EmpathyIrcNetworkManager *self)
   load_user_file (self);
 
   priv->loading = FALSE;
-  priv->have_to_save = FALSE;
 }
 
 static void
@@ -685,19 +664,13 @@ write_network_to_xml (const gchar *id,
   g_slist_free (servers);
 }
 
-static gboolean
-irc_network_manager_file_save (EmpathyIrcNetworkManager *self)
+static xmlDocPtr
+irc_network_manager_file_build (gpointer user_data)
 {
-  EmpathyIrcNetworkManagerPriv *priv = GET_PRIV (self);
+  EmpathyIrcNetworkManagerPriv *priv = GET_PRIV (user_data);
   xmlDocPtr doc;
   xmlNodePtr root;
 
-  if (priv->user_file == NULL)
-    {
-      DEBUG ("can't save: no user file defined");
-      return FALSE;
-    }
-
   DEBUG ("Saving IRC networks");
 
   doc = xmlNewDoc ("1.0");
@@ -706,18 +679,7 @@ irc_network_manager_file_save (EmpathyIrcNetworkManager *self)
 
   g_hash_table_foreach (priv->networks, (GHFunc) write_network_to_xml, root);
 
-  /* Make sure the XML is indented properly */
-  xmlIndentTreeOutput = 1;
-
-  xmlSaveFormatFileEnc (priv->user_file, doc, "utf-8", 1);
-  xmlFreeDoc (doc);
-
-  xmlCleanupParser ();
-  xmlMemoryDump ();
-
-  priv->have_to_save = FALSE;
-
-  return TRUE;
+  return doc;
 }
 
 static gboolean
@@ -241,6 +241,37 @@ empathy_log_manager_get_messages_for_date (EmpathyLogManager *manager,
   return out;
 }
 
+/* Same as empathy_log_manager_get_messages_for_date(), but the messages
+ * come in a block with one contact per sender. Unref it when done. */
+EmpathyMessageBlock *
+empathy_log_manager_get_message_block_for_date (EmpathyLogManager *manager,
+                                                EmpathyAccount *account,
+                                                const gchar *chat_id,
+                                                gboolean chatroom,
+                                                const gchar *date)
+{
+  EmpathyMessageBlock *block;
+  GList *l;
+  EmpathyLogManagerPriv *priv;
+
+  g_return_val_if_fail (EMPATHY_IS_LOG_MANAGER (manager), NULL);
+  g_return_val_if_fail (chat_id != NULL, NULL);
+
+  priv = GET_PRIV (manager);
+
+  block = empathy_message_block_new (account);
+
+  for (l = priv->stores; l; l = g_list_next (l))
+    {
+      EmpathyLogStore *store = EMPATHY_LOG_STORE (l->data);
+
+      empathy_log_store_add_messages_for_date (store, account, chat_id,
+          chatroom, date, block);
+    }
+
+  return block;
+}
+
 static gint
 log_manager_message_date_cmp (gconstpointer a,
 			      gconstpointer b)
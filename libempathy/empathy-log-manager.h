@@ -29,6 +29,7 @@
 #include <libmissioncontrol/mc-account.h>
 
 #include "empathy-message.h"
+#include "empathy-message-block.h"
 #include "empathy-dispatcher.h"
 
 G_BEGIN_DECLS
@@ -87,6 +88,9 @@ GList *empathy_log_manager_get_dates (EmpathyLogManager *manager,
 GList *empathy_log_manager_get_messages_for_date (EmpathyLogManager *manager,
     EmpathyAccount *account, const gchar *chat_id, gboolean chatroom,
     const gchar *date);
+EmpathyMessageBlock *empathy_log_manager_get_message_block_for_date (
+    EmpathyLogManager *manager, EmpathyAccount *account, const gchar *chat_id,
+    gboolean chatroom, const gchar *date);
 GList *empathy_log_manager_get_filtered_messages (EmpathyLogManager *manager,
     EmpathyAccount *account, const gchar *chat_id, gboolean chatroom,
     guint num_messages, EmpathyLogMessageFilter filter, gpointer user_data);
@@ -44,7 +44,6 @@
 #define LOG_FILE_CREATE_MODE      (S_IRUSR | S_IWUSR)
 #define LOG_DIR_CHATROOMS         "chatrooms"
 #define LOG_FILENAME_SUFFIX       ".log"
-#define LOG_TIME_FORMAT_FULL      "%Y%m%dT%H:%M:%S"
 #define LOG_TIME_FORMAT           "%Y%m%d"
 #define LOG_HEADER \
     "<?xml version='1.0' encoding='utf-8'?>\n" \
@@ -63,6 +62,11 @@ typedef struct
   EmpathyAccountManager *account_manager;
 } EmpathyLogStoreEmpathyPriv;
 
+enum {
+  PROP_0,
+  PROP_BASEDIR,
+};
+
 static void log_store_iface_init (gpointer g_iface,gpointer iface_data);
 
 G_DEFINE_TYPE_WITH_CODE (EmpathyLogStoreEmpathy, empathy_log_store_empathy,
@@ -80,12 +84,65 @@ log_store_empathy_finalize (GObject *object)
   g_free (priv->name);
 }
 
+static void
+log_store_empathy_get_property (GObject *object,
+                                guint param_id,
+                                GValue *value,
+                                GParamSpec *pspec)
+{
+  EmpathyLogStoreEmpathyPriv *priv = GET_PRIV (object);
+
+  switch (param_id)
+    {
+      case PROP_BASEDIR:
+        g_value_set_string (value, priv->basedir);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, param_id, pspec);
+        break;
+    }
+}
+
+static void
+log_store_empathy_set_property (GObject *object,
+                                guint param_id,
+                                const GValue *value,
+                                GParamSpec *pspec)
+{
+  EmpathyLogStoreEmpathyPriv *priv = GET_PRIV (object);
+
+  switch (param_id)
+    {
+      case PROP_BASEDIR:
+        /* NULL keeps the default, ~/.gnome2/Empathy/logs */
+        if (g_value_get_string (value) != NULL)
+          {
+            g_free (priv->basedir);
+            priv->basedir = g_value_dup_string (value);
+          }
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, param_id, pspec);
+        break;
+    }
+}
+
 static void
 empathy_log_store_empathy_class_init (EmpathyLogStoreEmpathyClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->finalize = log_store_empathy_finalize;
+  object_class->get_property = log_store_empathy_get_property;
+  object_class->set_property = log_store_empathy_set_property;
+
+  g_object_class_install_property (object_class, PROP_BASEDIR,
+      g_param_spec_string ("basedir",
+        "Base directory",
+        "The directory the logs are kept in",
+        NULL,
+        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+        G_PARAM_STATIC_STRINGS));
 
   g_type_class_add_private (object_class, sizeof (EmpathyLogStoreEmpathyPriv));
 }
@@ -153,7 +210,7 @@ log_store_empathy_get_timestamp_from_message (EmpathyMessage *message)
   t = empathy_message_get_timestamp (message);
 
   /* We keep the timestamps in the messages as UTC. */
-  return empathy_time_to_string_utc (t, LOG_TIME_FORMAT_FULL);
+  return empathy_time_to_string_log (t);
 }
 
 static gchar *
@@ -396,34 +453,28 @@ log_store_empathy_search_hit_new (EmpathyLogStore *self,
   return hit;
 }
 
-static GList *
-log_store_empathy_get_messages_for_file (EmpathyLogStore *self,
-                                         const gchar *filename)
+static void
+log_store_empathy_add_messages_for_file (EmpathyLogStore *self,
+                                         const gchar *filename,
+                                         EmpathyMessageBlock *block)
 {
-  GList *messages = NULL;
   xmlParserCtxtPtr ctxt;
   xmlDocPtr doc;
   xmlNodePtr log_node;
   xmlNodePtr node;
-  EmpathyLogSearchHit *hit;
-  EmpathyAccount *account;
+  guint n_messages;
 
-  g_return_val_if_fail (EMPATHY_IS_LOG_STORE (self), NULL);
-  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_if_fail (EMPATHY_IS_LOG_STORE (self));
+  g_return_if_fail (filename != NULL);
 
   DEBUG ("Attempting to parse filename:'%s'...", filename);
 
   if (!g_file_test (filename, G_FILE_TEST_EXISTS))
     {
       DEBUG ("Filename:'%s' does not exist", filename);
-      return NULL;
+      return;
     }
 
-  /* Get the account from the filename */
-  hit = log_store_empathy_search_hit_new (self, filename);
-  account = g_object_ref (hit->account);
-  empathy_log_manager_search_hit_free (hit);
-
   /* Create parser. */
   ctxt = xmlNewParserCtxt ();
 
@@ -433,7 +484,7 @@ log_store_empathy_get_messages_for_file (EmpathyLogStore *self,
     {
       g_warning ("Failed to parse file:'%s'", filename);
       xmlFreeParserCtxt (ctxt);
-      return NULL;
+      return;
     }
 
   /* The root node, presets. */
@@ -442,13 +493,15 @@ log_store_empathy_get_messages_for_file (EmpathyLogStore *self,
     {
       xmlFreeDoc (doc);
       xmlFreeParserCtxt (ctxt);
-      return NULL;
+      return;
     }
 
+  n_messages = empathy_message_block_get_length (block);
+
   /* Now get the messages. */
   for (node = log_node->children; node; node = node->next)
     {
-      EmpathyMessage *message;
+      EmpathyMessageRecord *record;
       EmpathyContact *sender;
       gchar *time;
       time_t t;
@@ -460,7 +513,6 @@ log_store_empathy_get_messages_for_file (EmpathyLogStore *self,
       gboolean is_user = FALSE;
       gchar *msg_type_str;
       gchar *cm_id_str;
-      guint cm_id;
       TpChannelTextMessageType msg_type = TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL;
 
       if (strcmp (node->name, "message") != 0)
@@ -481,29 +533,23 @@ log_store_empathy_get_messages_for_file (EmpathyLogStore *self,
       if (msg_type_str)
         msg_type = empathy_message_type_from_str (msg_type_str);
 
-      if (cm_id_str)
-        cm_id = atoi (cm_id_str);
-
       t = empathy_time_parse (time);
 
-      sender = empathy_contact_new_for_log (account, sender_id, sender_name,
-					    is_user);
+      /* One contact per sender in the block rather than one per line */
+      sender = empathy_message_block_intern_sender (block, sender_id,
+          sender_name, is_user);
 
-      if (!EMP_STR_EMPTY (sender_avatar_token))
+      if (sender != NULL && !EMP_STR_EMPTY (sender_avatar_token) &&
+          empathy_contact_get_avatar (sender) == NULL)
         empathy_contact_load_avatar_cache (sender,
             sender_avatar_token);
 
-      message = empathy_message_new (body);
-      empathy_message_set_sender (message, sender);
-      empathy_message_set_timestamp (message, t);
-      empathy_message_set_tptype (message, msg_type);
+      record = empathy_message_block_append (block, sender, body, t,
+          msg_type);
 
       if (cm_id_str)
-        empathy_message_set_id (message, cm_id);
+        record->id = atoi (cm_id_str);
 
-      messages = g_list_append (messages, message);
-
-      g_object_unref (sender);
       xmlFree (time);
       xmlFree (sender_id);
       xmlFree (sender_name);
@@ -514,10 +560,40 @@ log_store_empathy_get_messages_for_file (EmpathyLogStore *self,
       xmlFree (sender_avatar_token);
     }
 
-  DEBUG ("Parsed %d messages", g_list_length (messages));
+  DEBUG ("Parsed %d messages",
+      empathy_message_block_get_length (block) - n_messages);
 
   xmlFreeDoc (doc);
   xmlFreeParserCtxt (ctxt);
+}
+
+static GList *
+log_store_empathy_get_messages_for_file (EmpathyLogStore *self,
+                                         const gchar *filename)
+{
+  EmpathyMessageBlock *block;
+  EmpathyLogSearchHit *hit;
+  GList *messages = NULL;
+  guint i;
+
+  g_return_val_if_fail (EMPATHY_IS_LOG_STORE (self), NULL);
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  /* Get the account from the filename */
+  hit = log_store_empathy_search_hit_new (self, filename);
+  if (hit == NULL)
+    return NULL;
+
+  block = empathy_message_block_new (hit->account);
+  empathy_log_manager_search_hit_free (hit);
+
+  log_store_empathy_add_messages_for_file (self, filename, block);
+
+  for (i = empathy_message_block_get_length (block); i > 0; i--)
+    messages = g_list_prepend (messages,
+        empathy_message_block_dup_message (block, i - 1));
+
+  empathy_message_block_unref (block);
 
   return messages;
 }
@@ -690,6 +766,25 @@ log_store_empathy_get_messages_for_date (EmpathyLogStore *self,
   return messages;
 }
 
+static void
+log_store_empathy_add_messages_for_date (EmpathyLogStore *self,
+                                         EmpathyAccount *account,
+                                         const gchar *chat_id,
+                                         gboolean chatroom,
+                                         const gchar *date,
+                                         EmpathyMessageBlock *block)
+{
+  gchar *filename;
+
+  g_return_if_fail (EMPATHY_IS_LOG_STORE (self));
+  g_return_if_fail (chat_id != NULL);
+
+  filename = log_store_empathy_get_filename_for_date (self, account,
+      chat_id, chatroom, date);
+  log_store_empathy_add_messages_for_file (self, filename, block);
+  g_free (filename);
+}
+
 static GList *
 log_store_empathy_get_chats (EmpathyLogStore *self,
                               EmpathyAccount *account)
@@ -734,29 +829,32 @@ log_store_empathy_get_filtered_messages (EmpathyLogStore *self,
 
   for (l = g_list_last (dates); l && i < num_messages; l = g_list_previous (l))
     {
-      GList *new_messages, *n, *next;
+      EmpathyMessageBlock *block;
+      guint j;
 
-      /* FIXME: We should really restrict the message parsing to get only
-       * the newest num_messages. */
-      new_messages = log_store_empathy_get_messages_for_date (self, account,
-          chat_id, chatroom, l->data);
+      block = empathy_message_block_new (account);
+      log_store_empathy_add_messages_for_date (self, account, chat_id,
+          chatroom, l->data, block);
 
-      n = new_messages;
-      while (n != NULL)
+      /* Only the newest messages which pass the filter become objects */
+      for (j = empathy_message_block_get_length (block);
+           j > 0 && i < num_messages; j--)
         {
-          next = g_list_next (n);
-          if (!filter (n->data, user_data))
+          EmpathyMessage *message;
+
+          message = empathy_message_block_dup_message (block, j - 1);
+          if (filter (message, user_data))
             {
-              g_object_unref (n->data);
-              new_messages = g_list_delete_link (new_messages, n);
+              messages = g_list_prepend (messages, message);
+              i++;
             }
           else
             {
-              i++;
+              g_object_unref (message);
             }
-          n = next;
         }
-      messages = g_list_concat (messages, new_messages);
+
+      empathy_message_block_unref (block);
     }
 
   g_list_foreach (dates, (GFunc) g_free, NULL);
@@ -780,4 +878,5 @@ log_store_iface_init (gpointer g_iface,
   iface->search_new = log_store_empathy_search_new;
   iface->ack_message = NULL;
   iface->get_filtered_messages = log_store_empathy_get_filtered_messages;
+  iface->add_messages_for_date = log_store_empathy_add_messages_for_date;
 }
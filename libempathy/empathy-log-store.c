@@ -171,3 +171,35 @@ empathy_log_store_get_filtered_messages (EmpathyLogStore *self,
   return EMPATHY_LOG_STORE_GET_INTERFACE (self)->get_filtered_messages (
       self, account, chat_id, chatroom, num_messages, filter, user_data);
 }
+
+/* Appends the messages of @date to @block, for replaying them without an
+ * EmpathyMessage per line. Stores which don't implement it are still asked
+ * for their messages the usual way. */
+void
+empathy_log_store_add_messages_for_date (EmpathyLogStore *self,
+                                         EmpathyAccount *account,
+                                         const gchar *chat_id,
+                                         gboolean chatroom,
+                                         const gchar *date,
+                                         EmpathyMessageBlock *block)
+{
+  GList *messages, *l;
+
+  if (EMPATHY_LOG_STORE_GET_INTERFACE (self)->add_messages_for_date)
+    {
+      EMPATHY_LOG_STORE_GET_INTERFACE (self)->add_messages_for_date (
+          self, account, chat_id, chatroom, date, block);
+      return;
+    }
+
+  messages = empathy_log_store_get_messages_for_date (self, account,
+      chat_id, chatroom, date);
+
+  for (l = messages; l != NULL; l = g_list_next (l))
+    {
+      empathy_message_block_append_message (block, l->data);
+      g_object_unref (l->data);
+    }
+
+  g_list_free (messages);
+}
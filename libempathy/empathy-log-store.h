@@ -28,6 +28,7 @@
 #include <libempathy/empathy-account.h>
 
 #include "empathy-message.h"
+#include "empathy-message-block.h"
 #include "empathy-log-manager.h"
 
 G_BEGIN_DECLS
@@ -69,6 +70,9 @@ struct _EmpathyLogStoreInterface
   GList * (*get_filtered_messages) (EmpathyLogStore *self, EmpathyAccount *account,
       const gchar *chat_id, gboolean chatroom, guint num_messages,
       EmpathyLogMessageFilter filter, gpointer user_data);
+  void (*add_messages_for_date) (EmpathyLogStore *self,
+      EmpathyAccount *account, const gchar *chat_id, gboolean chatroom,
+      const gchar *date, EmpathyMessageBlock *block);
 };
 
 GType empathy_log_store_get_type (void) G_GNUC_CONST;
@@ -95,6 +99,9 @@ void empathy_log_store_ack_message (EmpathyLogStore *self,
 GList *empathy_log_store_get_filtered_messages (EmpathyLogStore *self,
     EmpathyAccount *account, const gchar *chat_id, gboolean chatroom,
     guint num_messages, EmpathyLogMessageFilter filter, gpointer user_data);
+void empathy_log_store_add_messages_for_date (EmpathyLogStore *self,
+    EmpathyAccount *account, const gchar *chat_id, gboolean chatroom,
+    const gchar *date, EmpathyMessageBlock *block);
 
 G_END_DECLS
 
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "empathy-message-block.h"
+#include "empathy-footprint.h"
+
+/* Records per slab; slabs never move, so records can be handed out */
+#define SLAB_SIZE 256
+
+/* Bodies are packed in chunks of at least this many bytes */
+#define BODY_CHUNK_SIZE 16384
+
+struct _EmpathyMessageBlock {
+  guint ref_count;
+  EmpathyAccount *account;
+  /* array of EmpathyMessageRecord[SLAB_SIZE] */
+  GPtrArray *slabs;
+  guint length;
+  GStringChunk *bodies;
+  /* "<is_user><id>\n<name>" -> borrowed EmpathyContact */
+  GHashTable *senders;
+  /* EmpathyContact -> owned EmpathyContact */
+  GHashTable *contacts;
+  /* bytes accounted for in the "message-block" footprint */
+  gssize footprint;
+};
+
+/* @account is the one of the contacts created by
+ * empathy_message_block_intern_sender(), it can be NULL. */
+EmpathyMessageBlock *
+empathy_message_block_new (EmpathyAccount *account)
+{
+  EmpathyMessageBlock *block;
+
+  block = g_slice_new0 (EmpathyMessageBlock);
+  block->ref_count = 1;
+  block->account = account != NULL ? g_object_ref (account) : NULL;
+  block->slabs = g_ptr_array_new ();
+  block->bodies = g_string_chunk_new (BODY_CHUNK_SIZE);
+  block->senders = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  block->contacts = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, g_object_unref);
+
+  EMPATHY_FOOTPRINT_ADD ("message-block", 1, 0);
+
+  return block;
+}
+
+EmpathyMessageBlock *
+empathy_message_block_ref (EmpathyMessageBlock *block)
+{
+  g_return_val_if_fail (block != NULL, NULL);
+
+  block->ref_count++;
+
+  return block;
+}
+
+void
+empathy_message_block_unref (EmpathyMessageBlock *block)
+{
+  g_return_if_fail (block != NULL);
+
+  if (--block->ref_count > 0)
+    return;
+
+  EMPATHY_FOOTPRINT_ADD ("message-block", -1, -block->footprint);
+
+  g_ptr_array_foreach (block->slabs, (GFunc) g_free, NULL);
+  g_ptr_array_free (block->slabs, TRUE);
+  g_string_chunk_free (block->bodies);
+  g_hash_table_destroy (block->senders);
+  g_hash_table_destroy (block->contacts);
+
+  if (block->account != NULL)
+    g_object_unref (block->account);
+
+  g_slice_free (EmpathyMessageBlock, block);
+}
+
+static void
+message_block_hold_contact (EmpathyMessageBlock *block,
+    EmpathyContact *contact)
+{
+  if (g_hash_table_lookup (block->contacts, contact) == NULL)
+    g_hash_table_insert (block->contacts, contact, g_object_ref (contact));
+}
+
+/* Returns the contact of the block for this sender, created the first time
+ * it is seen. The block keeps the reference. */
+EmpathyContact *
+empathy_message_block_intern_sender (EmpathyMessageBlock *block,
+    const gchar *id,
+    const gchar *name,
+    gboolean is_user)
+{
+  EmpathyContact *contact;
+  gchar *key;
+
+  g_return_val_if_fail (block != NULL, NULL);
+  g_return_val_if_fail (id != NULL, NULL);
+
+  key = g_strdup_printf ("%c%s\n%s", is_user ? '1' : '0', id,
+      name != NULL ? name : "");
+
+  contact = g_hash_table_lookup (block->senders, key);
+  if (contact != NULL)
+    {
+      g_free (key);
+      return contact;
+    }
+
+  contact = empathy_contact_new_for_log (block->account, id, name, is_user);
+  g_hash_table_insert (block->contacts, contact, contact);
+  g_hash_table_insert (block->senders, key, contact);
+
+  return contact;
+}
+
+/* Adds a message from @sender, which the block refs if it doesn't hold it
+ * already. @body is copied. Returns the new record, for the caller to fill
+ * the rest. */
+EmpathyMessageRecord *
+empathy_message_block_append (EmpathyMessageBlock *block,
+    EmpathyContact *sender,
+    const gchar *body,
+    time_t timestamp,
+    TpChannelTextMessageType type)
+{
+  EmpathyMessageRecord *slab, *record;
+
+  g_return_val_if_fail (block != NULL, NULL);
+
+  if (block->length % SLAB_SIZE == 0)
+    {
+      g_ptr_array_add (block->slabs, g_new (EmpathyMessageRecord, SLAB_SIZE));
+      block->footprint += SLAB_SIZE * sizeof (EmpathyMessageRecord);
+      EMPATHY_FOOTPRINT_ADD ("message-block", 0,
+          SLAB_SIZE * sizeof (EmpathyMessageRecord));
+    }
+
+  if (sender != NULL)
+    message_block_hold_contact (block, sender);
+
+  slab = g_ptr_array_index (block->slabs, block->length / SLAB_SIZE);
+  record = slab + block->length % SLAB_SIZE;
+  block->length++;
+
+  record->sender = sender;
+  record->body = NULL;
+  record->timestamp = timestamp;
+  record->type = type;
+  record->id = 0;
+
+  if (body != NULL)
+    {
+      gssize len = strlen (body) + 1;
+
+      record->body = g_string_chunk_insert_len (block->bodies, body, len - 1);
+      block->footprint += len;
+      EMPATHY_FOOTPRINT_ADD ("message-block", 0, len);
+    }
+
+  return record;
+}
+
+/* For stores which only know how to make EmpathyMessage objects */
+void
+empathy_message_block_append_message (EmpathyMessageBlock *block,
+    EmpathyMessage *message)
+{
+  EmpathyMessageRecord *record;
+
+  g_return_if_fail (block != NULL);
+  g_return_if_fail (EMPATHY_IS_MESSAGE (message));
+
+  record = empathy_message_block_append (block,
+      empathy_message_get_sender (message),
+      empathy_message_get_body (message),
+      empathy_message_get_timestamp (message),
+      empathy_message_get_tptype (message));
+  record->id = empathy_message_get_id (message);
+}
+
+guint
+empathy_message_block_get_length (EmpathyMessageBlock *block)
+{
+  g_return_val_if_fail (block != NULL, 0);
+
+  return block->length;
+}
+
+/* Returns the @i-th record, oldest first. It lives as long as the block. */
+const EmpathyMessageRecord *
+empathy_message_block_get (EmpathyMessageBlock *block,
+    guint i)
+{
+  EmpathyMessageRecord *slab;
+
+  g_return_val_if_fail (block != NULL, NULL);
+  g_return_val_if_fail (i < block->length, NULL);
+
+  slab = g_ptr_array_index (block->slabs, i / SLAB_SIZE);
+
+  return slab + i % SLAB_SIZE;
+}
+
+/* Returns a new EmpathyMessage for the @i-th record, sharing its sender
+ * with the block. */
+EmpathyMessage *
+empathy_message_block_dup_message (EmpathyMessageBlock *block,
+    guint i)
+{
+  const EmpathyMessageRecord *record;
+  EmpathyMessage *message;
+
+  record = empathy_message_block_get (block, i);
+  g_return_val_if_fail (record != NULL, NULL);
+
+  message = empathy_message_new (record->body);
+  if (record->sender != NULL)
+    empathy_message_set_sender (message, record->sender);
+  empathy_message_set_timestamp (message, record->timestamp);
+  empathy_message_set_tptype (message, record->type);
+  empathy_message_set_id (message, record->id);
+
+  return message;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_MESSAGE_BLOCK_H__
+#define __EMPATHY_MESSAGE_BLOCK_H__
+
+#include <glib.h>
+
+#include "empathy-account.h"
+#include "empathy-contact.h"
+#include "empathy-message.h"
+
+G_BEGIN_DECLS
+
+/* A block of messages which are only read, such as the ones replayed from a
+ * log: plain records allocated in slabs, with the bodies packed together and
+ * a single contact per distinct sender. Turn a record into an
+ * EmpathyMessage only when an object is really needed. */
+typedef struct _EmpathyMessageBlock EmpathyMessageBlock;
+
+typedef struct {
+  /* both owned by the block */
+  EmpathyContact *sender;
+  const gchar *body;
+  time_t timestamp;
+  TpChannelTextMessageType type;
+  guint id;
+} EmpathyMessageRecord;
+
+EmpathyMessageBlock *empathy_message_block_new (EmpathyAccount *account);
+EmpathyMessageBlock *empathy_message_block_ref (EmpathyMessageBlock *block);
+void empathy_message_block_unref (EmpathyMessageBlock *block);
+
+EmpathyContact *empathy_message_block_intern_sender (
+    EmpathyMessageBlock *block,
+    const gchar *id,
+    const gchar *name,
+    gboolean is_user);
+EmpathyMessageRecord *empathy_message_block_append (
+    EmpathyMessageBlock *block,
+    EmpathyContact *sender,
+    const gchar *body,
+    time_t timestamp,
+    TpChannelTextMessageType type);
+void empathy_message_block_append_message (EmpathyMessageBlock *block,
+    EmpathyMessage *message);
+
+guint empathy_message_block_get_length (EmpathyMessageBlock *block);
+const EmpathyMessageRecord *empathy_message_block_get (
+    EmpathyMessageBlock *block,
+    guint i);
+EmpathyMessage *empathy_message_block_dup_message (EmpathyMessageBlock *block,
+    guint i);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_MESSAGE_BLOCK_H__ */
@@ -31,6 +31,7 @@
 #include "empathy-message.h"
 #include "empathy-utils.h"
 #include "empathy-enum-types.h"
+#include "empathy-footprint.h"
 
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyMessage)
 typedef struct {
@@ -125,6 +126,7 @@ empathy_message_init (EmpathyMessage *message)
 		EMPATHY_TYPE_MESSAGE, EmpathyMessagePriv);
 
 	message->priv = priv;
+	EMPATHY_FOOTPRINT_TRACK (message);
 	priv->timestamp = empathy_time_get_current ();
 }
 
@@ -142,6 +144,10 @@ empathy_message_finalize (GObject *object)
 		g_object_unref (priv->receiver);
 	}
 
+	if (priv->body) {
+		EMPATHY_FOOTPRINT_ADD ("message-body", -1,
+				       -(gssize) strlen (priv->body));
+	}
 	g_free (priv->body);
 
 	G_OBJECT_CLASS (empathy_message_parent_class)->finalize (object);
@@ -332,6 +338,10 @@ empathy_message_set_body (EmpathyMessage *message,
 
 	g_return_if_fail (EMPATHY_IS_MESSAGE (message));
 
+	if (priv->body) {
+		EMPATHY_FOOTPRINT_ADD ("message-body", -1,
+				       -(gssize) strlen (priv->body));
+	}
 	g_free (priv->body);
 	priv->body = NULL;
 
@@ -346,6 +356,7 @@ empathy_message_set_body (EmpathyMessage *message,
 
 	if (body) {
 		priv->body = g_strdup (body);
+		EMPATHY_FOOTPRINT_ADD ("message-body", 1, strlen (body));
 	}
 
 	if (type != priv->type) {
@@ -0,0 +1,885 @@
+/*
+ * empathy-roster-cache.c - Source for EmpathyRosterCache
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <telepathy-glib/util.h>
+
+#include "empathy-roster-cache.h"
+#include "empathy-account-manager.h"
+#include "empathy-contact-manager.h"
+#include "empathy-utils.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_CONTACT
+#include "empathy-debug.h"
+
+/**
+ * SECTION:empathy-roster-cache
+ * @title:EmpathyRosterCache
+ * @short_description: snapshot of the roster from the previous session
+ * @include: libempathy/empathy-roster-cache.h
+ *
+ * #EmpathyRosterCache keeps a snapshot of each account's roster (contact
+ * identifiers, aliases, groups, last presence and avatar tokens) on disk,
+ * written periodically and by empathy_roster_cache_save().
+ *
+ * At startup it exposes the contacts of these snapshots as an
+ * #EmpathyContactList, so the contact list can be shown before the
+ * connections are up. Those stale contacts are removed as soon as the
+ * live contact with the same identifier appears in the
+ * #EmpathyContactManager, and the ones left over are removed once the
+ * account's live roster has stopped changing for a few seconds.
+ *
+ * Snapshots of accounts which don't exist anymore, or which were not
+ * written for %SNAPSHOT_MAX_AGE because the account never connected, are
+ * deleted at startup instead of being shown forever.
+ */
+
+/* Seconds between two snapshots of the live roster */
+#define SNAPSHOT_INTERVAL 300
+
+/* Seconds without live roster changes after which the stale contacts of
+ * an account are dropped */
+#define RECONCILE_TIMEOUT 5
+
+/* Seconds after which the snapshot of an account which didn't connect is
+ * deleted */
+#define SNAPSHOT_MAX_AGE (30 * 24 * 60 * 60)
+
+#define SNAPSHOT_KEY_ALIAS "alias"
+#define SNAPSHOT_KEY_GROUPS "groups"
+#define SNAPSHOT_KEY_PRESENCE "presence"
+#define SNAPSHOT_KEY_PRESENCE_MESSAGE "presence-message"
+#define SNAPSHOT_KEY_AVATAR_TOKEN "avatar-token"
+
+static void roster_cache_iface_init (EmpathyContactListIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (EmpathyRosterCache, empathy_roster_cache,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (EMPATHY_TYPE_CONTACT_LIST,
+      roster_cache_iface_init));
+
+#define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyRosterCache)
+
+typedef struct {
+  EmpathyContact *contact;
+  gchar *key;
+  GList *groups;
+} StaleContact;
+
+typedef struct {
+  EmpathyRosterCache *cache;
+  EmpathyAccount *account;
+} ReconcileData;
+
+typedef struct {
+  EmpathyAccountManager *account_manager;
+  EmpathyContactManager *contact_manager;
+
+  /* "<account unique name>/<contact id>" -> owned StaleContact */
+  GHashTable *stale_by_key;
+  /* EmpathyContact -> StaleContact */
+  GHashTable *stale_by_contact;
+  /* owned EmpathyAccount -> reconcile timeout id */
+  GHashTable *reconcile_timers;
+
+  guint snapshot_timer_id;
+  gboolean dispose_run;
+} EmpathyRosterCachePriv;
+
+static EmpathyRosterCache *cache_singleton = NULL;
+
+static void
+stale_contact_free (StaleContact *stale)
+{
+  g_object_unref (stale->contact);
+  g_free (stale->key);
+  g_list_foreach (stale->groups, (GFunc) g_free, NULL);
+  g_list_free (stale->groups);
+
+  g_slice_free (StaleContact, stale);
+}
+
+static gchar *
+roster_cache_dup_key (EmpathyAccount *account,
+    const gchar *id)
+{
+  return g_strdup_printf ("%s/%s", empathy_account_get_unique_name (account),
+      id);
+}
+
+static gchar *
+roster_cache_dup_dirname (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), PACKAGE_NAME, "roster",
+      NULL);
+}
+
+static gchar *
+roster_cache_dup_basename (EmpathyAccount *account)
+{
+  return tp_escape_as_identifier (empathy_account_get_unique_name (account));
+}
+
+static gchar *
+roster_cache_dup_filename (EmpathyAccount *account)
+{
+  gchar *dirname, *basename;
+  gchar *filename;
+
+  dirname = roster_cache_dup_dirname ();
+  basename = roster_cache_dup_basename (account);
+  filename = g_build_filename (dirname, basename, NULL);
+  g_free (basename);
+  g_free (dirname);
+
+  return filename;
+}
+
+static EmpathyContact *
+roster_cache_add_stale (EmpathyRosterCache *cache,
+    EmpathyAccount *account,
+    GKeyFile *key_file,
+    const gchar *id)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (cache);
+  StaleContact *stale;
+  gchar *alias, *message, *token;
+  gchar **groups;
+  gint presence;
+  guint i;
+
+  stale = g_slice_new0 (StaleContact);
+  stale->key = roster_cache_dup_key (account, id);
+
+  if (g_hash_table_lookup (priv->stale_by_key, stale->key) != NULL)
+    {
+      g_free (stale->key);
+      g_slice_free (StaleContact, stale);
+      return NULL;
+    }
+
+  alias = g_key_file_get_string (key_file, id, SNAPSHOT_KEY_ALIAS, NULL);
+  stale->contact = empathy_contact_new_for_log (account, id, alias, FALSE);
+  g_free (alias);
+
+  presence = g_key_file_get_integer (key_file, id, SNAPSHOT_KEY_PRESENCE,
+      NULL);
+  if (presence > TP_CONNECTION_PRESENCE_TYPE_UNSET)
+    empathy_contact_set_presence (stale->contact, presence);
+
+  message = g_key_file_get_string (key_file, id,
+      SNAPSHOT_KEY_PRESENCE_MESSAGE, NULL);
+  empathy_contact_set_presence_message (stale->contact, message);
+  g_free (message);
+
+  token = g_key_file_get_string (key_file, id, SNAPSHOT_KEY_AVATAR_TOKEN,
+      NULL);
+  if (!EMP_STR_EMPTY (token))
+    empathy_contact_load_avatar_cache (stale->contact, token);
+  g_free (token);
+
+  groups = g_key_file_get_string_list (key_file, id, SNAPSHOT_KEY_GROUPS,
+      NULL, NULL);
+  for (i = 0; groups != NULL && groups[i] != NULL; i++)
+    stale->groups = g_list_prepend (stale->groups, g_strdup (groups[i]));
+  g_strfreev (groups);
+
+  g_hash_table_insert (priv->stale_by_key, stale->key, stale);
+  g_hash_table_insert (priv->stale_by_contact, stale->contact, stale);
+
+  return stale->contact;
+}
+
+static void
+roster_cache_remove_stales (EmpathyRosterCache *cache,
+    GList *stales)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (cache);
+  GPtrArray *removed;
+  GList *l;
+
+  removed = g_ptr_array_new ();
+
+  for (l = stales; l != NULL; l = l->next)
+    {
+      StaleContact *stale = l->data;
+
+      g_hash_table_remove (priv->stale_by_contact, stale->contact);
+      /* Keep the stale contact alive while the signals are emitted */
+      g_hash_table_steal (priv->stale_by_key, stale->key);
+      g_ptr_array_add (removed, stale->contact);
+    }
+
+  empathy_contact_list_emit_members_changed (EMPATHY_CONTACT_LIST (cache),
+      NULL, removed, NULL, 0, NULL);
+
+  g_ptr_array_free (removed, TRUE);
+  g_list_foreach (stales, (GFunc) stale_contact_free, NULL);
+}
+
+static void
+roster_cache_drop_account (EmpathyRosterCache *cache,
+    EmpathyAccount *account)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (cache);
+  GHashTableIter iter;
+  gpointer value;
+  GList *dropped = NULL;
+
+  g_hash_table_remove (priv->reconcile_timers, account);
+
+  g_hash_table_iter_init (&iter, priv->stale_by_key);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      StaleContact *stale = value;
+
+      if (empathy_contact_get_account (stale->contact) == account)
+        dropped = g_list_prepend (dropped, stale);
+    }
+
+  if (dropped != NULL)
+    DEBUG ("Dropping %d stale contacts of %s", g_list_length (dropped),
+        empathy_account_get_unique_name (account));
+
+  roster_cache_remove_stales (cache, dropped);
+  g_list_free (dropped);
+}
+
+/* Deletes the snapshots of unknown accounts, and the ones too old to be
+ * worth showing */
+static void
+roster_cache_prune_snapshots (GList *accounts)
+{
+  GHashTable *known;
+  GDir *dir;
+  gchar *dirname;
+  const gchar *name;
+  GTimeVal now;
+  GList *l;
+
+  dirname = roster_cache_dup_dirname ();
+  dir = g_dir_open (dirname, 0, NULL);
+  if (dir == NULL)
+    {
+      g_free (dirname);
+      return;
+    }
+
+  known = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  for (l = accounts; l != NULL; l = l->next)
+    g_hash_table_insert (known, roster_cache_dup_basename (l->data),
+        GUINT_TO_POINTER (TRUE));
+
+  g_get_current_time (&now);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *filename;
+      struct stat st;
+
+      filename = g_build_filename (dirname, name, NULL);
+
+      if (g_hash_table_lookup (known, name) == NULL)
+        {
+          DEBUG ("Deleting the roster snapshot of unknown account %s", name);
+          g_unlink (filename);
+        }
+      else if (g_stat (filename, &st) == 0 &&
+          now.tv_sec - st.st_mtime > SNAPSHOT_MAX_AGE)
+        {
+          DEBUG ("Deleting the outdated roster snapshot %s", name);
+          g_unlink (filename);
+        }
+
+      g_free (filename);
+    }
+
+  g_hash_table_destroy (known);
+  g_dir_close (dir);
+  g_free (dirname);
+}
+
+static void
+roster_cache_load_account (EmpathyRosterCache *cache,
+    EmpathyAccount *account)
+{
+  GKeyFile *key_file;
+  gchar *filename;
+  gchar **ids;
+  gsize n_ids, i;
+  GPtrArray *added;
+  GError *error = NULL;
+
+  filename = roster_cache_dup_filename (account);
+  key_file = g_key_file_new ();
+
+  if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE,
+          &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        DEBUG ("Failed to load roster snapshot %s: %s", filename,
+            error->message);
+
+      g_error_free (error);
+      goto out;
+    }
+
+  ids = g_key_file_get_groups (key_file, &n_ids);
+  DEBUG ("Loading %" G_GSIZE_FORMAT " contacts from %s", n_ids, filename);
+
+  added = g_ptr_array_sized_new (n_ids);
+  for (i = 0; i < n_ids; i++)
+    {
+      EmpathyContact *contact;
+
+      contact = roster_cache_add_stale (cache, account, key_file, ids[i]);
+      if (contact != NULL)
+        g_ptr_array_add (added, contact);
+    }
+
+  empathy_contact_list_emit_members_changed (EMPATHY_CONTACT_LIST (cache),
+      added, NULL, NULL, 0, NULL);
+
+  g_ptr_array_free (added, TRUE);
+  g_strfreev (ids);
+
+out:
+  g_key_file_free (key_file);
+  g_free (filename);
+}
+
+static void
+roster_cache_save_account (EmpathyRosterCache *cache,
+    EmpathyAccount *account,
+    GList *contacts)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (cache);
+  GKeyFile *key_file;
+  gchar *filename, *dirname;
+  gchar *data;
+  gsize length;
+  GList *l;
+  GError *error = NULL;
+
+  key_file = g_key_file_new ();
+
+  for (l = contacts; l != NULL; l = l->next)
+    {
+      EmpathyContact *contact = l->data;
+      EmpathyAvatar *avatar;
+      const gchar *id;
+      const gchar *message;
+      GList *groups, *g;
+      GPtrArray *group_names;
+
+      id = empathy_contact_get_id (contact);
+      if (EMP_STR_EMPTY (id))
+        continue;
+
+      g_key_file_set_string (key_file, id, SNAPSHOT_KEY_ALIAS,
+          empathy_contact_get_name (contact));
+      g_key_file_set_integer (key_file, id, SNAPSHOT_KEY_PRESENCE,
+          empathy_contact_get_presence (contact));
+
+      message = empathy_contact_get_presence_message (contact);
+      if (!EMP_STR_EMPTY (message))
+        g_key_file_set_string (key_file, id, SNAPSHOT_KEY_PRESENCE_MESSAGE,
+            message);
+
+      avatar = empathy_contact_get_avatar (contact);
+      if (avatar != NULL && !EMP_STR_EMPTY (avatar->token))
+        g_key_file_set_string (key_file, id, SNAPSHOT_KEY_AVATAR_TOKEN,
+            avatar->token);
+
+      groups = empathy_contact_list_get_groups (
+          EMPATHY_CONTACT_LIST (priv->contact_manager), contact);
+      if (groups != NULL)
+        {
+          group_names = g_ptr_array_new ();
+          for (g = groups; g != NULL; g = g->next)
+            g_ptr_array_add (group_names, g->data);
+
+          g_key_file_set_string_list (key_file, id, SNAPSHOT_KEY_GROUPS,
+              (const gchar * const *) group_names->pdata, group_names->len);
+
+          g_ptr_array_free (group_names, TRUE);
+          g_list_foreach (groups, (GFunc) g_free, NULL);
+          g_list_free (groups);
+        }
+    }
+
+  filename = roster_cache_dup_filename (account);
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0700);
+
+  data = g_key_file_to_data (key_file, &length, NULL);
+  if (!g_file_set_contents (filename, data, length, &error))
+    {
+      DEBUG ("Failed to save roster snapshot %s: %s", filename,
+          error->message);
+      g_error_free (error);
+    }
+
+  g_free (data);
+  g_free (dirname);
+  g_free (filename);
+  g_key_file_free (key_file);
+}
+
+static gboolean
+roster_cache_reconcile_timeout_cb (gpointer user_data)
+{
+  ReconcileData *data = user_data;
+  EmpathyRosterCachePriv *priv = GET_PRIV (data->cache);
+
+  /* The timeout is removed with the table entry, which frees @data */
+  g_hash_table_steal (priv->reconcile_timers, data->account);
+  roster_cache_drop_account (data->cache, data->account);
+  g_object_unref (data->account);
+
+  return FALSE;
+}
+
+static void
+reconcile_data_free (ReconcileData *data)
+{
+  g_slice_free (ReconcileData, data);
+}
+
+static void
+roster_cache_schedule_reconcile (EmpathyRosterCache *cache,
+    EmpathyAccount *account)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (cache);
+  ReconcileData *data;
+  guint id;
+
+  data = g_slice_new (ReconcileData);
+  data->cache = cache;
+  data->account = account;
+
+  id = g_timeout_add_seconds_full (G_PRIORITY_DEFAULT, RECONCILE_TIMEOUT,
+      roster_cache_reconcile_timeout_cb, data,
+      (GDestroyNotify) reconcile_data_free);
+
+  /* Replacing the entry removes the previous timeout */
+  g_hash_table_insert (priv->reconcile_timers, g_object_ref (account),
+      GUINT_TO_POINTER (id));
+}
+
+static void
+roster_cache_remove_timeout (gpointer id)
+{
+  g_source_remove (GPOINTER_TO_UINT (id));
+}
+
+static void
+roster_cache_members_changed_cb (EmpathyContactList *list,
+    GPtrArray *added,
+    GPtrArray *removed,
+    EmpathyContact *actor,
+    guint reason,
+    gchar *message,
+    EmpathyRosterCache *cache)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (cache);
+  GList *stales = NULL, *accounts = NULL, *l;
+  guint i;
+
+  for (i = 0; added != NULL && i < added->len; i++)
+    {
+      EmpathyContact *contact = g_ptr_array_index (added, i);
+      EmpathyAccount *account;
+      StaleContact *stale;
+      gchar *key;
+
+      account = empathy_contact_get_account (contact);
+      if (account == NULL)
+        continue;
+
+      key = roster_cache_dup_key (account, empathy_contact_get_id (contact));
+      stale = g_hash_table_lookup (priv->stale_by_key, key);
+      g_free (key);
+
+      if (stale != NULL && g_list_find (stales, stale) == NULL)
+        stales = g_list_prepend (stales, stale);
+
+      if (g_list_find (accounts, account) == NULL)
+        accounts = g_list_prepend (accounts, account);
+    }
+
+  /* The snapshots replaced by the batch go away in a single signal */
+  if (stales != NULL)
+    roster_cache_remove_stales (cache, stales);
+  g_list_free (stales);
+
+  /* The live roster of these accounts is still arriving */
+  for (l = accounts; l != NULL; l = l->next)
+    if (g_hash_table_lookup (priv->reconcile_timers, l->data) != NULL)
+      roster_cache_schedule_reconcile (cache, l->data);
+  g_list_free (accounts);
+}
+
+static void
+roster_cache_new_connection_cb (EmpathyAccountManager *manager,
+    TpConnection *connection,
+    EmpathyRosterCache *cache)
+{
+  EmpathyAccount *account;
+
+  account = empathy_account_manager_get_account (manager, connection);
+  if (account != NULL)
+    roster_cache_schedule_reconcile (cache, account);
+}
+
+static void
+roster_cache_account_disabled_cb (EmpathyAccountManager *manager,
+    EmpathyAccount *account,
+    EmpathyRosterCache *cache)
+{
+  roster_cache_drop_account (cache, account);
+}
+
+static void
+roster_cache_account_deleted_cb (EmpathyAccountManager *manager,
+    EmpathyAccount *account,
+    EmpathyRosterCache *cache)
+{
+  gchar *filename;
+
+  roster_cache_drop_account (cache, account);
+
+  filename = roster_cache_dup_filename (account);
+  g_unlink (filename);
+  g_free (filename);
+}
+
+static gboolean
+roster_cache_snapshot_timeout_cb (gpointer user_data)
+{
+  empathy_roster_cache_save (EMPATHY_ROSTER_CACHE (user_data));
+
+  return TRUE;
+}
+
+static GList *
+roster_cache_get_members (EmpathyContactList *list)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (list);
+  GList *members = NULL;
+  GHashTableIter iter;
+  gpointer contact;
+
+  g_hash_table_iter_init (&iter, priv->stale_by_contact);
+  while (g_hash_table_iter_next (&iter, &contact, NULL))
+    members = g_list_prepend (members, g_object_ref (contact));
+
+  return members;
+}
+
+static GList *
+roster_cache_get_groups (EmpathyContactList *list,
+    EmpathyContact *contact)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (list);
+  StaleContact *stale;
+  GList *groups = NULL, *l;
+
+  stale = g_hash_table_lookup (priv->stale_by_contact, contact);
+  if (stale == NULL)
+    return NULL;
+
+  for (l = stale->groups; l != NULL; l = l->next)
+    groups = g_list_prepend (groups, g_strdup (l->data));
+
+  return groups;
+}
+
+static GList *
+roster_cache_get_all_groups (EmpathyContactList *list)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (list);
+  GList *groups = NULL, *l;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, priv->stale_by_contact);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      StaleContact *stale = value;
+
+      for (l = stale->groups; l != NULL; l = l->next)
+        {
+          if (g_list_find_custom (groups, l->data, (GCompareFunc) strcmp))
+            continue;
+
+          groups = g_list_prepend (groups, g_strdup (l->data));
+        }
+    }
+
+  return groups;
+}
+
+static void
+roster_cache_iface_init (EmpathyContactListIface *iface)
+{
+  iface->get_members = roster_cache_get_members;
+  iface->get_groups = roster_cache_get_groups;
+  iface->get_all_groups = roster_cache_get_all_groups;
+}
+
+static void
+roster_cache_constructed (GObject *object)
+{
+  EmpathyRosterCache *cache = EMPATHY_ROSTER_CACHE (object);
+  EmpathyRosterCachePriv *priv = GET_PRIV (cache);
+  GList *accounts, *members, *l;
+  GPtrArray *added;
+
+  priv->account_manager = empathy_account_manager_dup_singleton ();
+  priv->contact_manager = empathy_contact_manager_dup_singleton ();
+
+  accounts = empathy_account_manager_dup_accounts (priv->account_manager);
+  roster_cache_prune_snapshots (accounts);
+
+  for (l = accounts; l != NULL; l = l->next)
+    {
+      if (empathy_account_is_enabled (l->data))
+        roster_cache_load_account (cache, l->data);
+
+      g_object_unref (l->data);
+    }
+  g_list_free (accounts);
+
+  g_signal_connect (priv->contact_manager, "members-changed-bulk",
+      G_CALLBACK (roster_cache_members_changed_cb), cache);
+  g_signal_connect (priv->account_manager, "new-connection",
+      G_CALLBACK (roster_cache_new_connection_cb), cache);
+  g_signal_connect (priv->account_manager, "account-disabled",
+      G_CALLBACK (roster_cache_account_disabled_cb), cache);
+  g_signal_connect (priv->account_manager, "account-deleted",
+      G_CALLBACK (roster_cache_account_deleted_cb), cache);
+
+  /* Contacts which are already live replace their snapshot right away */
+  members = empathy_contact_list_get_members (
+      EMPATHY_CONTACT_LIST (priv->contact_manager));
+  added = g_ptr_array_new ();
+  for (l = members; l != NULL; l = l->next)
+    g_ptr_array_add (added, l->data);
+  roster_cache_members_changed_cb (
+      EMPATHY_CONTACT_LIST (priv->contact_manager), added, NULL, NULL, 0,
+      NULL, cache);
+  g_ptr_array_free (added, TRUE);
+
+  g_list_foreach (members, (GFunc) g_object_unref, NULL);
+  g_list_free (members);
+
+  priv->snapshot_timer_id = g_timeout_add_seconds (SNAPSHOT_INTERVAL,
+      roster_cache_snapshot_timeout_cb, cache);
+}
+
+static GObject *
+roster_cache_constructor (GType type,
+    guint n_props,
+    GObjectConstructParam *props)
+{
+  GObject *retval;
+
+  if (cache_singleton != NULL)
+    {
+      retval = g_object_ref (cache_singleton);
+    }
+  else
+    {
+      retval = G_OBJECT_CLASS (empathy_roster_cache_parent_class)->constructor
+        (type, n_props, props);
+
+      cache_singleton = EMPATHY_ROSTER_CACHE (retval);
+      g_object_add_weak_pointer (retval, (gpointer *) &cache_singleton);
+    }
+
+  return retval;
+}
+
+static void
+roster_cache_dispose (GObject *object)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (object);
+
+  if (priv->dispose_run)
+    return;
+
+  priv->dispose_run = TRUE;
+
+  /* The last snapshot is written by empathy_roster_cache_save(), while
+   * the connections are still up */
+  if (priv->snapshot_timer_id != 0)
+    {
+      g_source_remove (priv->snapshot_timer_id);
+      priv->snapshot_timer_id = 0;
+    }
+
+  g_hash_table_remove_all (priv->reconcile_timers);
+
+  g_signal_handlers_disconnect_by_func (priv->contact_manager,
+      roster_cache_members_changed_cb, object);
+  g_signal_handlers_disconnect_by_func (priv->account_manager,
+      roster_cache_new_connection_cb, object);
+  g_signal_handlers_disconnect_by_func (priv->account_manager,
+      roster_cache_account_disabled_cb, object);
+  g_signal_handlers_disconnect_by_func (priv->account_manager,
+      roster_cache_account_deleted_cb, object);
+
+  g_object_unref (priv->contact_manager);
+  g_object_unref (priv->account_manager);
+
+  G_OBJECT_CLASS (empathy_roster_cache_parent_class)->dispose (object);
+}
+
+static void
+roster_cache_finalize (GObject *object)
+{
+  EmpathyRosterCachePriv *priv = GET_PRIV (object);
+
+  g_hash_table_destroy (priv->reconcile_timers);
+  g_hash_table_destroy (priv->stale_by_contact);
+  g_hash_table_destroy (priv->stale_by_key);
+
+  G_OBJECT_CLASS (empathy_roster_cache_parent_class)->finalize (object);
+}
+
+static void
+empathy_roster_cache_class_init (EmpathyRosterCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructor = roster_cache_constructor;
+  object_class->constructed = roster_cache_constructed;
+  object_class->dispose = roster_cache_dispose;
+  object_class->finalize = roster_cache_finalize;
+
+  g_type_class_add_private (klass, sizeof (EmpathyRosterCachePriv));
+}
+
+static void
+empathy_roster_cache_init (EmpathyRosterCache *cache)
+{
+  EmpathyRosterCachePriv *priv = G_TYPE_INSTANCE_GET_PRIVATE (cache,
+      EMPATHY_TYPE_ROSTER_CACHE, EmpathyRosterCachePriv);
+
+  cache->priv = priv;
+
+  priv->stale_by_key = g_hash_table_new_full (g_str_hash, g_str_equal,
+      NULL, (GDestroyNotify) stale_contact_free);
+  priv->stale_by_contact = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->reconcile_timers = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, g_object_unref, roster_cache_remove_timeout);
+}
+
+/* public methods */
+
+/**
+ * empathy_roster_cache_dup_singleton:
+ *
+ * Returns a reference to the #EmpathyRosterCache singleton. The snapshots
+ * of the enabled accounts are loaded when it is first created.
+ *
+ * Returns: a new reference to the #EmpathyRosterCache singleton
+ */
+EmpathyRosterCache *
+empathy_roster_cache_dup_singleton (void)
+{
+  return g_object_new (EMPATHY_TYPE_ROSTER_CACHE, NULL);
+}
+
+/**
+ * empathy_roster_cache_save:
+ * @cache: an #EmpathyRosterCache
+ *
+ * Writes a snapshot of the live roster of every connected account. The
+ * snapshots of the other accounts are left untouched.
+ */
+void
+empathy_roster_cache_save (EmpathyRosterCache *cache)
+{
+  EmpathyRosterCachePriv *priv;
+  GHashTable *by_account;
+  GHashTableIter iter;
+  gpointer account, contacts;
+  GList *members, *l;
+
+  g_return_if_fail (EMPATHY_IS_ROSTER_CACHE (cache));
+
+  priv = GET_PRIV (cache);
+
+  members = empathy_contact_list_get_members (
+      EMPATHY_CONTACT_LIST (priv->contact_manager));
+
+  /* EmpathyAccount -> GList of EmpathyContact */
+  by_account = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (l = members; l != NULL; l = l->next)
+    {
+      account = empathy_contact_get_account (l->data);
+      if (account == NULL)
+        continue;
+
+      contacts = g_hash_table_lookup (by_account, account);
+      g_hash_table_insert (by_account, account,
+          g_list_prepend (contacts, l->data));
+    }
+
+  g_hash_table_iter_init (&iter, by_account);
+  while (g_hash_table_iter_next (&iter, &account, &contacts))
+    {
+      roster_cache_save_account (cache, account, contacts);
+      g_list_free (contacts);
+    }
+
+  g_hash_table_destroy (by_account);
+  g_list_foreach (members, (GFunc) g_object_unref, NULL);
+  g_list_free (members);
+}
+
+/**
+ * empathy_roster_cache_is_stale:
+ * @cache: an #EmpathyRosterCache
+ * @contact: an #EmpathyContact
+ *
+ * Checks whether @contact comes from a roster snapshot and has not been
+ * replaced by its live counterpart yet.
+ *
+ * Returns: %TRUE if @contact is a stale snapshot contact
+ */
+gboolean
+empathy_roster_cache_is_stale (EmpathyRosterCache *cache,
+    EmpathyContact *contact)
+{
+  EmpathyRosterCachePriv *priv;
+
+  g_return_val_if_fail (EMPATHY_IS_ROSTER_CACHE (cache), FALSE);
+
+  priv = GET_PRIV (cache);
+
+  return g_hash_table_lookup (priv->stale_by_contact, contact) != NULL;
+}
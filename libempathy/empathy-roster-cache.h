@@ -0,0 +1,64 @@
+/*
+ * empathy-roster-cache.h - Header for EmpathyRosterCache
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_ROSTER_CACHE_H__
+#define __EMPATHY_ROSTER_CACHE_H__
+
+#include <glib-object.h>
+
+#include "empathy-contact.h"
+#include "empathy-contact-list.h"
+
+G_BEGIN_DECLS
+
+#define EMPATHY_TYPE_ROSTER_CACHE empathy_roster_cache_get_type()
+#define EMPATHY_ROSTER_CACHE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   EMPATHY_TYPE_ROSTER_CACHE, EmpathyRosterCache))
+#define EMPATHY_ROSTER_CACHE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+   EMPATHY_TYPE_ROSTER_CACHE, EmpathyRosterCacheClass))
+#define EMPATHY_IS_ROSTER_CACHE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EMPATHY_TYPE_ROSTER_CACHE))
+#define EMPATHY_IS_ROSTER_CACHE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), EMPATHY_TYPE_ROSTER_CACHE))
+#define EMPATHY_ROSTER_CACHE_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+   EMPATHY_TYPE_ROSTER_CACHE, EmpathyRosterCacheClass))
+
+typedef struct {
+  GObject parent;
+  gpointer priv;
+} EmpathyRosterCache;
+
+typedef struct {
+  GObjectClass parent_class;
+} EmpathyRosterCacheClass;
+
+GType empathy_roster_cache_get_type (void);
+
+/* public methods */
+EmpathyRosterCache * empathy_roster_cache_dup_singleton (void);
+void empathy_roster_cache_save (EmpathyRosterCache *cache);
+gboolean empathy_roster_cache_is_stale (EmpathyRosterCache *cache,
+    EmpathyContact *contact);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_ROSTER_CACHE_H__ */
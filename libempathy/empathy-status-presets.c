@@ -36,6 +36,7 @@
 
 #include "empathy-utils.h"
 #include "empathy-status-presets.h"
+#include "empathy-xml-saver.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_OTHER
 #include "empathy-debug.h"
@@ -43,6 +44,7 @@
 #define STATUS_PRESETS_XML_FILENAME "status-presets.xml"
 #define STATUS_PRESETS_DTD_FILENAME "empathy-status-presets.dtd"
 #define STATUS_PRESETS_MAX_EACH     15
+#define STATUS_PRESETS_SAVE_TIMER   2
 
 typedef struct {
 	gchar      *status;
@@ -54,12 +56,81 @@ static StatusPreset *status_preset_new          (TpConnectionPresenceType    sta
 static void     status_preset_free              (StatusPreset *status);
 static void     status_presets_file_parse       (const gchar  *filename);
 const gchar *   status_presets_get_state_as_str (TpConnectionPresenceType    state);
-static gboolean status_presets_file_save        (void);
+static xmlDocPtr status_presets_file_build      (gpointer      user_data);
+static void     status_presets_file_save        (void);
 static void     status_presets_set_default      (TpConnectionPresenceType    state,
 						 const gchar  *status);
 
-static GList        *presets = NULL;
+/* Most recent first, one queue per presence type */
+static GQueue        presets[NUM_TP_CONNECTION_PRESENCE_TYPES];
+/* StatusPreset -> its GList link in presets[state] */
+static GHashTable   *presets_index = NULL;
 static StatusPreset *default_preset = NULL;
+static EmpathyXmlSaver *saver = NULL;
+
+static guint
+status_preset_hash (gconstpointer key)
+{
+	const StatusPreset *preset = key;
+
+	return preset->state ^ (preset->status ? g_str_hash (preset->status) : 0);
+}
+
+static gboolean
+status_preset_equal (gconstpointer a,
+		     gconstpointer b)
+{
+	const StatusPreset *preset_a = a;
+	const StatusPreset *preset_b = b;
+
+	return preset_a->state == preset_b->state &&
+		!tp_strdiff (preset_a->status, preset_b->status);
+}
+
+static GList *
+status_presets_lookup (TpConnectionPresenceType  state,
+		       const gchar              *status)
+{
+	StatusPreset key;
+
+	if (!presets_index) {
+		return NULL;
+	}
+
+	key.state = state;
+	key.status = (gchar *) status;
+
+	return g_hash_table_lookup (presets_index, &key);
+}
+
+static void
+status_presets_delete_link (GList *link)
+{
+	StatusPreset *preset = link->data;
+
+	g_hash_table_remove (presets_index, preset);
+	g_queue_delete_link (&presets[preset->state], link);
+	status_preset_free (preset);
+}
+
+static void
+status_presets_clear (void)
+{
+	gint i;
+
+	if (!presets_index) {
+		presets_index = g_hash_table_new (status_preset_hash,
+						  status_preset_equal);
+	}
+
+	g_hash_table_remove_all (presets_index);
+
+	for (i = 0; i < NUM_TP_CONNECTION_PRESENCE_TYPES; i++) {
+		g_list_foreach (presets[i].head, (GFunc) status_preset_free, NULL);
+		g_list_free (presets[i].head);
+		g_queue_init (&presets[i]);
+	}
+}
 
 static StatusPreset *
 status_preset_new (TpConnectionPresenceType   state,
@@ -138,9 +209,11 @@ status_presets_file_parse (const gchar *filename)
 							status);
 
 						status_presets_set_default (state, status);
-					} else {
+					} else if (!status_presets_lookup (state, status)) {
 						preset = status_preset_new (state, status);
-						presets = g_list_append (presets, preset);
+						g_queue_push_tail (&presets[state], preset);
+						g_hash_table_insert (presets_index, preset,
+								     presets[state].tail);
 					}
 				}
 			}
@@ -157,7 +230,7 @@ status_presets_file_parse (const gchar *filename)
 		status_presets_set_default (TP_CONNECTION_PRESENCE_TYPE_OFFLINE, NULL);
 	}
 
-	DEBUG ("Parsed %d status presets", g_list_length (presets));
+	DEBUG ("Parsed %d status presets", g_hash_table_size (presets_index));
 
 	xmlFreeDoc (doc);
 	xmlFreeParserCtxt (ctxt);
@@ -170,14 +243,9 @@ empathy_status_presets_get_all (void)
 	gchar *file_with_path;
 
 	/* If already set up clean up first. */
-	if (presets) {
-		g_list_foreach (presets, (GFunc) status_preset_free, NULL);
-		g_list_free (presets);
-		presets = NULL;
-	}
+	status_presets_clear ();
 
 	dir = g_build_filename (g_get_home_dir (), ".gnome2", PACKAGE_NAME, NULL);
-	g_mkdir_with_parents (dir, S_IRUSR | S_IWUSR | S_IXUSR);
 	file_with_path = g_build_filename (dir, STATUS_PRESETS_XML_FILENAME, NULL);
 	g_free (dir);
 
@@ -188,26 +256,15 @@ empathy_status_presets_get_all (void)
 	g_free (file_with_path);
 }
 
-static gboolean
-status_presets_file_save (void)
+static xmlDocPtr
+status_presets_file_build (gpointer user_data)
 {
 	xmlDocPtr   doc;
 	xmlNodePtr  root;
 	GList      *l;
-	gchar      *dir;
-	gchar      *file;
-	gint        count[NUM_TP_CONNECTION_PRESENCE_TYPES];
+	gint        count;
 	gint        i;
 
-	for (i = 0; i < NUM_TP_CONNECTION_PRESENCE_TYPES; i++) {
-		count[i] = 0;
-	}
-
-	dir = g_build_filename (g_get_home_dir (), ".gnome2", PACKAGE_NAME, NULL);
-	g_mkdir_with_parents (dir, S_IRUSR | S_IWUSR | S_IXUSR);
-	file = g_build_filename (dir, STATUS_PRESETS_XML_FILENAME, NULL);
-	g_free (dir);
-
 	doc = xmlNewDoc ("1.0");
 	root = xmlNewNode (NULL, "presets");
 	xmlDocSetRootElement (doc, root);
@@ -223,34 +280,44 @@ status_presets_file_save (void)
 		xmlNewProp (subnode, "presence", state);
 	}
 
-	for (l = presets; l; l = l->next) {
-		StatusPreset *sp;
-		xmlNodePtr    subnode;
-		xmlChar      *state;
-
-		sp = l->data;
-		state = (gchar *) empathy_presence_to_str (sp->state);
-
-		count[sp->state]++;
-		if (count[sp->state] > STATUS_PRESETS_MAX_EACH) {
-			continue;
+	for (i = 0; i < NUM_TP_CONNECTION_PRESENCE_TYPES; i++) {
+		count = 0;
+		for (l = presets[i].head;
+		     l && count < STATUS_PRESETS_MAX_EACH;
+		     l = l->next, count++) {
+			StatusPreset *sp;
+			xmlNodePtr    subnode;
+			xmlChar      *state;
+
+			sp = l->data;
+			state = (gchar *) empathy_presence_to_str (sp->state);
+
+			subnode = xmlNewTextChild (root, NULL,
+						   "status", sp->status);
+			xmlNewProp (subnode, "presence", state);
 		}
-
-		subnode = xmlNewTextChild (root, NULL,
-					   "status", sp->status);
-		xmlNewProp (subnode, "presence", state);
 	}
 
-	/* Make sure the XML is indented properly */
-	xmlIndentTreeOutput = 1;
-
-	DEBUG ("Saving file:'%s'", file);
-	xmlSaveFormatFileEnc (file, doc, "utf-8", 1);
-	xmlFreeDoc (doc);
+	return doc;
+}
 
-	g_free (file);
+static void
+status_presets_file_save (void)
+{
+	if (!saver) {
+		gchar *file;
+
+		file = g_build_filename (g_get_home_dir (), ".gnome2",
+					 PACKAGE_NAME, STATUS_PRESETS_XML_FILENAME,
+					 NULL);
+		saver = empathy_xml_saver_new (file,
+					       STATUS_PRESETS_SAVE_TIMER,
+					       status_presets_file_build,
+					       NULL);
+		g_free (file);
+	}
 
-	return TRUE;
+	empathy_xml_saver_queue (saver);
 }
 
 GList *
@@ -261,17 +328,15 @@ empathy_status_presets_get (TpConnectionPresenceType state,
 	GList *l;
 	gint   i;
 
+	g_return_val_if_fail (state < NUM_TP_CONNECTION_PRESENCE_TYPES, NULL);
+
 	i = 0;
-	for (l = presets; l; l = l->next) {
+	for (l = presets[state].head; l; l = l->next) {
 		StatusPreset *sp;
 
 		sp = l->data;
 
-		if (sp->state != state) {
-			continue;
-		}
-
-		list = g_list_append (list, sp->status);
+		list = g_list_prepend (list, sp->status);
 		i++;
 
 		if (max_number != -1 && i >= max_number) {
@@ -279,45 +344,32 @@ empathy_status_presets_get (TpConnectionPresenceType state,
 		}
 	}
 
-	return list;
+	return g_list_reverse (list);
 }
 
 void
 empathy_status_presets_set_last (TpConnectionPresenceType   state,
 				const gchar *status)
 {
-	GList        *l;
 	StatusPreset *preset;
-	gint          num;
 
-	/* Check if duplicate */
-	for (l = presets; l; l = l->next) {
-		preset = l->data;
+	g_return_if_fail (state < NUM_TP_CONNECTION_PRESENCE_TYPES);
 
-		if (state == preset->state &&
-		    !tp_strdiff (status, preset->status)) {
-			return;
-		}
+	if (!presets_index) {
+		empathy_status_presets_get_all ();
 	}
 
-	preset = status_preset_new (state, status);
-	presets = g_list_prepend (presets, preset);
-
-	num = 0;
-	for (l = presets; l; l = l->next) {
-		preset = l->data;
-
-		if (state != preset->state) {
-			continue;
-		}
+	/* Check if duplicate */
+	if (status_presets_lookup (state, status)) {
+		return;
+	}
 
-		num++;
+	preset = status_preset_new (state, status);
+	g_queue_push_head (&presets[state], preset);
+	g_hash_table_insert (presets_index, preset, presets[state].head);
 
-		if (num > STATUS_PRESETS_MAX_EACH) {
-			status_preset_free (preset);
-			presets = g_list_delete_link (presets, l);
-			break;
-		}
+	if (g_queue_get_length (&presets[state]) > STATUS_PRESETS_MAX_EACH) {
+		status_presets_delete_link (presets[state].tail);
 	}
 
 	status_presets_file_save ();
@@ -327,29 +379,19 @@ void
 empathy_status_presets_remove (TpConnectionPresenceType   state,
 			       const gchar *status)
 {
-	StatusPreset *preset;
-	GList        *l;
+	GList *link;
 
-	for (l = presets; l; l = l->next) {
-		preset = l->data;
-
-		if (state == preset->state &&
-		    !tp_strdiff (status, preset->status)) {
-			status_preset_free (preset);
-			presets = g_list_delete_link (presets, l);
-			status_presets_file_save ();
-			break;
-		}
+	link = status_presets_lookup (state, status);
+	if (link) {
+		status_presets_delete_link (link);
+		status_presets_file_save ();
 	}
 }
 
 void
 empathy_status_presets_reset (void)
 {
-	g_list_foreach (presets, (GFunc) status_preset_free, NULL);
-	g_list_free (presets);
-
-	presets = NULL;
+	status_presets_clear ();
 
 	status_presets_set_default (TP_CONNECTION_PRESENCE_TYPE_AVAILABLE, NULL);
 
@@ -37,6 +37,25 @@ empathy_time_get_current (void)
 	return time (NULL);
 }
 
+/* Microseconds from an unspecified point in the past, not affected by
+ * changes of the system clock. Only useful to measure intervals. */
+gint64
+empathy_time_get_monotonic (void)
+{
+	GTimeVal tv;
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0) {
+		return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+	}
+#endif
+
+	g_get_current_time (&tv);
+
+	return (gint64) tv.tv_sec * G_USEC_PER_SEC + tv.tv_usec;
+}
+
 time_t
 empathy_time_get_local_time (struct tm *tm)
 {
@@ -61,6 +80,68 @@ empathy_time_get_local_time (struct tm *tm)
 	return t;
 }
 
+/* Days from 1970-01-01 to the given date of the Gregorian calendar, without
+ * going through mktime() which has to look at the time zone. */
+static gint64
+time_days_from_civil (gint year,
+		      gint month,
+		      gint day)
+{
+	gint  era;
+	guint year_of_era, day_of_year, day_of_era;
+
+	year -= month <= 2;
+	era = (year >= 0 ? year : year - 399) / 400;
+	year_of_era = (guint) (year - era * 400);
+	day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 +
+		day_of_year;
+
+	return (gint64) era * 146097 + day_of_era - 719468;
+}
+
+/* The reverse of time_days_from_civil() */
+static void
+time_civil_from_days (gint64  days,
+		      gint   *year,
+		      gint   *month,
+		      gint   *day)
+{
+	gint64 era;
+	guint  day_of_era, year_of_era, day_of_year, mp;
+
+	days += 719468;
+	era = (days >= 0 ? days : days - 146096) / 146097;
+	day_of_era = (guint) (days - era * 146097);
+	year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 -
+		       day_of_era / 146096) / 365;
+	day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 -
+				    year_of_era / 100);
+	mp = (5 * day_of_year + 2) / 153;
+
+	*day = day_of_year - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = (gint) (year_of_era + era * 400) + (*month <= 2);
+}
+
+static gboolean
+time_parse_digits (const gchar *str,
+		   guint        n,
+		   gint        *value)
+{
+	guint i;
+
+	*value = 0;
+	for (i = 0; i < n; i++) {
+		if (!g_ascii_isdigit (str[i])) {
+			return FALSE;
+		}
+		*value = *value * 10 + str[i] - '0';
+	}
+
+	return TRUE;
+}
+
 /* The format is: "20021209T23:51:30" and is in UTC. 0 is returned on
  * failure. The alternative format "20021209" is also accepted.
  */
@@ -68,9 +149,27 @@ time_t
 empathy_time_parse (const gchar *str)
 {
 	struct tm tm;
-	gint      year, month;
+	gint      year, month, day;
+	gint      hour = 0, min = 0, sec = 0;
 	gint      n_parsed;
 
+	g_return_val_if_fail (str != NULL, 0);
+
+	/* Exactly what the logs contain, which is nearly always the case,
+	 * is converted by hand. */
+	if (time_parse_digits (str, 4, &year) &&
+	    time_parse_digits (str + 4, 2, &month) &&
+	    time_parse_digits (str + 6, 2, &day) &&
+	    month >= 1 && month <= 12 && day >= 1 && day <= 31 &&
+	    (str[8] == '\0' ||
+	     (str[8] == 'T' &&
+	      time_parse_digits (str + 9, 2, &hour) && str[11] == ':' &&
+	      time_parse_digits (str + 12, 2, &min) && str[14] == ':' &&
+	      time_parse_digits (str + 15, 2, &sec) && str[17] == '\0'))) {
+		return (time_t) (time_days_from_civil (year, month, day) * 86400 +
+				 hour * 3600 + min * 60 + sec);
+	}
+
 	memset (&tm, 0, sizeof (struct tm));
 
 	n_parsed = sscanf (str, "%4d%2d%2dT%2d:%2d:%2d",
@@ -123,6 +222,57 @@ empathy_time_to_string_local (time_t       t,
 	return g_strdup (stamp);
 }
 
+static gchar *
+time_put_digits (gchar *str,
+		 gint   value,
+		 guint  n)
+{
+	guint i;
+
+	for (i = n; i > 0; i--) {
+		str[i - 1] = '0' + value % 10;
+		value /= 10;
+	}
+
+	return str + n;
+}
+
+/* Same as empathy_time_to_string_utc (t, EMPATHY_TIME_FORMAT_LOG), without
+ * the overhead of gmtime() and strftime(). */
+gchar *
+empathy_time_to_string_log (time_t t)
+{
+	gint64  days, seconds;
+	gint    year, month, day;
+	gchar  *stamp, *p;
+
+	days = t / 86400;
+	seconds = t % 86400;
+	if (seconds < 0) {
+		seconds += 86400;
+		days--;
+	}
+
+	time_civil_from_days (days, &year, &month, &day);
+	if (year < 0 || year > 9999) {
+		return empathy_time_to_string_utc (t, EMPATHY_TIME_FORMAT_LOG);
+	}
+
+	stamp = g_malloc (sizeof ("YYYYMMDDTHH:MM:SS"));
+	p = time_put_digits (stamp, year, 4);
+	p = time_put_digits (p, month, 2);
+	p = time_put_digits (p, day, 2);
+	*p++ = 'T';
+	p = time_put_digits (p, seconds / 3600, 2);
+	*p++ = ':';
+	p = time_put_digits (p, seconds / 60 % 60, 2);
+	*p++ = ':';
+	p = time_put_digits (p, seconds % 60, 2);
+	*p = '\0';
+
+	return stamp;
+}
+
 gchar  *
 empathy_time_to_string_relative (time_t then)
 {
@@ -167,3 +317,88 @@ empathy_time_to_string_relative (time_t then)
 		return g_strdup (_("in the future"));
 	}
 }
+
+/* Views render the same few minutes over and over, so they keep the strings
+ * formatted for the last ones. Entries are found by minute and format, or by
+ * second for formats which show seconds. */
+
+#define TIME_CACHE_SIZE 32
+
+typedef struct {
+	/* interned */
+	const gchar *format;
+	time_t       key;
+	gchar       *string;
+} TimeCacheEntry;
+
+struct _EmpathyTimeCache {
+	TimeCacheEntry entries[TIME_CACHE_SIZE];
+};
+
+EmpathyTimeCache *
+empathy_time_cache_new (void)
+{
+	return g_slice_new0 (EmpathyTimeCache);
+}
+
+void
+empathy_time_cache_free (EmpathyTimeCache *cache)
+{
+	guint i;
+
+	if (!cache) {
+		return;
+	}
+
+	for (i = 0; i < TIME_CACHE_SIZE; i++) {
+		g_free (cache->entries[i].string);
+	}
+
+	g_slice_free (EmpathyTimeCache, cache);
+}
+
+static gboolean
+time_format_has_seconds (const gchar *format)
+{
+	const gchar *p;
+
+	for (p = strchr (format, '%'); p && p[1]; p = strchr (p + 2, '%')) {
+		if (strchr ("crsSTX+", p[1])) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Same as empathy_time_to_string_local(), but the string belongs to @cache
+ * and is only valid until the next call. */
+const gchar *
+empathy_time_cache_to_string_local (EmpathyTimeCache *cache,
+				    time_t            t,
+				    const gchar      *format)
+{
+	TimeCacheEntry *entry;
+	time_t          key;
+
+	g_return_val_if_fail (cache != NULL, NULL);
+	g_return_val_if_fail (format != NULL, NULL);
+
+	format = g_intern_string (format);
+
+	/* Time zones are all whole minutes away from UTC */
+	key = time_format_has_seconds (format) ? t : t - t % 60;
+
+	entry = cache->entries +
+		((guint) (key / 60) + (GPOINTER_TO_UINT (format) >> 3)) %
+		TIME_CACHE_SIZE;
+
+	if (entry->format != format || entry->key != key || !entry->string) {
+		g_free (entry->string);
+		entry->string = empathy_time_to_string_local (t, format);
+		entry->format = format;
+		entry->key = key;
+	}
+
+	return entry->string;
+}
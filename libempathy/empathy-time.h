@@ -32,8 +32,13 @@ G_BEGIN_DECLS
 
 #define EMPATHY_TIME_FORMAT_DISPLAY_SHORT "%H:%M"
 #define EMPATHY_TIME_FORMAT_DISPLAY_LONG  "%a %d %b %Y"
+/* Layout of the timestamps in the logs, always in UTC */
+#define EMPATHY_TIME_FORMAT_LOG           "%Y%m%dT%H:%M:%S"
+
+typedef struct _EmpathyTimeCache EmpathyTimeCache;
 
 time_t  empathy_time_get_current     (void);
+gint64  empathy_time_get_monotonic   (void);
 time_t  empathy_time_get_local_time  (struct tm   *tm);
 time_t  empathy_time_parse           (const gchar *str);
 gchar  *empathy_time_to_string_utc   (time_t       t,
@@ -41,6 +46,13 @@ gchar  *empathy_time_to_string_utc   (time_t       t,
 gchar  *empathy_time_to_string_local (time_t       t,
 				      const gchar *format);
 gchar  *empathy_time_to_string_relative (time_t t);
+gchar  *empathy_time_to_string_log   (time_t       t);
+
+EmpathyTimeCache *empathy_time_cache_new             (void);
+void              empathy_time_cache_free            (EmpathyTimeCache *cache);
+const gchar *     empathy_time_cache_to_string_local (EmpathyTimeCache *cache,
+						      time_t            t,
+						      const gchar      *format);
 
 G_END_DECLS
 
@@ -28,6 +28,7 @@
 
 #include "empathy-tp-call.h"
 #include "empathy-tp-contact-factory.h"
+#include "empathy-footprint.h"
 #include "empathy-utils.h"
 
 #define DEBUG_FLAG EMPATHY_DEBUG_TP
@@ -541,6 +542,7 @@ empathy_tp_call_init (EmpathyTpCall *call)
     EMPATHY_TYPE_TP_CALL, EmpathyTpCallPriv);
 
   call->priv = priv;
+  EMPATHY_FOOTPRINT_TRACK (call);
   priv->status = EMPATHY_TP_CALL_STATUS_READYING;
   priv->contact = NULL;
   priv->audio = g_slice_new0 (EmpathyTpCallStream);
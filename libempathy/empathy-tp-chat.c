@@ -31,6 +31,7 @@
 #include "empathy-tp-contact-factory.h"
 #include "empathy-contact-monitor.h"
 #include "empathy-contact-list.h"
+#include "empathy-footprint.h"
 #include "empathy-marshal.h"
 #include "empathy-time.h"
 #include "empathy-utils.h"
@@ -38,6 +39,9 @@
 #define DEBUG_FLAG EMPATHY_DEBUG_TP | EMPATHY_DEBUG_CHAT
 #include "empathy-debug.h"
 
+/* Time in milliseconds acknowledgements are accumulated before being sent */
+#define ACKNOWLEDGE_TIMEOUT 200
+
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyTpChat)
 typedef struct {
 	gboolean               dispose_has_run;
@@ -52,6 +56,18 @@ typedef struct {
 	GQueue                *messages_queue;
 	/* Queue of messages signalled but not acked yet */
 	GQueue                *pending_messages_queue;
+	/* EmpathyMessage -> its link in pending_messages_queue */
+	GHashTable            *pending_messages_links;
+	/* Ids of acknowledged messages not sent to the CM yet */
+	GArray                *acknowledge_ids;
+	guint                  acknowledge_id;
+	/* TpHandle -> EmpathyContact of resolved message senders */
+	GHashTable            *senders;
+	/* TpHandle -> GQueue of queued messages waiting for that sender */
+	GHashTable            *unresolved_senders;
+	/* Unresolved sender handles not requested to the factory yet */
+	GArray                *sender_requests;
+	guint                  sender_requests_id;
 	gboolean               had_properties_list;
 	GPtrArray             *properties;
 	gboolean               ready;
@@ -89,6 +105,7 @@ G_DEFINE_TYPE_WITH_CODE (EmpathyTpChat, empathy_tp_chat, G_TYPE_OBJECT,
 						tp_chat_iface_init));
 
 static void acknowledge_messages (EmpathyTpChat *chat, GArray *ids);
+static gboolean tp_chat_flush_acknowledgements (gpointer user_data);
 
 static void
 tp_chat_invalidated_cb (TpProxy       *proxy,
@@ -185,45 +202,171 @@ tp_chat_get_monitor (EmpathyContactList *list)
 	return priv->contact_monitor;
 }
 
+static void
+tp_chat_emit_message (EmpathyTpChat  *chat,
+		      EmpathyMessage *message)
+{
+	EmpathyTpChatPriv *priv = GET_PRIV (chat);
+
+	g_queue_push_tail (priv->pending_messages_queue, message);
+	g_hash_table_insert (priv->pending_messages_links, message,
+			     priv->pending_messages_queue->tail);
+	g_signal_emit (chat, signals[MESSAGE_RECEIVED], 0, message);
+}
+
+static void
+tp_chat_remove_pending_message (EmpathyTpChat  *chat,
+				EmpathyMessage *message)
+{
+	EmpathyTpChatPriv *priv = GET_PRIV (chat);
+	GList             *link;
+
+	link = g_hash_table_lookup (priv->pending_messages_links, message);
+	g_assert (link != NULL);
+	g_hash_table_remove (priv->pending_messages_links, message);
+	g_queue_delete_link (priv->pending_messages_queue, link);
+	g_object_unref (message);
+}
+
 static void
 tp_chat_emit_queued_messages (EmpathyTpChat *chat)
 {
 	EmpathyTpChatPriv *priv = GET_PRIV (chat);
-	EmpathyMessage    *message;
+	GList             *l, *next;
 
-	/* Check if we can now emit some queued messages */
-	while ((message = g_queue_peek_head (priv->messages_queue)) != NULL) {
+	/* Emit the queued messages whose sender is known, the others keep
+	 * their place until their sender is resolved. */
+	for (l = priv->messages_queue->head; l; l = next) {
+		EmpathyMessage *message = l->data;
+
+		next = l->next;
 		if (empathy_message_get_sender (message) == NULL) {
-			break;
+			continue;
 		}
 
 		DEBUG ("Queued message ready");
-		g_queue_pop_head (priv->messages_queue);
-		g_queue_push_tail (priv->pending_messages_queue, message);
-		g_signal_emit (chat, signals[MESSAGE_RECEIVED], 0, message);
+		g_queue_delete_link (priv->messages_queue, l);
+		tp_chat_emit_message (chat, message);
+	}
+}
+
+static void
+tp_chat_add_sender (EmpathyTpChat  *chat,
+		    EmpathyContact *contact)
+{
+	EmpathyTpChatPriv *priv = GET_PRIV (chat);
+	TpHandle           handle;
+	GQueue            *messages;
+	GList             *l;
+
+	handle = empathy_contact_get_handle (contact);
+	if (handle == 0) {
+		return;
+	}
+
+	g_hash_table_insert (priv->senders, GUINT_TO_POINTER (handle),
+			     g_object_ref (contact));
+
+	messages = g_hash_table_lookup (priv->unresolved_senders,
+					GUINT_TO_POINTER (handle));
+	if (messages == NULL) {
+		return;
+	}
+
+	for (l = messages->head; l; l = l->next) {
+		empathy_message_set_sender (l->data, contact);
 	}
+	g_hash_table_remove (priv->unresolved_senders,
+			     GUINT_TO_POINTER (handle));
 }
 
 static void
-tp_chat_got_sender_cb (EmpathyTpContactFactory *factory,
-		       EmpathyContact          *contact,
-		       const GError            *error,
-		       gpointer                 message,
-		       GObject                 *chat)
+tp_chat_drop_sender (EmpathyTpChat *chat,
+		     TpHandle       handle)
 {
 	EmpathyTpChatPriv *priv = GET_PRIV (chat);
+	GQueue            *messages;
+	GList             *l;
+
+	/* Do not block the message queue, just drop those messages */
+	messages = g_hash_table_lookup (priv->unresolved_senders,
+					GUINT_TO_POINTER (handle));
+	if (messages == NULL) {
+		return;
+	}
+
+	for (l = messages->head; l; l = l->next) {
+		g_queue_remove (priv->messages_queue, l->data);
+		g_object_unref (l->data);
+	}
+	g_hash_table_remove (priv->unresolved_senders,
+			     GUINT_TO_POINTER (handle));
+}
+
+static void
+tp_chat_got_senders_cb (EmpathyTpContactFactory *factory,
+			guint                    n_contacts,
+			EmpathyContact * const * contacts,
+			guint                    n_failed,
+			const TpHandle          *failed,
+			const GError            *error,
+			gpointer                 user_data,
+			GObject                 *chat)
+{
+	GArray *handles = user_data;
+	guint   i;
 
 	if (error) {
 		DEBUG ("Error: %s", error->message);
-		/* Do not block the message queue, just drop this message */
-		g_queue_remove (priv->messages_queue, message);
+		for (i = 0; i < handles->len; i++) {
+			tp_chat_drop_sender (EMPATHY_TP_CHAT (chat),
+					     g_array_index (handles, TpHandle, i));
+		}
 	} else {
-		empathy_message_set_sender (message, contact);
+		for (i = 0; i < n_contacts; i++) {
+			tp_chat_add_sender (EMPATHY_TP_CHAT (chat), contacts[i]);
+		}
+		for (i = 0; i < n_failed; i++) {
+			DEBUG ("Failed to get sender %u", failed[i]);
+			tp_chat_drop_sender (EMPATHY_TP_CHAT (chat), failed[i]);
+		}
 	}
 
 	tp_chat_emit_queued_messages (EMPATHY_TP_CHAT (chat));
 }
 
+static void
+tp_chat_array_free (GArray *array)
+{
+	g_array_free (array, TRUE);
+}
+
+static gboolean
+tp_chat_request_senders_cb (gpointer user_data)
+{
+	EmpathyTpChat     *chat = user_data;
+	EmpathyTpChatPriv *priv = GET_PRIV (chat);
+	GArray            *handles;
+
+	priv->sender_requests_id = 0;
+	if (priv->sender_requests->len == 0) {
+		return FALSE;
+	}
+
+	DEBUG ("Requesting %d message senders", priv->sender_requests->len);
+
+	/* One request for the whole burst of messages */
+	handles = priv->sender_requests;
+	priv->sender_requests = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+	empathy_tp_contact_factory_get_from_handles (priv->factory,
+		handles->len, (TpHandle *) handles->data,
+		tp_chat_got_senders_cb,
+		handles, (GDestroyNotify) tp_chat_array_free,
+		G_OBJECT (chat));
+
+	return FALSE;
+}
+
 static void
 tp_chat_build_message (EmpathyTpChat *chat,
 		       guint          id,
@@ -234,6 +377,8 @@ tp_chat_build_message (EmpathyTpChat *chat,
 {
 	EmpathyTpChatPriv *priv;
 	EmpathyMessage    *message;
+	EmpathyContact    *sender;
+	GQueue            *waiting;
 
 	priv = GET_PRIV (chat);
 
@@ -242,17 +387,38 @@ tp_chat_build_message (EmpathyTpChat *chat,
 	empathy_message_set_receiver (message, priv->user);
 	empathy_message_set_timestamp (message, timestamp);
 	empathy_message_set_id (message, id);
-	g_queue_push_tail (priv->messages_queue, message);
 
 	if (from_handle == 0) {
-		empathy_message_set_sender (message, priv->user);
-		tp_chat_emit_queued_messages (chat);
+		sender = priv->user;
 	} else {
-		empathy_tp_contact_factory_get_from_handle (priv->factory,
-			from_handle,
-			tp_chat_got_sender_cb,
-			message, NULL, G_OBJECT (chat));
+		sender = g_hash_table_lookup (priv->senders,
+					      GUINT_TO_POINTER (from_handle));
+	}
+
+	/* Messages from known senders don't wait behind unresolved ones */
+	if (sender) {
+		empathy_message_set_sender (message, sender);
+		tp_chat_emit_message (chat, message);
+		return;
 	}
+
+	g_queue_push_tail (priv->messages_queue, message);
+
+	/* Wait for the sender, requesting it only once per burst */
+	waiting = g_hash_table_lookup (priv->unresolved_senders,
+				       GUINT_TO_POINTER (from_handle));
+	if (waiting == NULL) {
+		waiting = g_queue_new ();
+		g_hash_table_insert (priv->unresolved_senders,
+				     GUINT_TO_POINTER (from_handle), waiting);
+
+		g_array_append_val (priv->sender_requests, from_handle);
+		if (priv->sender_requests_id == 0) {
+			priv->sender_requests_id =
+				g_idle_add (tp_chat_request_senders_cb, chat);
+		}
+	}
+	g_queue_push_tail (waiting, message);
 }
 
 static void
@@ -466,6 +632,12 @@ tp_chat_list_pending_messages_cb (TpChannel       *channel,
 				       message_body);
 	}
 
+	/* Resolve the senders of the whole backlog with a single request */
+	if (priv->sender_requests_id != 0) {
+		g_source_remove (priv->sender_requests_id);
+		tp_chat_request_senders_cb (chat);
+	}
+
 	if (empty_non_text_content_ids != NULL) {
 		acknowledge_messages (chat, empty_non_text_content_ids);
 		g_array_free (empty_non_text_content_ids, TRUE);
@@ -679,6 +851,8 @@ tp_chat_dispose (GObject *object)
 
 	priv->dispose_has_run = TRUE;
 
+	tp_chat_flush_acknowledgements (self);
+
 	if (priv->channel != NULL) {
 		g_signal_handlers_disconnect_by_func (priv->channel,
 			tp_chat_invalidated_cb, self);
@@ -702,9 +876,17 @@ tp_chat_dispose (GObject *object)
 		g_object_unref (priv->contact_monitor);
 	priv->contact_monitor = NULL;
 
+	if (priv->sender_requests_id != 0) {
+		g_source_remove (priv->sender_requests_id);
+		priv->sender_requests_id = 0;
+	}
+	g_hash_table_remove_all (priv->unresolved_senders);
+	g_hash_table_remove_all (priv->senders);
+
 	g_queue_foreach (priv->messages_queue, (GFunc) g_object_unref, NULL);
 	g_queue_clear (priv->messages_queue);
 
+	g_hash_table_remove_all (priv->pending_messages_links);
 	g_queue_foreach (priv->pending_messages_queue,
 		(GFunc) g_object_unref, NULL);
 	g_queue_clear (priv->pending_messages_queue);
@@ -737,6 +919,11 @@ tp_chat_finalize (GObject *object)
 
 	g_queue_free (priv->messages_queue);
 	g_queue_free (priv->pending_messages_queue);
+	g_hash_table_destroy (priv->senders);
+	g_hash_table_destroy (priv->unresolved_senders);
+	g_array_free (priv->sender_requests, TRUE);
+	g_hash_table_destroy (priv->pending_messages_links);
+	g_array_free (priv->acknowledge_ids, TRUE);
 
 	G_OBJECT_CLASS (empathy_tp_chat_parent_class)->finalize (object);
 }
@@ -851,6 +1038,7 @@ tp_chat_got_added_contacts_cb (EmpathyTpContactFactory *factory,
 	const TpIntSet *members;
 	TpHandle handle;
 	EmpathyContact *contact;
+	GPtrArray *added;
 
 	if (error) {
 		DEBUG ("Error: %s", error->message);
@@ -858,6 +1046,7 @@ tp_chat_got_added_contacts_cb (EmpathyTpContactFactory *factory,
 	}
 
 	members = tp_channel_group_get_members (priv->channel);
+	added = g_ptr_array_sized_new (n_contacts);
 	for (i = 0; i < n_contacts; i++) {
 		contact = contacts[i];
 		handle = empathy_contact_get_handle (contact);
@@ -866,11 +1055,18 @@ tp_chat_got_added_contacts_cb (EmpathyTpContactFactory *factory,
 		if (tp_intset_is_member (members, handle)) {
 			priv->members = g_list_prepend (priv->members,
 				g_object_ref (contact));
-			g_signal_emit_by_name (chat, "members-changed",
-					       contact, NULL, 0, NULL, TRUE);
+			g_ptr_array_add (added, contact);
 		}
+
+		/* Members are the usual senders, no need to resolve them */
+		tp_chat_add_sender (EMPATHY_TP_CHAT (chat), contact);
 	}
 
+	empathy_contact_list_emit_members_changed (EMPATHY_CONTACT_LIST (chat),
+						   added, NULL, NULL, 0, NULL);
+	g_ptr_array_free (added, TRUE);
+	tp_chat_emit_queued_messages (EMPATHY_TP_CHAT (chat));
+
 	tp_chat_update_remote_contact (EMPATHY_TP_CHAT (chat));
 	tp_chat_check_if_ready (EMPATHY_TP_CHAT (chat));
 }
@@ -917,6 +1113,7 @@ tp_chat_group_members_changed_cb (TpChannel     *self,
 	EmpathyTpChatPriv *priv = GET_PRIV (chat);
 	EmpathyContact *contact;
 	EmpathyContact *actor_contact = NULL;
+	GPtrArray *removed_contacts;
 	guint i;
 
 	if (actor != 0) {
@@ -931,17 +1128,21 @@ tp_chat_group_members_changed_cb (TpChannel     *self,
 	}
 
 	/* Remove contacts that are not members anymore */
+	removed_contacts = g_ptr_array_sized_new (removed->len);
 	for (i = 0; i < removed->len; i++) {
 		contact = chat_lookup_contact (chat,
 			g_array_index (removed, TpHandle, i), TRUE);
 
 		if (contact != NULL) {
-			g_signal_emit_by_name (chat, "members-changed", contact,
-					       actor_contact, reason, message,
-					       FALSE);
-			g_object_unref (contact);
+			g_ptr_array_add (removed_contacts, contact);
 		}
 	}
+	empathy_contact_list_emit_members_changed (EMPATHY_CONTACT_LIST (chat),
+						   NULL, removed_contacts,
+						   actor_contact, reason,
+						   message);
+	g_ptr_array_foreach (removed_contacts, (GFunc) g_object_unref, NULL);
+	g_ptr_array_free (removed_contacts, TRUE);
 
 	/* Request added contacts */
 	if (added->len > 0) {
@@ -974,6 +1175,7 @@ tp_chat_got_remote_contact_cb (EmpathyTpContactFactory *factory,
 	}
 
 	priv->remote_contact = g_object_ref (contact);
+	tp_chat_add_sender (EMPATHY_TP_CHAT (chat), contact);
 	g_object_notify (chat, "remote-contact");
 
 	tp_chat_check_if_ready (EMPATHY_TP_CHAT (chat));
@@ -996,6 +1198,7 @@ tp_chat_got_self_contact_cb (EmpathyTpContactFactory *factory,
 
 	priv->user = g_object_ref (contact);
 	empathy_contact_set_is_user (priv->user, TRUE);
+	tp_chat_add_sender (EMPATHY_TP_CHAT (chat), contact);
 	tp_chat_check_if_ready (EMPATHY_TP_CHAT (chat));
 }
 
@@ -1211,9 +1414,20 @@ empathy_tp_chat_init (EmpathyTpChat *chat)
 		EMPATHY_TYPE_TP_CHAT, EmpathyTpChatPriv);
 
 	chat->priv = priv;
+	EMPATHY_FOOTPRINT_TRACK (chat);
 	priv->contact_monitor = NULL;
 	priv->messages_queue = g_queue_new ();
 	priv->pending_messages_queue = g_queue_new ();
+	priv->senders = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					       NULL, g_object_unref);
+	priv->unresolved_senders = g_hash_table_new_full (g_direct_hash,
+							  g_direct_equal,
+							  NULL,
+							  (GDestroyNotify) g_queue_free);
+	priv->sender_requests = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+	priv->pending_messages_links = g_hash_table_new (g_direct_hash,
+							 g_direct_equal);
+	priv->acknowledge_ids = g_array_new (FALSE, FALSE, sizeof (guint));
 }
 
 static void
@@ -1237,6 +1451,9 @@ void
 empathy_tp_chat_close (EmpathyTpChat *chat) {
 	EmpathyTpChatPriv *priv = GET_PRIV (chat);
 
+	/* Acknowledged messages must not come back */
+	tp_chat_flush_acknowledgements (chat);
+
 	/* If there are still messages left, it'll come back..
 	 * We loose the ordering of sent messages though */
 	tp_cli_channel_call_close (priv->channel, -1, tp_chat_async_cb,
@@ -1349,41 +1566,67 @@ empathy_tp_chat_get_pending_messages (EmpathyTpChat *chat)
 	return priv->pending_messages_queue->head;
 }
 
-static void
-acknowledge_messages (EmpathyTpChat *chat, GArray *ids) {
+static gboolean
+tp_chat_flush_acknowledgements (gpointer user_data)
+{
+	EmpathyTpChat     *chat = user_data;
 	EmpathyTpChatPriv *priv = GET_PRIV (chat);
 
+	if (priv->acknowledge_id != 0) {
+		g_source_remove (priv->acknowledge_id);
+		priv->acknowledge_id = 0;
+	}
+
+	if (priv->acknowledge_ids->len == 0 || priv->channel == NULL) {
+		return FALSE;
+	}
+
+	DEBUG ("Acknowledging %d messages", priv->acknowledge_ids->len);
+
 	tp_cli_channel_type_text_call_acknowledge_pending_messages (
-		priv->channel, -1, ids, tp_chat_async_cb,
+		priv->channel, -1, priv->acknowledge_ids, tp_chat_async_cb,
 		"acknowledging received message", NULL, G_OBJECT (chat));
+	g_array_set_size (priv->acknowledge_ids, 0);
+
+	return FALSE;
+}
+
+static void
+tp_chat_schedule_acknowledgements (EmpathyTpChat *chat) {
+	EmpathyTpChatPriv *priv = GET_PRIV (chat);
+
+	if (priv->acknowledge_id == 0) {
+		priv->acknowledge_id = g_timeout_add (ACKNOWLEDGE_TIMEOUT,
+						      tp_chat_flush_acknowledgements,
+						      chat);
+	}
+}
+
+static void
+acknowledge_messages (EmpathyTpChat *chat, GArray *ids) {
+	EmpathyTpChatPriv *priv = GET_PRIV (chat);
+
+	/* Accumulate the ids, they are sent in a single call later */
+	g_array_append_vals (priv->acknowledge_ids, ids->data, ids->len);
+	tp_chat_schedule_acknowledgements (chat);
 }
 
 void
 empathy_tp_chat_acknowledge_message (EmpathyTpChat *chat,
 				     EmpathyMessage *message) {
 	EmpathyTpChatPriv *priv = GET_PRIV (chat);
-	GArray *message_ids;
-	GList *m;
 	guint id;
 
 	g_return_if_fail (EMPATHY_IS_TP_CHAT (chat));
 	g_return_if_fail (priv->ready);
 
-	if (empathy_message_get_sender (message) == priv->user)
-		goto out;
-
-	message_ids = g_array_sized_new (FALSE, FALSE, sizeof (guint), 1);
-
-	id = empathy_message_get_id (message);
-	g_array_append_val (message_ids, id);
-	acknowledge_messages (chat, message_ids);
-	g_array_free (message_ids, TRUE);
+	if (empathy_message_get_sender (message) != priv->user) {
+		id = empathy_message_get_id (message);
+		g_array_append_val (priv->acknowledge_ids, id);
+		tp_chat_schedule_acknowledgements (chat);
+	}
 
-out:
-	m = g_queue_find (priv->pending_messages_queue, message);
-	g_assert (m != NULL);
-	g_queue_delete_link (priv->pending_messages_queue, m);
-	g_object_unref (message);
+	tp_chat_remove_pending_message (chat, message);
 }
 
 void
@@ -1407,19 +1650,13 @@ empathy_tp_chat_acknowledge_messages (EmpathyTpChat *chat,
 	message_ids = g_array_sized_new (FALSE, FALSE, sizeof (guint), length);
 
 	for (l = msgs; l != NULL; l = g_list_next (l)) {
-		GList *m;
-
 		EmpathyMessage *message = EMPATHY_MESSAGE (l->data);
 
-		m = g_queue_find (priv->pending_messages_queue, message);
-		g_assert (m != NULL);
-		g_queue_delete_link (priv->pending_messages_queue, m);
-
 		if (empathy_message_get_sender (message) != priv->user) {
 			guint id = empathy_message_get_id (message);
 			g_array_append_val (message_ids, id);
 		}
-		g_object_unref (message);
+		tp_chat_remove_pending_message (chat, message);
 	}
 
 	if (message_ids->len > 0)
@@ -33,6 +33,8 @@
 #include <extensions/extensions.h>
 
 #include "empathy-tp-contact-factory.h"
+#include "empathy-avatar-cache.h"
+#include "empathy-footprint.h"
 #include "empathy-utils.h"
 #include "empathy-location.h"
 
@@ -44,6 +46,13 @@ typedef struct {
 	TpConnection   *connection;
 	GList          *contacts;
 
+	/* Handles whose avatar is not cached, requested together */
+	GArray         *avatar_requests;
+	guint           avatar_requests_id;
+	/* handle -> AvatarLoadData of the latest avatar being looked up in
+	 * the cache, the loads are detached when removed */
+	GHashTable     *avatar_loads;
+
 	gchar         **avatar_mime_types;
 	guint           avatar_min_width;
 	guint           avatar_min_height;
@@ -201,58 +210,151 @@ tp_contact_factory_request_avatars_cb (TpConnection *connection,
 }
 
 static gboolean
+tp_contact_factory_request_avatars_idle_cb (gpointer user_data)
+{
+	EmpathyTpContactFactory     *tp_factory = user_data;
+	EmpathyTpContactFactoryPriv *priv = GET_PRIV (tp_factory);
+
+	DEBUG ("Requesting %d avatars", priv->avatar_requests->len);
+
+	tp_cli_connection_interface_avatars_call_request_avatars (priv->connection,
+								  -1,
+								  priv->avatar_requests,
+								  tp_contact_factory_request_avatars_cb,
+								  NULL, NULL,
+								  G_OBJECT (tp_factory));
+
+	g_array_set_size (priv->avatar_requests, 0);
+	priv->avatar_requests_id = 0;
+
+	return FALSE;
+}
+
+static void
+tp_contact_factory_queue_avatar_request (EmpathyTpContactFactory *tp_factory,
+					 guint                    handle)
+{
+	EmpathyTpContactFactoryPriv *priv = GET_PRIV (tp_factory);
+
+	g_array_append_val (priv->avatar_requests, handle);
+
+	if (priv->avatar_requests_id == 0) {
+		priv->avatar_requests_id =
+			g_idle_add (tp_contact_factory_request_avatars_idle_cb,
+				    tp_factory);
+	}
+}
+
+typedef struct {
+	/* NULL once the load is outdated or the factory is gone */
+	EmpathyTpContactFactory *tp_factory;
+	guint                    handle;
+	gchar                   *token;
+} AvatarLoadData;
+
+static void
+tp_contact_factory_avatar_load_detach (AvatarLoadData *data)
+{
+	data->tp_factory = NULL;
+}
+
+static void
+tp_contact_factory_avatar_cache_loaded_cb (EmpathyAvatar *avatar,
+					   gpointer       user_data)
+{
+	AvatarLoadData *data = user_data;
+	EmpathyTpContactFactory *tp_factory = data->tp_factory;
+	EmpathyTpContactFactoryPriv *priv;
+	EmpathyContact *contact;
+
+	/* A newer avatar came while this one was loading */
+	if (tp_factory == NULL) {
+		DEBUG ("Ignoring outdated avatar token %s", data->token);
+		goto out;
+	}
+
+	priv = GET_PRIV (tp_factory);
+	g_hash_table_remove (priv->avatar_loads,
+			     GUINT_TO_POINTER (data->handle));
+
+	contact = tp_contact_factory_find_by_handle (tp_factory,
+						     data->handle);
+	if (!contact) {
+		goto out;
+	}
+
+	if (avatar) {
+		/* Got from cache, use it */
+		empathy_contact_set_avatar (contact, avatar);
+	} else {
+		/* Avatar is not up-to-date, we have to request it. */
+		DEBUG ("Need to request avatar for token %s", data->token);
+		tp_contact_factory_queue_avatar_request (tp_factory,
+							 data->handle);
+	}
+
+out:
+	g_free (data->token);
+	g_slice_free (AvatarLoadData, data);
+}
+
+static void
 tp_contact_factory_avatar_maybe_update (EmpathyTpContactFactory *tp_factory,
 					guint                    handle,
 					const gchar             *token)
 {
+	EmpathyTpContactFactoryPriv *priv = GET_PRIV (tp_factory);
 	EmpathyContact *contact;
 	EmpathyAvatar  *avatar;
+	EmpathyAvatarCache *cache;
+	AvatarLoadData *data;
 
 	contact = tp_contact_factory_find_by_handle (tp_factory, handle);
 	if (!contact) {
-		return TRUE;
+		return;
 	}
 
+	/* Whatever happens, a load still running is now outdated */
+	g_hash_table_remove (priv->avatar_loads, GUINT_TO_POINTER (handle));
+
 	/* Check if we have an avatar */
 	if (EMP_STR_EMPTY (token)) {
 		empathy_contact_set_avatar (contact, NULL);
-		return TRUE;
+		return;
 	}
 
 	/* Check if the avatar changed */
 	avatar = empathy_contact_get_avatar (contact);
 	if (avatar && !tp_strdiff (avatar->token, token)) {
-		return TRUE;
-	}
-
-	/* The avatar changed, search the new one in the cache */
-	if (empathy_contact_load_avatar_cache (contact, token)) {
-		/* Got from cache, use it */
-		return TRUE;
+		return;
 	}
 
-	/* Avatar is not up-to-date, we have to request it. */
-	return FALSE;
+	/* The avatar changed, search the new one in the cache without
+	 * blocking; it is requested from the connection if it's not there */
+	data = g_slice_new (AvatarLoadData);
+	data->tp_factory = tp_factory;
+	data->handle = handle;
+	data->token = g_strdup (token);
+	g_hash_table_insert (priv->avatar_loads, GUINT_TO_POINTER (handle),
+			     data);
+
+	cache = empathy_avatar_cache_dup_singleton ();
+	empathy_avatar_cache_load_async (cache, token,
+					 tp_contact_factory_avatar_cache_loaded_cb,
+					 data);
+	g_object_unref (cache);
 }
 
-typedef struct {
-	EmpathyTpContactFactory *tp_factory;
-	GArray                  *handles;
-} TokensData;
-
 static void
 tp_contact_factory_avatar_tokens_foreach (gpointer key,
 					  gpointer value,
 					  gpointer user_data)
 {
-	TokensData  *data = user_data;
+	EmpathyTpContactFactory *tp_factory = user_data;
 	const gchar *token = value;
 	guint        handle = GPOINTER_TO_UINT (key);
 
-	if (!tp_contact_factory_avatar_maybe_update (data->tp_factory,
-						     handle, token)) {
-		g_array_append_val (data->handles, handle);
-	}
+	tp_contact_factory_avatar_maybe_update (tp_factory, handle, token);
 }
 
 static void
@@ -260,34 +362,17 @@ tp_contact_factory_got_known_avatar_tokens (EmpathyTpContactFactory *tp_factory,
 					    GHashTable              *tokens,
 					    const GError            *error)
 {
-	EmpathyTpContactFactoryPriv *priv = GET_PRIV (tp_factory);
-	TokensData data;
-
 	if (error) {
 		DEBUG ("Error: %s", error->message);
 		return;
 	}
 
-	data.tp_factory = tp_factory;
-	data.handles = g_array_new (FALSE, FALSE, sizeof (guint));
+	DEBUG ("Got %d tokens", g_hash_table_size (tokens));
+
 	g_hash_table_foreach (tokens,
 			      tp_contact_factory_avatar_tokens_foreach,
-			      &data);
-
-	DEBUG ("Got %d tokens, need to request %d avatars",
-		g_hash_table_size (tokens), data.handles->len);
+			      tp_factory);
 
-	/* Request needed avatars */
-	if (data.handles->len > 0) {
-		tp_cli_connection_interface_avatars_call_request_avatars (priv->connection,
-									  -1,
-									  data.handles,
-									  tp_contact_factory_request_avatars_cb,
-									  NULL, NULL,
-									  G_OBJECT (tp_factory));
-	}
-
-	g_array_free (data.handles, TRUE);
 	g_hash_table_destroy (tokens);
 }
 
@@ -298,26 +383,8 @@ tp_contact_factory_avatar_updated_cb (TpConnection *connection,
 				      gpointer      user_data,
 				      GObject      *tp_factory)
 {
-	GArray *handles;
-
-	if (tp_contact_factory_avatar_maybe_update (EMPATHY_TP_CONTACT_FACTORY (tp_factory),
-						    handle, new_token)) {
-		/* Avatar was cached, nothing to do */
-		return;
-	}
-
-	DEBUG ("Need to request avatar for token %s", new_token);
-
-	handles = g_array_new (FALSE, FALSE, sizeof (guint));
-	g_array_append_val (handles, handle);
-
-	tp_cli_connection_interface_avatars_call_request_avatars (connection,
-								  -1,
-								  handles,
-								  tp_contact_factory_request_avatars_cb,
-								  NULL, NULL,
-								  tp_factory);
-	g_array_free (handles, TRUE);
+	tp_contact_factory_avatar_maybe_update (EMPATHY_TP_CONTACT_FACTORY (tp_factory),
+						handle, new_token);
 }
 
 static void
@@ -1280,6 +1347,13 @@ tp_contact_factory_finalize (GObject *object)
 
 	g_list_free (priv->contacts);
 
+	if (priv->avatar_requests_id != 0) {
+		g_source_remove (priv->avatar_requests_id);
+	}
+	g_array_free (priv->avatar_requests, TRUE);
+	/* Loads still running see they are detached when they finish */
+	g_hash_table_destroy (priv->avatar_loads);
+
 	g_object_unref (priv->connection);
 
 	g_strfreev (priv->avatar_mime_types);
@@ -1430,8 +1504,13 @@ empathy_tp_contact_factory_init (EmpathyTpContactFactory *tp_factory)
 		EMPATHY_TYPE_TP_CONTACT_FACTORY, EmpathyTpContactFactoryPriv);
 
 	tp_factory->priv = priv;
+	EMPATHY_FOOTPRINT_TRACK (tp_factory);
 	priv->can_request_ft = FALSE;
 	priv->can_request_st = FALSE;
+	priv->avatar_requests = g_array_new (FALSE, FALSE, sizeof (guint));
+	priv->avatar_loads = g_hash_table_new_full (g_direct_hash,
+		g_direct_equal, NULL,
+		(GDestroyNotify) tp_contact_factory_avatar_load_detach);
 }
 
 static GHashTable *factories = NULL;
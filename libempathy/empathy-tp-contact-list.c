@@ -343,13 +343,15 @@ tp_contact_list_got_added_members_cb (EmpathyTpContactFactory *factory,
 				      GObject                 *list)
 {
 	EmpathyTpContactListPriv *priv = GET_PRIV (list);
-	guint i;
+	GPtrArray                *added;
+	guint                     i;
 
 	if (error) {
 		DEBUG ("Error: %s", error->message);
 		return;
 	}
 
+	added = g_ptr_array_sized_new (n_contacts);
 	for (i = 0; i < n_contacts; i++) {
 		EmpathyContact *contact = contacts[i];
 		TpHandle handle;
@@ -358,11 +360,10 @@ tp_contact_list_got_added_members_cb (EmpathyTpContactFactory *factory,
 		if (g_hash_table_lookup (priv->members, GUINT_TO_POINTER (handle)))
 			continue;
 
-		/* Add to the list and emit signal */
+		/* Add to the list, signals are emitted for the whole batch */
 		g_hash_table_insert (priv->members, GUINT_TO_POINTER (handle),
 				     g_object_ref (contact));
-		g_signal_emit_by_name (list, "members-changed", contact,
-				       0, 0, NULL, TRUE);
+		g_ptr_array_add (added, contact);
 
 		/* This contact is now member, implicitly accept pending. */
 		if (g_hash_table_lookup (priv->pendings, GUINT_TO_POINTER (handle))) {
@@ -372,6 +373,10 @@ tp_contact_list_got_added_members_cb (EmpathyTpContactFactory *factory,
 				-1, &handles, NULL, NULL, NULL, NULL, NULL);
 		}
 	}
+
+	empathy_contact_list_emit_members_changed (EMPATHY_CONTACT_LIST (list),
+						   added, NULL, NULL, 0, NULL);
+	g_ptr_array_free (added, TRUE);
 }
 
 static void
@@ -427,25 +432,58 @@ tp_contact_list_remove_handle (EmpathyTpContactList *list,
 {
 	EmpathyTpContactListPriv *priv = GET_PRIV (list);
 	EmpathyContact *contact;
-	const gchar *signal;
 
-	if (table == priv->pendings)
-		signal = "pendings-changed";
-	else if (table == priv->members)
-		signal = "members-changed";
-	else
+	if (table != priv->pendings && table != priv->members)
 		return;
 
 	contact = g_hash_table_lookup (table, GUINT_TO_POINTER (handle));
 	if (contact) {
 		g_object_ref (contact);
 		g_hash_table_remove (table, GUINT_TO_POINTER (handle));
-		g_signal_emit_by_name (list, signal, contact, 0, 0, NULL,
-				       FALSE);
+		if (table == priv->pendings) {
+			g_signal_emit_by_name (list, "pendings-changed",
+					       contact, 0, 0, NULL, FALSE);
+		} else {
+			GPtrArray *removed = g_ptr_array_sized_new (1);
+
+			g_ptr_array_add (removed, contact);
+			empathy_contact_list_emit_members_changed (
+				EMPATHY_CONTACT_LIST (list), NULL, removed,
+				NULL, 0, NULL);
+			g_ptr_array_free (removed, TRUE);
+		}
 		g_object_unref (contact);
 	}
 }
 
+static void
+tp_contact_list_remove_members (EmpathyTpContactList *list,
+				GArray               *handles)
+{
+	EmpathyTpContactListPriv *priv = GET_PRIV (list);
+	GPtrArray                *removed;
+	guint                     i;
+
+	removed = g_ptr_array_sized_new (handles->len);
+	for (i = 0; i < handles->len; i++) {
+		TpHandle        handle = g_array_index (handles, TpHandle, i);
+		EmpathyContact *contact;
+
+		contact = g_hash_table_lookup (priv->members,
+					       GUINT_TO_POINTER (handle));
+		if (contact) {
+			g_ptr_array_add (removed, g_object_ref (contact));
+			g_hash_table_remove (priv->members,
+					     GUINT_TO_POINTER (handle));
+		}
+	}
+
+	empathy_contact_list_emit_members_changed (EMPATHY_CONTACT_LIST (list),
+						   NULL, removed, NULL, 0, NULL);
+	g_ptr_array_foreach (removed, (GFunc) g_object_unref, NULL);
+	g_ptr_array_free (removed, TRUE);
+}
+
 static void
 tp_contact_list_publish_group_members_changed_cb (TpChannel     *channel,
 						  gchar         *message,
@@ -469,7 +507,7 @@ tp_contact_list_publish_group_members_changed_cb (TpChannel     *channel,
 	/* We refuse to send our presence to those contacts, remove from pendings */
 	for (i = 0; i < removed->len; i++) {
 		tp_contact_list_remove_handle (list, priv->pendings,
-			g_array_index (added, TpHandle, i));
+			g_array_index (removed, TpHandle, i));
 	}
 
 	/* Those contacts want our presence, auto accept those that are already
@@ -545,7 +583,6 @@ tp_contact_list_subscribe_group_members_changed_cb (TpChannel     *channel,
 						    EmpathyTpContactList *list)
 {
 	EmpathyTpContactListPriv *priv = GET_PRIV (list);
-	guint i;
 
 	/* We now get the presence of those contacts, add them to members */
 	if (added->len > 0) {
@@ -556,9 +593,8 @@ tp_contact_list_subscribe_group_members_changed_cb (TpChannel     *channel,
 	}
 
 	/* Those contacts refuse to send us their presence, remove from members. */
-	for (i = 0; i < removed->len; i++) {
-		tp_contact_list_remove_handle (list, priv->members,
-			g_array_index (added, TpHandle, i));
+	if (removed->len > 0) {
+		tp_contact_list_remove_members (list, removed);
 	}
 
 	/* We want those contacts in our contact list but we don't get their
@@ -1112,16 +1148,19 @@ empathy_tp_contact_list_remove_all (EmpathyTpContactList *list)
 	EmpathyTpContactListPriv *priv = GET_PRIV (list);
 	GHashTableIter            iter;
 	gpointer                  contact;
+	GPtrArray                *removed;
 
 	g_return_if_fail (EMPATHY_IS_TP_CONTACT_LIST (list));
 
 	/* Remove all contacts */
+	removed = g_ptr_array_sized_new (g_hash_table_size (priv->members));
 	g_hash_table_iter_init (&iter, priv->members);
 	while (g_hash_table_iter_next (&iter, NULL, &contact)) {
-		g_signal_emit_by_name (list, "members-changed", contact,
-				       NULL, 0, NULL,
-				       FALSE);
+		g_ptr_array_add (removed, contact);
 	}
+	empathy_contact_list_emit_members_changed (EMPATHY_CONTACT_LIST (list),
+						   NULL, removed, NULL, 0, NULL);
+	g_ptr_array_free (removed, TRUE);
 	g_hash_table_remove_all (priv->members);
 
 	g_hash_table_iter_init (&iter, priv->pendings);
@@ -23,15 +23,23 @@
 
 #include <config.h>
 
+/* for splice() */
+#define _GNU_SOURCE
+
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 
 #include <gio/gio.h>
 #include <gio/gunixinputstream.h>
@@ -42,6 +50,7 @@
 #include <telepathy-glib/util.h>
 
 #include "empathy-tp-file.h"
+#include "empathy-footprint.h"
 #include "empathy-marshal.h"
 #include "empathy-time.h"
 #include "empathy-utils.h"
@@ -61,12 +70,24 @@
  * transferring files using libempathy.
  */
 
+#if defined (HAVE_SPLICE) || \
+    (defined (HAVE_SENDFILE) && defined (HAVE_SYS_SENDFILE_H))
+#define TP_FILE_HAVE_FAST_PATH
+#endif
+
+/* Maximum number of bytes moved by a single sendfile()/splice() call, so
+ * that cancellation is noticed during big transfers */
+#define FAST_PATH_CHUNK_SIZE (1024 * 1024)
+/* Size of the buffer used when the data has to go through userspace */
+#define COPY_BUFFER_SIZE (256 * 1024)
+
 /* EmpathyTpFile object */
 
 typedef struct {
   TpChannel *channel;
   gboolean ready;
 
+  GFile *gfile;
   GInputStream *in_stream;
   GOutputStream *out_stream;
 
@@ -86,6 +107,14 @@ typedef struct {
   /* GCancellable we're passed when offering/accepting the transfer */
   GCancellable *cancellable;
 
+  /* checksum of the data computed while transferring it */
+  GChecksum *checksum;
+  gchar *checksum_string;
+
+  /* the local I/O is still running, the CM may have completed before */
+  gboolean io_running;
+  gboolean completed_pending;
+
   /* callbacks for the operation */
   EmpathyTpFileProgressCallback progress_callback;
   gpointer progress_user_data;
@@ -234,6 +263,32 @@ ft_operation_close_with_error (EmpathyTpFile *tp_file,
     priv->op_callback (tp_file, error, priv->op_user_data);
 }
 
+static void
+tp_file_io_done (EmpathyTpFile *tp_file,
+    GError *error)
+{
+  EmpathyTpFilePriv *priv = GET_PRIV (tp_file);
+
+  priv->io_running = FALSE;
+
+  if (error != NULL)
+    {
+      ft_operation_close_with_error (tp_file, error);
+      return;
+    }
+
+  if (priv->checksum != NULL)
+    {
+      g_free (priv->checksum_string);
+      priv->checksum_string = g_strdup (g_checksum_get_string (priv->checksum));
+      DEBUG ("Checksum of the transferred data: %s", priv->checksum_string);
+    }
+
+  /* all the data is written, we can now report the completion */
+  if (priv->completed_pending)
+    ft_operation_close_clean (tp_file);
+}
+
 static void
 splice_stream_ready_cb (GObject *source,
     GAsyncResult *res,
@@ -248,12 +303,458 @@ splice_stream_ready_cb (GObject *source,
 
   DEBUG ("Splice stream ready cb, error %p", error);
 
-  if (error != NULL)
+  tp_file_io_done (tp_file, error);
+  g_clear_error (&error);
+}
+
+typedef struct {
+  EmpathyTpFile *tp_file;
+  GInputStream *in;
+  GOutputStream *out;
+  GChecksum *checksum;
+  GError *error;
+} CopyData;
+
+static gboolean
+copy_job_done (gpointer user_data)
+{
+  CopyData *data = user_data;
+
+  DEBUG ("Copy job done, error %p", data->error);
+
+  tp_file_io_done (data->tp_file, data->error);
+
+  g_clear_error (&data->error);
+  g_object_unref (data->tp_file);
+  g_object_unref (data->in);
+  g_object_unref (data->out);
+  g_slice_free (CopyData, data);
+
+  return FALSE;
+}
+
+/* Used instead of g_output_stream_splice_async() when the data has to be
+ * hashed while it passes through */
+static gboolean
+copy_job (GIOSchedulerJob *job,
+    GCancellable *cancellable,
+    gpointer user_data)
+{
+  CopyData *data = user_data;
+  gchar *buffer;
+  gssize n_read;
+  gsize n_written;
+
+  buffer = g_malloc (COPY_BUFFER_SIZE);
+
+  while ((n_read = g_input_stream_read (data->in, buffer, COPY_BUFFER_SIZE,
+              cancellable, &data->error)) > 0)
     {
-      ft_operation_close_with_error (tp_file, error);
+      g_checksum_update (data->checksum, (guchar *) buffer, n_read);
+
+      if (!g_output_stream_write_all (data->out, buffer, n_read, &n_written,
+              cancellable, &data->error))
+        break;
+    }
+
+  g_free (buffer);
+
+  if (data->error == NULL)
+    g_input_stream_close (data->in, cancellable, &data->error);
+  else
+    g_input_stream_close (data->in, NULL, NULL);
+
+  if (data->error == NULL)
+    g_output_stream_close (data->out, cancellable, &data->error);
+  else
+    g_output_stream_close (data->out, NULL, NULL);
+
+  g_io_scheduler_job_send_to_mainloop_async (job, copy_job_done, data, NULL);
+
+  return FALSE;
+}
+
+static void
+tp_file_copy_async (EmpathyTpFile *tp_file,
+    GInputStream *in,
+    GOutputStream *out)
+{
+  EmpathyTpFilePriv *priv = GET_PRIV (tp_file);
+  CopyData *data;
+
+  data = g_slice_new0 (CopyData);
+  data->tp_file = g_object_ref (tp_file);
+  data->in = g_object_ref (in);
+  data->out = g_object_ref (out);
+  data->checksum = priv->checksum;
+
+  g_io_scheduler_push_job (copy_job, data, NULL, G_PRIORITY_DEFAULT,
+      priv->cancellable);
+}
+
+#ifdef TP_FILE_HAVE_FAST_PATH
+
+typedef struct {
+  EmpathyTpFile *tp_file;
+  GCancellable *cancellable;
+  /* the stream created when accepting, closed before writing the file */
+  GOutputStream *out_stream;
+  gchar *path;
+  gint socket_fd;
+  gboolean incoming;
+  /* the data has to go through userspace when it is hashed */
+  GChecksum *checksum;
+  GError *error;
+} FastTransferData;
+
+static void
+fast_transfer_set_error (GError **error)
+{
+  int code = errno;
+
+  g_set_error_literal (error, EMPATHY_FT_ERROR_QUARK,
+      EMPATHY_FT_ERROR_SOCKET, g_strerror (code));
+}
+
+/* Fallback used when the kernel refuses sendfile() or splice() for these
+ * file descriptors */
+static gboolean
+fast_transfer_copy (gint in_fd,
+    gint out_fd,
+    GChecksum *checksum,
+    GCancellable *cancellable,
+    GError **error)
+{
+  gchar *buffer;
+  gboolean retval = FALSE;
+
+  buffer = g_malloc (COPY_BUFFER_SIZE);
+
+  while (!g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+      gssize n_read, n_written;
+      gssize offset = 0;
+
+      n_read = read (in_fd, buffer, COPY_BUFFER_SIZE);
+
+      if (n_read < 0 && errno == EINTR)
+        continue;
+
+      if (n_read < 0)
+        {
+          fast_transfer_set_error (error);
+          break;
+        }
+
+      if (n_read == 0)
+        {
+          retval = TRUE;
+          break;
+        }
+
+      if (checksum != NULL)
+        g_checksum_update (checksum, (guchar *) buffer, n_read);
+
+      while (offset < n_read)
+        {
+          n_written = write (out_fd, buffer + offset, n_read - offset);
+
+          if (n_written < 0 && errno == EINTR)
+            continue;
+
+          if (n_written < 0)
+            {
+              fast_transfer_set_error (error);
+              goto out;
+            }
+
+          offset += n_written;
+        }
+    }
+
+out:
+  g_free (buffer);
+
+  return retval;
+}
+
+#if defined (HAVE_SENDFILE) && defined (HAVE_SYS_SENDFILE_H)
+static gboolean
+fast_transfer_sendfile (gint file_fd,
+    gint socket_fd,
+    GCancellable *cancellable,
+    GError **error)
+{
+  gboolean first = TRUE;
+
+  while (!g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+      gssize n;
+
+      n = sendfile (socket_fd, file_fd, NULL, FAST_PATH_CHUNK_SIZE);
+
+      if (n == 0)
+        return TRUE;
+
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          if (first && (errno == EINVAL || errno == ENOSYS))
+            {
+              DEBUG ("sendfile() not supported, copying the file");
+              return fast_transfer_copy (file_fd, socket_fd, NULL,
+                  cancellable, error);
+            }
+
+          fast_transfer_set_error (error);
+          return FALSE;
+        }
+
+      first = FALSE;
+    }
+
+  return FALSE;
+}
+#endif
+
+#ifdef HAVE_SPLICE
+static gboolean
+fast_transfer_splice (gint socket_fd,
+    gint file_fd,
+    GCancellable *cancellable,
+    GError **error)
+{
+  gint pipe_fds[2];
+  gboolean first = TRUE;
+  gboolean retval = FALSE;
+
+  if (pipe (pipe_fds) < 0)
+    return fast_transfer_copy (socket_fd, file_fd, NULL, cancellable, error);
+
+  while (!g_cancellable_set_error_if_cancelled (cancellable, error))
+    {
+      gssize n, n_written;
+
+      n = splice (socket_fd, NULL, pipe_fds[1], NULL, FAST_PATH_CHUNK_SIZE,
+          SPLICE_F_MOVE | SPLICE_F_MORE);
+
+      if (n == 0)
+        {
+          retval = TRUE;
+          break;
+        }
+
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          if (first && (errno == EINVAL || errno == ENOSYS))
+            {
+              DEBUG ("splice() not supported, copying the file");
+              retval = fast_transfer_copy (socket_fd, file_fd, NULL,
+                  cancellable, error);
+              break;
+            }
+
+          fast_transfer_set_error (error);
+          break;
+        }
+
+      first = FALSE;
+
+      /* move what we got in the pipe to the file */
+      while (n > 0)
+        {
+          n_written = splice (pipe_fds[0], NULL, file_fd, NULL, n,
+              SPLICE_F_MOVE | SPLICE_F_MORE);
+
+          if (n_written < 0 && errno == EINTR)
+            continue;
+
+          if (n_written <= 0)
+            {
+              fast_transfer_set_error (error);
+              goto out;
+            }
+
+          n -= n_written;
+        }
+    }
+
+out:
+  close (pipe_fds[0]);
+  close (pipe_fds[1]);
+
+  return retval;
+}
+#endif
+
+static gboolean
+fast_transfer_done_cb (gpointer user_data)
+{
+  FastTransferData *data = user_data;
+
+  DEBUG ("Fast transfer done, error %p", data->error);
+
+  tp_file_io_done (data->tp_file, data->error);
+
+  g_clear_error (&data->error);
+  g_object_unref (data->tp_file);
+  g_object_unref (data->cancellable);
+  if (data->out_stream != NULL)
+    g_object_unref (data->out_stream);
+  g_free (data->path);
+  g_slice_free (FastTransferData, data);
+
+  return FALSE;
+}
+
+static gpointer
+fast_transfer_thread (gpointer user_data)
+{
+  FastTransferData *data = user_data;
+  gint file_fd;
+
+  if (data->incoming)
+    {
+      /* the file was created when accepting, write it directly */
+      if (!g_output_stream_close (data->out_stream, data->cancellable,
+              &data->error))
+        goto out;
+
+      file_fd = g_open (data->path, O_WRONLY | O_TRUNC, 0);
+    }
+  else
+    {
+      file_fd = g_open (data->path, O_RDONLY, 0);
+    }
+
+  if (file_fd < 0)
+    {
+      int code = errno;
+
+      g_set_error_literal (&data->error, EMPATHY_FT_ERROR_QUARK,
+          EMPATHY_FT_ERROR_FAILED, g_strerror (code));
+      goto out;
+    }
+
+  if (data->checksum != NULL)
+    {
+      if (data->incoming)
+        fast_transfer_copy (data->socket_fd, file_fd, data->checksum,
+            data->cancellable, &data->error);
+      else
+        fast_transfer_copy (file_fd, data->socket_fd, data->checksum,
+            data->cancellable, &data->error);
+    }
+  else if (data->incoming)
+    {
+#ifdef HAVE_SPLICE
+      fast_transfer_splice (data->socket_fd, file_fd, data->cancellable,
+          &data->error);
+#else
+      fast_transfer_copy (data->socket_fd, file_fd, NULL, data->cancellable,
+          &data->error);
+#endif
+    }
+  else
+    {
+#if defined (HAVE_SENDFILE) && defined (HAVE_SYS_SENDFILE_H)
+      fast_transfer_sendfile (file_fd, data->socket_fd, data->cancellable,
+          &data->error);
+#else
+      fast_transfer_copy (file_fd, data->socket_fd, NULL, data->cancellable,
+          &data->error);
+#endif
+    }
+
+  if (close (file_fd) < 0 && data->error == NULL)
+    fast_transfer_set_error (&data->error);
+
+out:
+  /* closing the socket tells the other side we are done */
+  close (data->socket_fd);
+
+  g_idle_add (fast_transfer_done_cb, data);
+
+  return NULL;
+}
+
+#endif /* TP_FILE_HAVE_FAST_PATH */
+
+/* Moves the data between the file and @fd with sendfile() or splice() in a
+ * dedicated thread, avoiding the copies of the GIO splice. Returns %FALSE if
+ * that is not possible, in which case @fd is left untouched. */
+static gboolean
+tp_file_start_fast_transfer (EmpathyTpFile *tp_file,
+    gint fd)
+{
+#ifdef TP_FILE_HAVE_FAST_PATH
+  EmpathyTpFilePriv *priv = GET_PRIV (tp_file);
+  FastTransferData *data;
+  gchar *path;
+  GError *error = NULL;
+
+#ifndef HAVE_SPLICE
+  if (priv->incoming)
+    return FALSE;
+#endif
+#if !defined (HAVE_SENDFILE) || !defined (HAVE_SYS_SENDFILE_H)
+  if (!priv->incoming)
+    return FALSE;
+#endif
+
+  if (!g_thread_supported () || priv->gfile == NULL)
+    return FALSE;
+
+  /* the thread copies whole files, leave resumed transfers to GIO */
+  if (priv->offset != 0)
+    return FALSE;
+
+  path = g_file_get_path (priv->gfile);
+  if (path == NULL)
+    return FALSE;
+
+  if (!priv->incoming && !g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    {
+      g_free (path);
+      return FALSE;
+    }
+
+  data = g_slice_new0 (FastTransferData);
+  data->tp_file = g_object_ref (tp_file);
+  data->cancellable = g_object_ref (priv->cancellable);
+  data->path = path;
+  data->socket_fd = fd;
+  data->incoming = priv->incoming;
+  data->checksum = priv->checksum;
+  if (priv->incoming)
+    data->out_stream = g_object_ref (priv->out_stream);
+
+  if (g_thread_create (fast_transfer_thread, data, FALSE, &error) == NULL)
+    {
+      DEBUG ("Failed to create the transfer thread: %s", error->message);
       g_clear_error (&error);
-      return;
+
+      g_object_unref (data->tp_file);
+      g_object_unref (data->cancellable);
+      if (data->out_stream != NULL)
+        g_object_unref (data->out_stream);
+      g_free (data->path);
+      g_slice_free (FastTransferData, data);
+
+      return FALSE;
     }
+
+  DEBUG ("Using the zero-copy path for %s", path);
+
+  return TRUE;
+#else
+  return FALSE;
+#endif
 }
 
 static void
@@ -354,17 +855,25 @@ tp_file_start_transfer (EmpathyTpFile *tp_file)
   if (priv->progress_callback != NULL)
     priv->progress_callback (tp_file, 0, priv->progress_user_data);
 
+  priv->io_running = TRUE;
+
+  if (tp_file_start_fast_transfer (tp_file, fd))
+    return;
+
   if (priv->incoming)
     {
       GInputStream *socket_stream;
 
       socket_stream = g_unix_input_stream_new (fd, TRUE);
 
-      g_output_stream_splice_async (priv->out_stream, socket_stream,
-          G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
-          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
-          G_PRIORITY_DEFAULT, priv->cancellable,
-          splice_stream_ready_cb, tp_file);
+      if (priv->checksum != NULL)
+        tp_file_copy_async (tp_file, socket_stream, priv->out_stream);
+      else
+        g_output_stream_splice_async (priv->out_stream, socket_stream,
+            G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+            G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+            G_PRIORITY_DEFAULT, priv->cancellable,
+            splice_stream_ready_cb, tp_file);
 
       g_object_unref (socket_stream);
     }
@@ -374,11 +883,14 @@ tp_file_start_transfer (EmpathyTpFile *tp_file)
 
       socket_stream = g_unix_output_stream_new (fd, TRUE);
 
-      g_output_stream_splice_async (socket_stream, priv->in_stream,
-          G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
-          G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
-          G_PRIORITY_DEFAULT, priv->cancellable,
-          splice_stream_ready_cb, tp_file);
+      if (priv->checksum != NULL)
+        tp_file_copy_async (tp_file, priv->in_stream, socket_stream);
+      else
+        g_output_stream_splice_async (socket_stream, priv->in_stream,
+            G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+            G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+            G_PRIORITY_DEFAULT, priv->cancellable,
+            splice_stream_ready_cb, tp_file);
 
       g_object_unref (socket_stream);
     }
@@ -456,7 +968,13 @@ tp_file_state_changed_cb (TpChannel *proxy,
     tp_file_start_transfer (EMPATHY_TP_FILE (weak_object));
 
   if (state == TP_FILE_TRANSFER_STATE_COMPLETED)
-    ft_operation_close_clean (EMPATHY_TP_FILE (weak_object));
+    {
+      /* wait for the local end to have written everything */
+      if (priv->io_running)
+        priv->completed_pending = TRUE;
+      else
+        ft_operation_close_clean (EMPATHY_TP_FILE (weak_object));
+    }
 
   if (state == TP_FILE_TRANSFER_STATE_CANCELLED)
     {
@@ -484,6 +1002,18 @@ tp_file_transferred_bytes_changed_cb (TpChannel *proxy,
         count, priv->progress_user_data);
 }
 
+static void
+tp_file_initial_offset_defined_cb (TpChannel *proxy,
+    guint64 offset,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  EmpathyTpFilePriv *priv = GET_PRIV (weak_object);
+
+  /* the receiver only wants the end of an outgoing file */
+  priv->offset = offset;
+}
+
 static void
 ft_operation_provide_or_accept_file_cb (TpChannel *proxy,
     const GValue *address,
@@ -688,6 +1218,7 @@ empathy_tp_file_init (EmpathyTpFile *tp_file)
       EMPATHY_TYPE_TP_FILE, EmpathyTpFilePriv);
 
   tp_file->priv = priv;
+  EMPATHY_FOOTPRINT_TRACK (tp_file);
 }
 
 static void
@@ -708,6 +1239,9 @@ do_dispose (GObject *object)
       priv->channel = NULL;
     }
 
+  if (priv->gfile != NULL)
+    g_object_unref (priv->gfile);
+
   if (priv->in_stream != NULL)
     g_object_unref (priv->in_stream);
 
@@ -733,6 +1267,11 @@ do_finalize (GObject *object)
       priv->socket_address = NULL;
     }
 
+  if (priv->checksum != NULL)
+    g_checksum_free (priv->checksum);
+
+  g_free (priv->checksum_string);
+
   G_OBJECT_CLASS (empathy_tp_file_parent_class)->finalize (object);
 }
 
@@ -798,6 +1337,10 @@ do_constructed (GObject *object)
       priv->channel, tp_file_transferred_bytes_changed_cb,
       NULL, NULL, object, NULL);
 
+  tp_cli_channel_type_file_transfer_connect_to_initial_offset_defined (
+      priv->channel, tp_file_initial_offset_defined_cb,
+      NULL, NULL, object, NULL);
+
   tp_cli_dbus_properties_call_get (priv->channel,
       -1, TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "State", tp_file_get_state_cb,
       NULL, NULL, object);
@@ -923,6 +1466,7 @@ empathy_tp_file_accept (EmpathyTpFile *tp_file,
   priv->op_callback = op_callback;
   priv->op_user_data = op_user_data;
   priv->offset = offset;
+  priv->gfile = g_object_ref (gfile);
 
   g_file_replace_async (gfile, NULL, FALSE, G_FILE_CREATE_NONE,
       G_PRIORITY_DEFAULT, cancellable, file_replace_async_cb, tp_file);
@@ -967,6 +1511,7 @@ empathy_tp_file_offer (EmpathyTpFile *tp_file,
   priv->progress_user_data = progress_user_data;
   priv->op_callback = op_callback;
   priv->op_user_data = op_user_data;
+  priv->gfile = g_object_ref (gfile);
 
   g_file_read_async (gfile, G_PRIORITY_DEFAULT, cancellable,
       file_read_async_cb, tp_file);
@@ -1021,3 +1566,53 @@ empathy_tp_file_close (EmpathyTpFile *tp_file)
 
   close_channel_internal (tp_file, FALSE);
 }
+
+/**
+ * empathy_tp_file_set_checksum_type:
+ * @tp_file: an #EmpathyTpFile
+ * @checksum_type: the #GChecksumType to compute
+ *
+ * Makes @tp_file compute a checksum of the data while it is transferred,
+ * saving a second pass on the file. Must be called before
+ * empathy_tp_file_accept() or empathy_tp_file_offer(). Note that the data
+ * can't be moved with sendfile() or splice() in that case.
+ */
+void
+empathy_tp_file_set_checksum_type (EmpathyTpFile *tp_file,
+    GChecksumType checksum_type)
+{
+  EmpathyTpFilePriv *priv;
+
+  g_return_if_fail (EMPATHY_IS_TP_FILE (tp_file));
+
+  priv = GET_PRIV (tp_file);
+
+  g_return_if_fail (!priv->io_running);
+
+  if (priv->checksum != NULL)
+    g_checksum_free (priv->checksum);
+
+  priv->checksum = g_checksum_new (checksum_type);
+}
+
+/**
+ * empathy_tp_file_get_checksum:
+ * @tp_file: an #EmpathyTpFile
+ *
+ * Returns the checksum of the transferred data, as requested with
+ * empathy_tp_file_set_checksum_type().
+ *
+ * Return value: the hexadecimal checksum, or %NULL if it was not
+ * requested or the transfer is not finished
+ */
+const gchar *
+empathy_tp_file_get_checksum (EmpathyTpFile *tp_file)
+{
+  EmpathyTpFilePriv *priv;
+
+  g_return_val_if_fail (EMPATHY_IS_TP_FILE (tp_file), NULL);
+
+  priv = GET_PRIV (tp_file);
+
+  return priv->checksum_string;
+}
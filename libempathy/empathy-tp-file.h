@@ -120,6 +120,10 @@ void empathy_tp_file_close (EmpathyTpFile *tp_file);
 
 gboolean empathy_tp_file_is_incoming (EmpathyTpFile *tp_file);
 
+void empathy_tp_file_set_checksum_type (EmpathyTpFile *tp_file,
+    GChecksumType checksum_type);
+const gchar * empathy_tp_file_get_checksum (EmpathyTpFile *tp_file);
+
 G_END_DECLS
 
 #endif /* __EMPATHY_TP_FILE_H__ */
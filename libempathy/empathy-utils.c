@@ -25,6 +25,7 @@
 
 #include "config.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <sys/types.h>
@@ -41,6 +42,7 @@
 #include "empathy-contact-manager.h"
 #include "empathy-dispatcher.h"
 #include "empathy-dispatch-operation.h"
+#include "empathy-footprint.h"
 #include "empathy-idle.h"
 #include "empathy-tp-call.h"
 
@@ -93,6 +95,12 @@ empathy_init (void)
 	empathy_debug_set_flags (g_getenv ("EMPATHY_DEBUG"));
 	tp_debug_divert_messages (g_getenv ("EMPATHY_LOGFILE"));
 
+	/* Opt-in memory accounting, the value is the number of seconds
+	 * between two footprint snapshots */
+	if (g_getenv ("EMPATHY_FOOTPRINT") != NULL) {
+		empathy_footprint_enable (atoi (g_getenv ("EMPATHY_FOOTPRINT")));
+	}
+
 	emp_cli_init ();
 
 	initialized = TRUE;
@@ -0,0 +1,334 @@
+/*
+ * empathy-xml-saver.c - Source for EmpathyXmlSaver
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "empathy-xml-saver.h"
+
+#define DEBUG_FLAG EMPATHY_DEBUG_OTHER
+#include "empathy-debug.h"
+
+/**
+ * SECTION:empathy-xml-saver
+ * @title:EmpathyXmlSaver
+ * @short_description: debounced saving of small XML files
+ * @include: libempathy/empathy-xml-saver.h
+ *
+ * #EmpathyXmlSaver is used by the stores keeping their state in an XML file
+ * under ~/.gnome2/Empathy. empathy_xml_saver_queue() (re)starts a timer;
+ * when it fires the document is built and serialized in the main thread and
+ * written out from a GIO worker thread, to a temporary file which is then
+ * renamed over the old one. A burst of changes costs one write, and a crash
+ * in the middle of it leaves the previous file in place.
+ *
+ * Pending changes are written synchronously by empathy_xml_saver_flush(),
+ * empathy_xml_saver_free() and empathy_xml_saver_flush_all(), which wait
+ * for a write already running in a worker without iterating the main loop.
+ */
+
+struct _EmpathyXmlSaver {
+  gchar *filename;
+  guint delay;
+  EmpathyXmlSaverBuildFunc build;
+  gpointer user_data;
+
+  guint timeout_id;
+  /* A write is running in a worker thread; the worker clears it and
+   * signals cond with lock held */
+  GMutex *lock;
+  GCond *cond;
+  gboolean writing;
+};
+
+typedef struct {
+  EmpathyXmlSaver *saver;
+  gchar *filename;
+  xmlChar *data;
+  int len;
+} WriteJob;
+
+/* All the live savers, for empathy_xml_saver_flush_all() */
+static GSList *savers = NULL;
+
+static xmlChar *
+xml_saver_serialize (EmpathyXmlSaver *saver,
+    int *len)
+{
+  xmlDocPtr doc;
+  xmlChar *data = NULL;
+
+  doc = saver->build (saver->user_data);
+
+  /* Make sure the XML is indented properly */
+  xmlIndentTreeOutput = 1;
+  xmlDocDumpFormatMemoryEnc (doc, &data, len, "utf-8", 1);
+  xmlFreeDoc (doc);
+
+  return data;
+}
+
+static void
+xml_saver_write (const gchar *filename,
+    const xmlChar *data,
+    int len)
+{
+  gchar *dirname;
+  GError *error = NULL;
+
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0700);
+  g_free (dirname);
+
+  /* g_file_set_contents() writes to a temporary file and renames it */
+  if (!g_file_set_contents (filename, (const gchar *) data, len, &error))
+    {
+      DEBUG ("Failed to save %s: %s", filename, error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      DEBUG ("Saved %s", filename);
+    }
+}
+
+static gboolean xml_saver_timeout_cb (gpointer user_data);
+
+static gboolean
+xml_saver_write_job (GIOSchedulerJob *io_job,
+    GCancellable *cancellable,
+    gpointer user_data)
+{
+  WriteJob *job = user_data;
+  EmpathyXmlSaver *saver = job->saver;
+
+  xml_saver_write (job->filename, job->data, job->len);
+
+  g_free (job->filename);
+  xmlFree (job->data);
+  g_slice_free (WriteJob, job);
+
+  /* The saver isn't freed before this, see empathy_xml_saver_flush() */
+  g_mutex_lock (saver->lock);
+  saver->writing = FALSE;
+  g_cond_broadcast (saver->cond);
+  g_mutex_unlock (saver->lock);
+
+  return FALSE;
+}
+
+static gboolean
+xml_saver_is_writing (EmpathyXmlSaver *saver)
+{
+  gboolean writing;
+
+  g_mutex_lock (saver->lock);
+  writing = saver->writing;
+  g_mutex_unlock (saver->lock);
+
+  return writing;
+}
+
+static void
+xml_saver_wait_write (EmpathyXmlSaver *saver)
+{
+  g_mutex_lock (saver->lock);
+  while (saver->writing)
+    g_cond_wait (saver->cond, saver->lock);
+  g_mutex_unlock (saver->lock);
+}
+
+static void
+xml_saver_schedule (EmpathyXmlSaver *saver)
+{
+  if (saver->delay == 0)
+    saver->timeout_id = g_idle_add (xml_saver_timeout_cb, saver);
+  else
+    saver->timeout_id = g_timeout_add_seconds (saver->delay,
+        xml_saver_timeout_cb, saver);
+}
+
+static void
+xml_saver_start_write (EmpathyXmlSaver *saver)
+{
+  WriteJob *job;
+
+  /* Only one write per file at a time, so they land in order: try again
+   * after the delay */
+  if (xml_saver_is_writing (saver))
+    {
+      xml_saver_schedule (saver);
+      return;
+    }
+
+  job = g_slice_new (WriteJob);
+  job->saver = saver;
+  job->filename = g_strdup (saver->filename);
+  job->data = xml_saver_serialize (saver, &job->len);
+
+  g_mutex_lock (saver->lock);
+  saver->writing = TRUE;
+  g_mutex_unlock (saver->lock);
+
+  g_io_scheduler_push_job (xml_saver_write_job, job, NULL,
+      G_PRIORITY_DEFAULT, NULL);
+}
+
+static gboolean
+xml_saver_timeout_cb (gpointer user_data)
+{
+  EmpathyXmlSaver *saver = user_data;
+
+  saver->timeout_id = 0;
+  xml_saver_start_write (saver);
+
+  return FALSE;
+}
+
+/**
+ * empathy_xml_saver_new:
+ * @filename: the file to save to
+ * @delay: seconds to wait after the last change before saving, or 0 to
+ *   save from the next main loop iteration
+ * @build: builds the document to save
+ * @user_data: data to pass to @build
+ *
+ * Creates a new #EmpathyXmlSaver. Nothing is written until
+ * empathy_xml_saver_queue() is called.
+ *
+ * Returns: a new #EmpathyXmlSaver
+ */
+EmpathyXmlSaver *
+empathy_xml_saver_new (const gchar *filename,
+    guint delay,
+    EmpathyXmlSaverBuildFunc build,
+    gpointer user_data)
+{
+  EmpathyXmlSaver *saver;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (build != NULL, NULL);
+
+  saver = g_slice_new0 (EmpathyXmlSaver);
+  saver->filename = g_strdup (filename);
+  saver->delay = delay;
+  saver->build = build;
+  saver->user_data = user_data;
+
+  /* As GIO does before running its first job */
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+  saver->lock = g_mutex_new ();
+  saver->cond = g_cond_new ();
+
+  savers = g_slist_prepend (savers, saver);
+
+  return saver;
+}
+
+/**
+ * empathy_xml_saver_free:
+ * @saver: an #EmpathyXmlSaver
+ *
+ * Writes pending changes, see empathy_xml_saver_flush(), and frees @saver.
+ */
+void
+empathy_xml_saver_free (EmpathyXmlSaver *saver)
+{
+  g_return_if_fail (saver != NULL);
+
+  empathy_xml_saver_flush (saver);
+
+  savers = g_slist_remove (savers, saver);
+  g_mutex_free (saver->lock);
+  g_cond_free (saver->cond);
+  g_free (saver->filename);
+  g_slice_free (EmpathyXmlSaver, saver);
+}
+
+/**
+ * empathy_xml_saver_queue:
+ * @saver: an #EmpathyXmlSaver
+ *
+ * Notes that the in-memory state changed. The file is saved once no more
+ * changes came for the delay given to empathy_xml_saver_new().
+ */
+void
+empathy_xml_saver_queue (EmpathyXmlSaver *saver)
+{
+  g_return_if_fail (saver != NULL);
+
+  if (saver->timeout_id != 0)
+    g_source_remove (saver->timeout_id);
+
+  xml_saver_schedule (saver);
+}
+
+/**
+ * empathy_xml_saver_flush:
+ * @saver: an #EmpathyXmlSaver
+ *
+ * Writes pending changes right away, blocking until they are on disk. This
+ * is meant for shutdown: it also blocks on a write already running in a
+ * worker thread, so it can be called from a finalize.
+ */
+void
+empathy_xml_saver_flush (EmpathyXmlSaver *saver)
+{
+  gboolean pending;
+  xmlChar *data;
+  int len;
+
+  g_return_if_fail (saver != NULL);
+
+  pending = saver->timeout_id != 0;
+
+  if (saver->timeout_id != 0)
+    {
+      g_source_remove (saver->timeout_id);
+      saver->timeout_id = 0;
+    }
+
+  /* Don't let an older write land after ours */
+  xml_saver_wait_write (saver);
+
+  if (!pending)
+    return;
+
+  data = xml_saver_serialize (saver, &len);
+  xml_saver_write (saver->filename, data, len);
+  xmlFree (data);
+}
+
+/**
+ * empathy_xml_saver_flush_all:
+ *
+ * Calls empathy_xml_saver_flush() on every #EmpathyXmlSaver, for stores
+ * that live until the process exits.
+ */
+void
+empathy_xml_saver_flush_all (void)
+{
+  GSList *l;
+
+  for (l = savers; l != NULL; l = l->next)
+    empathy_xml_saver_flush (l->data);
+}
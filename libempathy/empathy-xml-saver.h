@@ -0,0 +1,54 @@
+/*
+ * empathy-xml-saver.h - Header for EmpathyXmlSaver
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EMPATHY_XML_SAVER_H__
+#define __EMPATHY_XML_SAVER_H__
+
+#include <glib.h>
+
+#include <libxml/tree.h>
+
+G_BEGIN_DECLS
+
+typedef struct _EmpathyXmlSaver EmpathyXmlSaver;
+
+/**
+ * EmpathyXmlSaverBuildFunc:
+ * @user_data: the data passed to empathy_xml_saver_new()
+ *
+ * Builds the document to save from the in-memory state. Called in the main
+ * thread; the saver frees the returned document.
+ *
+ * Returns: a new #xmlDocPtr
+ */
+typedef xmlDocPtr (*EmpathyXmlSaverBuildFunc) (gpointer user_data);
+
+EmpathyXmlSaver * empathy_xml_saver_new (const gchar *filename,
+    guint delay,
+    EmpathyXmlSaverBuildFunc build,
+    gpointer user_data);
+void empathy_xml_saver_free (EmpathyXmlSaver *saver);
+
+void empathy_xml_saver_queue (EmpathyXmlSaver *saver);
+void empathy_xml_saver_flush (EmpathyXmlSaver *saver);
+void empathy_xml_saver_flush_all (void);
+
+G_END_DECLS
+
+#endif /* __EMPATHY_XML_SAVER_H__ */
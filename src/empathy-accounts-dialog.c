@@ -1053,7 +1053,6 @@ empathy_accounts_dialog_show (GtkWindow *parent,
 	GtkBuilder                   *gui;
 	gchar                        *filename;
 	GList                        *accounts, *l;
-	gboolean                      import_asked;
 
 	if (dialog) {
 		gtk_window_present (GTK_WINDOW (dialog->window));
@@ -1155,13 +1154,9 @@ empathy_accounts_dialog_show (GtkWindow *parent,
 
 	gtk_widget_show (dialog->window);
 
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_IMPORT_ASKED, &import_asked);
-
-
 	if (empathy_import_dialog_accounts_to_import ()) {
 
-		if (!import_asked) {
+		if (!empathy_conf_get_settings ()->import_asked) {
 			empathy_conf_set_bool (empathy_conf_get (),
 					       EMPATHY_PREFS_IMPORT_ASKED, TRUE);
 			empathy_import_dialog_show (GTK_WINDOW (dialog->window),
@@ -312,7 +312,6 @@ chat_window_update (EmpathyChatWindow *window)
 	guint                  n_chats;
 	GdkPixbuf             *icon;
 	EmpathyContact        *remote_contact;
-	gboolean               avatar_in_icon;
 	GtkWidget             *chat;
 	GtkWidget             *chat_close_button;
 	GtkWidget             *submenu;
@@ -360,11 +359,8 @@ chat_window_update (EmpathyChatWindow *window)
 		gtk_window_set_icon_name (GTK_WINDOW (priv->dialog),
 					  EMPATHY_IMAGE_MESSAGE);
 	} else {
-		empathy_conf_get_bool (empathy_conf_get (),
-				       EMPATHY_PREFS_CHAT_AVATAR_IN_ICON,
-				       &avatar_in_icon);
-
-		if (n_chats == 1 && avatar_in_icon) {
+		if (n_chats == 1 &&
+		    empathy_conf_get_settings ()->chat_avatar_in_icon) {
 			remote_contact = empathy_chat_get_remote_contact (priv->current_chat);
 			icon = empathy_pixbuf_avatar_from_contact_scaled (remote_contact, 0, 0);
 			gtk_window_set_icon (GTK_WINDOW (priv->dialog), icon);
@@ -653,13 +649,8 @@ static const gchar *
 chat_get_window_id_for_geometry (EmpathyChat *chat)
 {
 	const gchar *res = NULL;
-	gboolean     separate_windows;
-
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_UI_SEPARATE_CHAT_WINDOWS,
-			       &separate_windows);
 
-	if (separate_windows) {
+	if (empathy_conf_get_settings ()->ui_separate_chat_windows) {
 		res = empathy_chat_get_id (chat);
 	}
 
@@ -973,14 +964,9 @@ chat_window_add_indicator (EmpathyChatWindow *window,
 	EmpathyContact *sender;
 	const char *body;
 	NotificationData *cb_data;
-	gboolean use_libindicate;
 	EmpathyIndicator *indicator;
 
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_UI_USE_LIBINDICATE,
-		               &use_libindicate);
-
-	if (!use_libindicate) {
+	if (!empathy_conf_get_settings ()->ui_use_libindicate) {
 		return;
 	}
 
@@ -1036,16 +1022,10 @@ chat_window_show_or_update_notification (EmpathyChatWindow *window,
 	GdkPixbuf *pixbuf;
 	NotificationData *cb_data;
 	EmpathyChatWindowPriv *priv = GET_PRIV (window);
-	gboolean res;
 
-	if (!empathy_notification_is_enabled ()) {
+	if (!empathy_notification_is_enabled () ||
+	    !empathy_conf_get_settings ()->notifications_focus) {
 		return;
-	} else {
-		empathy_conf_get_bool (empathy_conf_get (),
-				       EMPATHY_PREFS_NOTIFICATIONS_FOCUS, &res);
-		if (!res) {
-			return;
-		}
 	}
 
 	cb_data = g_slice_new0 (NotificationData);
@@ -1650,13 +1630,8 @@ EmpathyChatWindow *
 empathy_chat_window_get_default (void)
 {
 	GList    *l;
-	gboolean  separate_windows = TRUE;
-
-	empathy_conf_get_bool (empathy_conf_get (),
-			      EMPATHY_PREFS_UI_SEPARATE_CHAT_WINDOWS,
-			      &separate_windows);
 
-	if (separate_windows) {
+	if (empathy_conf_get_settings ()->ui_separate_chat_windows) {
 		/* Always create a new window */
 		return NULL;
 	}
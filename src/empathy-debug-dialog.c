@@ -20,6 +20,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
 #include <gio/gio.h>
@@ -66,6 +68,20 @@ enum
   NUM_COLS_LEVEL
 };
 
+enum
+{
+  COL_FOOTPRINT_NAME,
+  COL_FOOTPRINT_LIVE,
+  COL_FOOTPRINT_TOTAL,
+  COL_FOOTPRINT_BYTES,
+  COL_FOOTPRINT_BYTES_STRING,
+  NUM_FOOTPRINT_COLS
+};
+
+/* Older messages are dropped from the view past this, so a chatty CM can't
+ * make the dialog grow forever */
+#define MAX_MESSAGES 5000
+
 #define GET_PRIV(obj) EMPATHY_GET_PRIV (obj, EmpathyDebugDialog)
 typedef struct
 {
@@ -75,6 +91,7 @@ typedef struct
   GtkToolItem *copy_button;
   GtkToolItem *clear_button;
   GtkToolItem *pause_button;
+  GtkToolItem *footprint_button;
   GtkToolItem *level_label;
   GtkWidget *level_filter;
 
@@ -90,11 +107,15 @@ typedef struct
   TpDBusDaemon *dbus;
   TpProxy *proxy;
   TpProxySignalConnection *new_debug_message_signal;
+  TpProxySignalConnection *new_debug_messages_signal;
   TpProxySignalConnection *name_owner_changed_signal;
 
   /* Whether NewDebugMessage will be fired */
   gboolean paused;
 
+  /* Most verbose level shown, cached from the level filter */
+  guint filter_level;
+
   /* CM chooser store */
   GtkListStore *cms;
 
@@ -139,42 +160,58 @@ debug_dialog_add_message (EmpathyDebugDialog *debug_dialog,
     const gchar *message)
 {
   EmpathyDebugDialogPriv *priv = GET_PRIV (debug_dialog);
-  gchar *domain, *category;
+  gchar *domain = NULL, *string = NULL;
+  const gchar *category, *slash;
   GtkTreeIter iter;
-  gchar *string;
 
-  if (g_strrstr (domain_category, "/"))
+  slash = strchr (domain_category, '/');
+  if (slash != NULL)
     {
-      gchar **parts = g_strsplit (domain_category, "/", 2);
-      domain = g_strdup (parts[0]);
-      category = g_strdup (parts[1]);
-      g_strfreev (parts);
+      domain = g_strndup (domain_category, slash - domain_category);
+      category = slash + 1;
     }
   else
     {
-      domain = g_strdup (domain_category);
-      category = g_strdup ("");
+      category = "";
     }
 
   if (g_str_has_suffix (message, "\n"))
     string = g_strchomp (g_strdup (message));
-  else
-    string = g_strdup (message);
 
+  if (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (priv->store), NULL) >=
+      MAX_MESSAGES &&
+      gtk_tree_model_get_iter_first (GTK_TREE_MODEL (priv->store), &iter))
+    gtk_list_store_remove (priv->store, &iter);
 
-  gtk_list_store_append (priv->store, &iter);
-  gtk_list_store_set (priv->store, &iter,
+  gtk_list_store_insert_with_values (priv->store, &iter, -1,
       COL_DEBUG_TIMESTAMP, timestamp,
-      COL_DEBUG_DOMAIN, domain,
+      COL_DEBUG_DOMAIN, domain != NULL ? domain : domain_category,
       COL_DEBUG_CATEGORY, category,
       COL_DEBUG_LEVEL_STRING, log_level_to_string (level),
-      COL_DEBUG_MESSAGE, string,
+      COL_DEBUG_MESSAGE, string != NULL ? string : message,
       COL_DEBUG_LEVEL_VALUE, level,
       -1);
 
   g_free (string);
   g_free (domain);
-  g_free (category);
+}
+
+static void
+debug_dialog_add_messages (EmpathyDebugDialog *debug_dialog,
+    const GPtrArray *messages)
+{
+  guint i;
+
+  for (i = 0; i < messages->len; i++)
+    {
+      GValueArray *values = g_ptr_array_index (messages, i);
+
+      debug_dialog_add_message (debug_dialog,
+          g_value_get_double (g_value_array_get_nth (values, 0)),
+          g_value_get_string (g_value_array_get_nth (values, 1)),
+          g_value_get_uint (g_value_array_get_nth (values, 2)),
+          g_value_get_string (g_value_array_get_nth (values, 3)));
+    }
 }
 
 static void
@@ -192,6 +229,17 @@ debug_dialog_new_debug_message_cb (TpProxy *proxy,
       message);
 }
 
+static void
+debug_dialog_new_debug_messages_cb (TpProxy *proxy,
+    const GPtrArray *messages,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  EmpathyDebugDialog *debug_dialog = (EmpathyDebugDialog *) user_data;
+
+  debug_dialog_add_messages (debug_dialog, messages);
+}
+
 static void
 debug_dialog_set_enabled (EmpathyDebugDialog *debug_dialog,
     gboolean enabled)
@@ -218,6 +266,7 @@ debug_dialog_set_toolbar_sensitivity (EmpathyDebugDialog *debug_dialog,
   gtk_widget_set_sensitive (GTK_WIDGET (priv->copy_button), sensitive);
   gtk_widget_set_sensitive (GTK_WIDGET (priv->clear_button), sensitive);
   gtk_widget_set_sensitive (GTK_WIDGET (priv->pause_button), sensitive);
+  gtk_widget_set_sensitive (GTK_WIDGET (priv->footprint_button), sensitive);
   gtk_widget_set_sensitive (GTK_WIDGET (priv->level_label), sensitive);
   gtk_widget_set_sensitive (GTK_WIDGET (priv->level_filter), sensitive);
   gtk_widget_set_sensitive (GTK_WIDGET (priv->view), sensitive);
@@ -248,7 +297,7 @@ debug_dialog_get_messages_cb (TpProxy *proxy,
 {
   EmpathyDebugDialog *debug_dialog = (EmpathyDebugDialog *) user_data;
   EmpathyDebugDialogPriv *priv = GET_PRIV (debug_dialog);
-  gint i;
+  GValue *val;
 
   if (error != NULL)
     {
@@ -259,21 +308,22 @@ debug_dialog_get_messages_cb (TpProxy *proxy,
 
   debug_dialog_set_toolbar_sensitivity (debug_dialog, TRUE);
 
-  for (i = 0; i < messages->len; i++)
-    {
-      GValueArray *values = g_ptr_array_index (messages, i);
+  debug_dialog_add_messages (debug_dialog, messages);
 
-      debug_dialog_add_message (debug_dialog,
-          g_value_get_double (g_value_array_get_nth (values, 0)),
-          g_value_get_string (g_value_array_get_nth (values, 1)),
-          g_value_get_uint (g_value_array_get_nth (values, 2)),
-          g_value_get_string (g_value_array_get_nth (values, 3)));
-    }
-
-  /* Connect to NewDebugMessage */
+  /* Connect to NewDebugMessage, and to NewDebugMessages for services which
+   * batch them once asked to; others ignore the request */
   priv->new_debug_message_signal = emp_cli_debug_connect_to_new_debug_message (
       proxy, debug_dialog_new_debug_message_cb, debug_dialog,
       NULL, NULL, NULL);
+  priv->new_debug_messages_signal =
+      emp_cli_debug_connect_to_new_debug_messages (proxy,
+          debug_dialog_new_debug_messages_cb, debug_dialog,
+          NULL, NULL, NULL);
+
+  val = tp_g_value_slice_new_boolean (TRUE);
+  tp_cli_dbus_properties_call_set (proxy, -1, EMP_IFACE_DEBUG,
+      "BatchMessages", val, NULL, NULL, NULL, NULL);
+  tp_g_value_slice_free (val);
 
   /* Set Enabled as appropriate */
   debug_dialog_set_enabled (debug_dialog, !priv->paused);
@@ -326,13 +376,19 @@ debug_dialog_cm_chooser_changed_cb (GtkComboBox *cm_chooser,
   if (priv->proxy != NULL)
     debug_dialog_set_enabled (debug_dialog, FALSE);
 
-  /* Disconnect from previous NewDebugMessage signal */
+  /* Disconnect from previous NewDebugMessage(s) signals */
   if (priv->new_debug_message_signal != NULL)
     {
       tp_proxy_signal_connection_disconnect (priv->new_debug_message_signal);
       priv->new_debug_message_signal = NULL;
     }
 
+  if (priv->new_debug_messages_signal != NULL)
+    {
+      tp_proxy_signal_connection_disconnect (priv->new_debug_messages_signal);
+      priv->new_debug_messages_signal = NULL;
+    }
+
   if (priv->proxy != NULL)
     g_object_unref (priv->proxy);
 
@@ -612,22 +668,11 @@ debug_dialog_visible_func (GtkTreeModel *model,
 {
   EmpathyDebugDialog *debug_dialog = (EmpathyDebugDialog *) user_data;
   EmpathyDebugDialogPriv *priv = GET_PRIV (debug_dialog);
-  guint filter_value, level;
-  GtkTreeModel *filter_model;
-  GtkTreeIter filter_iter;
-
-  filter_model = gtk_combo_box_get_model (GTK_COMBO_BOX (priv->level_filter));
-  gtk_combo_box_get_active_iter (GTK_COMBO_BOX (priv->level_filter),
-      &filter_iter);
+  guint level;
 
   gtk_tree_model_get (model, iter, COL_DEBUG_LEVEL_VALUE, &level, -1);
-  gtk_tree_model_get (filter_model, &filter_iter,
-      COL_LEVEL_VALUE, &filter_value, -1);
-
-  if (level <= filter_value)
-    return TRUE;
 
-  return FALSE;
+  return level <= priv->filter_level;
 }
 
 static void
@@ -635,6 +680,13 @@ debug_dialog_filter_changed_cb (GtkComboBox *filter,
     EmpathyDebugDialog *debug_dialog)
 {
   EmpathyDebugDialogPriv *priv = GET_PRIV (debug_dialog);
+  GtkTreeIter iter;
+
+  if (!gtk_combo_box_get_active_iter (filter, &iter))
+    return;
+
+  gtk_tree_model_get (gtk_combo_box_get_model (filter), &iter,
+      COL_LEVEL_VALUE, &priv->filter_level, -1);
 
   gtk_tree_model_filter_refilter (
       GTK_TREE_MODEL_FILTER (priv->store_filter));
@@ -925,6 +977,208 @@ debug_dialog_copy_clicked_cb (GtkToolButton *tool_button,
   g_free (text);
 }
 
+static void
+debug_dialog_get_footprint_history_cb (TpProxy *proxy,
+    const GPtrArray *snapshots,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  GValueArray *first, *last;
+  guint64 first_rss, last_rss, accounted;
+  gdouble hours;
+  gchar *rss_str, *accounted_str, *growth_str, *text;
+
+  if (error != NULL)
+    {
+      DEBUG ("GetFootprintHistory failed: %s", error->message);
+      return;
+    }
+
+  if (snapshots->len == 0)
+    return;
+
+  first = g_ptr_array_index (snapshots, 0);
+  last = g_ptr_array_index (snapshots, snapshots->len - 1);
+
+  first_rss = g_value_get_uint64 (g_value_array_get_nth (first, 1));
+  last_rss = g_value_get_uint64 (g_value_array_get_nth (last, 1));
+  accounted = g_value_get_uint64 (g_value_array_get_nth (last, 2));
+  hours = (g_value_get_double (g_value_array_get_nth (last, 0)) -
+      g_value_get_double (g_value_array_get_nth (first, 0))) / 3600;
+
+  rss_str = g_format_size_for_display (last_rss);
+  accounted_str = g_format_size_for_display (accounted);
+  growth_str = g_format_size_for_display (last_rss >= first_rss ?
+      last_rss - first_rss : first_rss - last_rss);
+
+  /* Translators: the last one is the RSS growth, like "+1.2 MB" */
+  text = g_strdup_printf (
+      _("Resident: %s, accounted for: %s, %s%s over the last %.1f hours"),
+      rss_str, accounted_str, last_rss >= first_rss ? "+" : "-",
+      growth_str, hours);
+  gtk_label_set_text (GTK_LABEL (weak_object), text);
+
+  g_free (text);
+  g_free (growth_str);
+  g_free (accounted_str);
+  g_free (rss_str);
+}
+
+static void
+debug_dialog_show_footprint (EmpathyDebugDialog *debug_dialog,
+    const GPtrArray *entries)
+{
+  EmpathyDebugDialogPriv *priv = GET_PRIV (debug_dialog);
+  GtkWidget *dialog;
+  GtkWidget *label;
+  GtkWidget *scrolled_win;
+  GtkWidget *view;
+  GtkListStore *store;
+  GtkCellRenderer *renderer;
+  guint i;
+  static const struct {
+    const gchar *title;
+    gint column;
+    gint sort_column;
+  } columns[] = {
+    { N_("Name"), COL_FOOTPRINT_NAME, COL_FOOTPRINT_NAME },
+    { N_("Live"), COL_FOOTPRINT_LIVE, COL_FOOTPRINT_LIVE },
+    { N_("Total"), COL_FOOTPRINT_TOTAL, COL_FOOTPRINT_TOTAL },
+    { N_("Size"), COL_FOOTPRINT_BYTES_STRING, COL_FOOTPRINT_BYTES },
+  };
+
+  store = gtk_list_store_new (NUM_FOOTPRINT_COLS,
+      G_TYPE_STRING,    /* name */
+      G_TYPE_UINT,      /* live */
+      G_TYPE_UINT64,    /* total */
+      G_TYPE_UINT64,    /* bytes */
+      G_TYPE_STRING);   /* bytes, for display */
+
+  for (i = 0; i < entries->len; i++)
+    {
+      GValueArray *values = g_ptr_array_index (entries, i);
+      guint64 bytes = g_value_get_uint64 (g_value_array_get_nth (values, 3));
+      gchar *bytes_str = g_format_size_for_display (bytes);
+
+      gtk_list_store_insert_with_values (store, NULL, -1,
+          COL_FOOTPRINT_NAME,
+              g_value_get_string (g_value_array_get_nth (values, 0)),
+          COL_FOOTPRINT_LIVE,
+              g_value_get_uint (g_value_array_get_nth (values, 1)),
+          COL_FOOTPRINT_TOTAL,
+              g_value_get_uint64 (g_value_array_get_nth (values, 2)),
+          COL_FOOTPRINT_BYTES, bytes,
+          COL_FOOTPRINT_BYTES_STRING, bytes_str,
+          -1);
+
+      g_free (bytes_str);
+    }
+
+  /* Biggest first, that's what one is looking for */
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (store),
+      COL_FOOTPRINT_BYTES, GTK_SORT_DESCENDING);
+
+  dialog = gtk_dialog_new_with_buttons (_("Memory Footprint"),
+      GTK_WINDOW (debug_dialog), GTK_DIALOG_DESTROY_WITH_PARENT,
+      GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+      NULL);
+  gtk_window_set_default_size (GTK_WINDOW (dialog), 500, 400);
+  g_signal_connect (dialog, "response",
+      G_CALLBACK (gtk_widget_destroy), NULL);
+
+  label = gtk_label_new (NULL);
+  gtk_misc_set_alignment (GTK_MISC (label), 0, 0.5);
+  gtk_misc_set_padding (GTK_MISC (label), 6, 6);
+  gtk_box_pack_start (GTK_BOX (GTK_DIALOG (dialog)->vbox), label,
+      FALSE, FALSE, 0);
+
+  view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (store));
+  renderer = gtk_cell_renderer_text_new ();
+  for (i = 0; i < G_N_ELEMENTS (columns); i++)
+    {
+      GtkTreeViewColumn *col;
+
+      col = gtk_tree_view_column_new_with_attributes (_(columns[i].title),
+          renderer, "text", columns[i].column, NULL);
+      gtk_tree_view_column_set_sort_column_id (col, columns[i].sort_column);
+      gtk_tree_view_column_set_resizable (col, TRUE);
+      gtk_tree_view_append_column (GTK_TREE_VIEW (view), col);
+    }
+  g_object_unref (store);
+
+  scrolled_win = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled_win),
+      GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+  gtk_container_add (GTK_CONTAINER (scrolled_win), view);
+  gtk_box_pack_start (GTK_BOX (GTK_DIALOG (dialog)->vbox), scrolled_win,
+      TRUE, TRUE, 0);
+
+  gtk_widget_show_all (dialog);
+
+  emp_cli_debug_call_get_footprint_history (priv->proxy, -1,
+      debug_dialog_get_footprint_history_cb, NULL, NULL, G_OBJECT (label));
+}
+
+static void
+debug_dialog_get_footprint_cb (TpProxy *proxy,
+    const GPtrArray *entries,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  EmpathyDebugDialog *debug_dialog = EMPATHY_DEBUG_DIALOG (weak_object);
+  GtkWidget *dialog;
+
+  if (error == NULL)
+    {
+      debug_dialog_show_footprint (debug_dialog, entries);
+      return;
+    }
+
+  DEBUG ("GetFootprint failed: %s", error->message);
+
+  dialog = gtk_message_dialog_new (GTK_WINDOW (debug_dialog),
+      GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_INFO, GTK_BUTTONS_CLOSE,
+      "%s", _("No memory footprint available"));
+  gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+      "%s", _("The service doesn't account for its memory. For Empathy, "
+          "start it with EMPATHY_FOOTPRINT set."));
+  g_signal_connect (dialog, "response",
+      G_CALLBACK (gtk_widget_destroy), NULL);
+  gtk_widget_show (dialog);
+}
+
+static void
+debug_dialog_footprint_clicked_cb (GtkToolButton *tool_button,
+    EmpathyDebugDialog *debug_dialog)
+{
+  EmpathyDebugDialogPriv *priv = GET_PRIV (debug_dialog);
+
+  if (priv->proxy == NULL)
+    return;
+
+  emp_cli_debug_call_get_footprint (priv->proxy, -1,
+      debug_dialog_get_footprint_cb, NULL, NULL, G_OBJECT (debug_dialog));
+}
+
+static void
+debug_dialog_add_column (GtkWidget *view,
+    const gchar *title,
+    GtkCellRenderer *renderer,
+    gint column,
+    gint width)
+{
+  GtkTreeViewColumn *col;
+
+  col = gtk_tree_view_column_new_with_attributes (title, renderer,
+      "text", column, NULL);
+  gtk_tree_view_column_set_sizing (col, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (col, width);
+  gtk_tree_view_column_set_resizable (col, TRUE);
+  gtk_tree_view_append_column (GTK_TREE_VIEW (view), col);
+}
+
 static GObject *
 debug_dialog_constructor (GType type,
     guint n_construct_params,
@@ -1002,6 +1256,17 @@ debug_dialog_constructor (GType type,
   gtk_tool_item_set_is_important (GTK_TOOL_ITEM (priv->clear_button), TRUE);
   gtk_toolbar_insert (GTK_TOOLBAR (toolbar), priv->clear_button, -1);
 
+  /* Footprint */
+  priv->footprint_button = gtk_tool_button_new_from_stock (GTK_STOCK_INFO);
+  gtk_tool_button_set_label (GTK_TOOL_BUTTON (priv->footprint_button),
+      _("Footprint"));
+  g_signal_connect (priv->footprint_button, "clicked",
+      G_CALLBACK (debug_dialog_footprint_clicked_cb), object);
+  gtk_widget_show (GTK_WIDGET (priv->footprint_button));
+  gtk_tool_item_set_is_important (GTK_TOOL_ITEM (priv->footprint_button),
+      TRUE);
+  gtk_toolbar_insert (GTK_TOOLBAR (toolbar), priv->footprint_button, -1);
+
   item = gtk_separator_tool_item_new ();
   gtk_widget_show (GTK_WIDGET (item));
   gtk_toolbar_insert (GTK_TOOLBAR (toolbar), item, -1);
@@ -1085,6 +1350,7 @@ debug_dialog_constructor (GType type,
       -1);
 
   gtk_combo_box_set_active (GTK_COMBO_BOX (priv->level_filter), 0);
+  priv->filter_level = EMP_DEBUG_LEVEL_DEBUG;
   g_signal_connect (priv->level_filter, "changed",
       G_CALLBACK (debug_dialog_filter_changed_cb), object);
 
@@ -1098,19 +1364,26 @@ debug_dialog_constructor (GType type,
   renderer = gtk_cell_renderer_text_new ();
   g_object_set (renderer, "yalign", 0, NULL);
 
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (priv->view),
-      -1, _("Time"), renderer, "text", COL_DEBUG_TIMESTAMP, NULL);
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (priv->view),
-      -1, _("Domain"), renderer, "text", COL_DEBUG_DOMAIN, NULL);
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (priv->view),
-      -1, _("Category"), renderer, "text", COL_DEBUG_CATEGORY, NULL);
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (priv->view),
-      -1, _("Level"), renderer, "text", COL_DEBUG_LEVEL_STRING, NULL);
-
+  debug_dialog_add_column (priv->view, _("Time"), renderer,
+      COL_DEBUG_TIMESTAMP, 140);
+  debug_dialog_add_column (priv->view, _("Domain"), renderer,
+      COL_DEBUG_DOMAIN, 100);
+  debug_dialog_add_column (priv->view, _("Category"), renderer,
+      COL_DEBUG_CATEGORY, 100);
+  debug_dialog_add_column (priv->view, _("Level"), renderer,
+      COL_DEBUG_LEVEL_STRING, 70);
+
+  /* Rows all have the same height so only the visible ones get measured,
+   * multi-line messages are shown on a single line */
   renderer = gtk_cell_renderer_text_new ();
-  g_object_set (renderer, "family", "Monospace", NULL);
-  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (priv->view),
-      -1, _("Message"), renderer, "text", COL_DEBUG_MESSAGE, NULL);
+  g_object_set (renderer,
+      "family", "Monospace",
+      "single-paragraph-mode", TRUE,
+      NULL);
+  debug_dialog_add_column (priv->view, _("Message"), renderer,
+      COL_DEBUG_MESSAGE, 800);
+
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (priv->view), TRUE);
 
   priv->store = gtk_list_store_new (NUM_DEBUG_COLS, G_TYPE_DOUBLE,
       G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
@@ -1217,6 +1490,9 @@ debug_dialog_dispose (GObject *object)
   if (priv->new_debug_message_signal != NULL)
     tp_proxy_signal_connection_disconnect (priv->new_debug_message_signal);
 
+  if (priv->new_debug_messages_signal != NULL)
+    tp_proxy_signal_connection_disconnect (priv->new_debug_messages_signal);
+
   if (priv->cms != NULL)
     g_object_unref (priv->cms);
 
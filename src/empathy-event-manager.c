@@ -28,6 +28,7 @@
 
 #include <libempathy/empathy-account-manager.h>
 #include <libempathy/empathy-dispatcher.h>
+#include <libempathy/empathy-footprint.h>
 #include <libempathy/empathy-tp-contact-factory.h>
 #include <libempathy/empathy-contact-manager.h>
 #include <libempathy/empathy-tp-chat.h>
@@ -164,6 +165,7 @@ event_free (EventPriv *event)
     }
 
   g_slice_free (EventPriv, event);
+  EMPATHY_FOOTPRINT_ADD ("event", -1, -(gssize) sizeof (EventPriv));
 }
 
 static void
@@ -193,6 +195,7 @@ event_manager_add (EmpathyEventManager *manager, EmpathyContact *contact,
   EventPriv               *event;
 
   event = g_slice_new0 (EventPriv);
+  EMPATHY_FOOTPRINT_ADD ("event", 1, sizeof (EventPriv));
   event->public.contact = contact ? g_object_ref (contact) : NULL;
   event->public.icon_name = g_strdup (icon_name);
   event->public.header = g_strdup (header);
@@ -916,7 +919,7 @@ event_manager_presence_changed_cb (EmpathyContactMonitor *monitor,
 {
   EmpathyAccount *account;
   gchar *header = NULL;
-  gboolean preference = FALSE;
+  const EmpathyConfSettings *settings = empathy_conf_get_settings ();
 
   account = empathy_contact_get_account (contact);
   if (empathy_account_is_just_connected (account))
@@ -926,9 +929,8 @@ event_manager_presence_changed_cb (EmpathyContactMonitor *monitor,
      TP_CONNECTION_PRESENCE_TYPE_OFFLINE) > 0)
     {
       /* contact was online */
-      empathy_conf_get_bool (empathy_conf_get (),
-                      EMPATHY_PREFS_NOTIFICATIONS_CONTACT_SIGNOUT, &preference);
-      if (preference && tp_connection_presence_type_cmp_availability (current,
+      if (settings->notifications_contact_signout &&
+          tp_connection_presence_type_cmp_availability (current,
           TP_CONNECTION_PRESENCE_TYPE_OFFLINE) <= 0)
         {
           /* someone is logging off */
@@ -942,9 +944,8 @@ event_manager_presence_changed_cb (EmpathyContactMonitor *monitor,
   else
     {
       /* contact was offline */
-      empathy_conf_get_bool (empathy_conf_get (),
-                      EMPATHY_PREFS_NOTIFICATIONS_CONTACT_SIGNIN, &preference);
-      if (preference && tp_connection_presence_type_cmp_availability (current,
+      if (settings->notifications_contact_signin &&
+          tp_connection_presence_type_cmp_availability (current,
           TP_CONNECTION_PRESENCE_TYPE_OFFLINE) > 0)
         {
           /* someone is logging in */
@@ -36,6 +36,7 @@
 
 #define DEBUG_FLAG EMPATHY_DEBUG_FT
 #include <libempathy/empathy-debug.h>
+#include <libempathy/empathy-ft-scheduler.h>
 #include <libempathy/empathy-tp-file.h>
 #include <libempathy/empathy-utils.h>
 
@@ -58,6 +59,7 @@ enum
 typedef struct {
   GtkTreeModel *model;
   GHashTable *ft_handler_to_row_ref;
+  EmpathyFTScheduler *scheduler;
 
   /* Widgets */
   GtkWidget *window;
@@ -65,6 +67,8 @@ typedef struct {
   GtkWidget *open_button;
   GtkWidget *abort_button;
   GtkWidget *clear_button;
+  GtkWidget *up_button;
+  GtkWidget *down_button;
 
   guint save_geometry_id;
 } EmpathyFTManagerPriv;
@@ -73,7 +77,9 @@ enum
 {
   RESPONSE_OPEN  = 1,
   RESPONSE_STOP  = 2,
-  RESPONSE_CLEAR = 3
+  RESPONSE_CLEAR = 3,
+  RESPONSE_UP    = 4,
+  RESPONSE_DOWN  = 5
 };
 
 G_DEFINE_TYPE (EmpathyFTManager, empathy_ft_manager, G_TYPE_OBJECT);
@@ -114,7 +120,10 @@ ft_manager_update_buttons (EmpathyFTManager *manager)
   gboolean open_enabled = FALSE;
   gboolean abort_enabled = FALSE;
   gboolean clear_enabled = FALSE;
+  gboolean up_enabled = FALSE;
+  gboolean down_enabled = FALSE;
   gboolean is_completed, is_cancelled;
+  gint position;
   GHashTableIter hash_iter;
   EmpathyFTManagerPriv *priv = GET_PRIV (manager);
 
@@ -133,6 +142,18 @@ ft_manager_update_buttons (EmpathyFTManager *manager)
       /* I can abort if the transfer is not already finished */
       abort_enabled = (is_cancelled == FALSE && is_completed == FALSE);
 
+      /* I can reorder the transfer while it is queued */
+      position = empathy_ft_scheduler_get_position (priv->scheduler, handler);
+      if (position >= 0)
+        {
+          GList *pending;
+
+          pending = empathy_ft_scheduler_get_pending (priv->scheduler);
+          up_enabled = (position > 0);
+          down_enabled = (position < (gint) g_list_length (pending) - 1);
+          g_list_free (pending);
+        }
+
       g_object_unref (handler);
     }
 
@@ -150,6 +171,8 @@ ft_manager_update_buttons (EmpathyFTManager *manager)
 
   gtk_widget_set_sensitive (priv->open_button, open_enabled);
   gtk_widget_set_sensitive (priv->abort_button, abort_enabled);
+  gtk_widget_set_sensitive (priv->up_button, up_enabled);
+  gtk_widget_set_sensitive (priv->down_button, down_enabled);
 
   if (clear_enabled)
     gtk_widget_set_sensitive (priv->clear_button, TRUE);
@@ -377,51 +400,6 @@ ft_manager_update_handler_message (EmpathyFTManager *manager,
   gtk_tree_path_free (path);
 }
 
-static void
-ft_manager_update_handler_progress (EmpathyFTManager *manager,
-                                    GtkTreeRowReference *row_ref,
-                                    int percentage)
-{
-  GtkTreePath *path;
-  GtkTreeIter iter;
-  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
-
-  /* Set new value in the store */
-  path = gtk_tree_row_reference_get_path (row_ref);
-  gtk_tree_model_get_iter (priv->model, &iter, path);
-  gtk_list_store_set (GTK_LIST_STORE (priv->model),
-      &iter,
-      COL_PERCENT, percentage,
-      -1);
-
-  gtk_tree_path_free (path);
-
-}
-
-static void
-ft_manager_update_handler_time (EmpathyFTManager *manager,
-                                GtkTreeRowReference *row_ref,
-                                guint remaining_time)
-{
-  GtkTreePath *path;
-  GtkTreeIter iter;
-  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
-  char *remaining_str;
-
-  remaining_str = ft_manager_format_interval (remaining_time);
-
-  /* Set new value in the store */
-  path = gtk_tree_row_reference_get_path (row_ref);
-  gtk_tree_model_get_iter (priv->model, &iter, path);
-  gtk_list_store_set (GTK_LIST_STORE (priv->model),
-      &iter,
-      COL_REMAINING, remaining_str,
-      -1);
-
-  gtk_tree_path_free (path);
-  g_free (remaining_str);
-}
-
 static void
 ft_manager_clear_handler_time (EmpathyFTManager *manager,
                                GtkTreeRowReference *row_ref)
@@ -547,9 +525,12 @@ ft_handler_transfer_progress_cb (EmpathyFTHandler *handler,
                                  gdouble speed,
                                  EmpathyFTManager *manager)
 {
-  char *first_line, *second_line, *message;
+  char *first_line, *second_line, *message, *remaining_str = NULL;
   int percentage;
   GtkTreeRowReference *row_ref;
+  GtkTreePath *path;
+  GtkTreeIter iter;
+  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
 
   DEBUG ("Transfer progress");
 
@@ -562,12 +543,31 @@ ft_handler_transfer_progress_cb (EmpathyFTHandler *handler,
 
   message = g_strdup_printf ("%s\n%s", first_line, second_line);
 
-  ft_manager_update_handler_message (manager, row_ref, message);
-  ft_manager_update_handler_progress (manager, row_ref, percentage);
+  /* update all the columns at once, so that the row is redrawn only once */
+  path = gtk_tree_row_reference_get_path (row_ref);
+  gtk_tree_model_get_iter (priv->model, &iter, path);
 
   if (remaining_time > 0)
-    ft_manager_update_handler_time (manager, row_ref, remaining_time);
+    {
+      remaining_str = ft_manager_format_interval (remaining_time);
+      gtk_list_store_set (GTK_LIST_STORE (priv->model),
+          &iter,
+          COL_MESSAGE, message,
+          COL_PERCENT, percentage,
+          COL_REMAINING, remaining_str,
+          -1);
+    }
+  else
+    {
+      gtk_list_store_set (GTK_LIST_STORE (priv->model),
+          &iter,
+          COL_MESSAGE, message,
+          COL_PERCENT, percentage,
+          -1);
+    }
 
+  gtk_tree_path_free (path);
+  g_free (remaining_str);
   g_free (message);
   g_free (first_line);
   g_free (second_line);
@@ -720,7 +720,9 @@ ft_manager_start_transfer (EmpathyFTManager *manager,
         G_CALLBACK (ft_handler_transfer_started_cb), manager);
   }
 
-  empathy_ft_handler_start_transfer (handler);
+  /* incoming transfers are started right away, they still count in the
+   * limits of outgoing ones while they are open */
+  empathy_ft_scheduler_queue (priv->scheduler, handler);
 }
 
 static void
@@ -733,7 +735,7 @@ ft_manager_add_handler_to_list (EmpathyFTManager *manager,
   GtkTreeSelection *selection;
   GtkTreePath *path;
   GIcon *icon;
-  const char *content_type, *second_line;
+  const char *content_type;
   char *first_line, *message;
   EmpathyFTManagerPriv *priv = GET_PRIV (manager);
 
@@ -773,6 +775,31 @@ ft_manager_add_handler_to_list (EmpathyFTManager *manager,
       return;
     }
 
+  /* the row is updated with the queue position by ::queue-changed */
+  first_line = ft_manager_format_contact_info (handler);
+  message = g_strdup_printf ("%s\n", first_line);
+  ft_manager_update_handler_message (manager, row_ref, message);
+
+  g_free (first_line);
+  g_free (message);
+
+  /* hook up the signals and queue the transfer */
+  ft_manager_start_transfer (manager, handler);
+}
+
+static void
+ft_manager_scheduler_transfer_started_cb (EmpathyFTScheduler *scheduler,
+                                          EmpathyFTHandler *handler,
+                                          EmpathyFTManager *manager)
+{
+  GtkTreeRowReference *row_ref;
+  const char *second_line;
+  char *first_line, *message;
+
+  row_ref = ft_manager_get_row_from_handler (manager, handler);
+  if (row_ref == NULL)
+    return;
+
   /* update the row with the initial values.
    * the only case where we postpone this is in case we're managing
    * an outgoing+hashing transfer, as the hashing started signal will
@@ -789,9 +816,43 @@ ft_manager_add_handler_to_list (EmpathyFTManager *manager,
     g_free (first_line);
     g_free (message);
   }
+}
 
-  /* hook up the signals and start the transfer */
-  ft_manager_start_transfer (manager, handler);
+static void
+ft_manager_scheduler_queue_changed_cb (EmpathyFTScheduler *scheduler,
+                                       EmpathyFTManager *manager)
+{
+  GList *pending, *l;
+  gint position = 1;
+
+  pending = empathy_ft_scheduler_get_pending (scheduler);
+
+  for (l = pending; l != NULL; l = l->next, position++)
+    {
+      EmpathyFTHandler *handler = l->data;
+      GtkTreeRowReference *row_ref;
+      char *first_line, *second_line, *message;
+
+      row_ref = ft_manager_get_row_from_handler (manager, handler);
+      if (row_ref == NULL)
+        continue;
+
+      first_line = ft_manager_format_contact_info (handler);
+      second_line = g_strdup_printf
+        (_("Waiting for other file transfers (position %d in the queue)"),
+        position);
+      message = g_strdup_printf ("%s\n%s", first_line, second_line);
+
+      ft_manager_update_handler_message (manager, row_ref, message);
+
+      g_free (first_line);
+      g_free (second_line);
+      g_free (message);
+    }
+
+  g_list_free (pending);
+
+  ft_manager_update_buttons (manager);
 }
 
 static void
@@ -867,6 +928,56 @@ ft_manager_stop (EmpathyFTManager *manager)
   g_object_unref (handler);
 }
 
+static void
+ft_manager_move (EmpathyFTManager *manager,
+                 gint offset)
+{
+  GtkTreeSelection *selection;
+  GtkTreeIter iter, other_iter;
+  GtkTreeModel *model;
+  GtkTreePath *path;
+  GtkTreeRowReference *other_row_ref;
+  EmpathyFTHandler *handler, *other;
+  GList *pending;
+  gint position;
+  EmpathyFTManagerPriv *priv = GET_PRIV (manager);
+
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->treeview));
+
+  if (!gtk_tree_selection_get_selected (selection, &model, &iter))
+    return;
+
+  gtk_tree_model_get (model, &iter, COL_FT_OBJECT, &handler, -1);
+  g_return_if_fail (handler != NULL);
+
+  position = empathy_ft_scheduler_get_position (priv->scheduler, handler);
+  pending = empathy_ft_scheduler_get_pending (priv->scheduler);
+  other = g_list_nth_data (pending, position + offset);
+
+  if (position < 0 || other == NULL)
+    goto out;
+
+  DEBUG ("Moving file transfer %s to position %d",
+      empathy_ft_handler_get_filename (handler), position + offset);
+
+  /* keep the rows in the same order as the queue */
+  other_row_ref = ft_manager_get_row_from_handler (manager, other);
+  path = gtk_tree_row_reference_get_path (other_row_ref);
+  gtk_tree_model_get_iter (model, &other_iter, path);
+  gtk_tree_path_free (path);
+
+  if (offset < 0)
+    gtk_list_store_move_before (GTK_LIST_STORE (model), &iter, &other_iter);
+  else
+    gtk_list_store_move_after (GTK_LIST_STORE (model), &iter, &other_iter);
+
+  empathy_ft_scheduler_move (priv->scheduler, handler, position + offset);
+
+out:
+  g_list_free (pending);
+  g_object_unref (handler);
+}
+
 static gboolean
 ft_manager_save_geometry_timeout_cb (EmpathyFTManager *manager)
 {
@@ -915,6 +1026,12 @@ ft_manager_response_cb (GtkWidget *widget,
       case RESPONSE_STOP:
         ft_manager_stop (manager);
         break;
+      case RESPONSE_UP:
+        ft_manager_move (manager, -1);
+        break;
+      case RESPONSE_DOWN:
+        ft_manager_move (manager, 1);
+        break;
     }
 }
 
@@ -970,6 +1087,8 @@ ft_manager_build_ui (EmpathyFTManager *manager)
       "clear_button", &priv->clear_button,
       "open_button", &priv->open_button,
       "abort_button", &priv->abort_button,
+      "up_button", &priv->up_button,
+      "down_button", &priv->down_button,
       NULL);
   g_free (filename);
 
@@ -1069,6 +1188,8 @@ ft_manager_build_ui (EmpathyFTManager *manager)
    * handlers in the store.
    */
   gtk_widget_set_sensitive (priv->clear_button, FALSE);
+  gtk_widget_set_sensitive (priv->up_button, FALSE);
+  gtk_widget_set_sensitive (priv->down_button, FALSE);
 }
 
 /* GObject method overrides */
@@ -1082,6 +1203,12 @@ empathy_ft_manager_finalize (GObject *object)
 
   g_hash_table_destroy (priv->ft_handler_to_row_ref);
 
+  g_signal_handlers_disconnect_by_func (priv->scheduler,
+      ft_manager_scheduler_transfer_started_cb, object);
+  g_signal_handlers_disconnect_by_func (priv->scheduler,
+      ft_manager_scheduler_queue_changed_cb, object);
+  g_object_unref (priv->scheduler);
+
   if (priv->save_geometry_id != 0)
     g_source_remove (priv->save_geometry_id);
 
@@ -1102,6 +1229,12 @@ empathy_ft_manager_init (EmpathyFTManager *manager)
       g_direct_equal, (GDestroyNotify) g_object_unref,
       (GDestroyNotify) gtk_tree_row_reference_free);
 
+  priv->scheduler = empathy_ft_scheduler_dup_singleton ();
+  g_signal_connect (priv->scheduler, "transfer-started",
+      G_CALLBACK (ft_manager_scheduler_transfer_started_cb), manager);
+  g_signal_connect (priv->scheduler, "queue-changed",
+      G_CALLBACK (ft_manager_scheduler_queue_changed_cb), manager);
+
   ft_manager_build_ui (manager);
 }
 
@@ -1123,6 +1123,7 @@ GtkWidget *
 empathy_main_window_show (void)
 {
 	EmpathyContactList       *list_iface;
+	EmpathyRosterCache       *roster_cache;
 	EmpathyContactMonitor    *monitor;
 	GtkBuilder               *gui;
 	EmpathyConf              *conf;
@@ -1131,9 +1132,7 @@ empathy_main_window_show (void)
 	GtkWidget                *ebox;
 	GtkAction                *show_map_widget;
 	GtkToolItem              *item;
-	gboolean                  show_offline;
-	gboolean                  show_avatars;
-	gboolean                  compact_contact_list;
+	const EmpathyConfSettings *settings;
 	gint                      x, y, w, h;
 	gchar                    *filename;
 	GSList                   *l;
@@ -1255,6 +1254,10 @@ empathy_main_window_show (void)
 	list_iface = EMPATHY_CONTACT_LIST (empathy_contact_manager_dup_singleton ());
 	monitor = empathy_contact_list_get_monitor (list_iface);
 	window->list_store = empathy_contact_list_store_new (list_iface);
+	roster_cache = empathy_roster_cache_dup_singleton ();
+	empathy_contact_list_store_set_roster_cache (window->list_store,
+						     roster_cache);
+	g_object_unref (roster_cache);
 	window->list_view = empathy_contact_list_view_new (window->list_store,
 							   EMPATHY_CONTACT_LIST_FEATURE_ALL,
 							   EMPATHY_CONTACT_FEATURE_ALL);
@@ -1316,37 +1319,32 @@ empathy_main_window_show (void)
 	}
 
 	conf = empathy_conf_get ();
+	settings = empathy_conf_get_settings ();
 
 	/* Show offline ? */
-	empathy_conf_get_bool (conf,
-			      EMPATHY_PREFS_CONTACTS_SHOW_OFFLINE,
-			      &show_offline);
 	empathy_conf_notify_add (conf,
 				EMPATHY_PREFS_CONTACTS_SHOW_OFFLINE,
 				main_window_notify_show_offline_cb,
 				show_offline_widget);
 
-	gtk_toggle_action_set_active (show_offline_widget, show_offline);
+	gtk_toggle_action_set_active (show_offline_widget,
+				      settings->contacts_show_offline);
 
 	/* Show avatars ? */
-	empathy_conf_get_bool (conf,
-			      EMPATHY_PREFS_UI_SHOW_AVATARS,
-			      &show_avatars);
 	empathy_conf_notify_add (conf,
 				EMPATHY_PREFS_UI_SHOW_AVATARS,
 				(EmpathyConfNotifyFunc) main_window_notify_show_avatars_cb,
 				window);
-	empathy_contact_list_store_set_show_avatars (window->list_store, show_avatars);
+	empathy_contact_list_store_set_show_avatars (window->list_store,
+						    settings->ui_show_avatars);
 
 	/* Is compact ? */
-	empathy_conf_get_bool (conf,
-			      EMPATHY_PREFS_UI_COMPACT_CONTACT_LIST,
-			      &compact_contact_list);
 	empathy_conf_notify_add (conf,
 				EMPATHY_PREFS_UI_COMPACT_CONTACT_LIST,
 				(EmpathyConfNotifyFunc) main_window_notify_compact_contact_list_cb,
 				window);
-	empathy_contact_list_store_set_is_compact (window->list_store, compact_contact_list);
+	empathy_contact_list_store_set_is_compact (window->list_store,
+						  settings->ui_compact_contact_list);
 
 	/* Sort criterium */
 	empathy_conf_notify_add (conf,
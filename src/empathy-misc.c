@@ -74,25 +74,15 @@ empathy_misc_get_pixbuf_for_notification (EmpathyContact *contact,
 gboolean
 empathy_notification_is_enabled (void)
 {
-	EmpathyConf *conf;
-	gboolean res;
+	const EmpathyConfSettings *settings = empathy_conf_get_settings ();
 
-	conf = empathy_conf_get ();
-	res = FALSE;
-
-	empathy_conf_get_bool (conf, EMPATHY_PREFS_NOTIFICATIONS_ENABLED, &res);
-
-	if (!res) {
+	if (!settings->notifications_enabled) {
 		return FALSE;
 	}
 
-	if (!empathy_check_available_state ()) {
-		empathy_conf_get_bool (conf,
-				       EMPATHY_PREFS_NOTIFICATIONS_DISABLED_AWAY,
-				       &res);
-		if (res) {
-			return FALSE;
-		}
+	if (!empathy_check_available_state () &&
+	    settings->notifications_disabled_away) {
+		return FALSE;
 	}
 
 	return TRUE;
@@ -414,16 +414,10 @@ status_icon_toggle_visibility (EmpathyStatusIcon *icon)
 {
 	EmpathyStatusIconPriv *priv = GET_PRIV (icon);
 	gboolean               visible;
-#ifdef HAVE_LIBINDICATE
-	gboolean               use_libindicate;
-#endif
 
 	visible = gtk_window_is_active (priv->window);
 #ifdef HAVE_LIBINDICATE
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_UI_USE_LIBINDICATE,
-		               &use_libindicate);
-	if (use_libindicate) {
+	if (empathy_conf_get_settings ()->ui_use_libindicate) {
 		visible = GTK_WIDGET_VISIBLE (priv->window);
 	}
 #endif
@@ -689,9 +683,6 @@ empathy_status_icon_new (GtkWindow *window, gboolean hide_contact_list)
 	EmpathyStatusIconPriv *priv;
 	EmpathyStatusIcon     *icon;
 	gboolean               should_hide;
-#ifdef HAVE_LIBINDICATE
-	gboolean               use_libindicate;
-#endif
 
 	g_return_val_if_fail (GTK_IS_WINDOW (window), NULL);
 
@@ -715,18 +706,14 @@ empathy_status_icon_new (GtkWindow *window, gboolean hide_contact_list)
 			  icon);
 
 	if (!hide_contact_list) {
-		empathy_conf_get_bool (empathy_conf_get (),
-				       EMPATHY_PREFS_UI_MAIN_WINDOW_HIDDEN,
-			               &should_hide);
+		should_hide = empathy_conf_get_settings ()->ui_main_window_hidden;
 	} else {
 		should_hide = TRUE;
 	}
 
 #ifdef HAVE_LIBINDICATE
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_UI_USE_LIBINDICATE,
-		               &use_libindicate);
-	status_icon_set_use_libindicate (icon, use_libindicate);
+	status_icon_set_use_libindicate (icon,
+		empathy_conf_get_settings ()->ui_use_libindicate);
 #endif
 
 	if (gtk_window_is_active (priv->window) == should_hide) {
@@ -31,10 +31,6 @@
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
 
-#if HAVE_LIBCHAMPLAIN
-#include <clutter-gtk/gtk-clutter-embed.h>
-#endif
-
 #include <libebook/e-book.h>
 #include <libnotify/notify.h>
 
@@ -52,8 +48,11 @@
 #include <libempathy/empathy-dispatch-operation.h>
 #include <libempathy/empathy-log-manager.h>
 #include <libempathy/empathy-ft-factory.h>
+#include <libempathy/empathy-roster-cache.h>
 #include <libempathy/empathy-tp-chat.h>
 #include <libempathy/empathy-tp-call.h>
+#include <libempathy/empathy-time.h>
+#include <libempathy/empathy-xml-saver.h>
 
 #include <libempathy-gtk/empathy-conf.h>
 #include <libempathy-gtk/empathy-ui-utils.h>
@@ -72,10 +71,39 @@
 #define DEBUG_FLAG EMPATHY_DEBUG_OTHER
 #include <libempathy/empathy-debug.h>
 
-#include <gst/gst.h>
-
 static BaconMessageConnection *connection = NULL;
 
+#if HAVE_GEOCLUE
+static EmpathyLocationManager *location_manager = NULL;
+#endif
+
+/* Startup trace, see startup_trace () */
+static gboolean profile_startup = FALSE;
+static gint64   startup_time = 0;
+static gint64   startup_phase_time = 0;
+
+/* Records how long the startup phase that just ended took. The trace goes
+ * to the debugger's latencies under the "startup" category, and to stdout
+ * with --profile-startup. */
+static void
+startup_trace (const gchar *phase)
+{
+	gint64 now;
+
+	now = empathy_time_get_monotonic ();
+	empathy_debugger_add_latency (empathy_debugger_get_singleton (),
+				      "startup", phase,
+				      now - startup_phase_time);
+
+	if (profile_startup) {
+		g_print ("startup: %-18s %8.1f ms %8.1f ms\n", phase,
+			 (now - startup_phase_time) / 1000.0,
+			 (now - startup_time) / 1000.0);
+	}
+
+	startup_phase_time = now;
+}
+
 static void
 dispatch_cb (EmpathyDispatcher *dispatcher,
 	     EmpathyDispatchOperation *operation,
@@ -220,12 +248,26 @@ use_nm_notify_cb (EmpathyConf *conf,
 	}
 }
 
+#if HAVE_GEOCLUE
+static void
+location_publish_notify_cb (EmpathyConf *conf,
+			    const gchar *key,
+			    gpointer     user_data)
+{
+	/* Geoclue is only started once the user wants to publish; the
+	 * manager follows the preference itself from then on */
+	if (!location_manager &&
+	    empathy_conf_get_settings ()->location_publish) {
+		location_manager = empathy_location_manager_dup_singleton ();
+	}
+}
+#endif
+
 static void
 create_salut_account (void)
 {
 	McProfile  *profile;
 	McProtocol *protocol;
-	gboolean    salut_created = FALSE;
 	EmpathyAccount  *account;
 	EmpathyAccountManager *account_manager;
 	GList      *accounts;
@@ -239,10 +281,7 @@ create_salut_account (void)
 	GError     *error = NULL;
 
 	/* Check if we already created a salut account */
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_SALUT_ACCOUNT_CREATED,
-			       &salut_created);
-	if (salut_created) {
+	if (empathy_conf_get_settings ()->salut_account_created) {
 		return;
 	}
 
@@ -462,6 +501,10 @@ default_log_handler (const gchar *log_domain,
 {
 	g_log_default_handler (log_domain, log_level, message, NULL);
 
+	/* Nobody would ever look at it */
+	if (empathy_debug_active_flags == 0)
+		return;
+
 	/* G_LOG_DOMAIN = "empathy". No need to send empathy messages to the
 	 * debugger as they already have in empathy_debug. */
 	if (log_level != G_LOG_LEVEL_DEBUG
@@ -478,23 +521,49 @@ default_log_handler (const gchar *log_domain,
 }
 #endif /* ENABLE_DEBUG */
 
+static gboolean
+startup_painted_cb (gpointer user_data)
+{
+	startup_trace ("first-paint");
+	empathy_debugger_add_latency (empathy_debugger_get_singleton (),
+				      "startup", "total",
+				      startup_phase_time - startup_time);
+
+	/* Only matters the first time Empathy runs, and looks at the
+	 * address book */
+	create_salut_account ();
+
+	return FALSE;
+}
+
+static gboolean
+startup_expose_cb (GtkWidget      *widget,
+		   GdkEventExpose *event,
+		   gpointer        user_data)
+{
+	g_signal_handlers_disconnect_by_func (widget, startup_expose_cb,
+					      user_data);
+
+	/* Runs once the redraws queued with this one are done */
+	g_idle_add (startup_painted_cb, NULL);
+
+	return FALSE;
+}
+
 int
 main (int argc, char *argv[])
 {
 	guint32            startup_timestamp;
-#if HAVE_GEOCLUE
-	EmpathyLocationManager *location_manager = NULL;
-#endif
 	EmpathyStatusIcon *icon;
 	EmpathyDispatcher *dispatcher;
 	EmpathyLogManager *log_manager;
 	EmpathyChatroomManager *chatroom_manager;
 	EmpathyCallFactory *call_factory;
 	EmpathyFTFactory  *ft_factory;
+	EmpathyRosterCache *roster_cache;
 	GtkWidget         *window;
 	MissionControl    *mc;
 	EmpathyIdle       *idle;
-	gboolean           autoconnect = TRUE;
 	gboolean           no_connect = FALSE;
 	gboolean           hide_contact_list = FALSE;
 	gboolean           accounts_dialog = FALSE;
@@ -513,11 +582,17 @@ main (int argc, char *argv[])
 		  0, G_OPTION_ARG_NONE, &accounts_dialog,
 		  N_("Show the accounts dialog"),
 		  NULL },
+		{ "profile-startup", 0,
+		  0, G_OPTION_ARG_NONE, &profile_startup,
+		  N_("Print how long each part of the startup takes"),
+		  NULL },
 		{ "version", 'v',
 		  G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, show_version_cb, NULL, NULL },
 		{ NULL }
 	};
 
+	startup_time = startup_phase_time = empathy_time_get_monotonic ();
+
 	/* Init */
 	g_thread_init (NULL);
 	empathy_init ();
@@ -533,11 +608,9 @@ main (int argc, char *argv[])
 	g_set_application_name (_(PACKAGE_NAME));
 	g_setenv ("PULSE_PROP_media.role", "phone", TRUE);
 
-	gst_init (&argc, &argv);
-
-#if HAVE_LIBCHAMPLAIN
-	gtk_clutter_init (&argc, &argv);
-#endif
+	/* GStreamer and Clutter are brought up by the first call and the
+	 * first map, see empathy_call_handler_class_init () and
+	 * empathy_gtk_clutter_init () */
 
 	gtk_window_set_default_icon_name ("empathy");
 	textdomain (GETTEXT_PACKAGE);
@@ -547,6 +620,8 @@ main (int argc, char *argv[])
 	g_log_set_default_handler (default_log_handler, NULL);
 #endif
 
+	startup_trace ("init");
+
         /* Setting up the bacon connection */
 	startup_timestamp = get_startup_timestamp ();
 	connection = bacon_message_connection_new ("empathy");
@@ -599,6 +674,8 @@ main (int argc, char *argv[])
 		g_clear_error (&error);
 	}
 
+	startup_trace ("single-instance");
+
 	/* Setting up MC */
 	mc = empathy_mission_control_dup_singleton ();
 	g_signal_connect (mc, "ServiceEnded",
@@ -608,6 +685,8 @@ main (int argc, char *argv[])
 			  G_CALLBACK (operation_error_cb),
 			  NULL);
 
+	startup_trace ("mission-control");
+
 	if (accounts_dialog) {
 		GtkWidget *dialog;
 
@@ -628,20 +707,31 @@ main (int argc, char *argv[])
 				 use_nm_notify_cb, idle);
 
 	/* Autoconnect */
-	empathy_conf_get_bool (empathy_conf_get (),
-			       EMPATHY_PREFS_AUTOCONNECT,
-			       &autoconnect);
-	if (autoconnect && ! no_connect &&
+	if (empathy_conf_get_settings ()->autoconnect && ! no_connect &&
 		tp_connection_presence_type_cmp_availability (empathy_idle_get_state
 			(idle), TP_CONNECTION_PRESENCE_TYPE_OFFLINE) <= 0) {
 		empathy_idle_set_state (idle, MC_PRESENCE_AVAILABLE);
 	}
 
-	create_salut_account ();
+	startup_trace ("idle");
+
+	/* Load the roster of the previous session, the contact list shows it
+	 * until the connections are up */
+	roster_cache = empathy_roster_cache_dup_singleton ();
+	startup_trace ("roster-cache");
 
 	/* Setting up UI */
 	window = empathy_main_window_show ();
+	startup_trace ("main-window");
 	icon = empathy_status_icon_new (GTK_WINDOW (window), hide_contact_list);
+	startup_trace ("status-icon");
+
+	if (GTK_WIDGET_VISIBLE (window)) {
+		g_signal_connect (window, "expose-event",
+				  G_CALLBACK (startup_expose_cb), NULL);
+	} else {
+		g_idle_add (startup_painted_cb, NULL);
+	}
 
 	if (connection) {
 		/* We se the callback here because we need window */
@@ -661,6 +751,8 @@ main (int argc, char *argv[])
 	chatroom_manager = empathy_chatroom_manager_dup_singleton (NULL);
 	empathy_chatroom_manager_observe (chatroom_manager, dispatcher);
 
+	startup_trace ("dispatcher");
+
 	notify_init (_(PACKAGE_NAME));
 	/* Create the call factory */
 	call_factory = empathy_call_factory_initialise ();
@@ -675,11 +767,23 @@ main (int argc, char *argv[])
 
 	/* Location mananger */
 #if HAVE_GEOCLUE
-	location_manager = empathy_location_manager_dup_singleton ();
+	location_publish_notify_cb (empathy_conf_get (),
+				    EMPATHY_PREFS_LOCATION_PUBLISH, NULL);
+	empathy_conf_notify_add (empathy_conf_get (),
+				 EMPATHY_PREFS_LOCATION_PUBLISH,
+				 location_publish_notify_cb, NULL);
 #endif
 
+	startup_trace ("factories");
+
 	gtk_main ();
 
+	/* Snapshot the roster before disconnecting */
+	empathy_roster_cache_save (roster_cache);
+
+	/* Write out contact groups and status presets changed just now */
+	empathy_xml_saver_flush_all ();
+
 	empathy_idle_set_state (idle, TP_CONNECTION_PRESENCE_TYPE_OFFLINE);
 
 	g_object_unref (mc);
@@ -689,9 +793,12 @@ main (int argc, char *argv[])
 	g_object_unref (dispatcher);
 	g_object_unref (chatroom_manager);
 #if HAVE_GEOCLUE
-	g_object_unref (location_manager);
+	if (location_manager) {
+		g_object_unref (location_manager);
+	}
 #endif
 	g_object_unref (ft_factory);
+	g_object_unref (roster_cache);
 
 	notify_uninit ();
 
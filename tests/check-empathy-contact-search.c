@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+#include "check-helpers.h"
+#include "check-libempathy.h"
+
+#include <libempathy/empathy-contact-search.h>
+
+static EmpathyContactSearch *
+create_search (EmpathyContact **alice,
+               EmpathyContact **bob,
+               EmpathyContact **carol)
+{
+  EmpathyContactSearch *search;
+
+  search = empathy_contact_search_new ();
+
+  *alice = empathy_contact_new_for_log (NULL, "alice@example.com",
+      "Alice Liddell", FALSE);
+  *bob = empathy_contact_new_for_log (NULL, "bob@example.com",
+      "Bob", FALSE);
+  *carol = empathy_contact_new_for_log (NULL, "carol@example.org",
+      "Carol Bobbins", FALSE);
+
+  empathy_contact_search_add_contact (search, *alice);
+  empathy_contact_search_add_contact (search, *bob);
+  empathy_contact_search_add_contact (search, *carol);
+
+  return search;
+}
+
+static void
+free_contacts (GList *contacts)
+{
+  g_list_foreach (contacts, (GFunc) g_object_unref, NULL);
+  g_list_free (contacts);
+}
+
+START_TEST (test_empathy_contact_search_query)
+{
+  EmpathyContactSearch *search;
+  EmpathyContact *alice, *bob, *carol;
+  GList *result;
+
+  search = create_search (&alice, &bob, &carol);
+
+  /* exact match first, then word prefix */
+  result = empathy_contact_search_query (search, "BOB", 0);
+  fail_if (g_list_length (result) != 2);
+  fail_if (result->data != bob);
+  fail_if (result->next->data != carol);
+  free_contacts (result);
+
+  /* long keys go through the trigram postings */
+  result = empathy_contact_search_query (search, "liddell", 0);
+  fail_if (g_list_length (result) != 1);
+  fail_if (result->data != alice);
+  free_contacts (result);
+
+  /* ids are indexed too */
+  result = empathy_contact_search_query (search, "example.org", 0);
+  fail_if (g_list_length (result) != 1);
+  fail_if (result->data != carol);
+  free_contacts (result);
+
+  result = empathy_contact_search_query (search, "example", 2);
+  fail_if (g_list_length (result) != 2);
+  free_contacts (result);
+
+  result = empathy_contact_search_query (search, "zzz", 0);
+  fail_if (result != NULL);
+
+  g_object_unref (search);
+  g_object_unref (alice);
+  g_object_unref (bob);
+  g_object_unref (carol);
+}
+END_TEST
+
+START_TEST (test_empathy_contact_search_matches)
+{
+  EmpathyContactSearch *search;
+  EmpathyContact *alice, *bob, *carol;
+
+  search = create_search (&alice, &bob, &carol);
+
+  fail_if (!empathy_contact_search_matches (search, alice, "ali"));
+  fail_if (empathy_contact_search_matches (search, bob, "ali"));
+  fail_if (!empathy_contact_search_matches (search, bob, ""));
+
+  /* renamed contacts are reindexed */
+  empathy_contact_set_name (bob, "Robert");
+  fail_if (!empathy_contact_search_matches (search, bob, "robert"));
+  fail_if (empathy_contact_search_matches (search, bob, "bob "));
+
+  /* removed contacts are matched directly */
+  empathy_contact_search_remove_contact (search, carol);
+  fail_if (!empathy_contact_search_matches (search, carol, "bobbins"));
+  fail_if (empathy_contact_search_query (search, "bobbins", 0) != NULL);
+
+  g_object_unref (search);
+  g_object_unref (alice);
+  g_object_unref (bob);
+  g_object_unref (carol);
+}
+END_TEST
+
+TCase *
+make_empathy_contact_search_tcase (void)
+{
+    TCase *tc = tcase_create ("empathy-contact-search");
+    tcase_add_test (tc, test_empathy_contact_search_query);
+    tcase_add_test (tc, test_empathy_contact_search_matches);
+    return tc;
+}
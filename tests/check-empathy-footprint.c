@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+#include "check-helpers.h"
+#include "check-libempathy.h"
+
+#include <libempathy/empathy-contact.h>
+#include <libempathy/empathy-footprint.h>
+
+static const EmpathyFootprintEntry *
+find_entry (GArray *entries,
+            const gchar *name)
+{
+  guint i;
+
+  for (i = 0; i < entries->len; i++)
+    {
+      EmpathyFootprintEntry *entry;
+
+      entry = &g_array_index (entries, EmpathyFootprintEntry, i);
+      if (!strcmp (entry->name, name))
+        return entry;
+    }
+
+  return NULL;
+}
+
+START_TEST (test_empathy_footprint_track)
+{
+  EmpathyContact *contact;
+  const EmpathyFootprintEntry *entry;
+  GArray *entries;
+
+  empathy_footprint_enable (0);
+
+  contact = empathy_contact_new_for_log (NULL, "alice@example.com",
+      "Alice", FALSE);
+  /* Contacts count themselves, this must not count it twice */
+  EMPATHY_FOOTPRINT_TRACK (contact);
+
+  entries = empathy_footprint_dup_entries ();
+  entry = find_entry (entries, "EmpathyContact");
+  fail_if (entry == NULL);
+  fail_if (entry->live != 1);
+  fail_if (entry->total != 1);
+  fail_if (entry->bytes == 0);
+  g_array_free (entries, TRUE);
+
+  g_object_unref (contact);
+
+  entries = empathy_footprint_dup_entries ();
+  entry = find_entry (entries, "EmpathyContact");
+  fail_if (entry->live != 0);
+  fail_if (entry->total != 1);
+  fail_if (entry->bytes != 0);
+  g_array_free (entries, TRUE);
+}
+END_TEST
+
+START_TEST (test_empathy_footprint_add)
+{
+  const EmpathyFootprintEntry *entry;
+  GArray *entries;
+  GArray *snapshots;
+
+  empathy_footprint_enable (0);
+
+  EMPATHY_FOOTPRINT_ADD ("check-category", 2, 300);
+  EMPATHY_FOOTPRINT_ADD ("check-category", -1, -100);
+
+  entries = empathy_footprint_dup_entries ();
+  entry = find_entry (entries, "check-category");
+  fail_if (entry == NULL);
+  fail_if (entry->live != 1);
+  fail_if (entry->total != 2);
+  fail_if (entry->bytes != 200);
+  g_array_free (entries, TRUE);
+
+  /* Enabling takes a first snapshot right away */
+  snapshots = empathy_footprint_dup_snapshots ();
+  fail_if (snapshots->len < 1);
+  g_array_free (snapshots, TRUE);
+}
+END_TEST
+
+TCase *
+make_empathy_footprint_tcase (void)
+{
+    TCase *tc = tcase_create ("empathy-footprint");
+    tcase_add_test (tc, test_empathy_footprint_track);
+    tcase_add_test (tc, test_empathy_footprint_add);
+    return tc;
+}
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <telepathy-glib/util.h>
+#include <check.h>
+
+#include "check-helpers.h"
+#include "check-libempathy.h"
+
+#include <libempathy/empathy-message-block.h>
+
+START_TEST (test_empathy_message_block_intern)
+{
+  EmpathyMessageBlock *block;
+  EmpathyContact *alice, *bob;
+
+  block = empathy_message_block_new (NULL);
+
+  alice = empathy_message_block_intern_sender (block, "alice@example.com",
+      "Alice", FALSE);
+  bob = empathy_message_block_intern_sender (block, "bob@example.com",
+      "Bob", FALSE);
+
+  fail_if (alice == NULL);
+  fail_if (alice == bob);
+  fail_if (alice != empathy_message_block_intern_sender (block,
+        "alice@example.com", "Alice", FALSE));
+  /* Renamed, or ourself, makes another contact */
+  fail_if (alice == empathy_message_block_intern_sender (block,
+        "alice@example.com", "Alice2", FALSE));
+  fail_if (alice == empathy_message_block_intern_sender (block,
+        "alice@example.com", "Alice", TRUE));
+
+  fail_if (tp_strdiff (empathy_contact_get_id (alice), "alice@example.com"));
+  fail_if (tp_strdiff (empathy_contact_get_name (bob), "Bob"));
+
+  empathy_message_block_unref (block);
+}
+END_TEST
+
+START_TEST (test_empathy_message_block_append)
+{
+  EmpathyMessageBlock *block;
+  EmpathyContact *alice;
+  EmpathyMessage *message;
+  EmpathyMessageRecord *record;
+  const EmpathyMessageRecord *got;
+  gchar body[32];
+  guint i;
+
+  block = empathy_message_block_new (NULL);
+  alice = empathy_message_block_intern_sender (block, "alice@example.com",
+      "Alice", FALSE);
+
+  /* Enough to need a few slabs */
+  for (i = 0; i < 1000; i++)
+    {
+      g_snprintf (body, sizeof (body), "message %u", i);
+      record = empathy_message_block_append (block, alice, body, 1000 + i,
+          TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL);
+      record->id = i;
+    }
+
+  /* The body was copied */
+  strcpy (body, "overwritten");
+
+  fail_if (empathy_message_block_get_length (block) != 1000);
+
+  for (i = 0; i < 1000; i++)
+    {
+      g_snprintf (body, sizeof (body), "message %u", i);
+      got = empathy_message_block_get (block, i);
+      fail_if (tp_strdiff (got->body, body));
+      fail_if (got->sender != alice);
+      fail_if (got->timestamp != 1000 + i);
+      fail_if (got->id != i);
+    }
+
+  message = empathy_message_block_dup_message (block, 999);
+  fail_if (tp_strdiff (empathy_message_get_body (message), "message 999"));
+  fail_if (empathy_message_get_sender (message) != alice);
+  fail_if (empathy_message_get_timestamp (message) != 1999);
+  fail_if (empathy_message_get_id (message) != 999);
+
+  /* The message keeps the sender alive */
+  empathy_message_block_unref (block);
+  fail_if (tp_strdiff (empathy_contact_get_id (
+        empathy_message_get_sender (message)), "alice@example.com"));
+  g_object_unref (message);
+}
+END_TEST
+
+TCase *
+make_empathy_message_block_tcase (void)
+{
+    TCase *tc = tcase_create ("empathy-message-block");
+    tcase_add_test (tc, test_empathy_message_block_intern);
+    tcase_add_test (tc, test_empathy_message_block_append);
+    return tc;
+}
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+#include "check-helpers.h"
+#include "check-libempathy.h"
+
+#include <libempathy/empathy-time.h>
+
+START_TEST (test_empathy_time_parse)
+{
+  fail_if (empathy_time_parse ("20091020T12:34:56") != 1256042096);
+  fail_if (empathy_time_parse ("20091020") != 1255996800);
+  fail_if (empathy_time_parse ("19700101T00:00:00") != 0);
+
+  /* Not exactly the log format, left to sscanf () */
+  fail_if (empathy_time_parse ("20091020 12:34:56") != 1255996800);
+  fail_if (empathy_time_parse ("garbage") != 0);
+}
+END_TEST
+
+START_TEST (test_empathy_time_to_string_log)
+{
+  gchar *str;
+  time_t t;
+
+  str = empathy_time_to_string_log (1256042096);
+  fail_if (str == NULL || strcmp (str, "20091020T12:34:56") != 0);
+  g_free (str);
+
+  /* Same output as strftime () */
+  for (t = 0; t < 2000000000; t += 86399 * 37)
+    {
+      gchar *expected;
+
+      str = empathy_time_to_string_log (t);
+      expected = empathy_time_to_string_utc (t, EMPATHY_TIME_FORMAT_LOG);
+      fail_if (strcmp (str, expected) != 0);
+      fail_if (empathy_time_parse (str) != t);
+      g_free (expected);
+      g_free (str);
+    }
+}
+END_TEST
+
+START_TEST (test_empathy_time_cache)
+{
+  EmpathyTimeCache *cache;
+  gchar *expected;
+  const gchar *str;
+
+  cache = empathy_time_cache_new ();
+
+  expected = empathy_time_to_string_local (1256042096, "%H:%M");
+  str = empathy_time_cache_to_string_local (cache, 1256042096, "%H:%M");
+  fail_if (strcmp (str, expected) != 0);
+  /* Same minute, same string */
+  str = empathy_time_cache_to_string_local (cache, 1256042099, "%H:%M");
+  fail_if (strcmp (str, expected) != 0);
+  g_free (expected);
+
+  /* Seconds are shown, so they count */
+  str = empathy_time_cache_to_string_local (cache, 1256042099, "%H:%M:%S");
+  expected = empathy_time_to_string_local (1256042099, "%H:%M:%S");
+  fail_if (strcmp (str, expected) != 0);
+  g_free (expected);
+
+  empathy_time_cache_free (cache);
+}
+END_TEST
+
+TCase *
+make_empathy_time_tcase (void)
+{
+    TCase *tc = tcase_create ("empathy-time");
+    tcase_add_test (tc, test_empathy_time_parse);
+    tcase_add_test (tc, test_empathy_time_to_string_log);
+    tcase_add_test (tc, test_empathy_time_cache);
+    return tc;
+}
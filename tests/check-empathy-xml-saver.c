@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <check.h>
+#include "check-helpers.h"
+#include "check-libempathy.h"
+#include "check-empathy-helpers.h"
+
+#include <libempathy/empathy-xml-saver.h>
+
+#define SAVER_FILE "xml-saver-test.xml"
+
+static xmlDocPtr
+build_doc (gpointer user_data)
+{
+  guint *n_builds = user_data;
+  xmlDocPtr doc;
+  xmlNodePtr root;
+
+  (*n_builds)++;
+
+  doc = xmlNewDoc ("1.0");
+  root = xmlNewNode (NULL, "test");
+  xmlDocSetRootElement (doc, root);
+  xmlNewTextChild (root, NULL, "builds", "yes");
+
+  return doc;
+}
+
+static void
+check_saved (const gchar *file)
+{
+  gchar *contents;
+
+  fail_unless (g_file_get_contents (file, &contents, NULL, NULL));
+  fail_if (strstr (contents, "<builds>yes</builds>") == NULL);
+  g_free (contents);
+}
+
+START_TEST (test_empathy_xml_saver_flush)
+{
+  EmpathyXmlSaver *saver;
+  gchar *file;
+  guint n_builds = 0;
+
+  file = get_user_xml_file (SAVER_FILE);
+  g_unlink (file);
+
+  saver = empathy_xml_saver_new (file, 60, build_doc, &n_builds);
+
+  /* Nothing queued, nothing written */
+  empathy_xml_saver_flush (saver);
+  fail_if (n_builds != 0);
+  fail_if (g_file_test (file, G_FILE_TEST_EXISTS));
+
+  /* A burst of changes is written once */
+  empathy_xml_saver_queue (saver);
+  empathy_xml_saver_queue (saver);
+  empathy_xml_saver_queue (saver);
+  empathy_xml_saver_flush (saver);
+  fail_if (n_builds != 1);
+  check_saved (file);
+
+  empathy_xml_saver_free (saver);
+  fail_if (n_builds != 1);
+
+  g_unlink (file);
+  g_free (file);
+}
+END_TEST
+
+START_TEST (test_empathy_xml_saver_timeout)
+{
+  EmpathyXmlSaver *saver;
+  gchar *file;
+  guint n_builds = 0;
+
+  file = get_user_xml_file (SAVER_FILE);
+  g_unlink (file);
+
+  /* No delay: the save runs from the main loop, without waiting for real
+   * time to pass */
+  saver = empathy_xml_saver_new (file, 0, build_doc, &n_builds);
+
+  empathy_xml_saver_queue (saver);
+  empathy_xml_saver_queue (saver);
+  fail_if (n_builds != 0);
+
+  while (n_builds == 0)
+    g_main_context_iteration (NULL, TRUE);
+
+  fail_if (n_builds != 1);
+
+  /* The write already started, freeing waits for it without building the
+   * document again */
+  empathy_xml_saver_free (saver);
+  fail_if (n_builds != 1);
+  check_saved (file);
+
+  g_unlink (file);
+  g_free (file);
+}
+END_TEST
+
+TCase *
+make_empathy_xml_saver_tcase (void)
+{
+    TCase *tc = tcase_create ("empathy-xml-saver");
+    tcase_add_test (tc, test_empathy_xml_saver_flush);
+    tcase_add_test (tc, test_empathy_xml_saver_timeout);
+    return tc;
+}
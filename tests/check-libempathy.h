@@ -7,5 +7,10 @@ TCase * make_empathy_irc_network_tcase (void);
 TCase * make_empathy_irc_network_manager_tcase (void);
 TCase * make_empathy_chatroom_tcase (void);
 TCase * make_empathy_chatroom_manager_tcase (void);
+TCase * make_empathy_contact_search_tcase (void);
+TCase * make_empathy_xml_saver_tcase (void);
+TCase * make_empathy_footprint_tcase (void);
+TCase * make_empathy_message_block_tcase (void);
+TCase * make_empathy_time_tcase (void);
 
 #endif /* #ifndef __CHECK_LIBEMPATHY__ */
@@ -22,6 +22,11 @@ make_libempathy_suite (void)
     suite_add_tcase (s, make_empathy_irc_network_manager_tcase ());
     suite_add_tcase (s, make_empathy_chatroom_tcase ());
     suite_add_tcase (s, make_empathy_chatroom_manager_tcase ());
+    suite_add_tcase (s, make_empathy_contact_search_tcase ());
+    suite_add_tcase (s, make_empathy_xml_saver_tcase ());
+    suite_add_tcase (s, make_empathy_footprint_tcase ());
+    suite_add_tcase (s, make_empathy_message_block_tcase ());
+    suite_add_tcase (s, make_empathy_time_tcase ());
 
     return s;
 }
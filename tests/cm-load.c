@@ -0,0 +1,820 @@
+/*
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Drives a StandInConnection through a roster download, a presence storm,
+ * a batch of busy chat rooms and a pile of file transfer offers, and reports
+ * how long EmpathyContactManager, EmpathyDispatcher, EmpathyTpChat and
+ * EmpathyLogManager needed to keep up. As in dispatcher-stress, the
+ * connection lives in a child process so its own cost doesn't show up in
+ * the numbers. Run it on a private bus:
+ *
+ *   make -C tests load
+ *   tools/with-session-bus.sh --session -- tests/cm-load --contacts=20000
+ *
+ * Messages are logged with the account of the "test" Mission Control
+ * profile, in the --log-dir directory or a temporary one removed at exit.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <telepathy-glib/connection.h>
+#include <telepathy-glib/dbus.h>
+#include <telepathy-glib/interfaces.h>
+
+#include <libmissioncontrol/mc-account.h>
+#include <libmissioncontrol/mc-profile.h>
+
+#include <libempathy/empathy-account-manager.h>
+#include <libempathy/empathy-contact-manager.h>
+#include <libempathy/empathy-debug.h>
+#include <libempathy/empathy-dispatcher.h>
+#include <libempathy/empathy-log-store-empathy.h>
+#include <libempathy/empathy-time.h>
+#include <libempathy/empathy-tp-chat.h>
+
+#include "stand-in-connection.h"
+
+#define TIMEOUT 600
+
+static gint n_contacts = 5000;
+static gint n_groups = 20;
+static gint n_presence_changes = 20000;
+static gint presence_batch = 100;
+static gint n_rooms = 50;
+static gint n_members = 100;
+static gint n_messages = 10000;
+static gint message_rate = 1000;
+static gint n_files = 500;
+static gchar *log_dir = NULL;
+
+static GOptionEntry entries[] = {
+  { "contacts", 0, 0, G_OPTION_ARG_INT, &n_contacts,
+    "Contacts in the roster", "N" },
+  { "groups", 0, 0, G_OPTION_ARG_INT, &n_groups,
+    "Groups the roster is spread over", "N" },
+  { "presence-changes", 0, 0, G_OPTION_ARG_INT, &n_presence_changes,
+    "Presence changes in the storm", "N" },
+  { "presence-batch", 0, 0, G_OPTION_ARG_INT, &presence_batch,
+    "Presence changes per PresencesChanged signal", "N" },
+  { "rooms", 0, 0, G_OPTION_ARG_INT, &n_rooms,
+    "Chat rooms to join", "N" },
+  { "members", 0, 0, G_OPTION_ARG_INT, &n_members,
+    "Members of each room", "N" },
+  { "messages", 0, 0, G_OPTION_ARG_INT, &n_messages,
+    "Messages sent to the rooms", "N" },
+  { "rate", 0, 0, G_OPTION_ARG_INT, &message_rate,
+    "Messages per second, 0 to send them all at once", "N" },
+  { "files", 0, 0, G_OPTION_ARG_INT, &n_files,
+    "File transfers offered", "N" },
+  { "log-dir", 0, 0, G_OPTION_ARG_FILENAME, &log_dir,
+    "Keep the logs there instead of in a temporary directory", "DIR" },
+  { NULL }
+};
+
+/* Connection manager side */
+
+static gboolean
+cm_command_cb (GIOChannel *source,
+    GIOCondition condition,
+    gpointer user_data)
+{
+  StandInConnection *conn = STAND_IN_CONNECTION (user_data);
+  gchar *line = NULL;
+  guint a, b;
+
+  if (g_io_channel_read_line (source, &line, NULL, NULL, NULL) !=
+      G_IO_STATUS_NORMAL)
+    {
+      tp_base_connection_change_status (TP_BASE_CONNECTION (conn),
+          TP_CONNECTION_STATUS_DISCONNECTED,
+          TP_CONNECTION_STATUS_REASON_REQUESTED);
+      return FALSE;
+    }
+
+  if (sscanf (line, "roster %u %u", &a, &b) == 2)
+    stand_in_connection_add_roster (conn, a, b);
+  else if (sscanf (line, "presence %u %u", &a, &b) == 2)
+    stand_in_connection_change_presences (conn, a, b);
+  else if (sscanf (line, "rooms %u %u", &a, &b) == 2)
+    stand_in_connection_open_rooms (conn, a, b);
+  else if (sscanf (line, "messages %u %u", &a, &b) == 2)
+    stand_in_connection_receive_messages (conn, a, b);
+  else if (sscanf (line, "files %u", &a) == 1)
+    stand_in_connection_offer_files (conn, a);
+  else if (g_str_has_prefix (line, "close"))
+    stand_in_connection_close_channels (conn);
+
+  g_free (line);
+
+  return TRUE;
+}
+
+static void
+cm_shutdown_finished_cb (TpBaseConnection *conn,
+    GMainLoop *loop)
+{
+  g_main_loop_quit (loop);
+}
+
+static int
+run_connection_manager (int command_fd,
+    int reply_fd)
+{
+  StandInConnection *conn;
+  GMainLoop *loop;
+  GIOChannel *commands;
+  gchar *bus_name, *object_path, *reply;
+  GError *error = NULL;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  conn = stand_in_connection_new ("self@stand-in");
+  g_signal_connect (conn, "shutdown-finished",
+      G_CALLBACK (cm_shutdown_finished_cb), loop);
+
+  if (!tp_base_connection_register (TP_BASE_CONNECTION (conn), "standin",
+        &bus_name, &object_path, &error))
+    {
+      g_printerr ("Couldn't register the connection: %s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  reply = g_strdup_printf ("%s %s\n", bus_name, object_path);
+  if (write (reply_fd, reply, strlen (reply)) < 0)
+    return EXIT_FAILURE;
+
+  g_free (reply);
+  g_free (bus_name);
+  g_free (object_path);
+  close (reply_fd);
+
+  commands = g_io_channel_unix_new (command_fd);
+  g_io_add_watch (commands, G_IO_IN | G_IO_HUP, cm_command_cb, conn);
+
+  g_main_loop_run (loop);
+
+  g_io_channel_unref (commands);
+  g_object_unref (conn);
+  g_main_loop_unref (loop);
+
+  return EXIT_SUCCESS;
+}
+
+/* Client side */
+
+typedef enum {
+  PHASE_CONNECTING,
+  PHASE_ROSTER,
+  PHASE_PRESENCE,
+  PHASE_ROOMS,
+  PHASE_MESSAGES,
+  PHASE_FILES,
+  PHASE_DONE,
+} Phase;
+
+static const gchar *phase_names[] = {
+  "connecting",
+  "roster",
+  "presence",
+  "rooms",
+  "messages",
+  "files",
+  "done",
+};
+
+typedef struct {
+  GMainLoop *loop;
+  int command_fd;
+  Phase phase;
+  guint expected;
+  guint count;
+  struct rusage start_usage;
+  gint64 start_time;
+  /* EmpathyContact -> itself, the roster seen so far */
+  GHashTable *roster;
+  /* EmpathyTpChat, the rooms we're in */
+  GPtrArray *rooms;
+  /* gint64, usec between sending and message-received */
+  GArray *latencies;
+  EmpathyLogStore *log_store;
+  EmpathyAccount *account;
+  /* sender id -> EmpathyContact for the logs */
+  GHashTable *log_senders;
+  gint64 log_usec;
+  gboolean success;
+} LoadData;
+
+static void load_next_phase (LoadData *data);
+
+static gdouble
+timeval_to_seconds (const struct timeval *tv)
+{
+  return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void
+load_send_command (LoadData *data,
+    const gchar *format,
+    ...)
+{
+  va_list args;
+  gchar *command;
+
+  va_start (args, format);
+  command = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  if (write (data->command_fd, command, strlen (command)) < 0)
+    g_error ("Lost the connection manager");
+
+  g_free (command);
+}
+
+static void
+load_start_phase (LoadData *data,
+    Phase phase,
+    guint expected)
+{
+  data->phase = phase;
+  data->expected = expected;
+  data->count = 0;
+  getrusage (RUSAGE_SELF, &data->start_usage);
+  data->start_time = empathy_time_get_monotonic ();
+}
+
+static void
+load_end_phase (LoadData *data)
+{
+  struct rusage usage;
+  gdouble user, sys, wall;
+
+  getrusage (RUSAGE_SELF, &usage);
+  wall = (empathy_time_get_monotonic () - data->start_time) / 1e6;
+  user = timeval_to_seconds (&usage.ru_utime) -
+      timeval_to_seconds (&data->start_usage.ru_utime);
+  sys = timeval_to_seconds (&usage.ru_stime) -
+      timeval_to_seconds (&data->start_usage.ru_stime);
+
+  g_print ("%s %u events: %.3f s cpu (%.3f user, %.3f sys), "
+      "%.3f s wall, %.0f events/s, %.1f us cpu per event\n",
+      phase_names[data->phase], data->count, user + sys, user, sys, wall,
+      wall > 0 ? data->count / wall : 0,
+      data->count > 0 ? (user + sys) * 1e6 / data->count : 0);
+}
+
+/* Counts one event of the current phase and moves on once they are all in.
+ * Later events, duplicates from signals we can't tell apart, are ignored. */
+static void
+load_count (LoadData *data,
+    Phase phase)
+{
+  if (data->phase != phase)
+    return;
+
+  if (++data->count < data->expected)
+    return;
+
+  load_end_phase (data);
+  load_next_phase (data);
+}
+
+static gint
+compare_gint64 (gconstpointer a,
+    gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void
+load_report_messages (LoadData *data)
+{
+  GArray *latencies = data->latencies;
+
+  if (latencies->len == 0)
+    return;
+
+  g_array_sort (latencies, compare_gint64);
+  g_print ("message latency: %.3f ms median, %.3f ms 95th percentile, "
+      "%.3f ms max\n",
+      g_array_index (latencies, gint64, latencies->len / 2) / 1e3,
+      g_array_index (latencies, gint64, latencies->len * 95 / 100) / 1e3,
+      g_array_index (latencies, gint64, latencies->len - 1) / 1e3);
+
+  if (data->log_store != NULL)
+    g_print ("log store: %.1f us per message\n",
+        (gdouble) data->log_usec / latencies->len);
+}
+
+static void
+load_next_phase (LoadData *data)
+{
+  switch (data->phase)
+    {
+      case PHASE_CONNECTING:
+        load_start_phase (data, PHASE_ROSTER, n_contacts);
+        load_send_command (data, "roster %u %u\n", n_contacts, n_groups);
+        break;
+      case PHASE_ROSTER:
+        load_start_phase (data, PHASE_PRESENCE, n_presence_changes);
+        load_send_command (data, "presence %u %u\n", n_presence_changes,
+            presence_batch);
+        break;
+      case PHASE_PRESENCE:
+        /* Each room member shows up once per room */
+        load_start_phase (data, PHASE_ROOMS, n_rooms * n_members);
+        load_send_command (data, "rooms %u %u\n", n_rooms, n_members);
+        break;
+      case PHASE_ROOMS:
+        load_start_phase (data, PHASE_MESSAGES, n_messages);
+        load_send_command (data, "messages %u %u\n", n_messages,
+            message_rate);
+        break;
+      case PHASE_MESSAGES:
+        load_report_messages (data);
+        load_start_phase (data, PHASE_FILES, n_files);
+        load_send_command (data, "files %u\n", n_files);
+        break;
+      case PHASE_FILES:
+        data->phase = PHASE_DONE;
+        data->success = TRUE;
+        g_main_loop_quit (data->loop);
+        return;
+      case PHASE_DONE:
+        return;
+    }
+
+  /* Nothing to wait for in this phase, skip it */
+  if (data->expected == 0)
+    load_next_phase (data);
+}
+
+static void
+load_presence_changed_cb (EmpathyContact *contact,
+    GParamSpec *pspec,
+    LoadData *data)
+{
+  load_count (data, PHASE_PRESENCE);
+}
+
+static void
+load_roster_changed_cb (EmpathyContactList *list,
+    GPtrArray *added,
+    GPtrArray *removed,
+    EmpathyContact *actor,
+    guint reason,
+    gchar *message,
+    LoadData *data)
+{
+  guint i;
+
+  for (i = 0; added != NULL && i < added->len; i++)
+    {
+      EmpathyContact *contact = g_ptr_array_index (added, i);
+
+      /* The same contact is in several lists */
+      if (g_hash_table_lookup (data->roster, contact) != NULL)
+        continue;
+
+      g_hash_table_insert (data->roster, g_object_ref (contact), contact);
+      g_signal_connect (contact, "notify::presence",
+          G_CALLBACK (load_presence_changed_cb), data);
+
+      load_count (data, PHASE_ROSTER);
+    }
+}
+
+static void
+load_room_members_changed_cb (EmpathyTpChat *chat,
+    GPtrArray *added,
+    GPtrArray *removed,
+    EmpathyContact *actor,
+    guint reason,
+    gchar *message,
+    LoadData *data)
+{
+  guint i;
+
+  for (i = 0; added != NULL && i < added->len; i++)
+    if (!empathy_contact_is_user (g_ptr_array_index (added, i)))
+      load_count (data, PHASE_ROOMS);
+}
+
+static EmpathyContact *
+load_get_log_sender (LoadData *data,
+    EmpathyContact *sender)
+{
+  EmpathyContact *log_sender;
+  const gchar *id = empathy_contact_get_id (sender);
+
+  /* The stand-in connection isn't a Mission Control account, give the log
+   * manager a contact which has one */
+  log_sender = g_hash_table_lookup (data->log_senders, id);
+  if (log_sender == NULL)
+    {
+      log_sender = empathy_contact_new_for_log (data->account, id,
+          empathy_contact_get_name (sender), FALSE);
+      g_hash_table_insert (data->log_senders, g_strdup (id), log_sender);
+    }
+
+  return log_sender;
+}
+
+static void
+load_message_received_cb (EmpathyTpChat *chat,
+    EmpathyMessage *message,
+    LoadData *data)
+{
+  gint64 now = empathy_time_get_monotonic ();
+  gint64 sent;
+  guint seq;
+
+  if (sscanf (empathy_message_get_body (message), STAND_IN_MESSAGE_FORMAT,
+        &seq, &sent) == 2)
+    {
+      gint64 latency = now - sent;
+
+      g_array_append_val (data->latencies, latency);
+    }
+
+  if (data->log_store != NULL)
+    {
+      EmpathyMessage *log_message;
+      gint64 start;
+
+      log_message = empathy_message_new (empathy_message_get_body (message));
+      empathy_message_set_sender (log_message,
+          load_get_log_sender (data, empathy_message_get_sender (message)));
+      empathy_message_set_timestamp (log_message,
+          empathy_message_get_timestamp (message));
+
+      start = empathy_time_get_monotonic ();
+      empathy_log_store_add_message (data->log_store,
+          empathy_tp_chat_get_id (chat), TRUE, log_message, NULL);
+      data->log_usec += empathy_time_get_monotonic () - start;
+
+      g_object_unref (log_message);
+    }
+
+  /* As the chat window would, so the pending list doesn't grow */
+  empathy_tp_chat_acknowledge_message (chat, message);
+
+  load_count (data, PHASE_MESSAGES);
+}
+
+static void
+load_observe_cb (EmpathyDispatcher *dispatcher,
+    EmpathyDispatchOperation *operation,
+    LoadData *data)
+{
+  GQuark channel_type;
+  TpHandleType handle_type;
+
+  channel_type = empathy_dispatch_operation_get_channel_type_id (operation);
+  tp_channel_get_handle (empathy_dispatch_operation_get_channel (operation),
+      &handle_type);
+
+  if (channel_type == TP_IFACE_QUARK_CHANNEL_TYPE_FILE_TRANSFER)
+    {
+      load_count (data, PHASE_FILES);
+    }
+  else if (channel_type == TP_IFACE_QUARK_CHANNEL_TYPE_TEXT &&
+      handle_type == TP_HANDLE_TYPE_ROOM)
+    {
+      EmpathyTpChat *chat = EMPATHY_TP_CHAT (
+          empathy_dispatch_operation_get_channel_wrapper (operation));
+
+      g_ptr_array_add (data->rooms, g_object_ref (chat));
+      g_signal_connect (chat, "members-changed-bulk",
+          G_CALLBACK (load_room_members_changed_cb), data);
+      g_signal_connect (chat, "message-received",
+          G_CALLBACK (load_message_received_cb), data);
+    }
+}
+
+static void
+load_approve_cb (EmpathyDispatcher *dispatcher,
+    EmpathyDispatchOperation *operation,
+    LoadData *data)
+{
+  empathy_dispatch_operation_approve (operation);
+}
+
+static void
+load_dispatch_cb (EmpathyDispatcher *dispatcher,
+    EmpathyDispatchOperation *operation,
+    LoadData *data)
+{
+  /* Act like a handler so the channel ends up in the dispatched set */
+  empathy_dispatch_operation_claim (operation);
+}
+
+static void
+load_requests_got_all_cb (TpProxy *proxy,
+    GHashTable *properties,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  LoadData *data = user_data;
+
+  /* The dispatcher's NewChannels match rule went out before this call, so
+   * it is in place by the time we get the reply */
+  if (error != NULL)
+    {
+      g_printerr ("Couldn't get the Requests properties: %s\n",
+          error->message);
+      g_main_loop_quit (data->loop);
+      return;
+    }
+
+  load_next_phase (data);
+}
+
+static void
+load_connection_ready_cb (TpConnection *connection,
+    const GError *error,
+    gpointer user_data)
+{
+  LoadData *data = user_data;
+  EmpathyAccountManager *account_manager;
+
+  if (error != NULL)
+    {
+      g_printerr ("Connection failed: %s\n", error->message);
+      g_main_loop_quit (data->loop);
+      return;
+    }
+
+  /* Pretend Mission Control told us about the connection */
+  account_manager = empathy_account_manager_dup_singleton ();
+  g_signal_emit_by_name (account_manager, "new-connection", connection);
+  g_object_unref (account_manager);
+
+  tp_cli_dbus_properties_call_get_all (connection, -1,
+      TP_IFACE_CONNECTION_INTERFACE_REQUESTS,
+      load_requests_got_all_cb, data, NULL, NULL);
+}
+
+static gboolean
+load_timeout_cb (gpointer user_data)
+{
+  LoadData *data = user_data;
+
+  g_printerr ("Timed out in the %s phase: %u of %u events\n",
+      phase_names[data->phase], data->count, data->expected);
+  g_main_loop_quit (data->loop);
+
+  return FALSE;
+}
+
+static EmpathyAccount *
+load_get_account (void)
+{
+  McProfile *profile;
+  EmpathyAccountManager *account_manager;
+  EmpathyAccount *account;
+  GList *accounts;
+
+  profile = mc_profile_lookup ("test");
+  if (profile == NULL)
+    return NULL;
+
+  account_manager = empathy_account_manager_dup_singleton ();
+  accounts = mc_accounts_list_by_profile (profile);
+
+  if (accounts == NULL)
+    {
+      account = empathy_account_manager_create (account_manager, profile);
+    }
+  else
+    {
+      account = empathy_account_manager_lookup (account_manager,
+          mc_account_get_unique_name (accounts->data));
+    }
+
+  mc_accounts_list_free (accounts);
+  g_object_unref (account_manager);
+  g_object_unref (profile);
+
+  return account;
+}
+
+static void
+load_remove_dir (const gchar *path)
+{
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          gchar *child = g_build_filename (path, name, NULL);
+
+          if (g_file_test (child, G_FILE_TEST_IS_DIR))
+            load_remove_dir (child);
+          else
+            g_unlink (child);
+
+          g_free (child);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_rmdir (path);
+}
+
+static int
+run_client (int command_fd,
+    int reply_fd)
+{
+  LoadData data = { NULL, };
+  EmpathyDispatcher *dispatcher;
+  EmpathyContactManager *contact_manager;
+  TpDBusDaemon *dbus;
+  TpConnection *connection;
+  FILE *reply;
+  gchar bus_name[256], object_path[256];
+  gchar *tmp_dir = NULL;
+  GError *error = NULL;
+
+  reply = fdopen (reply_fd, "r");
+  if (reply == NULL || fscanf (reply, "%255s %255s", bus_name,
+        object_path) != 2)
+    {
+      g_printerr ("The connection manager didn't start\n");
+      return EXIT_FAILURE;
+    }
+  fclose (reply);
+
+  if (log_dir == NULL)
+    {
+      tmp_dir = g_build_filename (g_get_tmp_dir (), "cm-load-XXXXXX", NULL);
+      if (mkdtemp (tmp_dir) == NULL)
+        {
+          g_printerr ("Couldn't create a log directory\n");
+          return EXIT_FAILURE;
+        }
+    }
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.command_fd = command_fd;
+  data.phase = PHASE_CONNECTING;
+  data.roster = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      g_object_unref, NULL);
+  data.rooms = g_ptr_array_new ();
+  data.latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  data.log_senders = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_object_unref);
+
+  data.account = load_get_account ();
+  /* The same store as the log manager's, kept out of the user's logs */
+  if (data.account != NULL)
+    data.log_store = g_object_new (EMPATHY_TYPE_LOG_STORE_EMPATHY,
+        "basedir", log_dir != NULL ? log_dir : tmp_dir,
+        NULL);
+  else
+    g_printerr ("No \"test\" profile, set MC_PROFILE_DIR to tests/ to "
+        "measure the log store\n");
+
+  contact_manager = empathy_contact_manager_dup_singleton ();
+  g_signal_connect (contact_manager, "members-changed-bulk",
+      G_CALLBACK (load_roster_changed_cb), &data);
+
+  dispatcher = empathy_dispatcher_dup_singleton ();
+  g_signal_connect (dispatcher, "observe",
+      G_CALLBACK (load_observe_cb), &data);
+  g_signal_connect (dispatcher, "approve",
+      G_CALLBACK (load_approve_cb), &data);
+  g_signal_connect (dispatcher, "dispatch",
+      G_CALLBACK (load_dispatch_cb), &data);
+
+  dbus = tp_dbus_daemon_new (tp_get_bus ());
+  connection = tp_connection_new (dbus, bus_name, object_path, &error);
+  if (connection == NULL)
+    {
+      g_printerr ("Couldn't create the connection: %s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  tp_cli_connection_call_connect (connection, -1, NULL, NULL, NULL, NULL);
+  tp_connection_call_when_ready (connection, load_connection_ready_cb,
+      &data);
+  g_timeout_add_seconds (TIMEOUT, load_timeout_cb, &data);
+
+  g_main_loop_run (data.loop);
+
+  g_ptr_array_foreach (data.rooms, (GFunc) g_object_unref, NULL);
+  g_ptr_array_free (data.rooms, TRUE);
+  g_hash_table_destroy (data.roster);
+  g_hash_table_destroy (data.log_senders);
+  g_array_free (data.latencies, TRUE);
+  if (data.log_store != NULL)
+    g_object_unref (data.log_store);
+  if (data.account != NULL)
+    g_object_unref (data.account);
+
+  g_object_unref (connection);
+  g_object_unref (dbus);
+  g_object_unref (dispatcher);
+  g_object_unref (contact_manager);
+  g_main_loop_unref (data.loop);
+
+  if (tmp_dir != NULL)
+    {
+      load_remove_dir (tmp_dir);
+      g_free (tmp_dir);
+    }
+
+  return data.success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  GOptionContext *context;
+  int command_pipe[2], reply_pipe[2];
+  pid_t pid;
+  int ret;
+  GError *error = NULL;
+
+  context = g_option_context_new ("- load Empathy with a stand-in "
+      "connection manager");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free (context);
+
+  n_contacts = MAX (n_contacts, 0);
+  n_groups = MAX (n_groups, 0);
+  n_presence_changes = n_contacts > 0 ? MAX (n_presence_changes, 0) : 0;
+  n_rooms = MAX (n_rooms, 0);
+  n_members = MAX (n_members, 0);
+  n_messages = n_rooms > 0 ? MAX (n_messages, 0) : 0;
+  message_rate = MAX (message_rate, 0);
+  n_files = MAX (n_files, 0);
+
+  /* Fork before anything touches D-Bus, both sides need their own
+   * connection to the bus */
+  if (pipe (command_pipe) < 0 || pipe (reply_pipe) < 0)
+    return EXIT_FAILURE;
+
+  pid = fork ();
+  if (pid < 0)
+    return EXIT_FAILURE;
+
+  g_type_init ();
+  empathy_debug_set_flags (g_getenv ("EMPATHY_DEBUG"));
+
+  if (pid == 0)
+    {
+      close (command_pipe[1]);
+      close (reply_pipe[0]);
+      return run_connection_manager (command_pipe[0], reply_pipe[1]);
+    }
+
+  close (command_pipe[0]);
+  close (reply_pipe[1]);
+  ret = run_client (command_pipe[1], reply_pipe[0]);
+
+  /* The connection manager disconnects and exits on EOF */
+  close (command_pipe[1]);
+  waitpid (pid, NULL, 0);
+
+  return ret;
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Opens and then closes a large number of incoming text channels on a
+ * StandInConnection and reports how much CPU the dispatcher needed to see
+ * them all come and go. The connection lives in a child process so its own
+ * cost doesn't show up in the numbers. Run it on a private bus:
+ *
+ *   make -C tests stress
+ *   tools/with-session-bus.sh --session -- tests/dispatcher-stress [n]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <telepathy-glib/connection.h>
+#include <telepathy-glib/dbus.h>
+#include <telepathy-glib/interfaces.h>
+
+#include <libempathy/empathy-account-manager.h>
+#include <libempathy/empathy-debug.h>
+#include <libempathy/empathy-dispatcher.h>
+#include <libempathy/empathy-time.h>
+
+#include "stand-in-connection.h"
+
+#define DEFAULT_N_CHANNELS 10000
+#define TIMEOUT 300
+
+/* Connection manager side */
+
+static gboolean
+cm_command_cb (GIOChannel *source,
+    GIOCondition condition,
+    gpointer user_data)
+{
+  StandInConnection *conn = STAND_IN_CONNECTION (user_data);
+  gchar *line = NULL;
+  guint n;
+
+  if (g_io_channel_read_line (source, &line, NULL, NULL, NULL) !=
+      G_IO_STATUS_NORMAL)
+    {
+      tp_base_connection_change_status (TP_BASE_CONNECTION (conn),
+          TP_CONNECTION_STATUS_DISCONNECTED,
+          TP_CONNECTION_STATUS_REASON_REQUESTED);
+      return FALSE;
+    }
+
+  if (sscanf (line, "open %u", &n) == 1)
+    stand_in_connection_open_channels (conn, n);
+  else if (g_str_has_prefix (line, "close"))
+    stand_in_connection_close_channels (conn);
+
+  g_free (line);
+
+  return TRUE;
+}
+
+static void
+cm_shutdown_finished_cb (TpBaseConnection *conn,
+    GMainLoop *loop)
+{
+  g_main_loop_quit (loop);
+}
+
+static int
+run_connection_manager (int command_fd,
+    int reply_fd)
+{
+  StandInConnection *conn;
+  GMainLoop *loop;
+  GIOChannel *commands;
+  gchar *bus_name, *object_path, *reply;
+  GError *error = NULL;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  conn = stand_in_connection_new ("self@stand-in");
+  g_signal_connect (conn, "shutdown-finished",
+      G_CALLBACK (cm_shutdown_finished_cb), loop);
+
+  if (!tp_base_connection_register (TP_BASE_CONNECTION (conn), "standin",
+        &bus_name, &object_path, &error))
+    {
+      g_printerr ("Couldn't register the connection: %s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  reply = g_strdup_printf ("%s %s\n", bus_name, object_path);
+  if (write (reply_fd, reply, strlen (reply)) < 0)
+    return EXIT_FAILURE;
+
+  g_free (reply);
+  g_free (bus_name);
+  g_free (object_path);
+  close (reply_fd);
+
+  commands = g_io_channel_unix_new (command_fd);
+  g_io_add_watch (commands, G_IO_IN | G_IO_HUP, cm_command_cb, conn);
+
+  g_main_loop_run (loop);
+
+  g_io_channel_unref (commands);
+  g_object_unref (conn);
+  g_main_loop_unref (loop);
+
+  return EXIT_SUCCESS;
+}
+
+/* Client side */
+
+typedef enum {
+  PHASE_CONNECTING,
+  PHASE_OPENING,
+  PHASE_CLOSING,
+} Phase;
+
+typedef struct {
+  GMainLoop *loop;
+  int command_fd;
+  guint n_channels;
+  Phase phase;
+  guint observed;
+  guint closed;
+  struct rusage start_usage;
+  gint64 start_time;
+  gboolean success;
+} StressData;
+
+static gdouble
+timeval_to_seconds (const struct timeval *tv)
+{
+  return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void
+stress_send_command (StressData *data,
+    const gchar *command)
+{
+  if (write (data->command_fd, command, strlen (command)) < 0)
+    g_error ("Lost the connection manager");
+}
+
+static void
+stress_start_phase (StressData *data,
+    Phase phase)
+{
+  data->phase = phase;
+  getrusage (RUSAGE_SELF, &data->start_usage);
+  data->start_time = empathy_time_get_monotonic ();
+}
+
+static void
+stress_end_phase (StressData *data,
+    const gchar *what)
+{
+  struct rusage usage;
+  gdouble user, sys, wall;
+
+  getrusage (RUSAGE_SELF, &usage);
+  wall = (empathy_time_get_monotonic () - data->start_time) / 1e6;
+  user = timeval_to_seconds (&usage.ru_utime) -
+      timeval_to_seconds (&data->start_usage.ru_utime);
+  sys = timeval_to_seconds (&usage.ru_stime) -
+      timeval_to_seconds (&data->start_usage.ru_stime);
+
+  g_print ("%s %u channels: %.3f s cpu (%.3f user, %.3f sys), "
+      "%.3f s wall, %.1f us cpu per channel\n",
+      what, data->n_channels, user + sys, user, sys, wall,
+      (user + sys) * 1e6 / data->n_channels);
+}
+
+static void
+stress_channel_invalidated_cb (TpProxy *channel,
+    guint domain,
+    gint code,
+    gchar *message,
+    StressData *data)
+{
+  if (data->phase != PHASE_CLOSING)
+    return;
+
+  if (++data->closed < data->n_channels)
+    return;
+
+  stress_end_phase (data, "closed");
+  data->success = TRUE;
+  g_main_loop_quit (data->loop);
+}
+
+static void
+stress_observe_cb (EmpathyDispatcher *dispatcher,
+    EmpathyDispatchOperation *operation,
+    StressData *data)
+{
+  TpChannel *channel = empathy_dispatch_operation_get_channel (operation);
+
+  g_signal_connect (channel, "invalidated",
+      G_CALLBACK (stress_channel_invalidated_cb), data);
+
+  if (++data->observed < data->n_channels)
+    return;
+
+  stress_end_phase (data, "opened");
+
+  stress_start_phase (data, PHASE_CLOSING);
+  stress_send_command (data, "close\n");
+}
+
+static void
+stress_approve_cb (EmpathyDispatcher *dispatcher,
+    EmpathyDispatchOperation *operation,
+    StressData *data)
+{
+  empathy_dispatch_operation_approve (operation);
+}
+
+static void
+stress_dispatch_cb (EmpathyDispatcher *dispatcher,
+    EmpathyDispatchOperation *operation,
+    StressData *data)
+{
+  /* Act like a handler so the channel ends up in the dispatched set */
+  empathy_dispatch_operation_claim (operation);
+}
+
+static void
+stress_requests_got_all_cb (TpProxy *proxy,
+    GHashTable *properties,
+    const GError *error,
+    gpointer user_data,
+    GObject *weak_object)
+{
+  StressData *data = user_data;
+  gchar *command;
+
+  /* The dispatcher's NewChannels match rule went out before this call, so
+   * it is in place by the time we get the reply */
+  if (error != NULL)
+    {
+      g_printerr ("Couldn't get the Requests properties: %s\n",
+          error->message);
+      g_main_loop_quit (data->loop);
+      return;
+    }
+
+  stress_start_phase (data, PHASE_OPENING);
+  command = g_strdup_printf ("open %u\n", data->n_channels);
+  stress_send_command (data, command);
+  g_free (command);
+}
+
+static void
+stress_connection_ready_cb (TpConnection *connection,
+    const GError *error,
+    gpointer user_data)
+{
+  StressData *data = user_data;
+  EmpathyAccountManager *account_manager;
+
+  if (error != NULL)
+    {
+      g_printerr ("Connection failed: %s\n", error->message);
+      g_main_loop_quit (data->loop);
+      return;
+    }
+
+  /* Pretend Mission Control told us about the connection */
+  account_manager = empathy_account_manager_dup_singleton ();
+  g_signal_emit_by_name (account_manager, "new-connection", connection);
+  g_object_unref (account_manager);
+
+  tp_cli_dbus_properties_call_get_all (connection, -1,
+      TP_IFACE_CONNECTION_INTERFACE_REQUESTS,
+      stress_requests_got_all_cb, data, NULL, NULL);
+}
+
+static gboolean
+stress_timeout_cb (gpointer user_data)
+{
+  StressData *data = user_data;
+
+  g_printerr ("Timed out: %u channels observed, %u closed\n",
+      data->observed, data->closed);
+  g_main_loop_quit (data->loop);
+
+  return FALSE;
+}
+
+static int
+run_client (int command_fd,
+    int reply_fd,
+    guint n_channels)
+{
+  StressData data = { NULL, };
+  EmpathyDispatcher *dispatcher;
+  TpDBusDaemon *dbus;
+  TpConnection *connection;
+  FILE *reply;
+  gchar bus_name[256], object_path[256];
+  GError *error = NULL;
+
+  reply = fdopen (reply_fd, "r");
+  if (reply == NULL || fscanf (reply, "%255s %255s", bus_name,
+        object_path) != 2)
+    {
+      g_printerr ("The connection manager didn't start\n");
+      return EXIT_FAILURE;
+    }
+  fclose (reply);
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.command_fd = command_fd;
+  data.n_channels = n_channels;
+  data.phase = PHASE_CONNECTING;
+
+  dispatcher = empathy_dispatcher_dup_singleton ();
+  g_signal_connect (dispatcher, "observe",
+      G_CALLBACK (stress_observe_cb), &data);
+  g_signal_connect (dispatcher, "approve",
+      G_CALLBACK (stress_approve_cb), &data);
+  g_signal_connect (dispatcher, "dispatch",
+      G_CALLBACK (stress_dispatch_cb), &data);
+
+  dbus = tp_dbus_daemon_new (tp_get_bus ());
+  connection = tp_connection_new (dbus, bus_name, object_path, &error);
+  if (connection == NULL)
+    {
+      g_printerr ("Couldn't create the connection: %s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  tp_cli_connection_call_connect (connection, -1, NULL, NULL, NULL, NULL);
+  tp_connection_call_when_ready (connection, stress_connection_ready_cb,
+      &data);
+  g_timeout_add_seconds (TIMEOUT, stress_timeout_cb, &data);
+
+  g_main_loop_run (data.loop);
+
+  g_object_unref (connection);
+  g_object_unref (dbus);
+  g_object_unref (dispatcher);
+  g_main_loop_unref (data.loop);
+
+  return data.success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  int command_pipe[2], reply_pipe[2];
+  guint n_channels = DEFAULT_N_CHANNELS;
+  pid_t pid;
+  int ret;
+
+  if (argc > 1)
+    n_channels = MAX (1, atoi (argv[1]));
+
+  /* Fork before anything touches D-Bus, both sides need their own
+   * connection to the bus */
+  if (pipe (command_pipe) < 0 || pipe (reply_pipe) < 0)
+    return EXIT_FAILURE;
+
+  pid = fork ();
+  if (pid < 0)
+    return EXIT_FAILURE;
+
+  g_type_init ();
+  empathy_debug_set_flags (g_getenv ("EMPATHY_DEBUG"));
+
+  if (pid == 0)
+    {
+      close (command_pipe[1]);
+      close (reply_pipe[0]);
+      return run_connection_manager (command_pipe[0], reply_pipe[1]);
+    }
+
+  close (command_pipe[0]);
+  close (reply_pipe[1]);
+  ret = run_client (command_pipe[1], reply_pipe[0], n_channels);
+
+  /* The connection manager disconnects and exits on EOF */
+  close (command_pipe[1]);
+  waitpid (pid, NULL, 0);
+
+  return ret;
+}
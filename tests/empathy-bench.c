@@ -0,0 +1,685 @@
+/*
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Microbenchmarks for the code paths that show up when profiling Empathy:
+ * the log store, smiley parsing, Adium message formatting, the contact list
+ * store and timestamp parsing. Everything runs on generated fixtures, the
+ * only outside dependency is the "test" Mission Control profile the check
+ * suite uses, for an account to attach logs and contacts to. Results are
+ * written as JSON so they can be compared from one commit to the next:
+ *
+ *   make -C tests bench
+ *   tests/empathy-bench --log-mb=4096 --output=bench.json
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include <libmissioncontrol/mc-account.h>
+#include <libmissioncontrol/mc-profile.h>
+
+#include <libempathy/empathy-account-manager.h>
+#include <libempathy/empathy-contact-list.h>
+#include <libempathy/empathy-debug.h>
+#include <libempathy/empathy-log-store-empathy.h>
+#include <libempathy/empathy-log-store.h>
+#include <libempathy/empathy-message.h>
+#include <libempathy/empathy-time.h>
+
+#include <libempathy-gtk/empathy-contact-list-store.h>
+#include <libempathy-gtk/empathy-smiley-manager.h>
+#include <libempathy-gtk/empathy-theme-adium.h>
+#include <libempathy-gtk/empathy-ui-utils.h>
+
+#define LOG_CHATS 64
+#define LOG_MESSAGES_PER_FILE 500
+#define LOG_ADDED_MESSAGES 2000
+#define LOG_READ_DATES 30
+#define TEXT_ITERATIONS 100000
+#define TIME_ITERATIONS 1000000
+
+static gint log_mb = 64;
+static gchar *log_dir = NULL;
+static gchar *contact_counts = NULL;
+static gchar *output = NULL;
+
+static GOptionEntry entries[] = {
+  { "log-mb", 0, 0, G_OPTION_ARG_INT, &log_mb,
+    "Size of the generated log tree, in MB (default 64)", "MB" },
+  { "log-dir", 0, 0, G_OPTION_ARG_FILENAME, &log_dir,
+    "Generate the log tree there and keep it for the next run", "DIR" },
+  { "contacts", 0, 0, G_OPTION_ARG_STRING, &contact_counts,
+    "Contact list sizes (default 1000,5000,20000)", "N,N,..." },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+    "Write the JSON results there instead of stdout", "FILE" },
+  { NULL }
+};
+
+/* Results */
+
+static GString *results = NULL;
+
+static void
+bench_report (const gchar *name,
+    guint size,
+    guint iterations,
+    gint64 usec)
+{
+  gdouble ns_per_op = usec * 1000.0 / MAX (iterations, 1);
+
+  g_printerr ("%-28s %8u %9u ops %10.3f ms %12.1f ns/op\n", name, size,
+      iterations, usec / 1000.0, ns_per_op);
+
+  if (results->len > 0)
+    g_string_append (results, ",\n");
+
+  g_string_append_printf (results,
+      "    { \"name\": \"%s\", \"size\": %u, \"iterations\": %u, "
+      "\"total_us\": %" G_GINT64_FORMAT ", \"ns_per_op\": %.1f }",
+      name, size, iterations, usec, ns_per_op);
+}
+
+static void
+bench_write_results (void)
+{
+  const gchar *revision = g_getenv ("BENCH_REVISION");
+  GString *json;
+  GError *error = NULL;
+
+  json = g_string_new ("{\n");
+  if (revision != NULL && *revision != '\0')
+    g_string_append_printf (json, "  \"revision\": \"%s\",\n", revision);
+  g_string_append_printf (json, "  \"time\": %ld,\n",
+      (glong) empathy_time_get_current ());
+  g_string_append_printf (json, "  \"results\": [\n%s\n  ]\n}\n",
+      results->str);
+
+  if (output == NULL)
+    fputs (json->str, stdout);
+  else if (!g_file_set_contents (output, json->str, json->len, &error))
+    {
+      g_printerr ("Couldn't write %s: %s\n", output, error->message);
+      g_error_free (error);
+    }
+
+  g_string_free (json, TRUE);
+}
+
+static void
+bench_iterate_main_loop (void)
+{
+  while (g_main_context_pending (NULL))
+    g_main_context_iteration (NULL, FALSE);
+}
+
+/* Fixtures */
+
+static const gchar *messages[] = {
+  "hi",
+  "how are you? :-)",
+  "did you see http://www.example.com/some/page?id=42 yet",
+  "I'll be there in 5 minutes ;) don't start without me",
+  "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod "
+      "tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim "
+      "veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip.",
+  "line one\nline two\nline three :D\nwww.gnome.org",
+  "<b>not html</b> & \"quotes\" :( :P",
+};
+
+static const gchar *adium_template =
+  "<div class=\"%messageClasses%\"><img class=\"avatar\" "
+  "src=\"%userIconPath%\" /><div class=\"header\"><span class=\"sender\">"
+  "%sender%</span> <span class=\"id\">%senderScreenName%</span> on "
+  "%service% <span class=\"time\">%time{%H:%M:%S}%</span></div>"
+  "<div class=\"message\">%message%</div><span class=\"short\">"
+  "%shortTime%</span><div id=\"insert\"></div></div>";
+
+static EmpathyAccount *
+bench_get_account (void)
+{
+  McProfile *profile;
+  EmpathyAccountManager *account_manager;
+  EmpathyAccount *account;
+  GList *accounts;
+
+  profile = mc_profile_lookup ("test");
+  if (profile == NULL)
+    return NULL;
+
+  account_manager = empathy_account_manager_dup_singleton ();
+  accounts = mc_accounts_list_by_profile (profile);
+
+  if (accounts == NULL)
+    {
+      account = empathy_account_manager_create (account_manager, profile);
+    }
+  else
+    {
+      account = empathy_account_manager_lookup (account_manager,
+          mc_account_get_unique_name (accounts->data));
+    }
+
+  mc_accounts_list_free (accounts);
+  g_object_unref (account_manager);
+  g_object_unref (profile);
+
+  return account;
+}
+
+static void
+bench_remove_dir (const gchar *path)
+{
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          gchar *child = g_build_filename (path, name, NULL);
+
+          if (g_file_test (child, G_FILE_TEST_IS_DIR))
+            bench_remove_dir (child);
+          else
+            g_unlink (child);
+
+          g_free (child);
+        }
+      g_dir_close (dir);
+    }
+
+  g_rmdir (path);
+}
+
+/* Writes the files the way EmpathyLogStoreEmpathy does, without going
+ * through it: generating gigabytes one add_message () at a time would take
+ * hours. Every 1000th file contains the word "needle". */
+static guint
+bench_generate_logs (const gchar *basedir,
+    EmpathyAccount *account,
+    guint mb)
+{
+  guint n_files, days, chat, day, i;
+  guint64 size = 0;
+  time_t start;
+  gchar *stamp;
+
+  n_files = MAX (1, (guint64) mb * 1024 * 1024 /
+      (LOG_MESSAGES_PER_FILE * 200));
+  days = MAX (1, n_files / LOG_CHATS);
+
+  stamp = g_strdup_printf ("%s/generated-%u", basedir, mb);
+  if (g_file_test (stamp, G_FILE_TEST_EXISTS))
+    {
+      g_free (stamp);
+      return days;
+    }
+
+  start = empathy_time_get_current () - days * 86400;
+
+  for (chat = 0; chat < LOG_CHATS; chat++)
+    {
+      gchar *dir;
+
+      dir = g_strdup_printf ("%s/%s/contact%u@example.com", basedir,
+          empathy_account_get_unique_name (account), chat);
+      g_mkdir_with_parents (dir, 0700);
+
+      for (day = 0; day < days; day++)
+        {
+          time_t t = start + day * 86400;
+          gchar *date, *filename;
+          FILE *file;
+
+          date = empathy_time_to_string_utc (t, "%Y%m%d");
+          filename = g_strdup_printf ("%s/%s.log", dir, date);
+          file = g_fopen (filename, "w");
+          if (file == NULL)
+            g_error ("Couldn't create %s", filename);
+
+          fputs ("<?xml version='1.0' encoding='utf-8'?>\n"
+              "<?xml-stylesheet type=\"text/xsl\" "
+              "href=\"empathy-log.xsl\"?>\n<log>\n", file);
+
+          for (i = 0; i < LOG_MESSAGES_PER_FILE; i++)
+            {
+              gchar *time_str, *body;
+
+              time_str = empathy_time_to_string_utc (t + i * 60,
+                  "%Y%m%dT%H:%M:%S");
+              body = g_markup_escape_text (
+                  messages[i % G_N_ELEMENTS (messages)], -1);
+
+              fprintf (file, "<message time='%s' cm_id='%u' "
+                  "id='contact%u@example.com' name='Contact %u' token='' "
+                  "isuser='%s' type='normal'>%s%s</message>\n", time_str, i,
+                  chat, chat, i % 2 ? "true" : "false", body,
+                  (chat * days + day) % 1000 == 0 && i == 0 ? " needle" : "");
+
+              g_free (time_str);
+              g_free (body);
+            }
+
+          fputs ("</log>\n", file);
+          size += ftell (file);
+          fclose (file);
+
+          g_free (filename);
+          g_free (date);
+        }
+
+      g_free (dir);
+    }
+
+  g_printerr ("Generated %u log files, %" G_GUINT64_FORMAT " MB\n",
+      LOG_CHATS * days, size / (1024 * 1024));
+  g_file_set_contents (stamp, "", 0, NULL);
+  g_free (stamp);
+
+  return days;
+}
+
+/* Benchmarks */
+
+static void
+bench_time_parse (void)
+{
+  gint64 start;
+  guint i;
+  time_t sum = 0;
+
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < TIME_ITERATIONS; i++)
+    sum += empathy_time_parse ("20091019T12:34:56");
+  bench_report ("time-parse", 0, TIME_ITERATIONS,
+      empathy_time_get_monotonic () - start);
+
+  /* Keep the loop from being optimized away */
+  if (sum == 0)
+    g_printerr ("empathy_time_parse () returned 0\n");
+}
+
+static void
+bench_time_format (void)
+{
+  gint64 start;
+  guint i;
+
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < TIME_ITERATIONS; i++)
+    g_free (empathy_time_to_string_utc (1256000000 + i,
+          EMPATHY_TIME_FORMAT_LOG));
+  bench_report ("time-format-strftime", 0, TIME_ITERATIONS,
+      empathy_time_get_monotonic () - start);
+
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < TIME_ITERATIONS; i++)
+    g_free (empathy_time_to_string_log (1256000000 + i));
+  bench_report ("time-format-log", 0, TIME_ITERATIONS,
+      empathy_time_get_monotonic () - start);
+}
+
+static void
+bench_smiley_parse (void)
+{
+  EmpathySmileyManager *manager;
+  gint64 start;
+  guint i;
+
+  manager = empathy_smiley_manager_dup_singleton ();
+
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < TEXT_ITERATIONS; i++)
+    {
+      GSList *smileys;
+
+      smileys = empathy_smiley_manager_parse (manager,
+          messages[i % G_N_ELEMENTS (messages)]);
+      g_slist_foreach (smileys, (GFunc) empathy_smiley_free, NULL);
+      g_slist_free (smileys);
+    }
+  bench_report ("smiley-parse", 0, TEXT_ITERATIONS,
+      empathy_time_get_monotonic () - start);
+
+  g_object_unref (manager);
+}
+
+static void
+bench_adium (void)
+{
+  EmpathySmileyManager *manager;
+  EmpathyTimeCache *time_cache;
+  gint64 start;
+  gsize len;
+  guint i;
+
+  manager = empathy_smiley_manager_dup_singleton ();
+
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < TEXT_ITERATIONS; i++)
+    g_free (empathy_adium_parse_body (manager,
+          messages[i % G_N_ELEMENTS (messages)]));
+  bench_report ("adium-parse-body", 0, TEXT_ITERATIONS,
+      empathy_time_get_monotonic () - start);
+
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < TEXT_ITERATIONS; i++)
+    g_free (empathy_adium_parse_body (NULL,
+          messages[i % G_N_ELEMENTS (messages)]));
+  bench_report ("adium-parse-body-no-smileys", 0, TEXT_ITERATIONS,
+      empathy_time_get_monotonic () - start);
+
+  len = strlen (adium_template);
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < TEXT_ITERATIONS; i++)
+    g_free (empathy_adium_build_script ("appendMessage", adium_template, len,
+          messages[i % G_N_ELEMENTS (messages)], "/tmp/avatar.png",
+          "Contact", "contact@example.com", "Jabber",
+          "incoming message", 1256000000 + i, NULL));
+  bench_report ("adium-build-script", 0, TEXT_ITERATIONS,
+      empathy_time_get_monotonic () - start);
+
+  /* As views do, one message per second */
+  time_cache = empathy_time_cache_new ();
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < TEXT_ITERATIONS; i++)
+    g_free (empathy_adium_build_script ("appendMessage", adium_template, len,
+          messages[i % G_N_ELEMENTS (messages)], "/tmp/avatar.png",
+          "Contact", "contact@example.com", "Jabber",
+          "incoming message", 1256000000 + i, time_cache));
+  bench_report ("adium-build-script-time-cache", 0, TEXT_ITERATIONS,
+      empathy_time_get_monotonic () - start);
+  empathy_time_cache_free (time_cache);
+
+  g_object_unref (manager);
+}
+
+/* A contact list whose members the benchmark controls */
+
+typedef struct {
+  GObject parent;
+  GList *members;
+} BenchContactList;
+
+typedef struct {
+  GObjectClass parent_class;
+} BenchContactListClass;
+
+static void bench_contact_list_iface_init (EmpathyContactListIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (BenchContactList, bench_contact_list, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (EMPATHY_TYPE_CONTACT_LIST,
+      bench_contact_list_iface_init));
+
+static void
+bench_contact_list_finalize (GObject *object)
+{
+  BenchContactList *list = (BenchContactList *) object;
+
+  g_list_foreach (list->members, (GFunc) g_object_unref, NULL);
+  g_list_free (list->members);
+
+  G_OBJECT_CLASS (bench_contact_list_parent_class)->finalize (object);
+}
+
+static void
+bench_contact_list_class_init (BenchContactListClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = bench_contact_list_finalize;
+}
+
+static void
+bench_contact_list_init (BenchContactList *list)
+{
+}
+
+static GList *
+bench_contact_list_get_members (EmpathyContactList *list)
+{
+  GList *members;
+
+  members = g_list_copy (((BenchContactList *) list)->members);
+  g_list_foreach (members, (GFunc) g_object_ref, NULL);
+
+  return members;
+}
+
+static GList *
+bench_contact_list_get_groups (EmpathyContactList *list,
+    EmpathyContact *contact)
+{
+  guint handle = empathy_contact_get_handle (contact);
+
+  return g_list_prepend (NULL, g_strdup_printf ("Group %u", handle % 20));
+}
+
+static void
+bench_contact_list_iface_init (EmpathyContactListIface *iface)
+{
+  iface->get_members = bench_contact_list_get_members;
+  iface->get_groups = bench_contact_list_get_groups;
+}
+
+static void
+bench_contact_list_store (EmpathyAccount *account,
+    guint n_contacts)
+{
+  BenchContactList *list;
+  EmpathyContactListStore *store;
+  GPtrArray *added;
+  gint64 start;
+  guint i;
+
+  list = g_object_new (bench_contact_list_get_type (), NULL);
+  store = empathy_contact_list_store_new (EMPATHY_CONTACT_LIST (list));
+  empathy_contact_list_store_set_show_offline (store, TRUE);
+  bench_iterate_main_loop ();
+
+  added = g_ptr_array_sized_new (n_contacts);
+  for (i = 0; i < n_contacts; i++)
+    {
+      EmpathyContact *contact;
+      gchar *id, *name;
+
+      id = g_strdup_printf ("contact%u@example.com", i);
+      name = g_strdup_printf ("Contact %u", (i * 7919) % n_contacts);
+      contact = empathy_contact_new_for_log (account, id, name, FALSE);
+      empathy_contact_set_handle (contact, i + 1);
+      empathy_contact_set_presence (contact,
+          i % 3 ? TP_CONNECTION_PRESENCE_TYPE_AVAILABLE :
+          TP_CONNECTION_PRESENCE_TYPE_OFFLINE);
+
+      g_ptr_array_add (added, contact);
+      list->members = g_list_prepend (list->members, contact);
+
+      g_free (id);
+      g_free (name);
+    }
+
+  start = empathy_time_get_monotonic ();
+  empathy_contact_list_emit_members_changed (EMPATHY_CONTACT_LIST (list),
+      added, NULL, NULL, 0, NULL);
+  bench_iterate_main_loop ();
+  bench_report ("contact-list-store-insert", n_contacts, n_contacts,
+      empathy_time_get_monotonic () - start);
+
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < added->len; i++)
+    {
+      empathy_contact_set_presence (g_ptr_array_index (added, i),
+          i % 3 ? TP_CONNECTION_PRESENCE_TYPE_AWAY :
+          TP_CONNECTION_PRESENCE_TYPE_AVAILABLE);
+    }
+  bench_iterate_main_loop ();
+  bench_report ("contact-list-store-update", n_contacts, n_contacts,
+      empathy_time_get_monotonic () - start);
+
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < 10; i++)
+    {
+      empathy_contact_list_store_set_sort_criterium (store,
+          i % 2 ? EMPATHY_CONTACT_LIST_STORE_SORT_STATE :
+          EMPATHY_CONTACT_LIST_STORE_SORT_NAME);
+      bench_iterate_main_loop ();
+    }
+  bench_report ("contact-list-store-sort", n_contacts, 10,
+      empathy_time_get_monotonic () - start);
+
+  g_ptr_array_free (added, TRUE);
+  g_object_unref (store);
+  g_object_unref (list);
+  bench_iterate_main_loop ();
+}
+
+static void
+bench_log_store (EmpathyAccount *account)
+{
+  EmpathyLogStore *store;
+  EmpathyContact *sender;
+  GList *dates, *hits, *l;
+  gchar *basedir;
+  gint64 start;
+  guint days, n_read, i;
+
+  if (log_dir != NULL)
+    basedir = g_strdup (log_dir);
+  else
+    basedir = g_build_filename (g_get_tmp_dir (), "empathy-bench-logs",
+        NULL);
+
+  days = bench_generate_logs (basedir, account, log_mb);
+  store = g_object_new (EMPATHY_TYPE_LOG_STORE_EMPATHY,
+      "basedir", basedir,
+      NULL);
+
+  sender = empathy_contact_new_for_log (account, "bench@example.com",
+      "Bench", FALSE);
+
+  start = empathy_time_get_monotonic ();
+  for (i = 0; i < LOG_ADDED_MESSAGES; i++)
+    {
+      EmpathyMessage *message;
+
+      message = empathy_message_new (messages[i % G_N_ELEMENTS (messages)]);
+      empathy_message_set_sender (message, sender);
+      empathy_message_set_timestamp (message, empathy_time_get_current ());
+      empathy_log_store_add_message (store, "bench@example.com", FALSE,
+          message, NULL);
+      g_object_unref (message);
+    }
+  bench_report ("log-store-add", 0, LOG_ADDED_MESSAGES,
+      empathy_time_get_monotonic () - start);
+
+  start = empathy_time_get_monotonic ();
+  dates = empathy_log_store_get_dates (store, account,
+      "contact1@example.com", FALSE);
+  bench_report ("log-store-get-dates", days, 1,
+      empathy_time_get_monotonic () - start);
+
+  n_read = 0;
+  start = empathy_time_get_monotonic ();
+  for (l = g_list_last (dates); l != NULL && n_read < LOG_READ_DATES;
+      l = l->prev, n_read++)
+    {
+      GList *read;
+
+      read = empathy_log_store_get_messages_for_date (store, account,
+          "contact1@example.com", FALSE, l->data);
+      g_list_foreach (read, (GFunc) g_object_unref, NULL);
+      g_list_free (read);
+    }
+  bench_report ("log-store-read-date", LOG_MESSAGES_PER_FILE, n_read,
+      empathy_time_get_monotonic () - start);
+
+  g_list_foreach (dates, (GFunc) g_free, NULL);
+  g_list_free (dates);
+
+  start = empathy_time_get_monotonic ();
+  hits = empathy_log_store_search_new (store, "needle");
+  bench_report ("log-store-search", log_mb, 1,
+      empathy_time_get_monotonic () - start);
+  g_printerr ("  %u hits\n", g_list_length (hits));
+  empathy_log_manager_search_free (hits);
+
+  g_object_unref (sender);
+  g_object_unref (store);
+
+  if (log_dir == NULL)
+    bench_remove_dir (basedir);
+  g_free (basedir);
+}
+
+int
+main (int argc,
+    char **argv)
+{
+  GOptionContext *context;
+  EmpathyAccount *account;
+  gchar **counts;
+  guint i;
+  GError *error = NULL;
+
+  context = g_option_context_new ("- run the Empathy benchmarks");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gtk_get_option_group (TRUE));
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free (context);
+
+  empathy_gtk_init ();
+  empathy_debug_set_flags (g_getenv ("EMPATHY_DEBUG"));
+
+  account = bench_get_account ();
+  if (account == NULL)
+    {
+      g_printerr ("No \"test\" profile, set MC_PROFILE_DIR to tests/\n");
+      return EXIT_FAILURE;
+    }
+
+  results = g_string_new (NULL);
+
+  bench_time_parse ();
+  bench_time_format ();
+  bench_smiley_parse ();
+  bench_adium ();
+
+  counts = g_strsplit (contact_counts ? contact_counts : "1000,5000,20000",
+      ",", -1);
+  for (i = 0; counts[i] != NULL; i++)
+    bench_contact_list_store (account, MAX (1, atoi (counts[i])));
+  g_strfreev (counts);
+
+  bench_log_store (account);
+
+  bench_write_results ();
+
+  g_string_free (results, TRUE);
+  g_object_unref (account);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,1211 @@
+/*
+ * stand-in-connection.c - Source for StandInConnection
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* A connection which never goes on the network. It connects immediately and
+ * lets the test programs generate whatever load they want: incoming text
+ * channels, a roster with groups, presence storms, busy chat rooms and file
+ * transfer offers, so the client side can be measured without a real CM. */
+
+#include <telepathy-glib/channel-manager.h>
+#include <telepathy-glib/errors.h>
+#include <telepathy-glib/handle-repo-dynamic.h>
+#include <telepathy-glib/handle-repo-static.h>
+#include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/svc-connection.h>
+#include <telepathy-glib/util.h>
+
+#include <libempathy/empathy-time.h>
+
+#include "stand-in-connection.h"
+#include "stand-in-contact-list.h"
+#include "stand-in-file-channel.h"
+#include "stand-in-text-channel.h"
+
+#define FILE_SIZE (1024 * 1024)
+
+/* StandInIncomingManager: the channel manager owning the text, room and file
+ * transfer channels, all of them incoming */
+
+#define STAND_IN_TYPE_INCOMING_MANAGER stand_in_incoming_manager_get_type()
+#define STAND_IN_INCOMING_MANAGER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   STAND_IN_TYPE_INCOMING_MANAGER, StandInIncomingManager))
+
+typedef struct {
+  GObject parent;
+  TpBaseConnection *conn;
+  /* channel -> itself */
+  GHashTable *channels;
+  guint next_id;
+} StandInIncomingManager;
+
+typedef struct {
+  GObjectClass parent_class;
+} StandInIncomingManagerClass;
+
+static GType stand_in_incoming_manager_get_type (void);
+static void incoming_manager_iface_init (gpointer iface, gpointer data);
+
+G_DEFINE_TYPE_WITH_CODE (StandInIncomingManager, stand_in_incoming_manager,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_CHANNEL_MANAGER,
+      incoming_manager_iface_init));
+
+static void
+stand_in_incoming_manager_init (StandInIncomingManager *self)
+{
+  self->channels = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      g_object_unref, NULL);
+}
+
+static void
+incoming_manager_dispose (GObject *object)
+{
+  StandInIncomingManager *self = STAND_IN_INCOMING_MANAGER (object);
+
+  if (self->channels != NULL)
+    {
+      g_hash_table_destroy (self->channels);
+      self->channels = NULL;
+    }
+
+  G_OBJECT_CLASS (stand_in_incoming_manager_parent_class)->dispose (object);
+}
+
+static void
+stand_in_incoming_manager_class_init (StandInIncomingManagerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = incoming_manager_dispose;
+}
+
+static void
+foreach_channel (GHashTable *channels,
+    TpExportableChannelFunc func,
+    gpointer user_data)
+{
+  GHashTableIter iter;
+  gpointer channel;
+
+  g_hash_table_iter_init (&iter, channels);
+  while (g_hash_table_iter_next (&iter, NULL, &channel))
+    func (TP_EXPORTABLE_CHANNEL (channel), user_data);
+}
+
+static void
+incoming_manager_foreach_channel (TpChannelManager *manager,
+    TpExportableChannelFunc func,
+    gpointer user_data)
+{
+  StandInIncomingManager *self = STAND_IN_INCOMING_MANAGER (manager);
+
+  foreach_channel (self->channels, func, user_data);
+}
+
+static void
+emit_channel_class (TpChannelManager *manager,
+    const gchar *channel_type,
+    TpHandleType handle_type,
+    TpChannelManagerChannelClassFunc func,
+    gpointer user_data)
+{
+  static const gchar * const allowed[] = {
+      TP_IFACE_CHANNEL ".TargetHandle",
+      TP_IFACE_CHANNEL ".TargetID",
+      NULL
+  };
+  GHashTable *table;
+
+  table = g_hash_table_new_full (g_str_hash, g_str_equal,
+      NULL, (GDestroyNotify) tp_g_value_slice_free);
+  g_hash_table_insert (table, TP_IFACE_CHANNEL ".ChannelType",
+      tp_g_value_slice_new_static_string (channel_type));
+  g_hash_table_insert (table, TP_IFACE_CHANNEL ".TargetHandleType",
+      tp_g_value_slice_new_uint (handle_type));
+
+  func (manager, table, allowed, user_data);
+
+  g_hash_table_destroy (table);
+}
+
+static void
+incoming_manager_foreach_channel_class (TpChannelManager *manager,
+    TpChannelManagerChannelClassFunc func,
+    gpointer user_data)
+{
+  emit_channel_class (manager, TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_HANDLE_TYPE_CONTACT, func, user_data);
+  emit_channel_class (manager, TP_IFACE_CHANNEL_TYPE_TEXT,
+      TP_HANDLE_TYPE_ROOM, func, user_data);
+  emit_channel_class (manager, TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER,
+      TP_HANDLE_TYPE_CONTACT, func, user_data);
+}
+
+static gboolean
+incoming_manager_request (TpChannelManager *manager,
+    gpointer request_token,
+    GHashTable *request_properties)
+{
+  /* Only incoming channels are interesting for the tests */
+  return FALSE;
+}
+
+static void
+incoming_manager_iface_init (gpointer iface,
+    gpointer data)
+{
+  TpChannelManagerIface *klass = iface;
+
+  klass->foreach_channel = incoming_manager_foreach_channel;
+  klass->foreach_channel_class = incoming_manager_foreach_channel_class;
+  klass->create_channel = incoming_manager_request;
+  klass->request_channel = incoming_manager_request;
+  klass->ensure_channel = incoming_manager_request;
+}
+
+static void
+incoming_manager_channel_closed_cb (GObject *channel,
+    StandInIncomingManager *self)
+{
+  tp_channel_manager_emit_channel_closed_for_object (self,
+      TP_EXPORTABLE_CHANNEL (channel));
+
+  g_hash_table_remove (self->channels, channel);
+}
+
+static void
+incoming_manager_add_channel (StandInIncomingManager *self,
+    gpointer channel)
+{
+  g_signal_connect (channel, "closed",
+      G_CALLBACK (incoming_manager_channel_closed_cb), self);
+  g_hash_table_insert (self->channels, channel, channel);
+
+  tp_channel_manager_emit_new_channel (self,
+      TP_EXPORTABLE_CHANNEL (channel), NULL);
+}
+
+static StandInTextChannel *
+incoming_manager_new_text_channel (StandInIncomingManager *self,
+    TpHandleType handle_type,
+    TpHandle handle)
+{
+  StandInTextChannel *channel;
+  gchar *object_path;
+
+  object_path = g_strdup_printf ("%s/TextChannel%u",
+      self->conn->object_path, self->next_id++);
+
+  channel = g_object_new (STAND_IN_TYPE_TEXT_CHANNEL,
+      "connection", self->conn,
+      "object-path", object_path,
+      "handle-type", handle_type,
+      "handle", handle,
+      NULL);
+
+  incoming_manager_add_channel (self, channel);
+  g_free (object_path);
+
+  return channel;
+}
+
+static void
+incoming_manager_new_file_channel (StandInIncomingManager *self,
+    TpHandle handle,
+    const gchar *filename,
+    guint64 size)
+{
+  StandInFileChannel *channel;
+  gchar *object_path;
+
+  object_path = g_strdup_printf ("%s/FileChannel%u",
+      self->conn->object_path, self->next_id++);
+
+  channel = g_object_new (STAND_IN_TYPE_FILE_CHANNEL,
+      "connection", self->conn,
+      "object-path", object_path,
+      "handle", handle,
+      "filename", filename,
+      "size", size,
+      NULL);
+
+  incoming_manager_add_channel (self, channel);
+  g_free (object_path);
+}
+
+/* StandInListManager: the channel manager owning the contact lists and the
+ * groups */
+
+#define STAND_IN_TYPE_LIST_MANAGER stand_in_list_manager_get_type()
+#define STAND_IN_LIST_MANAGER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   STAND_IN_TYPE_LIST_MANAGER, StandInListManager))
+
+typedef struct {
+  GObject parent;
+  TpBaseConnection *conn;
+  /* TpHandle -> StandInContactList */
+  GHashTable *lists;
+  GHashTable *groups;
+  guint next_id;
+} StandInListManager;
+
+typedef struct {
+  GObjectClass parent_class;
+} StandInListManagerClass;
+
+static GType stand_in_list_manager_get_type (void);
+static void list_manager_iface_init (gpointer iface, gpointer data);
+
+G_DEFINE_TYPE_WITH_CODE (StandInListManager, stand_in_list_manager,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_CHANNEL_MANAGER,
+      list_manager_iface_init));
+
+static const gchar *list_handle_strings[] = {
+    "publish",
+    "subscribe",
+    "stored",
+    NULL
+};
+
+static void
+stand_in_list_manager_init (StandInListManager *self)
+{
+  self->lists = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, g_object_unref);
+  self->groups = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, g_object_unref);
+}
+
+static void
+list_manager_dispose (GObject *object)
+{
+  StandInListManager *self = STAND_IN_LIST_MANAGER (object);
+
+  if (self->lists != NULL)
+    {
+      g_hash_table_destroy (self->lists);
+      self->lists = NULL;
+    }
+
+  if (self->groups != NULL)
+    {
+      g_hash_table_destroy (self->groups);
+      self->groups = NULL;
+    }
+
+  G_OBJECT_CLASS (stand_in_list_manager_parent_class)->dispose (object);
+}
+
+static void
+stand_in_list_manager_class_init (StandInListManagerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = list_manager_dispose;
+}
+
+static void
+list_manager_foreach_channel (TpChannelManager *manager,
+    TpExportableChannelFunc func,
+    gpointer user_data)
+{
+  StandInListManager *self = STAND_IN_LIST_MANAGER (manager);
+
+  foreach_channel (self->lists, func, user_data);
+  foreach_channel (self->groups, func, user_data);
+}
+
+static void
+list_manager_foreach_channel_class (TpChannelManager *manager,
+    TpChannelManagerChannelClassFunc func,
+    gpointer user_data)
+{
+  emit_channel_class (manager, TP_IFACE_CHANNEL_TYPE_CONTACT_LIST,
+      TP_HANDLE_TYPE_LIST, func, user_data);
+  emit_channel_class (manager, TP_IFACE_CHANNEL_TYPE_CONTACT_LIST,
+      TP_HANDLE_TYPE_GROUP, func, user_data);
+}
+
+static StandInContactList *
+list_manager_new_list (StandInListManager *self,
+    TpHandleType handle_type,
+    TpHandle handle,
+    gpointer request_token)
+{
+  StandInContactList *list;
+  GSList *tokens = NULL;
+  gchar *object_path;
+
+  object_path = g_strdup_printf ("%s/ContactList%u",
+      self->conn->object_path, self->next_id++);
+
+  list = g_object_new (STAND_IN_TYPE_CONTACT_LIST,
+      "connection", self->conn,
+      "object-path", object_path,
+      "handle-type", handle_type,
+      "handle", handle,
+      NULL);
+
+  g_hash_table_insert (handle_type == TP_HANDLE_TYPE_LIST ?
+      self->lists : self->groups, GUINT_TO_POINTER (handle), list);
+
+  if (request_token != NULL)
+    tokens = g_slist_prepend (NULL, request_token);
+
+  tp_channel_manager_emit_new_channel (self,
+      TP_EXPORTABLE_CHANNEL (list), tokens);
+
+  g_slist_free (tokens);
+  g_free (object_path);
+
+  return list;
+}
+
+static void
+list_manager_create_lists (StandInListManager *self)
+{
+  TpHandleRepoIface *list_repo = tp_base_connection_get_handles (self->conn,
+      TP_HANDLE_TYPE_LIST);
+  guint i;
+
+  for (i = 0; list_handle_strings[i] != NULL; i++)
+    {
+      TpHandle handle;
+
+      handle = tp_handle_lookup (list_repo, list_handle_strings[i],
+          NULL, NULL);
+      list_manager_new_list (self, TP_HANDLE_TYPE_LIST, handle, NULL);
+    }
+}
+
+static StandInContactList *
+list_manager_get_list (StandInListManager *self,
+    const gchar *name)
+{
+  TpHandleRepoIface *list_repo = tp_base_connection_get_handles (self->conn,
+      TP_HANDLE_TYPE_LIST);
+  TpHandle handle;
+
+  handle = tp_handle_lookup (list_repo, name, NULL, NULL);
+
+  return g_hash_table_lookup (self->lists, GUINT_TO_POINTER (handle));
+}
+
+static StandInContactList *
+list_manager_ensure_group (StandInListManager *self,
+    const gchar *name)
+{
+  TpHandleRepoIface *group_repo = tp_base_connection_get_handles (
+      self->conn, TP_HANDLE_TYPE_GROUP);
+  StandInContactList *group;
+  TpHandle handle;
+
+  handle = tp_handle_ensure (group_repo, name, NULL, NULL);
+  group = g_hash_table_lookup (self->groups, GUINT_TO_POINTER (handle));
+  if (group == NULL)
+    group = list_manager_new_list (self, TP_HANDLE_TYPE_GROUP, handle, NULL);
+  tp_handle_unref (group_repo, handle);
+
+  return group;
+}
+
+static gboolean
+list_manager_request (TpChannelManager *manager,
+    gpointer request_token,
+    GHashTable *request_properties)
+{
+  StandInListManager *self = STAND_IN_LIST_MANAGER (manager);
+  StandInContactList *list;
+  TpHandleType handle_type;
+  TpHandle handle;
+
+  if (tp_strdiff (tp_asv_get_string (request_properties,
+          TP_IFACE_CHANNEL ".ChannelType"),
+        TP_IFACE_CHANNEL_TYPE_CONTACT_LIST))
+    return FALSE;
+
+  handle_type = tp_asv_get_uint32 (request_properties,
+      TP_IFACE_CHANNEL ".TargetHandleType", NULL);
+  handle = tp_asv_get_uint32 (request_properties,
+      TP_IFACE_CHANNEL ".TargetHandle", NULL);
+
+  if (handle_type == TP_HANDLE_TYPE_LIST)
+    {
+      list = g_hash_table_lookup (self->lists, GUINT_TO_POINTER (handle));
+      if (list == NULL)
+        {
+          tp_channel_manager_emit_request_failed (self, request_token,
+              TP_ERRORS, TP_ERROR_NOT_AVAILABLE,
+              "Contact lists only exist once connected");
+          return TRUE;
+        }
+    }
+  else if (handle_type == TP_HANDLE_TYPE_GROUP)
+    {
+      list = g_hash_table_lookup (self->groups, GUINT_TO_POINTER (handle));
+      if (list == NULL)
+        {
+          /* The client is creating a group */
+          list_manager_new_list (self, handle_type, handle, request_token);
+          return TRUE;
+        }
+    }
+  else
+    {
+      return FALSE;
+    }
+
+  tp_channel_manager_emit_request_already_satisfied (self, request_token,
+      TP_EXPORTABLE_CHANNEL (list));
+
+  return TRUE;
+}
+
+static void
+list_manager_iface_init (gpointer iface,
+    gpointer data)
+{
+  TpChannelManagerIface *klass = iface;
+
+  klass->foreach_channel = list_manager_foreach_channel;
+  klass->foreach_channel_class = list_manager_foreach_channel_class;
+  klass->create_channel = list_manager_request;
+  klass->request_channel = list_manager_request;
+  klass->ensure_channel = list_manager_request;
+}
+
+/* StandInConnection */
+
+G_DEFINE_TYPE_WITH_CODE (StandInConnection, stand_in_connection,
+    TP_TYPE_BASE_CONNECTION,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_CONTACTS,
+      tp_contacts_mixin_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+      tp_presence_mixin_simple_presence_iface_init));
+
+/* properties */
+enum {
+  PROP_ACCOUNT = 1,
+};
+
+/* indexes in presence_statuses */
+enum {
+  PRESENCE_AVAILABLE,
+  PRESENCE_AWAY,
+  PRESENCE_OFFLINE,
+};
+
+static const TpPresenceStatusSpec presence_statuses[] = {
+    { "available", TP_CONNECTION_PRESENCE_TYPE_AVAILABLE, TRUE, NULL },
+    { "away", TP_CONNECTION_PRESENCE_TYPE_AWAY, TRUE, NULL },
+    { "offline", TP_CONNECTION_PRESENCE_TYPE_OFFLINE, FALSE, NULL },
+    { NULL }
+};
+
+/* private structure */
+typedef struct {
+  gchar *account;
+  StandInIncomingManager *incoming_manager;
+  StandInListManager *list_manager;
+  guint next_contact;
+  guint next_room;
+  /* Contacts in the roster and members of the rooms, the handle sets hold
+   * a reference on each of them */
+  GArray *roster;
+  TpHandleSet *roster_refs;
+  GArray *room_members;
+  TpHandleSet *room_member_refs;
+  guint next_presence_change;
+  /* TpHandle -> index in presence_statuses, offline when missing */
+  GHashTable *presences;
+  guint self_presence;
+} StandInConnectionPriv;
+
+#define GET_PRIV(obj) (((StandInConnection *) (obj))->priv)
+
+static void
+stand_in_connection_init (StandInConnection *self)
+{
+  StandInConnectionPriv *priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      STAND_IN_TYPE_CONNECTION, StandInConnectionPriv);
+
+  self->priv = priv;
+  priv->roster = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  priv->room_members = g_array_new (FALSE, FALSE, sizeof (TpHandle));
+  priv->presences = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->self_presence = PRESENCE_AVAILABLE;
+}
+
+static void
+stand_in_connection_constructed (GObject *object)
+{
+  TpBaseConnection *base = TP_BASE_CONNECTION (object);
+
+  if (G_OBJECT_CLASS (stand_in_connection_parent_class)->constructed)
+    G_OBJECT_CLASS (stand_in_connection_parent_class)->constructed (object);
+
+  tp_contacts_mixin_init (object,
+      G_STRUCT_OFFSET (StandInConnection, contacts_mixin));
+  tp_base_connection_register_with_contacts_mixin (base);
+
+  tp_presence_mixin_init (object,
+      G_STRUCT_OFFSET (StandInConnection, presence_mixin));
+  tp_presence_mixin_simple_presence_register_with_contacts_mixin (object);
+}
+
+static void
+do_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  StandInConnectionPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_ACCOUNT:
+        g_value_set_string (value, priv->account);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+do_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  StandInConnectionPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_ACCOUNT:
+        g_free (priv->account);
+        priv->account = g_value_dup_string (value);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+do_finalize (GObject *object)
+{
+  StandInConnectionPriv *priv = GET_PRIV (object);
+
+  /* The handle repos are still alive, the parent class drops them */
+  if (priv->roster_refs != NULL)
+    tp_handle_set_destroy (priv->roster_refs);
+  if (priv->room_member_refs != NULL)
+    tp_handle_set_destroy (priv->room_member_refs);
+
+  g_array_free (priv->roster, TRUE);
+  g_array_free (priv->room_members, TRUE);
+  g_hash_table_destroy (priv->presences);
+  g_free (priv->account);
+
+  tp_presence_mixin_finalize (object);
+  tp_contacts_mixin_finalize (object);
+
+  G_OBJECT_CLASS (stand_in_connection_parent_class)->finalize (object);
+}
+
+static gchar *
+normalize_contact (TpHandleRepoIface *repo,
+    const gchar *id,
+    gpointer context,
+    GError **error)
+{
+  if (id[0] == '\0')
+    {
+      g_set_error (error, TP_ERRORS, TP_ERROR_INVALID_HANDLE,
+          "Contact ID must not be empty");
+      return NULL;
+    }
+
+  return g_utf8_strdown (id, -1);
+}
+
+static void
+create_handle_repos (TpBaseConnection *base,
+    TpHandleRepoIface *repos[NUM_TP_HANDLE_TYPES])
+{
+  repos[TP_HANDLE_TYPE_CONTACT] = tp_dynamic_handle_repo_new (
+      TP_HANDLE_TYPE_CONTACT, normalize_contact, NULL);
+  repos[TP_HANDLE_TYPE_ROOM] = tp_dynamic_handle_repo_new (
+      TP_HANDLE_TYPE_ROOM, NULL, NULL);
+  repos[TP_HANDLE_TYPE_LIST] = tp_static_handle_repo_new (
+      TP_HANDLE_TYPE_LIST, list_handle_strings);
+  repos[TP_HANDLE_TYPE_GROUP] = tp_dynamic_handle_repo_new (
+      TP_HANDLE_TYPE_GROUP, NULL, NULL);
+}
+
+static GPtrArray *
+create_channel_managers (TpBaseConnection *base)
+{
+  StandInConnectionPriv *priv = GET_PRIV (base);
+  GPtrArray *managers = g_ptr_array_sized_new (2);
+
+  priv->incoming_manager = g_object_new (STAND_IN_TYPE_INCOMING_MANAGER,
+      NULL);
+  priv->incoming_manager->conn = base;
+  g_ptr_array_add (managers, priv->incoming_manager);
+
+  priv->list_manager = g_object_new (STAND_IN_TYPE_LIST_MANAGER, NULL);
+  priv->list_manager->conn = base;
+  g_ptr_array_add (managers, priv->list_manager);
+
+  return managers;
+}
+
+static gchar *
+get_unique_connection_name (TpBaseConnection *base)
+{
+  StandInConnectionPriv *priv = GET_PRIV (base);
+
+  return g_strdup (priv->account);
+}
+
+static gboolean
+start_connecting (TpBaseConnection *base,
+    GError **error)
+{
+  StandInConnectionPriv *priv = GET_PRIV (base);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (base,
+      TP_HANDLE_TYPE_CONTACT);
+
+  base->self_handle = tp_handle_ensure (contact_repo, priv->account,
+      NULL, error);
+
+  if (base->self_handle == 0)
+    return FALSE;
+
+  priv->roster_refs = tp_handle_set_new (contact_repo);
+  priv->room_member_refs = tp_handle_set_new (contact_repo);
+
+  tp_base_connection_change_status (base, TP_CONNECTION_STATUS_CONNECTING,
+      TP_CONNECTION_STATUS_REASON_REQUESTED);
+  tp_base_connection_change_status (base, TP_CONNECTION_STATUS_CONNECTED,
+      TP_CONNECTION_STATUS_REASON_REQUESTED);
+
+  return TRUE;
+}
+
+static void
+connected (TpBaseConnection *base)
+{
+  StandInConnectionPriv *priv = GET_PRIV (base);
+
+  /* Like a real server, the lists are known as soon as we're in */
+  list_manager_create_lists (priv->list_manager);
+}
+
+static void
+shut_down (TpBaseConnection *base)
+{
+  tp_base_connection_finish_shutdown (base);
+}
+
+static guint
+get_presence (StandInConnection *self,
+    TpHandle handle)
+{
+  StandInConnectionPriv *priv = GET_PRIV (self);
+  gpointer presence;
+
+  if (handle == TP_BASE_CONNECTION (self)->self_handle)
+    return priv->self_presence;
+
+  if (g_hash_table_lookup_extended (priv->presences,
+        GUINT_TO_POINTER (handle), NULL, &presence))
+    return GPOINTER_TO_UINT (presence);
+
+  return PRESENCE_OFFLINE;
+}
+
+static gboolean
+status_available (GObject *object,
+    guint index)
+{
+  return TRUE;
+}
+
+static GHashTable *
+get_contact_statuses (GObject *object,
+    const GArray *contacts,
+    GError **error)
+{
+  StandInConnection *self = STAND_IN_CONNECTION (object);
+  GHashTable *statuses;
+  guint i;
+
+  statuses = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) tp_presence_status_free);
+
+  for (i = 0; i < contacts->len; i++)
+    {
+      TpHandle handle = g_array_index (contacts, TpHandle, i);
+
+      g_hash_table_insert (statuses, GUINT_TO_POINTER (handle),
+          tp_presence_status_new (get_presence (self, handle), NULL));
+    }
+
+  return statuses;
+}
+
+static gboolean
+set_own_status (GObject *object,
+    const TpPresenceStatus *status,
+    GError **error)
+{
+  StandInConnectionPriv *priv = GET_PRIV (object);
+  TpBaseConnection *base = TP_BASE_CONNECTION (object);
+
+  priv->self_presence = status != NULL ? status->index : PRESENCE_AVAILABLE;
+  tp_presence_mixin_emit_one_presence_update (object, base->self_handle,
+      status);
+
+  return TRUE;
+}
+
+static void
+stand_in_connection_class_init (StandInConnectionClass *klass)
+{
+  static const gchar *interfaces_always_present[] = {
+      TP_IFACE_CONNECTION_INTERFACE_REQUESTS,
+      TP_IFACE_CONNECTION_INTERFACE_CONTACTS,
+      TP_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE,
+      NULL };
+  TpBaseConnectionClass *base_class = (TpBaseConnectionClass *) klass;
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GParamSpec *param_spec;
+
+  g_type_class_add_private (klass, sizeof (StandInConnectionPriv));
+
+  object_class->constructed = stand_in_connection_constructed;
+  object_class->get_property = do_get_property;
+  object_class->set_property = do_set_property;
+  object_class->finalize = do_finalize;
+
+  base_class->create_handle_repos = create_handle_repos;
+  base_class->create_channel_managers = create_channel_managers;
+  base_class->get_unique_connection_name = get_unique_connection_name;
+  base_class->start_connecting = start_connecting;
+  base_class->connected = connected;
+  base_class->shut_down = shut_down;
+  base_class->interfaces_always_present = interfaces_always_present;
+
+  param_spec = g_param_spec_string ("account", "Account name",
+      "The username of this user", NULL,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_ACCOUNT, param_spec);
+
+  tp_presence_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (StandInConnectionClass, presence_mixin),
+      status_available, get_contact_statuses, set_own_status,
+      presence_statuses);
+  tp_presence_mixin_simple_presence_init_dbus_properties (object_class);
+
+  tp_contacts_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (StandInConnectionClass, contacts_mixin));
+}
+
+StandInConnection *
+stand_in_connection_new (const gchar *account)
+{
+  return g_object_new (STAND_IN_TYPE_CONNECTION,
+      "protocol", "stand-in",
+      "account", account,
+      NULL);
+}
+
+static TpHandle
+ensure_contact (StandInConnection *connection,
+    const gchar *format,
+    guint n)
+{
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      TP_BASE_CONNECTION (connection), TP_HANDLE_TYPE_CONTACT);
+  TpHandle handle;
+  gchar *id;
+
+  id = g_strdup_printf (format, n);
+  handle = tp_handle_ensure (contact_repo, id, NULL, NULL);
+  g_free (id);
+
+  return handle;
+}
+
+void
+stand_in_connection_open_channels (StandInConnection *connection,
+    guint n_channels)
+{
+  StandInConnectionPriv *priv = GET_PRIV (connection);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      TP_BASE_CONNECTION (connection), TP_HANDLE_TYPE_CONTACT);
+  guint i;
+
+  g_return_if_fail (priv->incoming_manager != NULL);
+
+  for (i = 0; i < n_channels; i++)
+    {
+      TpHandle handle;
+
+      handle = ensure_contact (connection, "contact%u@stand-in",
+          priv->next_contact++);
+      incoming_manager_new_text_channel (priv->incoming_manager,
+          TP_HANDLE_TYPE_CONTACT, handle);
+      tp_handle_unref (contact_repo, handle);
+    }
+}
+
+void
+stand_in_connection_close_channels (StandInConnection *connection)
+{
+  StandInConnectionPriv *priv = GET_PRIV (connection);
+  GList *channels, *l;
+
+  g_return_if_fail (priv->incoming_manager != NULL);
+
+  /* Closing a channel removes it from the table, so work on a copy */
+  channels = g_hash_table_get_keys (priv->incoming_manager->channels);
+  for (l = channels; l != NULL; l = l->next)
+    {
+      if (STAND_IN_IS_TEXT_CHANNEL (l->data))
+        stand_in_text_channel_close (STAND_IN_TEXT_CHANNEL (l->data));
+      else
+        stand_in_file_channel_close (STAND_IN_FILE_CHANNEL (l->data));
+    }
+
+  g_list_free (channels);
+}
+
+/* Adds n_contacts to publish, subscribe and stored, spread over n_groups
+ * groups. Calling it again grows the roster. */
+void
+stand_in_connection_add_roster (StandInConnection *connection,
+    guint n_contacts,
+    guint n_groups)
+{
+  StandInConnectionPriv *priv = GET_PRIV (connection);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      TP_BASE_CONNECTION (connection), TP_HANDLE_TYPE_CONTACT);
+  TpIntSet *added, **group_members;
+  guint i;
+
+  g_return_if_fail (priv->roster_refs != NULL);
+
+  added = tp_intset_new ();
+  group_members = g_new0 (TpIntSet *, n_groups);
+  for (i = 0; i < n_groups; i++)
+    group_members[i] = tp_intset_new ();
+
+  for (i = 0; i < n_contacts; i++)
+    {
+      TpHandle handle;
+
+      handle = ensure_contact (connection, "buddy%u@stand-in",
+          priv->roster->len);
+      g_array_append_val (priv->roster, handle);
+      tp_handle_set_add (priv->roster_refs, handle);
+      tp_handle_unref (contact_repo, handle);
+
+      tp_intset_add (added, handle);
+      if (n_groups > 0)
+        tp_intset_add (group_members[i % n_groups], handle);
+    }
+
+  for (i = 0; list_handle_strings[i] != NULL; i++)
+    stand_in_contact_list_add_members (
+        list_manager_get_list (priv->list_manager, list_handle_strings[i]),
+        added);
+
+  for (i = 0; i < n_groups; i++)
+    {
+      gchar *name;
+
+      name = g_strdup_printf ("Group %u", i);
+      stand_in_contact_list_add_members (
+          list_manager_ensure_group (priv->list_manager, name),
+          group_members[i]);
+      tp_intset_destroy (group_members[i]);
+      g_free (name);
+    }
+
+  g_free (group_members);
+  tp_intset_destroy (added);
+}
+
+/* Flips n_changes roster contacts between available and away, batch of
+ * them per PresencesChanged signal. */
+void
+stand_in_connection_change_presences (StandInConnection *connection,
+    guint n_changes,
+    guint batch)
+{
+  StandInConnectionPriv *priv = GET_PRIV (connection);
+  GHashTable *updates = NULL;
+  guint i;
+
+  g_return_if_fail (priv->roster->len > 0);
+
+  /* A contact changing twice in one signal would only count once */
+  batch = CLAMP (batch, 1, priv->roster->len);
+
+  for (i = 0; i < n_changes; i++)
+    {
+      TpHandle handle;
+      guint presence;
+
+      handle = g_array_index (priv->roster, TpHandle,
+          priv->next_presence_change++ % priv->roster->len);
+      presence = get_presence (connection, handle) == PRESENCE_AVAILABLE ?
+          PRESENCE_AWAY : PRESENCE_AVAILABLE;
+      g_hash_table_insert (priv->presences, GUINT_TO_POINTER (handle),
+          GUINT_TO_POINTER (presence));
+
+      if (updates == NULL)
+        updates = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+            NULL, (GDestroyNotify) tp_presence_status_free);
+
+      g_hash_table_insert (updates, GUINT_TO_POINTER (handle),
+          tp_presence_status_new (presence, NULL));
+
+      if (g_hash_table_size (updates) >= batch || i == n_changes - 1)
+        {
+          tp_presence_mixin_emit_presence_update (G_OBJECT (connection),
+              updates);
+          g_hash_table_destroy (updates);
+          updates = NULL;
+        }
+    }
+}
+
+/* Joins n_rooms new rooms, each of them with the same n_members other
+ * members. */
+void
+stand_in_connection_open_rooms (StandInConnection *connection,
+    guint n_rooms,
+    guint n_members)
+{
+  StandInConnectionPriv *priv = GET_PRIV (connection);
+  TpBaseConnection *base = TP_BASE_CONNECTION (connection);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (base,
+      TP_HANDLE_TYPE_CONTACT);
+  TpHandleRepoIface *room_repo = tp_base_connection_get_handles (base,
+      TP_HANDLE_TYPE_ROOM);
+  TpIntSet *members;
+  guint i;
+
+  g_return_if_fail (priv->room_member_refs != NULL);
+
+  while (priv->room_members->len < n_members)
+    {
+      TpHandle handle;
+
+      handle = ensure_contact (connection, "member%u@stand-in",
+          priv->room_members->len);
+      g_array_append_val (priv->room_members, handle);
+      tp_handle_set_add (priv->room_member_refs, handle);
+      tp_handle_unref (contact_repo, handle);
+    }
+
+  members = tp_intset_new ();
+  for (i = 0; i < n_members; i++)
+    tp_intset_add (members, g_array_index (priv->room_members, TpHandle, i));
+
+  for (i = 0; i < n_rooms; i++)
+    {
+      StandInTextChannel *room;
+      TpHandle handle;
+      gchar *id;
+
+      id = g_strdup_printf ("room%u@conference.stand-in", priv->next_room++);
+      handle = tp_handle_ensure (room_repo, id, NULL, NULL);
+
+      room = incoming_manager_new_text_channel (priv->incoming_manager,
+          TP_HANDLE_TYPE_ROOM, handle);
+      stand_in_text_channel_add_members (room, members);
+
+      tp_handle_unref (room_repo, handle);
+      g_free (id);
+    }
+
+  tp_intset_destroy (members);
+}
+
+typedef struct {
+  StandInConnection *connection;
+  /* StandInTextChannel, reffed */
+  GPtrArray *rooms;
+  GPtrArray *chats;
+  guint n_messages;
+  guint sent;
+  guint rate;
+  gint64 start;
+} MessageRun;
+
+static void
+message_run_send (MessageRun *run)
+{
+  StandInConnectionPriv *priv = GET_PRIV (run->connection);
+  guint n_channels = run->rooms->len + run->chats->len;
+  guint i = run->sent % n_channels;
+  gchar *text;
+
+  text = g_strdup_printf (STAND_IN_MESSAGE_FORMAT, run->sent,
+      empathy_time_get_monotonic ());
+
+  if (i < run->rooms->len)
+    {
+      TpHandle sender;
+
+      sender = priv->room_members->len > 0 ?
+          g_array_index (priv->room_members, TpHandle,
+              run->sent % priv->room_members->len) :
+          TP_BASE_CONNECTION (run->connection)->self_handle;
+      stand_in_text_channel_receive_from (g_ptr_array_index (run->rooms, i),
+          sender, text);
+    }
+  else
+    {
+      stand_in_text_channel_receive (
+          g_ptr_array_index (run->chats, i - run->rooms->len), text);
+    }
+
+  run->sent++;
+  g_free (text);
+}
+
+static void
+message_run_free (MessageRun *run)
+{
+  g_ptr_array_foreach (run->rooms, (GFunc) g_object_unref, NULL);
+  g_ptr_array_free (run->rooms, TRUE);
+  g_ptr_array_foreach (run->chats, (GFunc) g_object_unref, NULL);
+  g_ptr_array_free (run->chats, TRUE);
+  g_object_unref (run->connection);
+  g_slice_free (MessageRun, run);
+}
+
+static gboolean
+message_run_timeout_cb (gpointer user_data)
+{
+  MessageRun *run = user_data;
+  gint64 elapsed = empathy_time_get_monotonic () - run->start;
+  guint due;
+
+  due = MIN (run->n_messages, elapsed * run->rate / G_USEC_PER_SEC);
+  while (run->sent < due)
+    message_run_send (run);
+
+  if (run->sent < run->n_messages)
+    return TRUE;
+
+  message_run_free (run);
+
+  return FALSE;
+}
+
+/* Sends n_messages round-robin to the open rooms and text channels, at rate
+ * messages per second or all at once if rate is 0. The body of each of
+ * them follows STAND_IN_MESSAGE_FORMAT. */
+void
+stand_in_connection_receive_messages (StandInConnection *connection,
+    guint n_messages,
+    guint rate)
+{
+  StandInConnectionPriv *priv = GET_PRIV (connection);
+  MessageRun *run;
+  GHashTableIter iter;
+  gpointer channel;
+
+  g_return_if_fail (priv->incoming_manager != NULL);
+
+  run = g_slice_new0 (MessageRun);
+  run->connection = g_object_ref (connection);
+  run->rooms = g_ptr_array_new ();
+  run->chats = g_ptr_array_new ();
+  run->n_messages = n_messages;
+  run->rate = rate;
+  run->start = empathy_time_get_monotonic ();
+
+  g_hash_table_iter_init (&iter, priv->incoming_manager->channels);
+  while (g_hash_table_iter_next (&iter, &channel, NULL))
+    {
+      guint handle_type;
+
+      if (!STAND_IN_IS_TEXT_CHANNEL (channel))
+        continue;
+
+      g_object_get (channel, "handle-type", &handle_type, NULL);
+      g_ptr_array_add (handle_type == TP_HANDLE_TYPE_ROOM ?
+          run->rooms : run->chats, g_object_ref (channel));
+    }
+
+  if (run->rooms->len + run->chats->len == 0)
+    {
+      g_warning ("No text channel to send messages to");
+      message_run_free (run);
+      return;
+    }
+
+  if (rate == 0)
+    {
+      while (run->sent < run->n_messages)
+        message_run_send (run);
+      message_run_free (run);
+      return;
+    }
+
+  g_timeout_add (10, message_run_timeout_cb, run);
+}
+
+void
+stand_in_connection_offer_files (StandInConnection *connection,
+    guint n_files)
+{
+  StandInConnectionPriv *priv = GET_PRIV (connection);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      TP_BASE_CONNECTION (connection), TP_HANDLE_TYPE_CONTACT);
+  guint i;
+
+  g_return_if_fail (priv->incoming_manager != NULL);
+
+  for (i = 0; i < n_files; i++)
+    {
+      TpHandle handle;
+      gchar *filename;
+
+      handle = ensure_contact (connection, "contact%u@stand-in",
+          priv->next_contact);
+      filename = g_strdup_printf ("stand-in-%u.bin", priv->next_contact++);
+      incoming_manager_new_file_channel (priv->incoming_manager, handle,
+          filename, FILE_SIZE);
+      tp_handle_unref (contact_repo, handle);
+      g_free (filename);
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * stand-in-connection.h - Header for StandInConnection
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __STAND_IN_CONNECTION_H__
+#define __STAND_IN_CONNECTION_H__
+
+#include <glib-object.h>
+
+#include <telepathy-glib/base-connection.h>
+#include <telepathy-glib/contacts-mixin.h>
+#include <telepathy-glib/presence-mixin.h>
+
+G_BEGIN_DECLS
+
+#define STAND_IN_TYPE_CONNECTION stand_in_connection_get_type()
+#define STAND_IN_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   STAND_IN_TYPE_CONNECTION, StandInConnection))
+#define STAND_IN_CONNECTION_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+   STAND_IN_TYPE_CONNECTION, StandInConnectionClass))
+#define STAND_IN_IS_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), STAND_IN_TYPE_CONNECTION))
+#define STAND_IN_IS_CONNECTION_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), STAND_IN_TYPE_CONNECTION))
+#define STAND_IN_CONNECTION_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+   STAND_IN_TYPE_CONNECTION, StandInConnectionClass))
+
+/* Body of the messages sent by stand_in_connection_receive_messages(): a
+ * sequence number and the empathy_time_get_monotonic() of the sending */
+#define STAND_IN_MESSAGE_FORMAT "message %u sent at %" G_GINT64_FORMAT
+
+typedef struct {
+  TpBaseConnection parent;
+  TpPresenceMixin presence_mixin;
+  TpContactsMixin contacts_mixin;
+  gpointer priv;
+} StandInConnection;
+
+typedef struct {
+  TpBaseConnectionClass parent_class;
+  TpPresenceMixinClass presence_mixin;
+  TpContactsMixinClass contacts_mixin;
+} StandInConnectionClass;
+
+GType stand_in_connection_get_type (void);
+
+/* public methods */
+StandInConnection * stand_in_connection_new (const gchar *account);
+void stand_in_connection_open_channels (StandInConnection *connection,
+    guint n_channels);
+void stand_in_connection_close_channels (StandInConnection *connection);
+void stand_in_connection_add_roster (StandInConnection *connection,
+    guint n_contacts,
+    guint n_groups);
+void stand_in_connection_change_presences (StandInConnection *connection,
+    guint n_changes,
+    guint batch);
+void stand_in_connection_open_rooms (StandInConnection *connection,
+    guint n_rooms,
+    guint n_members);
+void stand_in_connection_receive_messages (StandInConnection *connection,
+    guint n_messages,
+    guint rate);
+void stand_in_connection_offer_files (StandInConnection *connection,
+    guint n_files);
+
+G_END_DECLS
+
+#endif /* __STAND_IN_CONNECTION_H__ */
@@ -0,0 +1,68 @@
+/*
+ * stand-in-contact-list.h - Header for StandInContactList
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __STAND_IN_CONTACT_LIST_H__
+#define __STAND_IN_CONTACT_LIST_H__
+
+#include <glib-object.h>
+
+#include <telepathy-glib/base-connection.h>
+#include <telepathy-glib/dbus-properties-mixin.h>
+#include <telepathy-glib/group-mixin.h>
+#include <telepathy-glib/intset.h>
+
+G_BEGIN_DECLS
+
+#define STAND_IN_TYPE_CONTACT_LIST stand_in_contact_list_get_type()
+#define STAND_IN_CONTACT_LIST(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   STAND_IN_TYPE_CONTACT_LIST, StandInContactList))
+#define STAND_IN_CONTACT_LIST_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+   STAND_IN_TYPE_CONTACT_LIST, StandInContactListClass))
+#define STAND_IN_IS_CONTACT_LIST(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), STAND_IN_TYPE_CONTACT_LIST))
+#define STAND_IN_IS_CONTACT_LIST_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), STAND_IN_TYPE_CONTACT_LIST))
+#define STAND_IN_CONTACT_LIST_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+   STAND_IN_TYPE_CONTACT_LIST, StandInContactListClass))
+
+typedef struct {
+  GObject parent;
+  TpGroupMixin group;
+  gpointer priv;
+} StandInContactList;
+
+typedef struct {
+  GObjectClass parent_class;
+  TpGroupMixinClass group_class;
+  TpDBusPropertiesMixinClass dbus_props_class;
+} StandInContactListClass;
+
+GType stand_in_contact_list_get_type (void);
+
+/* public methods */
+void stand_in_contact_list_add_members (StandInContactList *list,
+    TpIntSet *members);
+void stand_in_contact_list_close (StandInContactList *list);
+
+G_END_DECLS
+
+#endif /* __STAND_IN_CONTACT_LIST_H__ */
@@ -0,0 +1,599 @@
+/*
+ * stand-in-file-channel.c - Source for StandInFileChannel
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* An incoming file transfer offer. It has all the properties Empathy looks
+ * at but the file never arrives: accepting it fails, which is enough to
+ * measure how the client copes with many offers. */
+
+#include <time.h>
+
+#include <telepathy-glib/channel-iface.h>
+#include <telepathy-glib/dbus.h>
+#include <telepathy-glib/errors.h>
+#include <telepathy-glib/exportable-channel.h>
+#include <telepathy-glib/gtypes.h>
+#include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/svc-channel.h>
+#include <telepathy-glib/svc-generic.h>
+
+#include "stand-in-file-channel.h"
+
+static void channel_iface_init (gpointer iface, gpointer data);
+static void file_transfer_iface_init (gpointer iface, gpointer data);
+
+G_DEFINE_TYPE_WITH_CODE (StandInFileChannel, stand_in_file_channel,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL, channel_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_TYPE_FILE_TRANSFER,
+      file_transfer_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
+      tp_dbus_properties_mixin_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_CHANNEL_IFACE, NULL);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_EXPORTABLE_CHANNEL, NULL));
+
+static const gchar *stand_in_file_channel_interfaces[] = { NULL };
+
+/* properties */
+enum {
+  PROP_OBJECT_PATH = 1,
+  PROP_CHANNEL_TYPE,
+  PROP_HANDLE_TYPE,
+  PROP_HANDLE,
+  PROP_TARGET_ID,
+  PROP_CONNECTION,
+  PROP_INTERFACES,
+  PROP_REQUESTED,
+  PROP_INITIATOR_HANDLE,
+  PROP_INITIATOR_ID,
+  PROP_CHANNEL_DESTROYED,
+  PROP_CHANNEL_PROPERTIES,
+  PROP_STATE,
+  PROP_CONTENT_TYPE,
+  PROP_FILENAME,
+  PROP_SIZE,
+  PROP_CONTENT_HASH_TYPE,
+  PROP_CONTENT_HASH,
+  PROP_DESCRIPTION,
+  PROP_DATE,
+  PROP_AVAILABLE_SOCKET_TYPES,
+  PROP_TRANSFERRED_BYTES,
+  PROP_INITIAL_OFFSET,
+};
+
+/* private structure */
+typedef struct {
+  TpBaseConnection *conn;
+  gchar *object_path;
+  TpHandle handle;
+  gchar *filename;
+  guint64 size;
+  gint64 date;
+  gboolean closed;
+  gboolean dispose_has_run;
+} StandInFileChannelPriv;
+
+#define GET_PRIV(obj) (((StandInFileChannel *) (obj))->priv)
+
+static void
+stand_in_file_channel_init (StandInFileChannel *self)
+{
+  StandInFileChannelPriv *priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      STAND_IN_TYPE_FILE_CHANNEL, StandInFileChannelPriv);
+
+  self->priv = priv;
+  priv->date = time (NULL);
+}
+
+static void
+do_constructed (GObject *object)
+{
+  StandInFileChannel *self = STAND_IN_FILE_CHANNEL (object);
+  StandInFileChannelPriv *priv = GET_PRIV (self);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      priv->conn, TP_HANDLE_TYPE_CONTACT);
+  DBusGConnection *bus;
+
+  if (G_OBJECT_CLASS (stand_in_file_channel_parent_class)->constructed)
+    G_OBJECT_CLASS (stand_in_file_channel_parent_class)->constructed (object);
+
+  tp_handle_ref (contact_repo, priv->handle);
+
+  bus = tp_get_bus ();
+  dbus_g_connection_register_g_object (bus, priv->object_path, object);
+}
+
+static void
+free_array (GArray *array)
+{
+  g_array_free (array, TRUE);
+}
+
+static GHashTable *
+make_socket_types (void)
+{
+  GHashTable *types;
+  GArray *access_controls;
+  guint access_control = TP_SOCKET_ACCESS_CONTROL_LOCALHOST;
+
+  types = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) free_array);
+
+  access_controls = g_array_sized_new (FALSE, FALSE, sizeof (guint), 1);
+  g_array_append_val (access_controls, access_control);
+  g_hash_table_insert (types, GUINT_TO_POINTER (TP_SOCKET_ADDRESS_TYPE_UNIX),
+      access_controls);
+
+  return types;
+}
+
+static void
+do_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  StandInFileChannelPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_OBJECT_PATH:
+        g_value_set_string (value, priv->object_path);
+        break;
+      case PROP_CHANNEL_TYPE:
+        g_value_set_static_string (value, TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER);
+        break;
+      case PROP_HANDLE_TYPE:
+        g_value_set_uint (value, TP_HANDLE_TYPE_CONTACT);
+        break;
+      case PROP_HANDLE:
+      case PROP_INITIATOR_HANDLE:
+        g_value_set_uint (value, priv->handle);
+        break;
+      case PROP_TARGET_ID:
+      case PROP_INITIATOR_ID:
+        {
+          TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+              priv->conn, TP_HANDLE_TYPE_CONTACT);
+
+          g_value_set_string (value,
+              tp_handle_inspect (contact_repo, priv->handle));
+        }
+        break;
+      case PROP_CONNECTION:
+        g_value_set_object (value, priv->conn);
+        break;
+      case PROP_INTERFACES:
+        g_value_set_boxed (value, stand_in_file_channel_interfaces);
+        break;
+      case PROP_REQUESTED:
+        g_value_set_boolean (value, FALSE);
+        break;
+      case PROP_CHANNEL_DESTROYED:
+        g_value_set_boolean (value, priv->closed);
+        break;
+      case PROP_CHANNEL_PROPERTIES:
+        g_value_take_boxed (value,
+            tp_dbus_properties_mixin_make_properties_hash (object,
+                TP_IFACE_CHANNEL, "ChannelType",
+                TP_IFACE_CHANNEL, "TargetHandleType",
+                TP_IFACE_CHANNEL, "TargetHandle",
+                TP_IFACE_CHANNEL, "TargetID",
+                TP_IFACE_CHANNEL, "InitiatorHandle",
+                TP_IFACE_CHANNEL, "InitiatorID",
+                TP_IFACE_CHANNEL, "Requested",
+                TP_IFACE_CHANNEL, "Interfaces",
+                TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentType",
+                TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Filename",
+                TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Size",
+                TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHashType",
+                TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHash",
+                TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Description",
+                TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Date",
+                TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "AvailableSocketTypes",
+                NULL));
+        break;
+      case PROP_STATE:
+        g_value_set_uint (value, TP_FILE_TRANSFER_STATE_PENDING);
+        break;
+      case PROP_CONTENT_TYPE:
+        g_value_set_static_string (value, "application/octet-stream");
+        break;
+      case PROP_FILENAME:
+        g_value_set_string (value, priv->filename);
+        break;
+      case PROP_SIZE:
+        g_value_set_uint64 (value, priv->size);
+        break;
+      case PROP_CONTENT_HASH_TYPE:
+        g_value_set_uint (value, TP_FILE_HASH_TYPE_NONE);
+        break;
+      case PROP_CONTENT_HASH:
+      case PROP_DESCRIPTION:
+        g_value_set_static_string (value, "");
+        break;
+      case PROP_DATE:
+        g_value_set_int64 (value, priv->date);
+        break;
+      case PROP_AVAILABLE_SOCKET_TYPES:
+        g_value_take_boxed (value, make_socket_types ());
+        break;
+      case PROP_TRANSFERRED_BYTES:
+      case PROP_INITIAL_OFFSET:
+        g_value_set_uint64 (value, 0);
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+do_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  StandInFileChannelPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_OBJECT_PATH:
+        g_free (priv->object_path);
+        priv->object_path = g_value_dup_string (value);
+        break;
+      case PROP_HANDLE:
+        /* we don't ref it here because we don't necessarily have access to
+         * the contact repo yet - instead we ref it in constructed */
+        priv->handle = g_value_get_uint (value);
+        break;
+      case PROP_CONNECTION:
+        priv->conn = g_value_get_object (value);
+        break;
+      case PROP_FILENAME:
+        g_free (priv->filename);
+        priv->filename = g_value_dup_string (value);
+        break;
+      case PROP_SIZE:
+        priv->size = g_value_get_uint64 (value);
+        break;
+      case PROP_CHANNEL_TYPE:
+      case PROP_HANDLE_TYPE:
+        /* these are fixed, ignore whatever the channel manager says */
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+do_dispose (GObject *object)
+{
+  StandInFileChannel *self = STAND_IN_FILE_CHANNEL (object);
+  StandInFileChannelPriv *priv = GET_PRIV (self);
+
+  if (priv->dispose_has_run)
+    return;
+
+  priv->dispose_has_run = TRUE;
+
+  if (!priv->closed)
+    stand_in_file_channel_close (self);
+
+  G_OBJECT_CLASS (stand_in_file_channel_parent_class)->dispose (object);
+}
+
+static void
+do_finalize (GObject *object)
+{
+  StandInFileChannelPriv *priv = GET_PRIV (object);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      priv->conn, TP_HANDLE_TYPE_CONTACT);
+
+  tp_handle_unref (contact_repo, priv->handle);
+  g_free (priv->object_path);
+  g_free (priv->filename);
+
+  G_OBJECT_CLASS (stand_in_file_channel_parent_class)->finalize (object);
+}
+
+static void
+stand_in_file_channel_class_init (StandInFileChannelClass *klass)
+{
+  static TpDBusPropertiesMixinPropImpl channel_props[] = {
+      { "TargetHandleType", "handle-type", NULL },
+      { "TargetHandle", "handle", NULL },
+      { "TargetID", "target-id", NULL },
+      { "ChannelType", "channel-type", NULL },
+      { "Interfaces", "interfaces", NULL },
+      { "Requested", "requested", NULL },
+      { "InitiatorHandle", "initiator-handle", NULL },
+      { "InitiatorID", "initiator-id", NULL },
+      { NULL }
+  };
+  static TpDBusPropertiesMixinPropImpl file_props[] = {
+      { "State", "state", NULL },
+      { "ContentType", "content-type", NULL },
+      { "Filename", "filename", NULL },
+      { "Size", "size", NULL },
+      { "ContentHashType", "content-hash-type", NULL },
+      { "ContentHash", "content-hash", NULL },
+      { "Description", "description", NULL },
+      { "Date", "date", NULL },
+      { "AvailableSocketTypes", "available-socket-types", NULL },
+      { "TransferredBytes", "transferred-bytes", NULL },
+      { "InitialOffset", "initial-offset", NULL },
+      { NULL }
+  };
+  static TpDBusPropertiesMixinIfaceImpl prop_interfaces[] = {
+      { TP_IFACE_CHANNEL,
+        tp_dbus_properties_mixin_getter_gobject_properties,
+        NULL,
+        channel_props,
+      },
+      { TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER,
+        tp_dbus_properties_mixin_getter_gobject_properties,
+        NULL,
+        file_props,
+      },
+      { NULL }
+  };
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GParamSpec *param_spec;
+
+  g_type_class_add_private (klass, sizeof (StandInFileChannelPriv));
+
+  object_class->constructed = do_constructed;
+  object_class->get_property = do_get_property;
+  object_class->set_property = do_set_property;
+  object_class->dispose = do_dispose;
+  object_class->finalize = do_finalize;
+
+  g_object_class_override_property (object_class, PROP_OBJECT_PATH,
+      "object-path");
+  g_object_class_override_property (object_class, PROP_CHANNEL_TYPE,
+      "channel-type");
+  g_object_class_override_property (object_class, PROP_HANDLE_TYPE,
+      "handle-type");
+  g_object_class_override_property (object_class, PROP_HANDLE, "handle");
+  g_object_class_override_property (object_class, PROP_CHANNEL_DESTROYED,
+      "channel-destroyed");
+  g_object_class_override_property (object_class, PROP_CHANNEL_PROPERTIES,
+      "channel-properties");
+
+  param_spec = g_param_spec_object ("connection", "TpBaseConnection object",
+      "Connection object that owns this channel",
+      TP_TYPE_BASE_CONNECTION,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONNECTION, param_spec);
+
+  param_spec = g_param_spec_boxed ("interfaces", "Extra D-Bus interfaces",
+      "Additional Channel.Interface.* interfaces",
+      G_TYPE_STRV,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_INTERFACES, param_spec);
+
+  param_spec = g_param_spec_string ("target-id", "Peer's ID",
+      "The string obtained by inspecting the target handle",
+      NULL,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_TARGET_ID, param_spec);
+
+  param_spec = g_param_spec_uint ("initiator-handle", "Initiator's handle",
+      "The contact who initiated the channel",
+      0, G_MAXUINT32, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_INITIATOR_HANDLE,
+      param_spec);
+
+  param_spec = g_param_spec_string ("initiator-id", "Initiator's ID",
+      "The string obtained by inspecting the initiator-handle",
+      NULL,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_INITIATOR_ID,
+      param_spec);
+
+  param_spec = g_param_spec_boolean ("requested", "Requested?",
+      "True if this channel was requested by the local user",
+      FALSE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_REQUESTED, param_spec);
+
+  param_spec = g_param_spec_uint ("state", "State",
+      "Always pending, the offer is never accepted",
+      0, G_MAXUINT, TP_FILE_TRANSFER_STATE_PENDING,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_STATE, param_spec);
+
+  param_spec = g_param_spec_string ("content-type", "Content type",
+      "The MIME type of the file",
+      NULL,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_TYPE,
+      param_spec);
+
+  param_spec = g_param_spec_string ("filename", "Filename",
+      "The name of the file",
+      NULL,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_FILENAME, param_spec);
+
+  param_spec = g_param_spec_uint64 ("size", "Size",
+      "The size of the file",
+      0, G_MAXUINT64, 0,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_SIZE, param_spec);
+
+  param_spec = g_param_spec_uint ("content-hash-type", "Content hash type",
+      "Always none",
+      0, G_MAXUINT, TP_FILE_HASH_TYPE_NONE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_HASH_TYPE,
+      param_spec);
+
+  param_spec = g_param_spec_string ("content-hash", "Content hash",
+      "Always empty",
+      NULL,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_HASH,
+      param_spec);
+
+  param_spec = g_param_spec_string ("description", "Description",
+      "Always empty",
+      NULL,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_DESCRIPTION,
+      param_spec);
+
+  param_spec = g_param_spec_int64 ("date", "Date",
+      "When the offer was made",
+      G_MININT64, G_MAXINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_DATE, param_spec);
+
+  param_spec = g_param_spec_boxed ("available-socket-types",
+      "Available socket types",
+      "Unix sockets with localhost access control",
+      TP_HASH_TYPE_SUPPORTED_SOCKET_MAP,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_AVAILABLE_SOCKET_TYPES,
+      param_spec);
+
+  param_spec = g_param_spec_uint64 ("transferred-bytes", "Transferred bytes",
+      "Always 0",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_TRANSFERRED_BYTES,
+      param_spec);
+
+  param_spec = g_param_spec_uint64 ("initial-offset", "Initial offset",
+      "Always 0",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_INITIAL_OFFSET,
+      param_spec);
+
+  klass->dbus_props_class.interfaces = prop_interfaces;
+  tp_dbus_properties_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (StandInFileChannelClass, dbus_props_class));
+}
+
+void
+stand_in_file_channel_close (StandInFileChannel *self)
+{
+  StandInFileChannelPriv *priv = GET_PRIV (self);
+
+  if (priv->closed)
+    return;
+
+  priv->closed = TRUE;
+
+  /* The channel manager drops its reference when it sees Closed */
+  g_object_ref (self);
+  tp_svc_channel_emit_closed (self);
+  g_object_unref (self);
+}
+
+static void
+channel_close (TpSvcChannel *iface,
+    DBusGMethodInvocation *context)
+{
+  stand_in_file_channel_close (STAND_IN_FILE_CHANNEL (iface));
+  tp_svc_channel_return_from_close (context);
+}
+
+static void
+channel_get_channel_type (TpSvcChannel *iface,
+    DBusGMethodInvocation *context)
+{
+  tp_svc_channel_return_from_get_channel_type (context,
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER);
+}
+
+static void
+channel_get_handle (TpSvcChannel *iface,
+    DBusGMethodInvocation *context)
+{
+  StandInFileChannelPriv *priv = GET_PRIV (iface);
+
+  tp_svc_channel_return_from_get_handle (context, TP_HANDLE_TYPE_CONTACT,
+      priv->handle);
+}
+
+static void
+channel_get_interfaces (TpSvcChannel *iface,
+    DBusGMethodInvocation *context)
+{
+  tp_svc_channel_return_from_get_interfaces (context,
+      stand_in_file_channel_interfaces);
+}
+
+static void
+channel_iface_init (gpointer iface,
+    gpointer data)
+{
+  TpSvcChannelClass *klass = iface;
+
+#define IMPLEMENT(x) tp_svc_channel_implement_##x (klass, channel_##x)
+  IMPLEMENT (close);
+  IMPLEMENT (get_channel_type);
+  IMPLEMENT (get_handle);
+  IMPLEMENT (get_interfaces);
+#undef IMPLEMENT
+}
+
+static void
+file_transfer_accept_file (TpSvcChannelTypeFileTransfer *iface,
+    guint address_type,
+    guint access_control,
+    const GValue *access_control_param,
+    guint64 offset,
+    DBusGMethodInvocation *context)
+{
+  GError error = { TP_ERRORS, TP_ERROR_NOT_AVAILABLE,
+      "Stand-in transfers never carry any data" };
+
+  dbus_g_method_return_error (context, &error);
+}
+
+static void
+file_transfer_provide_file (TpSvcChannelTypeFileTransfer *iface,
+    guint address_type,
+    guint access_control,
+    const GValue *access_control_param,
+    DBusGMethodInvocation *context)
+{
+  GError error = { TP_ERRORS, TP_ERROR_NOT_AVAILABLE,
+      "Stand-in transfers are always incoming" };
+
+  dbus_g_method_return_error (context, &error);
+}
+
+static void
+file_transfer_iface_init (gpointer iface,
+    gpointer data)
+{
+  TpSvcChannelTypeFileTransferClass *klass = iface;
+
+#define IMPLEMENT(x) \
+  tp_svc_channel_type_file_transfer_implement_##x (klass, file_transfer_##x)
+  IMPLEMENT (accept_file);
+  IMPLEMENT (provide_file);
+#undef IMPLEMENT
+}
@@ -0,0 +1,62 @@
+/*
+ * stand-in-file-channel.h - Header for StandInFileChannel
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __STAND_IN_FILE_CHANNEL_H__
+#define __STAND_IN_FILE_CHANNEL_H__
+
+#include <glib-object.h>
+
+#include <telepathy-glib/base-connection.h>
+#include <telepathy-glib/dbus-properties-mixin.h>
+
+G_BEGIN_DECLS
+
+#define STAND_IN_TYPE_FILE_CHANNEL stand_in_file_channel_get_type()
+#define STAND_IN_FILE_CHANNEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+   STAND_IN_TYPE_FILE_CHANNEL, StandInFileChannel))
+#define STAND_IN_FILE_CHANNEL_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+   STAND_IN_TYPE_FILE_CHANNEL, StandInFileChannelClass))
+#define STAND_IN_IS_FILE_CHANNEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), STAND_IN_TYPE_FILE_CHANNEL))
+#define STAND_IN_IS_FILE_CHANNEL_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), STAND_IN_TYPE_FILE_CHANNEL))
+#define STAND_IN_FILE_CHANNEL_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+   STAND_IN_TYPE_FILE_CHANNEL, StandInFileChannelClass))
+
+typedef struct {
+  GObject parent;
+  gpointer priv;
+} StandInFileChannel;
+
+typedef struct {
+  GObjectClass parent_class;
+  TpDBusPropertiesMixinClass dbus_props_class;
+} StandInFileChannelClass;
+
+GType stand_in_file_channel_get_type (void);
+
+/* public methods */
+void stand_in_file_channel_close (StandInFileChannel *channel);
+
+G_END_DECLS
+
+#endif /* __STAND_IN_FILE_CHANNEL_H__ */
@@ -0,0 +1,529 @@
+/*
+ * stand-in-text-channel.c - Source for StandInTextChannel
+ * Copyright (C) 2009 Collabora Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* A text channel which does just enough for the dispatcher and
+ * EmpathyTpChat to consider it a real one. Messages sent on it are echoed
+ * back through the Sent signal and never delivered anywhere. With a room
+ * handle it is a chat room and has the Group interface for its members. */
+
+#include <time.h>
+
+#include <telepathy-glib/channel-iface.h>
+#include <telepathy-glib/dbus.h>
+#include <telepathy-glib/errors.h>
+#include <telepathy-glib/exportable-channel.h>
+#include <telepathy-glib/interfaces.h>
+#include <telepathy-glib/svc-channel.h>
+#include <telepathy-glib/svc-generic.h>
+
+#include "stand-in-text-channel.h"
+
+static void channel_iface_init (gpointer iface, gpointer data);
+static void text_iface_init (gpointer iface, gpointer data);
+
+G_DEFINE_TYPE_WITH_CODE (StandInTextChannel, stand_in_text_channel,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL, channel_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_TYPE_TEXT, text_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_INTERFACE_GROUP,
+      tp_group_mixin_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_DBUS_PROPERTIES,
+      tp_dbus_properties_mixin_iface_init);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_CHANNEL_IFACE, NULL);
+    G_IMPLEMENT_INTERFACE (TP_TYPE_EXPORTABLE_CHANNEL, NULL));
+
+static const gchar *stand_in_text_channel_interfaces[] = { NULL };
+static const gchar *stand_in_text_channel_room_interfaces[] = {
+    TP_IFACE_CHANNEL_INTERFACE_GROUP,
+    NULL
+};
+
+/* properties */
+enum {
+  PROP_OBJECT_PATH = 1,
+  PROP_CHANNEL_TYPE,
+  PROP_HANDLE_TYPE,
+  PROP_HANDLE,
+  PROP_TARGET_ID,
+  PROP_CONNECTION,
+  PROP_INTERFACES,
+  PROP_REQUESTED,
+  PROP_INITIATOR_HANDLE,
+  PROP_INITIATOR_ID,
+  PROP_CHANNEL_DESTROYED,
+  PROP_CHANNEL_PROPERTIES,
+};
+
+/* private structure */
+typedef struct {
+  TpBaseConnection *conn;
+  gchar *object_path;
+  TpHandleType handle_type;
+  TpHandle handle;
+  gboolean closed;
+  gboolean dispose_has_run;
+} StandInTextChannelPriv;
+
+#define GET_PRIV(obj) (((StandInTextChannel *) (obj))->priv)
+
+static void
+stand_in_text_channel_init (StandInTextChannel *self)
+{
+  StandInTextChannelPriv *priv = G_TYPE_INSTANCE_GET_PRIVATE (self,
+      STAND_IN_TYPE_TEXT_CHANNEL, StandInTextChannelPriv);
+
+  self->priv = priv;
+  priv->handle_type = TP_HANDLE_TYPE_CONTACT;
+}
+
+static const gchar **
+get_interfaces (StandInTextChannel *self)
+{
+  StandInTextChannelPriv *priv = GET_PRIV (self);
+
+  if (priv->handle_type == TP_HANDLE_TYPE_ROOM)
+    return stand_in_text_channel_room_interfaces;
+
+  return stand_in_text_channel_interfaces;
+}
+
+static void
+do_constructed (GObject *object)
+{
+  StandInTextChannel *self = STAND_IN_TEXT_CHANNEL (object);
+  StandInTextChannelPriv *priv = GET_PRIV (self);
+  TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+      priv->conn, TP_HANDLE_TYPE_CONTACT);
+  TpHandleRepoIface *repo = tp_base_connection_get_handles (priv->conn,
+      priv->handle_type);
+  DBusGConnection *bus;
+
+  if (G_OBJECT_CLASS (stand_in_text_channel_parent_class)->constructed)
+    G_OBJECT_CLASS (stand_in_text_channel_parent_class)->constructed (object);
+
+  tp_handle_ref (repo, priv->handle);
+
+  if (priv->handle_type == TP_HANDLE_TYPE_ROOM)
+    {
+      TpIntSet *self_set = tp_intset_new ();
+
+      tp_group_mixin_init (object,
+          G_STRUCT_OFFSET (StandInTextChannel, group), contact_repo,
+          priv->conn->self_handle);
+      tp_group_mixin_change_flags (object, TP_CHANNEL_GROUP_FLAG_CAN_ADD, 0);
+
+      /* We're already in the room */
+      tp_intset_add (self_set, priv->conn->self_handle);
+      tp_group_mixin_change_members (object, "", self_set, NULL, NULL, NULL,
+          0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+      tp_intset_destroy (self_set);
+    }
+
+  tp_text_mixin_init (object, G_STRUCT_OFFSET (StandInTextChannel, text),
+      contact_repo);
+  tp_text_mixin_set_message_types (object,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_ACTION,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NOTICE,
+      G_MAXUINT);
+
+  bus = tp_get_bus ();
+  dbus_g_connection_register_g_object (bus, priv->object_path, object);
+}
+
+static void
+do_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  StandInTextChannelPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_OBJECT_PATH:
+        g_value_set_string (value, priv->object_path);
+        break;
+      case PROP_CHANNEL_TYPE:
+        g_value_set_static_string (value, TP_IFACE_CHANNEL_TYPE_TEXT);
+        break;
+      case PROP_HANDLE_TYPE:
+        g_value_set_uint (value, priv->handle_type);
+        break;
+      case PROP_HANDLE:
+        g_value_set_uint (value, priv->handle);
+        break;
+      case PROP_INITIATOR_HANDLE:
+        /* Nobody in particular invited us to the rooms */
+        g_value_set_uint (value, priv->handle_type == TP_HANDLE_TYPE_ROOM ?
+            0 : priv->handle);
+        break;
+      case PROP_TARGET_ID:
+        {
+          TpHandleRepoIface *repo = tp_base_connection_get_handles (
+              priv->conn, priv->handle_type);
+
+          g_value_set_string (value, tp_handle_inspect (repo, priv->handle));
+        }
+        break;
+      case PROP_INITIATOR_ID:
+        if (priv->handle_type == TP_HANDLE_TYPE_ROOM)
+          {
+            g_value_set_static_string (value, "");
+          }
+        else
+          {
+            TpHandleRepoIface *contact_repo = tp_base_connection_get_handles (
+                priv->conn, TP_HANDLE_TYPE_CONTACT);
+
+            g_value_set_string (value,
+                tp_handle_inspect (contact_repo, priv->handle));
+          }
+        break;
+      case PROP_CONNECTION:
+        g_value_set_object (value, priv->conn);
+        break;
+      case PROP_INTERFACES:
+        g_value_set_boxed (value, get_interfaces (STAND_IN_TEXT_CHANNEL (object)));
+        break;
+      case PROP_REQUESTED:
+        g_value_set_boolean (value, FALSE);
+        break;
+      case PROP_CHANNEL_DESTROYED:
+        g_value_set_boolean (value, priv->closed);
+        break;
+      case PROP_CHANNEL_PROPERTIES:
+        g_value_take_boxed (value,
+            tp_dbus_properties_mixin_make_properties_hash (object,
+                TP_IFACE_CHANNEL, "ChannelType",
+                TP_IFACE_CHANNEL, "TargetHandleType",
+                TP_IFACE_CHANNEL, "TargetHandle",
+                TP_IFACE_CHANNEL, "TargetID",
+                TP_IFACE_CHANNEL, "InitiatorHandle",
+                TP_IFACE_CHANNEL, "InitiatorID",
+                TP_IFACE_CHANNEL, "Requested",
+                TP_IFACE_CHANNEL, "Interfaces",
+                NULL));
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+do_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  StandInTextChannelPriv *priv = GET_PRIV (object);
+
+  switch (property_id)
+    {
+      case PROP_OBJECT_PATH:
+        g_free (priv->object_path);
+        priv->object_path = g_value_dup_string (value);
+        break;
+      case PROP_HANDLE:
+        /* we don't ref it here because we don't necessarily have access to
+         * the contact repo yet - instead we ref it in constructed */
+        priv->handle = g_value_get_uint (value);
+        break;
+      case PROP_CONNECTION:
+        priv->conn = g_value_get_object (value);
+        break;
+      case PROP_HANDLE_TYPE:
+        /* 0 when the channel manager doesn't say */
+        if (g_value_get_uint (value) != 0)
+          priv->handle_type = g_value_get_uint (value);
+        break;
+      case PROP_CHANNEL_TYPE:
+        /* this is fixed, ignore whatever the channel manager says */
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+do_dispose (GObject *object)
+{
+  StandInTextChannel *self = STAND_IN_TEXT_CHANNEL (object);
+  StandInTextChannelPriv *priv = GET_PRIV (self);
+
+  if (priv->dispose_has_run)
+    return;
+
+  priv->dispose_has_run = TRUE;
+
+  if (!priv->closed)
+    stand_in_text_channel_close (self);
+
+  G_OBJECT_CLASS (stand_in_text_channel_parent_class)->dispose (object);
+}
+
+static void
+do_finalize (GObject *object)
+{
+  StandInTextChannelPriv *priv = GET_PRIV (object);
+  TpHandleRepoIface *repo = tp_base_connection_get_handles (priv->conn,
+      priv->handle_type);
+
+  tp_handle_unref (repo, priv->handle);
+  g_free (priv->object_path);
+
+  tp_text_mixin_finalize (object);
+  if (priv->handle_type == TP_HANDLE_TYPE_ROOM)
+    tp_group_mixin_finalize (object);
+
+  G_OBJECT_CLASS (stand_in_text_channel_parent_class)->finalize (object);
+}
+
+static gboolean
+add_member (GObject *object,
+    TpHandle handle,
+    const gchar *message,
+    GError **error)
+{
+  TpIntSet *set = tp_intset_new ();
+
+  /* Whoever we invite joins straight away */
+  tp_intset_add (set, handle);
+  stand_in_text_channel_add_members (STAND_IN_TEXT_CHANNEL (object), set);
+  tp_intset_destroy (set);
+
+  return TRUE;
+}
+
+static void
+stand_in_text_channel_class_init (StandInTextChannelClass *klass)
+{
+  static TpDBusPropertiesMixinPropImpl channel_props[] = {
+      { "TargetHandleType", "handle-type", NULL },
+      { "TargetHandle", "handle", NULL },
+      { "TargetID", "target-id", NULL },
+      { "ChannelType", "channel-type", NULL },
+      { "Interfaces", "interfaces", NULL },
+      { "Requested", "requested", NULL },
+      { "InitiatorHandle", "initiator-handle", NULL },
+      { "InitiatorID", "initiator-id", NULL },
+      { NULL }
+  };
+  static TpDBusPropertiesMixinIfaceImpl prop_interfaces[] = {
+      { TP_IFACE_CHANNEL,
+        tp_dbus_properties_mixin_getter_gobject_properties,
+        NULL,
+        channel_props,
+      },
+      { NULL }
+  };
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GParamSpec *param_spec;
+
+  g_type_class_add_private (klass, sizeof (StandInTextChannelPriv));
+
+  object_class->constructed = do_constructed;
+  object_class->get_property = do_get_property;
+  object_class->set_property = do_set_property;
+  object_class->dispose = do_dispose;
+  object_class->finalize = do_finalize;
+
+  g_object_class_override_property (object_class, PROP_OBJECT_PATH,
+      "object-path");
+  g_object_class_override_property (object_class, PROP_CHANNEL_TYPE,
+      "channel-type");
+  g_object_class_override_property (object_class, PROP_HANDLE_TYPE,
+      "handle-type");
+  g_object_class_override_property (object_class, PROP_HANDLE, "handle");
+  g_object_class_override_property (object_class, PROP_CHANNEL_DESTROYED,
+      "channel-destroyed");
+  g_object_class_override_property (object_class, PROP_CHANNEL_PROPERTIES,
+      "channel-properties");
+
+  param_spec = g_param_spec_object ("connection", "TpBaseConnection object",
+      "Connection object that owns this channel",
+      TP_TYPE_BASE_CONNECTION,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONNECTION, param_spec);
+
+  param_spec = g_param_spec_boxed ("interfaces", "Extra D-Bus interfaces",
+      "Additional Channel.Interface.* interfaces",
+      G_TYPE_STRV,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_INTERFACES, param_spec);
+
+  param_spec = g_param_spec_string ("target-id", "Peer's ID",
+      "The string obtained by inspecting the target handle",
+      NULL,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_TARGET_ID, param_spec);
+
+  param_spec = g_param_spec_uint ("initiator-handle", "Initiator's handle",
+      "The contact who initiated the channel",
+      0, G_MAXUINT32, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_INITIATOR_HANDLE,
+      param_spec);
+
+  param_spec = g_param_spec_string ("initiator-id", "Initiator's ID",
+      "The string obtained by inspecting the initiator-handle",
+      NULL,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_INITIATOR_ID,
+      param_spec);
+
+  param_spec = g_param_spec_boolean ("requested", "Requested?",
+      "True if this channel was requested by the local user",
+      FALSE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_REQUESTED, param_spec);
+
+  tp_text_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (StandInTextChannelClass, text_class));
+
+  klass->dbus_props_class.interfaces = prop_interfaces;
+  tp_dbus_properties_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (StandInTextChannelClass, dbus_props_class));
+
+  tp_group_mixin_class_init (object_class,
+      G_STRUCT_OFFSET (StandInTextChannelClass, group_class),
+      add_member, NULL);
+  tp_group_mixin_init_dbus_properties (object_class);
+}
+
+void
+stand_in_text_channel_close (StandInTextChannel *self)
+{
+  StandInTextChannelPriv *priv = GET_PRIV (self);
+
+  if (priv->closed)
+    return;
+
+  priv->closed = TRUE;
+  tp_text_mixin_clear ((GObject *) self);
+
+  /* The channel manager drops its reference when it sees Closed */
+  g_object_ref (self);
+  tp_svc_channel_emit_closed (self);
+  g_object_unref (self);
+}
+
+void
+stand_in_text_channel_receive (StandInTextChannel *self,
+    const gchar *text)
+{
+  StandInTextChannelPriv *priv = GET_PRIV (self);
+
+  g_return_if_fail (priv->handle_type == TP_HANDLE_TYPE_CONTACT);
+
+  stand_in_text_channel_receive_from (self, priv->handle, text);
+}
+
+void
+stand_in_text_channel_receive_from (StandInTextChannel *self,
+    TpHandle sender,
+    const gchar *text)
+{
+  tp_text_mixin_receive ((GObject *) self,
+      TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL, sender, time (NULL), text);
+}
+
+void
+stand_in_text_channel_add_members (StandInTextChannel *self,
+    TpIntSet *members)
+{
+  StandInTextChannelPriv *priv = GET_PRIV (self);
+
+  g_return_if_fail (priv->handle_type == TP_HANDLE_TYPE_ROOM);
+
+  tp_group_mixin_change_members ((GObject *) self, "", members, NULL, NULL,
+      NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE);
+}
+
+static void
+channel_close (TpSvcChannel *iface,
+    DBusGMethodInvocation *context)
+{
+  stand_in_text_channel_close (STAND_IN_TEXT_CHANNEL (iface));
+  tp_svc_channel_return_from_close (context);
+}
+
+static void
+channel_get_channel_type (TpSvcChannel *iface,
+    DBusGMethodInvocation *context)
+{
+  tp_svc_channel_return_from_get_channel_type (context,
+      TP_IFACE_CHANNEL_TYPE_TEXT);
+}
+
+static void
+channel_get_handle (TpSvcChannel *iface,
+    DBusGMethodInvocation *context)
+{
+  StandInTextChannelPriv *priv = GET_PRIV (iface);
+
+  tp_svc_channel_return_from_get_handle (context, priv->handle_type,
+      priv->handle);
+}
+
+static void
+channel_get_interfaces (TpSvcChannel *iface,
+    DBusGMethodInvocation *context)
+{
+  tp_svc_channel_return_from_get_interfaces (context,
+      get_interfaces (STAND_IN_TEXT_CHANNEL (iface)));
+}
+
+static void
+channel_iface_init (gpointer iface,
+    gpointer data)
+{
+  TpSvcChannelClass *klass = iface;
+
+#define IMPLEMENT(x) tp_svc_channel_implement_##x (klass, channel_##x)
+  IMPLEMENT (close);
+  IMPLEMENT (get_channel_type);
+  IMPLEMENT (get_handle);
+  IMPLEMENT (get_interfaces);
+#undef IMPLEMENT
+}
+
+static void
+text_send (TpSvcChannelTypeText *iface,
+    guint type,
+    const gchar *text,
+    DBusGMethodInvocation *context)
+{
+  tp_svc_channel_type_text_emit_sent (iface, time (NULL), type, text);
+  tp_svc_channel_type_text_return_from_send (context);
+}
+
+static void
+text_iface_init (gpointer iface,
+    gpointer data)
+{
+  TpSvcChannelTypeTextClass *klass = iface;
+
+  tp_text_mixin_iface_init (iface, data);
+#define IMPLEMENT(x) tp_svc_channel_type_text_implement_##x (klass, text_##x)
+  IMPLEMENT (send);
+#undef IMPLEMENT
+}